@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+import sys, os, time, json, csv, resource, subprocess, argparse
+
+#
+# Run a command, measure wall time and peak RSS and append a row to the
+# benchmark results (CSV and JSON). If the command was run with
+# --perf-out <file>, phase timings and counters are copied from that file.
+#
+# usage: bench-run.py [options] -- <cmd> [args ...]
+#
+
+COLUMNS = ["commit", "step", "threads", "wall_secs", "user_secs", "sys_secs",
+           "peak_rss_bytes", "items", "item_name", "items_per_sec",
+           "bytes_read", "bytes_read_per_sec", "exit"]
+
+def peak_rss_bytes(usage):
+  # ru_maxrss is in kilobytes on Linux, bytes on Mac OS X
+  if sys.platform == "darwin": return usage.ru_maxrss
+  return usage.ru_maxrss * 1024
+
+def load_json(path):
+  try:
+    with open(path) as fh: return json.load(fh)
+  except (IOError, ValueError): return None
+
+def main():
+  p = argparse.ArgumentParser(description="Time a benchmark step")
+  p.add_argument("--step", required=True, help="Name of the step e.g. build")
+  p.add_argument("--threads", type=int, default=1)
+  p.add_argument("--commit", default="", help="Label for this run e.g. git hash")
+  p.add_argument("--items", type=int, default=0,
+                 help="Number of items processed, for throughput")
+  p.add_argument("--item-name", default="", help="e.g. reads, kmers")
+  p.add_argument("--perf", help="--perf-out JSON written by the command")
+  p.add_argument("--csv", required=True, help="CSV file to append to")
+  p.add_argument("--json", required=True, help="JSON file to append to")
+  p.add_argument("--log", help="Write stdout/stderr of command to file")
+  p.add_argument("cmd", nargs=argparse.REMAINDER)
+  args = p.parse_args()
+
+  cmd = args.cmd[1:] if args.cmd and args.cmd[0] == "--" else args.cmd
+  if not cmd: p.error("No command given")
+
+  if args.perf and os.path.exists(args.perf): os.remove(args.perf)
+
+  logfh = open(args.log, "w") if args.log else None
+  start = time.time()
+  ret = subprocess.call(cmd, stdout=logfh, stderr=subprocess.STDOUT if logfh else None)
+  wall = time.time() - start
+  if logfh: logfh.close()
+
+  # We only run one child at a time, so children's usage is this command's
+  usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+  perf = load_json(args.perf) if args.perf else None
+  bytes_read = perf["counters"].get("bytes_read", 0) if perf else 0
+
+  row = {"commit": args.commit,
+         "step": args.step,
+         "threads": args.threads,
+         "wall_secs": round(wall, 4),
+         "user_secs": round(usage.ru_utime, 4),
+         "sys_secs": round(usage.ru_stime, 4),
+         "peak_rss_bytes": peak_rss_bytes(usage),
+         "items": args.items,
+         "item_name": args.item_name,
+         "items_per_sec": round(args.items / wall, 2) if wall > 0 else 0,
+         "bytes_read": bytes_read,
+         "bytes_read_per_sec": round(bytes_read / wall, 2) if wall > 0 else 0,
+         "exit": ret}
+
+  new_csv = not os.path.exists(args.csv) or os.path.getsize(args.csv) == 0
+  with open(args.csv, "a") as fh:
+    w = csv.DictWriter(fh, fieldnames=COLUMNS, lineterminator="\n")
+    if new_csv: w.writeheader()
+    w.writerow(row)
+
+  results = load_json(args.json) or []
+  if perf: row["phases"] = perf.get("phases", [])
+  results.append(row)
+  with open(args.json, "w") as fh:
+    json.dump(results, fh, indent=2)
+    fh.write("\n")
+
+  print("[bench] %-10s threads=%-2i wall=%.2fs rss=%.1fMB %s" %
+        (args.step, args.threads, wall, row["peak_rss_bytes"]/1e6,
+         "%.0f %s/s" % (row["items_per_sec"], args.item_name) if args.items else ""),
+        file=sys.stderr)
+
+  sys.exit(ret)
+
+if __name__ == '__main__':
+  main()
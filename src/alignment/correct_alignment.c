@@ -19,6 +19,7 @@ void correct_aln_worker_alloc(CorrectAlnWorker *wrkr, bool store_contig_lens,
 {
   CorrectAlnWorker tmp = {.db_graph = db_graph,
                           .start_idx = 0, .gap_idx = 0, .end_idx = 0,
+                          .gapcache = NULL,
                           .store_contig_lens = store_contig_lens};
 
   // Graph alignment of reads
@@ -122,10 +123,12 @@ static TraversalResult traverse_one_way2(const dBNode *block, size_t n,
 
   // max_len allows for node on other side of gap
   size_t init_len = contig->len, max_len = contig->len + gap_max + 1;
+  size_t init_forks = wlk->fork_count; // forks taken whilst priming
   db_node_buf_capacity(contig, max_len);
 
   TraversalResult result = {.traversed = false, .paths_disagreed = false,
-                            .gap_too_short = false, .gap_len = 0};
+                            .gap_too_short = false, .met_fork = false,
+                            .gap_len = 0};
 
   // DEBUG
   // fprintf(stderr, "\ntraverse_one_way2:\n\n");
@@ -148,6 +151,9 @@ static TraversalResult traverse_one_way2(const dBNode *block, size_t n,
   result.gap_len = contig->len - init_len;
   rpt_walker_fast_clear(rptwlk, contig->b+init_len, result.gap_len);
 
+  result.met_fork = (wlk->fork_count > init_forks ||
+                     graph_step_status_is_fork(wlk->last_step.status));
+
   // Check paths match remaining nodes
   if(result.traversed && do_paths_check) {
     if(( forward && !graph_walker_agrees_contig(wlk, block+1, n-1, true)) ||
@@ -200,10 +206,12 @@ static TraversalResult traverse_two_way2(dBNodeBuffer *contig0,
   RepeatWalker *rptwlk[2] = {rptwlk0, rptwlk1};
   dBNodeBuffer *contig[2] = {contig0, contig1};
   dBNode nodes[2] = {wlk0->node, wlk1->node};
+  size_t init_forks[2] = {wlk0->fork_count, wlk1->fork_count};
   size_t i, gap_len = 0;
 
   TraversalResult result = {.traversed = false, .paths_disagreed = false,
-                            .gap_too_short = false, .gap_len = 0};
+                            .gap_too_short = false, .met_fork = false,
+                            .gap_len = 0};
 
   while(gap_len <= gap_max && (use[0] || use[1])) {
     for(i = 0; i < 2; i++) {
@@ -237,6 +245,11 @@ static TraversalResult traverse_two_way2(dBNodeBuffer *contig0,
 
   // printf("2-way Traversal %s\n", result.traversed ? "Worked" : "Failed");
 
+  for(i = 0; i < 2; i++) {
+    result.met_fork |= (wlk[i]->fork_count > init_forks[i] ||
+                        graph_step_status_is_fork(wlk[i]->last_step.status));
+  }
+
   if(result.traversed && do_paths_check)
   {
     // Check paths match remaining nodes
@@ -282,9 +295,12 @@ static TraversalResult traverse_two_way2(dBNodeBuffer *contig0,
   return result;
 }
 
+// Results of each attempt are stored in `results`, which must have length 2
 static TraversalResult traverse_one_way(CorrectAlnWorker *wrkr,
                                         size_t gap_idx, size_t end_idx,
-                                        size_t gap_min, size_t gap_max)
+                                        size_t gap_min, size_t gap_max,
+                                        TraversalResult *results,
+                                        size_t *num_results)
 {
   const CorrectAlnParam *params = &wrkr->params;
   const int aln_colour = wrkr->aln.colour; // -1 for all
@@ -309,6 +325,8 @@ static TraversalResult traverse_one_way(CorrectAlnWorker *wrkr,
                              only_in_one_col, params->use_end_check);
 
   correct_aln_stats_update(&wrkr->aln_stats, result);
+  results[0] = result;
+  *num_results = 1;
 
   if(result.traversed) return result;
 
@@ -324,13 +342,18 @@ static TraversalResult traverse_one_way(CorrectAlnWorker *wrkr,
                              only_in_one_col, params->use_end_check);
 
   correct_aln_stats_update(&wrkr->aln_stats, result);
+  results[1] = result;
+  *num_results = 2;
 
   return result;
 }
 
+// Result is also stored in `results[0]`
 static TraversalResult traverse_two_way(CorrectAlnWorker *wrkr,
                                         size_t gap_idx, size_t end_idx,
-                                        size_t gap_min, size_t gap_max)
+                                        size_t gap_min, size_t gap_max,
+                                        TraversalResult *results,
+                                        size_t *num_results)
 {
   const CorrectAlnParam *params = &wrkr->params;
   const int aln_colour = wrkr->aln.colour; // -1 for all
@@ -353,10 +376,75 @@ static TraversalResult traverse_two_way(CorrectAlnWorker *wrkr,
                              aln_colour != -1, params->use_end_check);
 
   correct_aln_stats_update(&wrkr->aln_stats, result);
+  results[0] = result;
+  *num_results = 1;
 
   return result;
 }
 
+// Traverse a gap, looking it up in the gap cache first if we have one.
+// We only cache results that cannot depend on the links picked up whilst
+// priming the GraphWalker with the nodes before the gap: those where no walk
+// reached a fork in the colour, or any result if the graph has no links and
+// none are being added.
+static TraversalResult traverse_gap(CorrectAlnWorker *wrkr,
+                                    size_t gap_idx, size_t end_idx,
+                                    size_t gap_min, size_t gap_max)
+{
+  const CorrectAlnParam *params = &wrkr->params;
+  const dBNodeBuffer *contig = &wrkr->contig, *revcontig = &wrkr->revcontig;
+  const size_t init_len = contig->len;
+  GapCache *cache = wrkr->gapcache;
+  TraversalResult results[2];
+  size_t i, num_results = 0;
+  bool met_fork = false;
+  GapCacheKey key;
+
+  // Checking paths agree with the rest of the read depends on the read
+  bool use_cache = (cache != NULL && !params->use_end_check);
+
+  if(use_cache)
+  {
+    uint32_t flags = (wrkr->aln.colour != -1 ? GAP_CACHE_ONLY_IN_COL : 0) |
+                     (params->one_way_gap_traverse ? 0 : GAP_CACHE_TWO_WAY);
+
+    gap_cache_key_init(&key, contig->b[contig->len-1],
+                       wrkr->aln.nodes.b[gap_idx],
+                       gap_min, gap_max, params->ctxcol, flags);
+
+    if(gap_cache_find(cache, &key, results, &num_results, &wrkr->contig)) {
+      wrkr->aln_stats.num_gap_cache_hits++;
+      for(i = 0; i < num_results; i++)
+        correct_aln_stats_update(&wrkr->aln_stats, results[i]);
+      return results[num_results-1];
+    }
+
+    wrkr->aln_stats.num_gap_cache_misses++;
+  }
+
+  if(params->one_way_gap_traverse)
+    traverse_one_way(wrkr, gap_idx, end_idx, gap_min, gap_max,
+                     results, &num_results);
+  else
+    traverse_two_way(wrkr, gap_idx, end_idx, gap_min, gap_max,
+                     results, &num_results);
+
+  if(use_cache)
+  {
+    for(i = 0; i < num_results; i++) met_fork |= results[i].met_fork;
+
+    if(!met_fork ||
+       (cache->fixed_links && wrkr->db_graph->gpstore.num_paths == 0))
+    {
+      gap_cache_add(cache, &key, results, num_results,
+                    contig->b + init_len, contig->len - init_len,
+                    revcontig->b, revcontig->len);
+    }
+  }
+
+  return results[num_results-1];
+}
+
 // @return NULL if end of alignment, otherwise returns pointer to wrkr->contig
 dBNodeBuffer* correct_alignment_nxt(CorrectAlnWorker *wrkr)
 {
@@ -441,14 +529,8 @@ dBNodeBuffer* correct_alignment_nxt(CorrectAlnWorker *wrkr)
 
     // Alternative traversing from both sides
     // gap len is the number of kmers filling the gap
-    TraversalResult result;
-
-    if(params.one_way_gap_traverse)
-      result = traverse_one_way(wrkr, wrkr->gap_idx, wrkr->end_idx,
-                                gap_min, gap_max);
-    else
-      result = traverse_two_way(wrkr, wrkr->gap_idx, wrkr->end_idx,
-                                gap_min, gap_max);
+    TraversalResult result = traverse_gap(wrkr, wrkr->gap_idx, wrkr->end_idx,
+                                          gap_min, gap_max);
 
     // status("traversal: %s!\n", result.traversed ? "worked" : "failed");
 
@@ -9,6 +9,7 @@
 #include "graph_walker.h"
 #include "repeat_walker.h"
 #include "correct_aln_stats.h"
+#include "gap_cache.h"
 
 // Default min and max values for the length of a correct fragment
 #define DEFAULT_CRTALN_FRAGLEN_MIN 0
@@ -72,6 +73,9 @@ typedef struct
   dBNodeBuffer contig, revcontig;
   Int32Buffer rpos;
 
+  // Cache of gap traversals shared between workers, may be NULL
+  GapCache *gapcache;
+
   // Statistics on gap traversal
   SeqLoadingStats load_stats;
   CorrectAlnStats aln_stats;
@@ -24,11 +24,13 @@ typedef struct
   uint64_t num_mid_gaps, num_mid_traversed; // gaps in the middle of reads
   uint64_t num_end_gaps, num_end_traversed; // gaps at the ends of reads
   uint64_t num_missing_edges; // gaps due to missing edges
+  uint64_t num_gap_cache_hits, num_gap_cache_misses; // see gap_cache.h
 } CorrectAlnStats;
 
 typedef struct {
   uint32_t gap_len;
   bool traversed, paths_disagreed, gap_too_short;
+  bool met_fork; // walk reached a fork in the colour, so may depend on links
 } TraversalResult;
 
 void correct_aln_stats_alloc(CorrectAlnStats *stats);
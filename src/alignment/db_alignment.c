@@ -75,6 +75,8 @@ static size_t db_alignment_from_read(dBAlignment *aln, const read_t *r,
         n++;
       }
     }
+
+    perf_count(PERF_KMERS, contig_len + 1 - kmer_size);
   }
 
   // Return number of bases from the last kmer found until read end
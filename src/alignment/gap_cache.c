@@ -0,0 +1,120 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
+#include "global.h"
+#include "gap_cache.h"
+#include "hash.h"
+#include "util.h"
+
+void gap_cache_alloc(GapCache *cache, size_t mem, bool fixed_links)
+{
+  size_t bucket_mem = GAP_CACHE_WAYS * sizeof(GapCacheEntry);
+  size_t nbuckets = 1;
+  while(2 * nbuckets * bucket_mem <= mem) nbuckets *= 2;
+
+  cache->num_buckets = nbuckets;
+  cache->table = ctx_calloc(nbuckets * GAP_CACHE_WAYS, sizeof(GapCacheEntry));
+  cache->bktlocks = ctx_calloc(roundup_bits2bytes(nbuckets), 1);
+  cache->fixed_links = fixed_links;
+
+  char num_str[50], mem_str[50];
+  ulong_to_str(nbuckets * GAP_CACHE_WAYS, num_str);
+  bytes_to_str(nbuckets * bucket_mem, 1, mem_str);
+  status("[GapCache] Caching up to %s gaps [%s]", num_str, mem_str);
+}
+
+void gap_cache_dealloc(GapCache *cache)
+{
+  ctx_free(cache->table);
+  ctx_free(cache->bktlocks);
+  memset(cache, 0, sizeof(GapCache));
+}
+
+static inline size_t gap_cache_bucket(const GapCache *cache,
+                                      const GapCacheKey *key)
+{
+  return ctx_hash64((void*)key, sizeof(GapCacheKey), 0) & (cache->num_buckets-1);
+}
+
+// Most recent use in bucket, plus one. Must hold the bucket lock.
+static inline uint64_t gap_cache_next_use(const GapCacheEntry *bkt)
+{
+  uint64_t last = 0;
+  size_t i;
+  for(i = 0; i < GAP_CACHE_WAYS; i++) last = MAX2(last, bkt[i].last_used);
+  return last + 1;
+}
+
+/**
+ * Look up a gap. If found, gap nodes are appended to `contig`.
+ * @param results   array of length 2 to store the traversal results
+ * @param num_results set to the number of traversal attempts stored
+ * @return true if found
+ */
+bool gap_cache_find(GapCache *cache, const GapCacheKey *key,
+                    TraversalResult *results, size_t *num_results,
+                    dBNodeBuffer *contig)
+{
+  size_t b = gap_cache_bucket(cache, key), i;
+  GapCacheEntry *bkt = cache->table + b * GAP_CACHE_WAYS, *entry = NULL;
+
+  perf_bitlock_acquire(cache->bktlocks, b);
+
+  for(i = 0; i < GAP_CACHE_WAYS; i++) {
+    if(bkt[i].last_used && memcmp(&bkt[i].key, key, sizeof(GapCacheKey)) == 0) {
+      entry = &bkt[i];
+      break;
+    }
+  }
+
+  if(entry != NULL) {
+    entry->last_used = gap_cache_next_use(bkt);
+    memcpy(results, entry->results, entry->num_results*sizeof(TraversalResult));
+    *num_results = entry->num_results;
+    db_node_buf_push(contig, entry->nodes, entry->num_nodes);
+  }
+
+  bitlock_release(cache->bktlocks, b);
+
+  return (entry != NULL);
+}
+
+/**
+ * Store a gap traversal. Ignored if successful and longer than
+ * GAP_CACHE_MAX_NODES nodes.
+ * @param results     traversal results, one per attempt (at most 2)
+ * @param nodes0,n0   first part of the gap, left to right
+ * @param nodes1,n1   second part of the gap, right to left and reverse
+ *                    complemented (as GraphWalker fills it in from the right)
+ */
+void gap_cache_add(GapCache *cache, const GapCacheKey *key,
+                   const TraversalResult *results, size_t num_results,
+                   const dBNode *nodes0, size_t n0,
+                   const dBNode *nodes1, size_t n1)
+{
+  ctx_assert(num_results > 0 && num_results <= 2);
+  if(n0 + n1 > GAP_CACHE_MAX_NODES) return;
+
+  size_t b = gap_cache_bucket(cache, key), i, j;
+  GapCacheEntry *bkt = cache->table + b * GAP_CACHE_WAYS, *entry = &bkt[0];
+
+  perf_bitlock_acquire(cache->bktlocks, b);
+
+  // Replace the same key, else the least recently used entry
+  for(i = 0; i < GAP_CACHE_WAYS; i++) {
+    if(bkt[i].last_used && memcmp(&bkt[i].key, key, sizeof(GapCacheKey)) == 0) {
+      entry = &bkt[i];
+      break;
+    }
+    if(bkt[i].last_used < entry->last_used) entry = &bkt[i];
+  }
+
+  entry->key = *key;
+  entry->last_used = gap_cache_next_use(bkt);
+  memcpy(entry->results, results, num_results*sizeof(TraversalResult));
+  entry->num_results = num_results;
+  entry->num_nodes = n0 + n1;
+  memcpy(entry->nodes, nodes0, n0 * sizeof(dBNode));
+  for(i = n0, j = n1; j > 0; i++, j--)
+    entry->nodes[i] = db_node_reverse(nodes1[j-1]);
+
+  bitlock_release(cache->bktlocks, b);
+}
@@ -0,0 +1,94 @@
+#ifndef GAP_CACHE_H_
+#define GAP_CACHE_H_
+
+#include "cortex_types.h"
+#include "db_node.h"
+#include "correct_aln_stats.h"
+
+//
+// Cache of gap traversals, shared between threads correcting reads.
+// A gap is identified by the nodes either side of it, the colour, the range of
+// permitted gap lengths and how it was traversed. We store failures and
+// successful traversals of up to GAP_CACHE_MAX_NODES nodes. The table is split
+// into buckets of GAP_CACHE_WAYS entries, each with a bit lock. When a bucket
+// is full, the least recently used entry is replaced.
+//
+// Only results that do not depend on the context used to prime a GraphWalker
+// may be added -- see traverse_gap() in correct_alignment.c
+//
+
+#define GAP_CACHE_WAYS 4
+#define GAP_CACHE_MAX_NODES 40
+#define GAP_CACHE_DEFAULT_MEM (16UL<<20) /* 16MB */
+
+// Flags
+#define GAP_CACHE_ONLY_IN_COL 1 /* only traverse nodes in colour */
+#define GAP_CACHE_TWO_WAY 2 /* traversed from both sides at once */
+
+typedef struct
+{
+  dBNode left, right; // last node before gap, first node after gap
+  uint32_t gap_min, gap_max, colour, flags;
+} GapCacheKey;
+
+typedef struct
+{
+  GapCacheKey key;
+  uint64_t last_used; // zero if unused
+  TraversalResult results[2]; // one result per traversal attempt
+  uint32_t num_results, num_nodes;
+  dBNode nodes[GAP_CACHE_MAX_NODES]; // gap nodes, left to right
+} GapCacheEntry;
+
+typedef struct
+{
+  GapCacheEntry *table;
+  uint8_t *bktlocks; // one bit lock per bucket
+  size_t num_buckets; // power of two
+  // If true, links are not added whilst the cache is in use. Then if the
+  // graph has no links, no traversal depends on the GraphWalker context
+  bool fixed_links;
+} GapCache;
+
+// @param mem amount of memory to use, at least one bucket is allocated
+void gap_cache_alloc(GapCache *cache, size_t mem, bool fixed_links);
+void gap_cache_dealloc(GapCache *cache);
+
+static inline void gap_cache_key_init(GapCacheKey *key,
+                                      dBNode left, dBNode right,
+                                      size_t gap_min, size_t gap_max,
+                                      Colour colour, uint32_t flags)
+{
+  memset(key, 0, sizeof(GapCacheKey)); // hashed, so zero any padding
+  key->left = left;
+  key->right = right;
+  key->gap_min = gap_min;
+  key->gap_max = gap_max;
+  key->colour = colour;
+  key->flags = flags;
+}
+
+/**
+ * Look up a gap. If found, gap nodes are appended to `contig`.
+ * @param results   array of length 2 to store the traversal results
+ * @param num_results set to the number of traversal attempts stored
+ * @return true if found
+ */
+bool gap_cache_find(GapCache *cache, const GapCacheKey *key,
+                    TraversalResult *results, size_t *num_results,
+                    dBNodeBuffer *contig);
+
+/**
+ * Store a gap traversal. Ignored if successful and longer than
+ * GAP_CACHE_MAX_NODES nodes.
+ * @param results     traversal results, one per attempt (at most 2)
+ * @param nodes0,n0   first part of the gap, left to right
+ * @param nodes1,n1   second part of the gap, right to left and reverse
+ *                    complemented (as GraphWalker fills it in from the right)
+ */
+void gap_cache_add(GapCache *cache, const GapCacheKey *key,
+                   const TraversalResult *results, size_t num_results,
+                   const dBNode *nodes0, size_t n0,
+                   const dBNode *nodes1, size_t n1);
+
+#endif /* GAP_CACHE_H_ */
@@ -1,8 +1,10 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "async_read_io.h"
 #include "seq_reader.h"
 #include "file_util.h"
 #include "util.h" // util_run_threads()
+#include "ctx_progress.h"
 
 #include <pthread.h>
 
@@ -12,6 +14,8 @@ struct AsyncIOWorker
   MsgPool *const pool;
   AsyncIOInput task;
   size_t *const num_running;
+  size_t num_reads; // reads added to the pool from this input
+  size_t progress1, progress2; // ids to report bytes read with --progress
 };
 
 
@@ -105,13 +109,21 @@ void asynciodata_pool_init(void *el, size_t idx, void *args)
   memcpy(el, &data, sizeof(AsyncIOData*));
 }
 
+static size_t async_io_progress_add(const seq_file_t *file)
+{
+  if(file == NULL || !progress_running()) return 0;
+  return progress_input_add(file->path, futil_get_file_size(file->path));
+}
+
 // No memory allocated for io worker
 static void async_io_worker_init(AsyncIOWorker *wrkr,
                                  const AsyncIOInput *task,
                                  MsgPool *pool, size_t *num_running)
 {
   ctx_assert(pool->elsize == sizeof(AsyncIOData*));
-  AsyncIOWorker tmp = {.pool = pool, .task = *task, .num_running = num_running};
+  AsyncIOWorker tmp = {.pool = pool, .task = *task, .num_running = num_running,
+                       .progress1 = async_io_progress_add(task->file1),
+                       .progress2 = async_io_progress_add(task->file2)};
   memcpy(wrkr, &tmp, sizeof(AsyncIOWorker));
 }
 
@@ -131,6 +143,19 @@ static void add_to_pool(read_t *r1, read_t *r2,
   data->fq_offset1 = fq_offset1;
   data->fq_offset2 = fq_offset2;
   data->ptr = wrkr->task.ptr;
+  data->seqn = wrkr->num_reads++;
+
+  size_t nbytes1 = r1->name.end + r1->seq.end + r1->qual.end;
+  size_t nbytes2 = r2 ? r2->name.end + r2->seq.end + r2->qual.end : 0;
+  perf_count(PERF_BYTES_READ, nbytes1 + nbytes2);
+  perf_count(PERF_READS, 1 + (r2 != NULL));
+
+  // Interleaved pairs come from one file
+  if(wrkr->progress2) {
+    progress_input_read(wrkr->progress1, nbytes1, 1);
+    progress_input_read(wrkr->progress2, nbytes2, r2 != NULL);
+  }
+  else progress_input_read(wrkr->progress1, nbytes1 + nbytes2, 1 + (r2 != NULL));
 
   SWAP(data->r1, *r1);
 
@@ -163,6 +188,9 @@ static void* async_io_reader(void *ptr)
   seq_read_dealloc(&r1);
   seq_read_dealloc(&r2);
 
+  progress_input_done(wrkr->progress1);
+  progress_input_done(wrkr->progress2);
+
   // Check if we are the last thread to finish, if so close the pool
   size_t n = __sync_sub_and_fetch((volatile size_t*)wrkr->num_running, 1);
 
@@ -21,6 +21,7 @@ typedef struct
 {
   read_t r1, r2;
   void *ptr; // pointer from AsyncIOInput (specific to source sequence file(s))
+  size_t seqn; // index of this read (pair) in its input, 0,1,2,...
   uint8_t fq_offset1, fq_offset2;
 } AsyncIOData;
 
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "file_util.h"
 
@@ -281,7 +282,7 @@ void futil_get_strbuf_of_dir_path(const char *path, StrBuf *dir)
   char *tmp = strdup(path);
   strbuf_set(dir, dirname(tmp));
   strbuf_append_char(dir, '/');
-  ctx_free(tmp);
+  free(tmp);
 }
 
 char* futil_get_current_dir(char abspath[PATH_MAX+1])
@@ -0,0 +1,83 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
+#include "global.h"
+#include "reorder_buffer.h"
+
+void reorder_buf_alloc(ReorderBuffer *rb, size_t nbufs, size_t nthreads)
+{
+  rb->nbufs = nbufs;
+  rb->cap = roundup2pow(MSGPOOLSIZE + nthreads);
+  rb->next = 0;
+  rb->bufs = ctx_calloc(rb->cap * nbufs, sizeof(StrBuf));
+  rb->ready = ctx_calloc(rb->cap, sizeof(bool));
+}
+
+void reorder_buf_dealloc(ReorderBuffer *rb)
+{
+  size_t i;
+  for(i = 0; i < rb->cap; i++) ctx_assert(!rb->ready[i]);
+  for(i = 0; i < rb->cap * rb->nbufs; i++)
+    if(rb->bufs[i].b != NULL) strbuf_dealloc(&rb->bufs[i]);
+  ctx_free(rb->bufs);
+  ctx_free(rb->ready);
+  memset(rb, 0, sizeof(ReorderBuffer));
+}
+
+// Make room to store item `seqn`
+static void reorder_buf_reserve(ReorderBuffer *rb, size_t seqn)
+{
+  if(seqn - rb->next < rb->cap) return;
+
+  // Every slot holds one of the items [next, next+cap), move each to its slot
+  // in the new arrays
+  size_t i, s, from, to, newcap = roundup2pow(seqn - rb->next + 1);
+  StrBuf *bufs = ctx_calloc(newcap * rb->nbufs, sizeof(StrBuf));
+  bool *ready = ctx_calloc(newcap, sizeof(bool));
+
+  for(i = 0; i < rb->cap; i++) {
+    s = rb->next + i;
+    from = s & (rb->cap-1);
+    to = s & (newcap-1);
+    memcpy(&bufs[to*rb->nbufs], &rb->bufs[from*rb->nbufs],
+           rb->nbufs * sizeof(StrBuf));
+    ready[to] = rb->ready[from];
+  }
+
+  ctx_free(rb->bufs);
+  ctx_free(rb->ready);
+  rb->bufs = bufs;
+  rb->ready = ready;
+  rb->cap = newcap;
+}
+
+StrBuf* reorder_buf_store(ReorderBuffer *rb, size_t seqn)
+{
+  ctx_assert(seqn > rb->next);
+  reorder_buf_reserve(rb, seqn);
+
+  size_t i, slot = seqn & (rb->cap-1);
+  StrBuf *bufs = &rb->bufs[slot*rb->nbufs];
+  ctx_assert(!rb->ready[slot]);
+
+  for(i = 0; i < rb->nbufs; i++) {
+    if(bufs[i].b == NULL) strbuf_alloc(&bufs[i], 256);
+    else strbuf_reset(&bufs[i]);
+  }
+
+  rb->ready[slot] = true;
+  return bufs;
+}
+
+StrBuf* reorder_buf_take(ReorderBuffer *rb)
+{
+  size_t slot = rb->next & (rb->cap-1);
+  if(!rb->ready[slot]) return NULL;
+  rb->ready[slot] = false;
+  rb->next++;
+  return &rb->bufs[slot*rb->nbufs];
+}
+
+void reorder_buf_reset(ReorderBuffer *rb)
+{
+  ctx_assert(!rb->ready[rb->next & (rb->cap-1)]);
+  rb->next = 0;
+}
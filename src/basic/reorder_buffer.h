@@ -0,0 +1,40 @@
+#ifndef REORDER_BUFFER_H_
+#define REORDER_BUFFER_H_
+
+//
+// Reorder buffer: hold items that finish out of order until the items before
+// them are done, so output can be written in input order.
+//
+// Item `seqn` is stored at slot seqn % cap, each slot holds `nbufs` strings.
+// Strings are allocated the first time a slot is used and reused after that.
+// The array grows if an item arrives more than `cap` items ahead.
+// Not thread safe, callers must hold their own lock.
+//
+
+typedef struct
+{
+  StrBuf *bufs; // cap*nbufs strings, slot i starts at bufs[i*nbufs]
+  bool *ready;
+  size_t nbufs, cap, next; // next: index of the next item to take
+} ReorderBuffer;
+
+// Items are reads from asyncio_run_pool(), at most MSGPOOLSIZE reads plus
+// one per worker thread are in flight, start with that many slots
+void reorder_buf_alloc(ReorderBuffer *rb, size_t nbufs, size_t nthreads);
+void reorder_buf_dealloc(ReorderBuffer *rb);
+
+// Store item `seqn`, which must come after rb->next.
+// Returns its nbufs strings, emptied, for the caller to fill
+StrBuf* reorder_buf_store(ReorderBuffer *rb, size_t seqn);
+
+// If the next item has been stored, return its strings and move on to the
+// item after. Otherwise return NULL. Strings are valid until the next store.
+StrBuf* reorder_buf_take(ReorderBuffer *rb);
+
+// The next item was handled without being stored, move on to the item after
+static inline void reorder_buf_pass(ReorderBuffer *rb) { rb->next++; }
+
+// Start again from item 0, once all items have been taken
+void reorder_buf_reset(ReorderBuffer *rb);
+
+#endif /* REORDER_BUFFER_H_ */
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "seq_reader.h"
 #include "util.h"
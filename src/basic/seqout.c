@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "seqout.h"
 #include "file_util.h"
@@ -20,7 +21,8 @@ static char* _seqout_alloc_path(char *out_base, int pe, const char *suffix)
 
 // Returns gzFile or NULL if file already exists and !futil_get_force()
 // Creates directories as required
-static gzFile _seqout_open(const char *path)
+// @mode "w" to compress or "wT" to write as-is
+static gzFile _seqout_open(const char *path, const char *mode)
 {
   gzFile gzout;
 
@@ -31,7 +33,7 @@ static gzFile _seqout_open(const char *path)
     return NULL;
   }
 
-  if((gzout = gzdopen(fd, "w")) == NULL) {
+  if((gzout = gzdopen(fd, mode)) == NULL) {
     warn("Cannot open %s", path);
     close(fd);
     return NULL;
@@ -48,13 +50,17 @@ static gzFile _seqout_open(const char *path)
 // Returns true on success, false on failure
 // fmt may be: SEQ_FMT_FASTQ, SEQ_FMT_FASTA, SEQ_FMT_PLAIN
 // file extensions are: <O>.fq.gz, <O>.fa.gz, <O>.txt.gz
-bool seqout_open(SeqOutput *seqout, char *out_base, seq_format fmt, bool is_pe)
+// @gzblocks if true and supported by zlib, open files without compression so
+//           the caller can write gzip members. Check seqout->gzblocks after.
+bool seqout_open(SeqOutput *seqout, char *out_base, seq_format fmt, bool is_pe,
+                 bool gzblocks)
 {
   memset(seqout, 0, sizeof(SeqOutput));
 
   seqout->fmt = fmt;
   seqout->is_pe = is_pe;
-  const char *ext = NULL;
+  seqout->gzblocks = gzblocks && SEQOUT_GZBLOCKS_SUPPORTED;
+  const char *ext = NULL, *mode = seqout->gzblocks ? "wT" : "w";
 
   switch(fmt) {
     case SEQ_FMT_FASTQ: ext = ".fq.gz";  break;
@@ -64,13 +70,13 @@ bool seqout_open(SeqOutput *seqout, char *out_base, seq_format fmt, bool is_pe)
   }
 
   seqout->path_se = _seqout_alloc_path(out_base, 0, ext);
-  if((seqout->gzout_se = _seqout_open(seqout->path_se)) == NULL) return false;
+  if((seqout->gzout_se = _seqout_open(seqout->path_se, mode)) == NULL) return false;
 
   if(is_pe) {
     seqout->path_pe[0] = _seqout_alloc_path(out_base, 1, ext);
     seqout->path_pe[1] = _seqout_alloc_path(out_base, 2, ext);
-    if((seqout->gzout_pe[0] = _seqout_open(seqout->path_pe[0])) == NULL) return false;
-    if((seqout->gzout_pe[1] = _seqout_open(seqout->path_pe[1])) == NULL) return false;
+    if((seqout->gzout_pe[0] = _seqout_open(seqout->path_pe[0], mode)) == NULL) return false;
+    if((seqout->gzout_pe[1] = _seqout_open(seqout->path_pe[1], mode)) == NULL) return false;
   }
 
   if(pthread_mutex_init(&seqout->lock_se, NULL) != 0) die("Mutex init failed");
@@ -12,18 +12,30 @@
 
 #include "seq_file/seq_file.h"
 
+// zlib >= 1.2.5.2 can write a gzFile without compressing ("wT"), so callers can
+// compress blocks themselves and write them as concatenated gzip members
+#if ZLIB_VERNUM >= 0x1252
+  #define SEQOUT_GZBLOCKS_SUPPORTED 1
+#else
+  #define SEQOUT_GZBLOCKS_SUPPORTED 0
+#endif
+
 typedef struct {
   char *path_se, *path_pe[2];
   gzFile gzout_se, gzout_pe[2];
   pthread_mutex_t lock_se, lock_pe;
   bool is_pe; // if we have X.{1,2}.fq.gz as well as X.fq.gz
+  bool gzblocks; // if true, data written must already be gzip compressed
   seq_format fmt; // output format
 } SeqOutput;
 
 // Returns true on success, false on failure
 // fmt may be: SEQ_FMT_FASTQ, SEQ_FMT_FASTA, SEQ_FMT_PLAIN
 // file extensions are: <O>.fq.gz, <O>.fa.gz, <O>.txt.gz
-bool seqout_open(SeqOutput *seqout, char *out_base, seq_format fmt, bool is_pe);
+// @gzblocks if true and supported by zlib, open files without compression so
+//           the caller can write gzip members. Check seqout->gzblocks after.
+bool seqout_open(SeqOutput *seqout, char *out_base, seq_format fmt, bool is_pe,
+                 bool gzblocks);
 
 // Free memory
 // @rm if true, delete files as well
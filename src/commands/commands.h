@@ -29,6 +29,7 @@ int ctx_uniqkmers(int argc, char **argv);
 int ctx_links(int argc, char **argv);
 int ctx_pop_bubbles(int argc, char **argv);
 int ctx_dist_matrix(int argc, char **argv);
+int ctx_sketch(int argc, char **argv);
 int ctx_server(int argc, char **argv);
 int ctx_vcfcov(int argc, char **argv);
 int ctx_vcfgeno(int argc, char **argv);
@@ -62,6 +63,7 @@ extern const char uniqkmers_usage[];
 extern const char links_usage[];
 extern const char pop_bubbles_usage[];
 extern const char dist_matrix_usage[];
+extern const char sketch_usage[];
 extern const char server_usage[];
 extern const char vcfcov_usage[];
 extern const char vcfgeno_usage[];
@@ -7,6 +7,7 @@
 #include "graphs_load.h"
 #include "graph_writer.h"
 #include "clean_graph.h"
+#include "clean_graph_disk.h"
 #include "db_unitig.h" // for saving length histogram
 
 const char clean_usage[] =
@@ -25,11 +26,14 @@ const char clean_usage[] =
 "  -t, --threads <T>        Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 "  -N, --ncols <N>          Number of graph colours to use\n"
 "  -S, --sort               Output a graph file ordered by kmer\n"
+"  -D, --disk               Clean a sorted graph on disk without loading it\n"
 "\n"
 "  Cleaning:\n"
 "  -T[L], --tips[=L]        Clip tips shorter than <L> kmers [default: auto]\n"
 "  -U[X], --unitigs[=X]     Remove low coverage unitigs with median cov < X [default: auto]\n"
 "  -B, --fallback <T>       Fall back threshold if we can't pick\n"
+"  -P, --pop                Pop bubbles in the same pass (see `"CMD" pop`)\n"
+"  -s, --per-sample         Clean each colour with its own threshold\n"
 "\n"
 "  Statistics:\n"
 "  -c, --covg-before <out.csv> Save kmer coverage histogram before cleaning\n"
@@ -40,6 +44,12 @@ const char clean_usage[] =
 "  --unitigs without a threshold, causes a calculated threshold to be used\n"
 "  Default: --tips 2*kmer_size --unitigs\n"
 "  Set thresholds to zero to turn-off cleaning\n"
+"  --pop on its own only pops bubbles\n"
+"  --disk takes one sorted graph (see `"CMD" sort`) and needs 3 bits per kmer.\n"
+"    Output is sorted. Does not support --pop.\n"
+"  --per-sample walks the population unitigs once and removes each unitig from\n"
+"    colours where its median coverage is below that colour's threshold. Tips are\n"
+"    removed from all colours. Needs all colours loaded.\n"
 "\n";
 
 static struct option longopts[] =
@@ -53,10 +63,13 @@ static struct option longopts[] =
   {"threads",      required_argument, NULL, 't'},
   {"ncols",        required_argument, NULL, 'N'},
   {"sort",         no_argument,       NULL, 'S'},
+  {"disk",         no_argument,       NULL, 'D'},
 // command specific
   {"tips",         optional_argument, NULL, 'T'},
   {"unitigs",      optional_argument, NULL, 'U'},
   {"fallback",     required_argument, NULL, 'B'},
+  {"pop",          no_argument,       NULL, 'P'},
+  {"per-sample",   no_argument,       NULL, 's'},
 // output
   {"len-before",   required_argument, NULL, 'l'},
   {"len-after",    required_argument, NULL, 'L'},
@@ -130,14 +143,104 @@ static size_t ctx_max_cols(struct MemArgs memargs, uint64_t ctx_max_kmers,
   return MIN2(ncols, file_ncols);
 }
 
+// Use estimated threshold if threshold not set
+// Dies if we failed to find suitable cleaning threshold
+static int clean_pick_threshold(int unitig_min, int est_min_covg,
+                                uint32_t fallback_thresh)
+{
+  if(est_min_covg < 0) status("Cannot find recommended cleaning threshold");
+  else status("Recommended cleaning threshold is: %i", est_min_covg);
+
+  if(unitig_min < 0) {
+    if(fallback_thresh > 0 && est_min_covg < (int)fallback_thresh) {
+      status("Using fallback threshold: %i", fallback_thresh);
+      unitig_min = fallback_thresh;
+    }
+    else if(est_min_covg >= 0) unitig_min = est_min_covg;
+  }
+
+  if(unitig_min < 0)
+    die("Need cleaning threshold (--unitigs=<D> or --fallback <D>)");
+
+  return unitig_min;
+}
+
+// Set output header ginfo cleaned
+// `col_mins` gives a threshold per colour, if NULL `unitig_min` is used
+static void clean_set_header(GraphFileHeader *outhdr, size_t ncols,
+                             bool unitig_cleaning, bool tip_cleaning,
+                             int unitig_min, const size_t *col_mins)
+{
+  ErrorCleaning *cleaning;
+  size_t col;
+
+  for(col = 0; col < ncols; col++)
+  {
+    if(col_mins != NULL) unitig_min = col_mins[col];
+    cleaning = &outhdr->ginfo[col].cleaning;
+    cleaning->cleaned_unitigs |= unitig_cleaning;
+    cleaning->cleaned_tips |= tip_cleaning;
+
+    // if(tip_cleaning) {
+    //   strbuf_append_str(&outhdr->ginfo[col].sample_name, ".tipclean");
+    // }
+
+    if(unitig_cleaning) {
+      size_t thresh = cleaning->clean_unitigs_thresh;
+      thresh = cleaning->cleaned_unitigs ? MAX2(thresh, (uint32_t)unitig_min)
+                                        : (uint32_t)unitig_min;
+      cleaning->clean_unitigs_thresh = thresh;
+
+      // char name_append[200];
+      // sprintf(name_append, ".supclean%zu", thresh);
+      // strbuf_append_str(&outhdr->ginfo[col].sample_name, name_append);
+    }
+  }
+}
+
+// Clean a sorted graph file without loading it into memory
+static void ctx_clean_disk(GraphFileReader *file, const char *out_ctx_path,
+                           bool unitig_cleaning, bool tip_cleaning,
+                           int unitig_min, size_t min_keep_tip,
+                           uint32_t fallback_thresh,
+                           const char *covg_before_path,
+                           const char *len_before_path,
+                           const char *covg_after_path,
+                           const char *len_after_path)
+{
+  futil_create_output(out_ctx_path);
+  futil_create_output(covg_before_path);
+  futil_create_output(covg_after_path);
+  futil_create_output(len_before_path);
+  futil_create_output(len_after_path);
+
+  GraphFileHeader outhdr;
+  memset(&outhdr, 0, sizeof(GraphFileHeader));
+  graph_file_merge_header(&outhdr, file);
+
+  int est_min_covg = cleaning_disk_get_threshold(file);
+  unitig_min = clean_pick_threshold(unitig_min, est_min_covg, fallback_thresh);
+
+  clean_set_header(&outhdr, outhdr.num_of_cols, unitig_cleaning, tip_cleaning,
+                   unitig_min, NULL);
+
+  clean_graph_disk(file, unitig_min, min_keep_tip,
+                   covg_before_path, len_before_path,
+                   covg_after_path, len_after_path,
+                   out_ctx_path, &outhdr);
+
+  graph_header_dealloc(&outhdr);
+}
+
 int ctx_clean(int argc, char **argv)
 {
   size_t nthreads = 0;
   struct MemArgs memargs = MEM_ARGS_INIT;
   const char *out_ctx_path = NULL;
-  bool sort_kmers = false;
+  bool sort_kmers = false, disk_cleaning = false;
   int min_keep_tip = -1, unitig_min = -1; // <0 => default, 0 => noclean
-  bool unitig_cleaning = false, tip_cleaning = false;
+  bool unitig_cleaning = false, tip_cleaning = false, bubble_popping = false;
+  bool per_sample = false;
   uint32_t fallback_thresh = 0;
   const char *len_before_path = NULL, *len_after_path = NULL;
   const char *covg_before_path = NULL, *covg_after_path = NULL;
@@ -174,12 +277,15 @@ int ctx_clean(int argc, char **argv)
         tip_cleaning = true;
         break;
       case 'S': cmd_check(!sort_kmers,cmd); sort_kmers = true; break;
+      case 'D': cmd_check(!disk_cleaning,cmd); disk_cleaning = true; break;
       case 'U':
         cmd_check(unitig_min<0, cmd);
         unitig_min = (optarg != NULL ? (int)cmd_uint32(cmd, optarg) : -1);
         unitig_cleaning = true;
         break;
       case 'B': cmd_check(!fallback_thresh, cmd); fallback_thresh = cmd_uint32_nonzero(cmd, optarg); break;
+      case 'P': cmd_check(!bubble_popping, cmd); bubble_popping = true; break;
+      case 's': cmd_check(!per_sample, cmd); per_sample = true; break;
       case 'l': cmd_check(!len_before_path, cmd); len_before_path = optarg; break;
       case 'L': cmd_check(!len_after_path, cmd); len_after_path = optarg; break;
       case 'c': cmd_check(!covg_before_path, cmd); covg_before_path = optarg; break;
@@ -196,7 +302,11 @@ int ctx_clean(int argc, char **argv)
 
   if(optind >= argc) cmd_print_usage("Please give input graph files");
 
-  bool doing_cleaning = (unitig_cleaning || tip_cleaning);
+  // Only pop bubbles if that is all we were asked to do
+  if(bubble_popping && !unitig_cleaning && !tip_cleaning)
+    min_keep_tip = unitig_min = 0;
+
+  bool doing_cleaning = (unitig_cleaning || tip_cleaning || bubble_popping);
 
   // set default cleaning
   if(!doing_cleaning && out_ctx_path != NULL) {
@@ -213,7 +323,7 @@ int ctx_clean(int argc, char **argv)
 
   if(!doing_cleaning && (covg_after_path || len_after_path)) {
     warn("You gave --len-after <out> / --covg-after <out> without "
-         "any cleaning (set -U, --unitigs or -t, --tips)");
+         "any cleaning (set -U, --unitigs, -T, --tips or -P, --pop)");
   }
 
   if(doing_cleaning && strcmp(out_ctx_path,"-") != 0 &&
@@ -225,19 +335,42 @@ int ctx_clean(int argc, char **argv)
   if(fallback_thresh && !unitig_cleaning)
     warn("-B, --fallback <T> without --unitigs");
 
+  if(disk_cleaning && bubble_popping)
+    cmd_print_usage("--disk does not support --pop");
+
+  if(disk_cleaning && cmd_mem_get_plan())
+    cmd_print_usage("--disk does not support --plan");
+
+  if(per_sample && (disk_cleaning || bubble_popping))
+    cmd_print_usage("--per-sample does not support --disk or --pop");
+
+  if(per_sample && (covg_before_path || len_before_path ||
+                    covg_after_path || len_after_path))
+    cmd_print_usage("--per-sample does not save histograms");
+
+  if(per_sample && out_ctx_path == NULL)
+    cmd_print_usage("--per-sample needs --out <out.ctx>");
+
   // Use remaining args as graph files
   char **gfile_paths = argv + optind;
   size_t i, j, num_gfiles = (size_t)(argc - optind);
 
   // Open graph files
   GraphFileReader *gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
-  size_t col, ctx_max_kmers = 0, ctx_sum_kmers = 0;
+  size_t ctx_max_kmers = 0, ctx_sum_kmers = 0;
 
   file_ncols = graph_files_open(gfile_paths, gfiles, num_gfiles,
                                 &ctx_max_kmers, &ctx_sum_kmers);
 
   size_t kmer_size = gfiles[0].hdr.kmer_size;
 
+  if(disk_cleaning) {
+    if(num_gfiles != 1 || out_ctx_path == NULL)
+      cmd_print_usage("--disk takes one sorted graph file and --out <out.ctx>");
+    if(gfiles[0].num_of_kmers < 0)
+      cmd_print_usage("--disk cannot read a graph from a stream");
+  }
+
   // Flatten if we don't have to remember colours / output a graph
   if(out_ctx_path == NULL)
   {
@@ -290,12 +423,27 @@ int ctx_clean(int argc, char **argv)
       status("%zu. Cleaning unitigs with coverage < %i", step++, unitig_min);
     if(unitig_min < 0)
       status("%zu. Cleaning unitigs with auto-detected threshold", step++);
+    if(per_sample)
+      status("%zu. Cleaning each colour separately", step++);
   }
+  if(bubble_popping)
+    status("%zu. Popping bubbles", step++);
   if(covg_after_path != NULL)
     status("%zu. Saving kmer coverage distribution to: %s", step++, covg_after_path);
   if(len_after_path != NULL)
     status("%zu. Saving unitig length distribution to: %s", step++, len_after_path);
 
+  if(disk_cleaning)
+  {
+    ctx_clean_disk(&gfiles[0], out_ctx_path,
+                   unitig_cleaning, tip_cleaning, unitig_min, min_keep_tip,
+                   fallback_thresh, covg_before_path, len_before_path,
+                   covg_after_path, len_after_path);
+    graph_file_close(&gfiles[0]);
+    ctx_free(gfiles);
+    return EXIT_SUCCESS;
+  }
+
   //
   // Decide memory usage
   //
@@ -303,7 +451,12 @@ int ctx_clean(int argc, char **argv)
   size_t kmers_in_hash = 0, graph_mem = 0;
   bool all_colours_loaded;
 
-  if(user_ncols)
+  if(per_sample) {
+    if(user_ncols && user_ncols < file_ncols)
+      cmd_print_usage("--per-sample needs all %zu colours loaded", file_ncols);
+    using_ncols = file_ncols;
+  }
+  else if(user_ncols)
     using_ncols = user_ncols;
   else
     using_ncols = ctx_max_cols(memargs, ctx_max_kmers, file_ncols, sort_kmers);
@@ -377,42 +530,59 @@ int ctx_clean(int argc, char **argv)
   uint8_t *visited = ctx_calloc(roundup_bits2bytes(db_graph.ht.capacity), 1);
   uint8_t *keep = ctx_calloc(roundup_bits2bytes(db_graph.ht.capacity), 1);
 
-  // Always estimate cleaning threshold
-  // if(unitig_min <= 0 || covg_before_path || len_before_path)
-  // {
-    // Get coverage distribution and estimate cleaning threshold
-    int est_min_covg = cleaning_get_threshold(nthreads,
-                                              covg_before_path,
-                                              len_before_path,
-                                              visited, &db_graph);
-
-    if(est_min_covg < 0) status("Cannot find recommended cleaning threshold");
-    else status("Recommended cleaning threshold is: %i", est_min_covg);
-
-    // Use estimated threshold if threshold not set
-    if(unitig_min < 0) {
-      if(fallback_thresh > 0 && est_min_covg < (int)fallback_thresh) {
-        status("Using fallback threshold: %i", fallback_thresh);
-        unitig_min = fallback_thresh;
-      }
-      else if(est_min_covg >= 0) unitig_min = est_min_covg;
+  // Threshold for each colour, only used with --per-sample
+  size_t *col_mins = NULL;
+
+  if(per_sample)
+  {
+    int *col_est = ctx_calloc(using_ncols, sizeof(int));
+    col_mins = ctx_calloc(using_ncols, sizeof(size_t));
+    if(unitig_cleaning)
+      cleaning_get_col_thresholds(nthreads, col_est, &db_graph);
+    for(i = 0; unitig_cleaning && i < using_ncols; i++) {
+      status("[cleaning] Colour %zu:", i);
+      col_mins[i] = clean_pick_threshold(unitig_min, col_est[i],
+                                         fallback_thresh);
     }
-  // }
+    ctx_free(col_est);
 
-  // Die if we failed to find suitable cleaning threshold
-  if(unitig_min < 0)
-    die("Need cleaning threshold (--unitigs=<D> or --fallback <D>)");
+    clean_graph_per_colour(nthreads, col_mins, min_keep_tip,
+                           visited, keep, &db_graph);
+    unitig_min = 0;
+  }
+
+  // Estimate cleaning threshold from the pooled graph
+  if(!per_sample)
+  {
+    // Get coverage distribution and estimate cleaning threshold
+    // If we are cleaning, unitig histograms are collected in the cleaning pass
+    int est_min_covg;
+    if(doing_cleaning)
+      est_min_covg = cleaning_get_kmer_threshold(nthreads, &db_graph);
+    else
+      est_min_covg = cleaning_get_threshold(nthreads,
+                                            covg_before_path,
+                                            len_before_path,
+                                            visited, &db_graph);
+
+    unitig_min = clean_pick_threshold(unitig_min, est_min_covg, fallback_thresh);
+  }
 
   // Cleaning parameters should now be set (>0) or turned off (==0)
   ctx_assert(unitig_min >= 0);
   ctx_assert(min_keep_tip >= 0);
 
-  if(unitig_cleaning || tip_cleaning)
+  if(doing_cleaning && !per_sample)
   {
-    // Clean graph of tips (if min_keep_tip > 0) and unitigs (if threshold > 0)
-    clean_graph(nthreads, unitig_min, min_keep_tip,
-                covg_after_path, len_after_path,
-                visited, keep, &db_graph);
+    // Clean graph of tips (if min_keep_tip > 0), unitigs (if threshold > 0)
+    // and bubbles in a single pass
+    PopBubblesPrefs pop_prefs = {.max_rmv_covg = -1, .max_rmv_klen = -1,
+                                 .max_rmv_kdiff = -1};
+    clean_graph_fused(nthreads, unitig_min, min_keep_tip,
+                      bubble_popping ? &pop_prefs : NULL,
+                      covg_before_path, len_before_path,
+                      covg_after_path, len_after_path,
+                      visited, keep, &db_graph);
   }
 
   ctx_free(visited);
@@ -421,27 +591,8 @@ int ctx_clean(int argc, char **argv)
   if(out_ctx_path != NULL)
   {
     // Set output header ginfo cleaned
-    for(col = 0; col < using_ncols; col++)
-    {
-      cleaning = &outhdr.ginfo[col].cleaning;
-      cleaning->cleaned_unitigs |= unitig_cleaning;
-      cleaning->cleaned_tips |= tip_cleaning;
-
-      // if(tip_cleaning) {
-      //   strbuf_append_str(&outhdr.ginfo[col].sample_name, ".tipclean");
-      // }
-
-      if(unitig_cleaning) {
-        size_t thresh = cleaning->clean_unitigs_thresh;
-        thresh = cleaning->cleaned_unitigs ? MAX2(thresh, (uint32_t)unitig_min)
-                                          : (uint32_t)unitig_min;
-        cleaning->clean_unitigs_thresh = thresh;
-
-        // char name_append[200];
-        // sprintf(name_append, ".supclean%zu", thresh);
-        // strbuf_append_str(&outhdr.ginfo[col].sample_name, name_append);
-      }
-    }
+    clean_set_header(&outhdr, using_ncols, unitig_cleaning, tip_cleaning,
+                     unitig_min, col_mins);
 
     // Print stats on removed kmers
     size_t removed_nkmers = initial_nkmers - hash_table_nkmers(&db_graph.ht);
@@ -463,6 +614,7 @@ int ctx_clean(int argc, char **argv)
   // TODO: report kmer coverage for each sample
 
   graph_header_dealloc(&outhdr);
+  ctx_free(col_mins);
 
   for(i = 0; i < num_gfiles; i++) graph_file_close(&gfiles[i]);
   ctx_free(gfiles);
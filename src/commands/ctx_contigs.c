@@ -195,9 +195,10 @@ int ctx_contigs(int argc, char **argv)
   //
   size_t bits_per_kmer, kmers_in_hash, graph_mem, path_mem, total_mem;
 
-  // 1 bit needed per kmer if we need to keep track of kmer usage
+  // 3 bits needed per kmer if we need to keep track of kmer usage:
+  // visited, plus two bits used to claim unitigs as seeds
   bits_per_kmer = sizeof(BinaryKmer)*8 + sizeof(Edges)*8 + sizeof(GPath*)*8 +
-                  ncols + !sample_with_replacement;
+                  ncols + 3*!sample_with_replacement;
 
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
@@ -53,7 +53,7 @@ const char correct_usage[] =
 "\n"
 "  Output is <O>.fq.gz for FASTQ, <O>.fa.gz for FASTA, <O>.txt.gz for plain\n"
 "  --seq outputs <out>.fa.gz, --seq2 outputs <out>.1.fa.gz, <out>.2.fa.gz\n"
-"  --seq must come AFTER two/oneway options. Output may be slightly shuffled.\n"
+"  --seq must come AFTER two/oneway options. Reads are output in input order.\n"
 "\n";
 
 static struct option longopts[] =
@@ -168,7 +168,8 @@ int ctx_correct(int argc, char **argv)
     // We loaded target colour into colour zero
     input->crt_params.ctxcol = input->crt_params.ctpcol = 0;
     bool is_pe = asyncio_task_is_pe(&input->files);
-    err_occurred = !seqout_open(&outputs[i], input->out_base, args.fmt, is_pe);
+    err_occurred = !seqout_open(&outputs[i], input->out_base, args.fmt, is_pe,
+                                true);
     input->output = &outputs[i];
   }
 
@@ -6,6 +6,8 @@
 #include "db_node.h"
 #include "seq_reader.h"
 #include "graphs_load.h"
+#include "async_read_io.h"
+#include "reorder_buffer.h"
 
 const char coverage_usage[] =
 "usage: "CMD" coverage [options] <in.ctx> [in2.ctx ..]\n"
@@ -17,10 +19,23 @@ const char coverage_usage[] =
 "  -f, --force          Overwrite output files\n"
 "  -m, --memory <mem>   Memory to use (e.g. 1M, 20GB)\n"
 "  -n, --nkmers <N>     Number of hash table entries (e.g. 1G ~ 1 billion)\n"
+"  -t, --threads <T>    Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 "  -e, --edges          Print edges as well. Uses hex encoding [TGCA|TGCA].\n"
 "  -E, --degree         Print edge degree: 00. 01/ 02[ 10\\ 11- 12{ 20] 21} 22X\n"
 "  -s, --seq <in>       Sequence file to get coverages for (can specify multiple times)\n"
 "  -o, --out <out.txt>  Save output [default: STDOUT]\n"
+"  -b, --binary         Write binary output (see below)\n"
+"\n"
+"  Reads are printed in input order for any number of threads.\n"
+"\n"
+"  Binary output is a header then one record per read, all integers in host\n"
+"  byte order (little endian on x86):\n"
+"    header: \"CTXCOVG\" uint8_t version=1, uint32_t kmer_size, ncols, has_edges\n"
+"    record: uint32_t name_len, char name[name_len],\n"
+"            uint32_t seq_len, char seq[seq_len], uint32_t num_kmers,\n"
+"            uint32_t covgs[num_kmers][ncols],\n"
+"            uint8_t edges[num_kmers][ncols] (if has_edges, from -e)\n"
+"  Kmers not in the graph have zero coverage and no edges.\n"
 "\n";
 
 static struct option longopts[] =
@@ -31,11 +46,13 @@ static struct option longopts[] =
   {"force",        no_argument,       NULL, 'f'},
   {"memory",       required_argument, NULL, 'm'},
   {"nkmers",       required_argument, NULL, 'n'},
+  {"threads",      required_argument, NULL, 't'},
 // command specific
   {"edges",        no_argument,       NULL, 'e'},
   {"degrees",      no_argument,       NULL, 'E'},
   {"seq",          required_argument, NULL, '1'},
   {"seq",          required_argument, NULL, 's'},
+  {"binary",       no_argument,       NULL, 'b'},
   {NULL, 0, NULL, 0}
 };
 
@@ -44,6 +61,104 @@ static struct option longopts[] =
 madcrow_buffer(covg_buf,  CovgBuffer,  Covg);
 madcrow_buffer(edges_buf, EdgesBuffer, Edges);
 
+//
+// Reads are processed by multiple threads but printed in input order. Each
+// read is formatted into a string, which is stored if the reads before it have
+// not yet been printed. Kmers are looked up COVG_LOOKUP_BATCH at a time, so
+// that the hash table buckets of a batch are prefetched together.
+//
+
+#define COVG_LOOKUP_BATCH 256
+#define COVG_WRITE_BUFSIZE (1UL<<20) /* write output in 1MB chunks */
+
+#define COVG_BINARY_MAGIC "CTXCOVG"
+#define COVG_BINARY_VERSION 1
+
+typedef struct
+{
+  FILE *fout;
+  const char *path;
+  ReorderBuffer order; // reads that finished early
+  StrBuf buf; // output waiting to be written
+  pthread_mutex_t lock;
+} CovgOutput;
+
+typedef struct
+{
+  const dBGraph *db_graph;
+  bool print_edges, print_edge_degrees, binary;
+  CovgOutput *out;
+  volatile size_t *nreads;
+  CovgBuffer covgbuf;
+  EdgesBuffer edgebuf;
+  StrBuf text;
+  // Kmers waiting to be looked up
+  BinaryKmer bkmers[COVG_LOOKUP_BATCH], bkeys[COVG_LOOKUP_BATCH];
+  hkey_t hkeys[COVG_LOOKUP_BATCH];
+  size_t kidx[COVG_LOOKUP_BATCH]; // index of each kmer in the read
+  size_t nlookups;
+} CovgWorker;
+
+static void covg_output_alloc(CovgOutput *out, FILE *fout, const char *path,
+                              size_t nthreads)
+{
+  memset(out, 0, sizeof(CovgOutput));
+  out->fout = fout;
+  out->path = path;
+  reorder_buf_alloc(&out->order, 1, nthreads);
+  strbuf_alloc(&out->buf, COVG_WRITE_BUFSIZE + 1024);
+  if(pthread_mutex_init(&out->lock, NULL) != 0) die("Mutex init failed");
+}
+
+static void covg_output_dealloc(CovgOutput *out)
+{
+  reorder_buf_dealloc(&out->order);
+  strbuf_dealloc(&out->buf);
+  pthread_mutex_destroy(&out->lock);
+}
+
+// Write buffered output. Must hold out->lock.
+static void covg_output_flush(CovgOutput *out)
+{
+  if(out->buf.end > 0 &&
+     fwrite(out->buf.b, 1, out->buf.end, out->fout) != out->buf.end) {
+    die("Cannot write to file: %s", out->path);
+  }
+  strbuf_reset(&out->buf);
+}
+
+// Append the next read to the output. Must hold out->lock.
+static void covg_output_append(CovgOutput *out, const StrBuf *text)
+{
+  strbuf_append_strn(&out->buf, text->b, text->end);
+  if(out->buf.end >= COVG_WRITE_BUFSIZE) covg_output_flush(out);
+}
+
+// Add formatted read `seqn` to the output. If it is the next read, append it
+// and any stored reads that follow it. Otherwise store it until the reads
+// before it have been added.
+static void covg_output_add(CovgOutput *out, size_t seqn, const StrBuf *text)
+{
+  StrBuf *pend;
+
+  pthread_mutex_lock(&out->lock);
+
+  if(seqn != out->order.next)
+  {
+    pend = reorder_buf_store(&out->order, seqn);
+    strbuf_set_buff(pend, text);
+  }
+  else
+  {
+    reorder_buf_pass(&out->order);
+    covg_output_append(out, text);
+    while((pend = reorder_buf_take(&out->order)) != NULL)
+      covg_output_append(out, pend);
+  }
+
+  pthread_mutex_unlock(&out->lock);
+}
+
 // [c]AGG[t]
 // [a]CCT[g]
 static inline void fetch_node_edges(const dBGraph *db_graph, dBNode node,
@@ -67,16 +182,17 @@ static inline void fetch_node_edges(const dBGraph *db_graph, dBNode node,
 // 20: ] 21: } 22: X
 static inline
 void _print_edge_degrees(const Edges *edges, size_t col, size_t ncols,
-                         size_t num, FILE *fout)
+                         size_t num, StrBuf *sbuf)
 {
   size_t i, indegree, outdegree;
   const char symbols[3][3] = {"./[", "\\-{", "]}X"};
+  strbuf_ensure_capacity(sbuf, sbuf->end + num + 1);
   for(i = 0; i < num; i++) {
     indegree  = MIN2(edges_get_indegree(edges[i*ncols+col],  FORWARD), 2);
     outdegree = MIN2(edges_get_outdegree(edges[i*ncols+col], FORWARD), 2);
-    fputc(symbols[indegree][outdegree], fout);
+    sbuf->b[sbuf->end++] = symbols[indegree][outdegree];
   }
-  fputc('\n', fout);
+  strbuf_append_char(sbuf, '\n');
 }
 
 // Print edges using hex coding, two characters [0-9a-f] per edge
@@ -84,42 +200,78 @@ void _print_edge_degrees(const Edges *edges, size_t col, size_t ncols,
 // "3b" => [AC] AACTA [ACT]
 static inline
 void _print_edges(const Edges *edges, size_t col, size_t ncols,
-                  size_t num, FILE *fout)
+                  size_t num, StrBuf *sbuf)
 {
   size_t i;
-  if(num) {
-    edges_print(fout, edges[col]);
-    for(i = 1; i < num; i++) {
-      fputc(' ', fout);
-      edges_print(fout, edges[i*ncols+col]);
+  char estr[3];
+  for(i = 0; i < num; i++) {
+    if(i) strbuf_append_char(sbuf, ' ');
+    strbuf_append_strn(sbuf, edges_to_char(edges[i*ncols+col], estr), 2);
+  }
+  strbuf_append_char(sbuf, '\n');
+}
+
+// Same as printf("%2u", covg)
+static inline void _print_covg(Covg covg, StrBuf *sbuf)
+{
+  char tmp[12], *end = tmp + sizeof(tmp), *ptr = end;
+  do { *(--ptr) = '0' + covg % 10; covg /= 10; } while(covg);
+  if(end - ptr < 2) *(--ptr) = ' ';
+  strbuf_append_strn(sbuf, ptr, end - ptr);
+}
+
+static inline void _print_uint32(uint32_t x, StrBuf *sbuf)
+{
+  strbuf_append_strn(sbuf, (const char*)&x, sizeof(x));
+}
+
+// Look up the kmers in the batch, copying their coverages and edges
+static inline void covg_worker_lookup(CovgWorker *wrkr)
+{
+  const dBGraph *db_graph = wrkr->db_graph;
+  const size_t ncols = db_graph->num_of_cols;
+  size_t i, k;
+  dBNode node;
+
+  hash_table_find_batch(&db_graph->ht, wrkr->bkeys, wrkr->nlookups,
+                        wrkr->hkeys);
+
+  for(i = 0; i < wrkr->nlookups; i++) {
+    if(wrkr->hkeys[i] != HASH_NOT_FOUND) {
+      k = wrkr->kidx[i];
+      memcpy(wrkr->covgbuf.b+k*ncols, &db_node_covg(db_graph, wrkr->hkeys[i], 0),
+             ncols * sizeof(Covg));
+      if(db_graph->col_edges) {
+        node.key = wrkr->hkeys[i];
+        node.orient = bkmer_get_orientation(wrkr->bkeys[i], wrkr->bkmers[i]);
+        fetch_node_edges(db_graph, node, wrkr->edgebuf.b+k*ncols);
+      }
     }
   }
-  fputc('\n', fout);
+
+  wrkr->nlookups = 0;
 }
 
-static inline void print_read_covg(const dBGraph *db_graph, const read_t *r,
-                                   CovgBuffer *covgbuf, EdgesBuffer *edgebuf,
-                                   bool print_edges, bool print_edge_degrees,
-                                   FILE *fout)
+// Fill covgbuf and edgebuf with the coverages and edges of each kmer in a read
+// Returns number of kmers in the read
+static inline size_t fetch_read_covg(CovgWorker *wrkr, const read_t *r)
 {
-  // Find nodes, set covgs
+  const dBGraph *db_graph = wrkr->db_graph;
   const size_t kmer_size = db_graph->kmer_size, ncols = db_graph->num_of_cols;
   size_t klen = r->seq.end < kmer_size ? 0 : r->seq.end - kmer_size + 1;
 
-  covg_buf_capacity(covgbuf, ncols * klen);
-  memset(covgbuf->b, 0, ncols * klen * sizeof(Covg));
+  covg_buf_capacity(&wrkr->covgbuf, ncols * klen);
+  memset(wrkr->covgbuf.b, 0, ncols * klen * sizeof(Covg));
 
   if(db_graph->col_edges) {
-    edges_buf_capacity(edgebuf, ncols * klen);
-    memset(edgebuf->b, 0, ncols * klen * sizeof(Edges));
+    edges_buf_capacity(&wrkr->edgebuf, ncols * klen);
+    memset(wrkr->edgebuf.b, 0, ncols * klen * sizeof(Edges));
   }
 
-  size_t i, j, col, search_start = 0;
+  size_t i, j, search_start = 0;
   size_t contig_start, contig_end;
   BinaryKmer bkmer;
   Nucleotide nuc;
-  dBNode node;
-  Covg *covgs;
 
   while((contig_start = seq_contig_start(r, search_start, kmer_size, 0, 0)) < r->seq.end)
   {
@@ -132,47 +284,91 @@ static inline void print_read_covg(const dBGraph *db_graph, const read_t *r,
     {
       nuc = dna_char_to_nuc(r->seq.b[j]);
       bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
-      node = db_graph_find(db_graph, bkmer);
-      if(node.key != HASH_NOT_FOUND) {
-        covgs = &db_node_covg(db_graph, node.key, 0);
-        memcpy(covgbuf->b+i*ncols, covgs, ncols * sizeof(Covg));
-        if(db_graph->col_edges) {
-          fetch_node_edges(db_graph, node, edgebuf->b+i*ncols);
-        }
-      }
+      wrkr->bkmers[wrkr->nlookups] = bkmer;
+      wrkr->bkeys[wrkr->nlookups] = binary_kmer_get_key(bkmer, kmer_size);
+      wrkr->kidx[wrkr->nlookups] = i;
+      if(++wrkr->nlookups == COVG_LOOKUP_BATCH) covg_worker_lookup(wrkr);
     }
   }
 
+  if(wrkr->nlookups) covg_worker_lookup(wrkr);
+
+  return klen;
+}
+
+static inline void print_read_covg_text(CovgWorker *wrkr, const read_t *r,
+                                        size_t klen)
+{
+  const size_t ncols = wrkr->db_graph->num_of_cols;
+  const Covg *covgs = wrkr->covgbuf.b;
+  const Edges *edges = wrkr->edgebuf.b;
+  StrBuf *sbuf = &wrkr->text;
+  size_t i, col;
+
   // Print sequence
-  fprintf(fout, ">%s\n%s\n", r->name.b, r->seq.b);
+  strbuf_sprintf(sbuf, ">%s\n%s\n", r->name.b, r->seq.b);
 
   for(col = 0; col < ncols; col++)
   {
-    if(print_edges) {
-      fprintf(fout, ">%s_c%zu_edges\n", r->name.b, col);
-      _print_edges(edgebuf->b, col, ncols, klen, fout);
+    if(wrkr->print_edges) {
+      strbuf_sprintf(sbuf, ">%s_c%zu_edges\n", r->name.b, col);
+      _print_edges(edges, col, ncols, klen, sbuf);
     }
 
-    if(print_edge_degrees) {
-      fprintf(fout, ">%s_c%zu_degree\n", r->name.b, col);
-      _print_edge_degrees(edgebuf->b, col, ncols, klen, fout);
+    if(wrkr->print_edge_degrees) {
+      strbuf_sprintf(sbuf, ">%s_c%zu_degree\n", r->name.b, col);
+      _print_edge_degrees(edges, col, ncols, klen, sbuf);
     }
 
     // Print coverages
-    fprintf(fout, ">%s_c%zu_covgs\n", r->name.b, col);
-    if(klen > 0) {
-      fprintf(fout, "%2u", covgbuf->b[col]);
-      for(i = 1; i < klen; i++)
-        fprintf(fout, " %2u", covgbuf->b[i*ncols+col]);
+    strbuf_sprintf(sbuf, ">%s_c%zu_covgs\n", r->name.b, col);
+    for(i = 0; i < klen; i++) {
+      if(i) strbuf_append_char(sbuf, ' ');
+      _print_covg(covgs[i*ncols+col], sbuf);
     }
-    fputc('\n', fout);
+    strbuf_append_char(sbuf, '\n');
   }
 }
 
+// See coverage_usage for the binary format
+static inline void print_read_covg_binary(CovgWorker *wrkr, const read_t *r,
+                                          size_t klen)
+{
+  const size_t ncols = wrkr->db_graph->num_of_cols;
+  StrBuf *sbuf = &wrkr->text;
+
+  _print_uint32(r->name.end, sbuf);
+  strbuf_append_strn(sbuf, r->name.b, r->name.end);
+  _print_uint32(r->seq.end, sbuf);
+  strbuf_append_strn(sbuf, r->seq.b, r->seq.end);
+  _print_uint32(klen, sbuf);
+  strbuf_append_strn(sbuf, (const char*)wrkr->covgbuf.b, klen*ncols*sizeof(Covg));
+  if(wrkr->print_edges) {
+    strbuf_append_strn(sbuf, (const char*)wrkr->edgebuf.b,
+                       klen*ncols*sizeof(Edges));
+  }
+}
+
+static void covg_worker_read(AsyncIOData *data, size_t threadid, void *arg)
+{
+  (void)threadid;
+  CovgWorker *wrkr = (CovgWorker*)arg;
+  const read_t *r = &data->r1;
+
+  size_t klen = fetch_read_covg(wrkr, r);
+
+  strbuf_reset(&wrkr->text);
+  if(wrkr->binary) print_read_covg_binary(wrkr, r, klen);
+  else print_read_covg_text(wrkr, r, klen);
+
+  covg_output_add(wrkr->out, data->seqn, &wrkr->text);
+  __sync_fetch_and_add(wrkr->nreads, 1);
+}
 int ctx_coverage(int argc, char **argv)
 {
   struct MemArgs memargs = MEM_ARGS_INIT;
-  bool print_edges = false, print_edge_degrees = false;
+  size_t nthreads = 0;
+  bool print_edges = false, print_edge_degrees = false, binary = false;
   const char *output_file = NULL;
   SeqFilePtrBuffer sfilebuf;
 
@@ -196,8 +392,10 @@ int ctx_coverage(int argc, char **argv)
       case 'o': cmd_check(!output_file, cmd); output_file = optarg; break;
       case 'm': cmd_mem_args_set_memory(&memargs, optarg); break;
       case 'n': cmd_mem_args_set_nkmers(&memargs, optarg); break;
+      case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
       case 'e': cmd_check(!print_edges,cmd); print_edges = true; break;
       case 'E': cmd_check(!print_edge_degrees,cmd); print_edge_degrees = true; break;
+      case 'b': cmd_check(!binary,cmd); binary = true; break;
       case '1':
       case 's':
         if((tmp_sfile = seq_open(optarg)) == NULL)
@@ -212,8 +410,14 @@ int ctx_coverage(int argc, char **argv)
     }
   }
 
+  if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
   if(sfilebuf.len == 0) cmd_print_usage("Require at least one --seq file");
   if(optind == argc) cmd_print_usage("Require input graph files (.ctx)");
+  if(binary && print_edge_degrees)
+    cmd_print_usage("Cannot use --binary with --degree");
+
+  // --degree also needs edges
+  bool load_edges = print_edges || print_edge_degrees;
 
   //
   // Open graph files
@@ -234,7 +438,7 @@ int ctx_coverage(int argc, char **argv)
 
   // kmer memory = kmer + (coverage + edges) per colour
   bits_per_kmer = sizeof(BinaryKmer)*8 +
-                  (sizeof(Covg) + (print_edges ? sizeof(Edges) : 0)) * 8 * ncols;
+                  (sizeof(Covg) + (load_edges ? sizeof(Edges) : 0)) * 8 * ncols;
 
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
@@ -257,8 +461,8 @@ int ctx_coverage(int argc, char **argv)
   size_t kmer_size = gfiles[0].hdr.kmer_size;
 
   dBGraph db_graph;
-  db_graph_alloc(&db_graph, kmer_size, ncols, print_edges ? ncols : 0, kmers_in_hash,
-                 DBG_ALLOC_COVGS | (print_edges ? DBG_ALLOC_EDGES : 0));
+  db_graph_alloc(&db_graph, kmer_size, ncols, load_edges ? ncols : 0, kmers_in_hash,
+                 DBG_ALLOC_COVGS | (load_edges ? DBG_ALLOC_EDGES : 0));
 
   //
   // Load graphs
@@ -278,33 +482,60 @@ int ctx_coverage(int argc, char **argv)
   //
   // Load sequence
   //
-  CovgBuffer covgbuf;
-  EdgesBuffer edgebuf;
-  covg_buf_alloc(&covgbuf, 2048);
-  edges_buf_alloc(&edgebuf, 2048);
+  CovgOutput output;
+  covg_output_alloc(&output, fout, output_file ? output_file : "STDOUT", nthreads);
+
+  if(binary) {
+    uint32_t hdr[3] = {kmer_size, ncols, print_edges};
+    strbuf_append_strn(&output.buf, COVG_BINARY_MAGIC, strlen(COVG_BINARY_MAGIC));
+    strbuf_append_char(&output.buf, COVG_BINARY_VERSION);
+    strbuf_append_strn(&output.buf, (const char*)hdr, sizeof(hdr));
+  }
 
-  read_t r;
-  seq_read_alloc(&r);
+  volatile size_t nreads = 0;
+  CovgWorker *wrkrs = ctx_calloc(nthreads, sizeof(CovgWorker));
+
+  for(i = 0; i < nthreads; i++) {
+    wrkrs[i].db_graph = &db_graph;
+    wrkrs[i].print_edges = print_edges;
+    wrkrs[i].print_edge_degrees = print_edge_degrees;
+    wrkrs[i].binary = binary;
+    wrkrs[i].out = &output;
+    wrkrs[i].nreads = &nreads;
+    covg_buf_alloc(&wrkrs[i].covgbuf, 2048);
+    edges_buf_alloc(&wrkrs[i].edgebuf, 2048);
+    strbuf_alloc(&wrkrs[i].text, 4096);
+  }
 
-  status("Reading coverage...");
-  size_t nreads = 0;
+  status("Reading coverage with %zu threads...", nthreads);
+  double start = util_wall_secs();
 
-  // Deal with one read at a time
+  // One file at a time, so that reads are printed in the order of the files
   for(i = 0; i < sfilebuf.len; i++) {
-    while(seq_read_primary(sfilebuf.b[i], &r) > 0) {
-      print_read_covg(&db_graph, &r, &covgbuf, &edgebuf,
-                      print_edges, print_edge_degrees, fout);
-      nreads++;
-    }
+    AsyncIOInput input = {.file1 = sfilebuf.b[i], .file2 = NULL, .ptr = NULL,
+                          .fq_offset = 0, .interleaved = false};
+    reorder_buf_reset(&output.order);
+    asyncio_run_pool(&input, 1, covg_worker_read, wrkrs, nthreads,
+                     sizeof(CovgWorker));
     seq_close(sfilebuf.b[i]);
   }
 
-  char nstr[50];
-  status("Printed graph coverage for %s reads", ulong_to_str(nreads, nstr));
+  covg_output_flush(&output);
 
-  seq_read_dealloc(&r);
-  covg_buf_dealloc(&covgbuf);
-  edges_buf_dealloc(&edgebuf);
+  double secs = util_wall_secs() - start;
+  char nstr[50], ratestr[50];
+  ulong_to_str(nreads, nstr);
+  num_to_str(safe_frac(nreads, secs), 1, ratestr);
+  status("Printed graph coverage for %s reads in %.2f secs [%s reads/sec]",
+         nstr, secs, ratestr);
+
+  for(i = 0; i < nthreads; i++) {
+    covg_buf_dealloc(&wrkrs[i].covgbuf);
+    edges_buf_dealloc(&wrkrs[i].edgebuf);
+    strbuf_dealloc(&wrkrs[i].text);
+  }
+  ctx_free(wrkrs);
+  covg_output_dealloc(&output);
 
   seq_file_ptr_buf_dealloc(&sfilebuf);
 
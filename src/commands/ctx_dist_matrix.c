@@ -6,9 +6,12 @@
 #include "db_node.h"
 #include "graphs_load.h"
 #include "gpath_checks.h"
+#include "dist_matrix.h"
+#include "kmer_sketch.h"
 
 const char dist_matrix_usage[] =
 "usage: "CMD" dist [options] <in.ctx> [in2.ctx ...]\n"
+"       "CMD" dist --sketch [options] <in.sk> [in2.sk ...]\n"
 "\n"
 "  Generate a distance matrix counting kmers shared between colours.\n"
 "\n"
@@ -19,6 +22,15 @@ const char dist_matrix_usage[] =
 "  -n, --nkmers <kmers>  Number of hash table entries (e.g. 1G ~ 1 billion)\n"
 "  -t, --threads <T>     Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 "  -o, --out <out.csv>   Ouput matrix, tab separated [defaults to STDOUT]\n"
+"  -J, --jaccard         Print Jaccard index |A&B|/|A|B| instead of counts\n"
+"  -C, --containment     Print fraction of row kmers in column |A&B|/|A|\n"
+"  -S, --stream          Stream sorted graph files without loading a graph.\n"
+"                        Memory use is independent of graph size.\n"
+"  -K, --sketch          Inputs are sketches from `"CMD" sketch`, estimate values\n"
+"                        from MinHash sketches instead of counting kmers.\n"
+"\n"
+"  Kmers are counted in blocks of "QUOTE_VALUE(DIST_BLOCK_KMERS)", "
+"pairs of colours in tiles of "QUOTE_VALUE(DIST_TILE_COLS)".\n"
 "\n";
 
 static struct option longopts[] =
@@ -30,33 +42,137 @@ static struct option longopts[] =
   {"threads",      required_argument, NULL, 't'},
   {"force",        no_argument,       NULL, 'f'},
   {"out",          required_argument, NULL, 'o'},
+// command specific
+  {"jaccard",      no_argument,       NULL, 'J'},
+  {"containment",  no_argument,       NULL, 'C'},
+  {"stream",       no_argument,       NULL, 'S'},
+  {"sketch",       no_argument,       NULL, 'K'},
   {NULL, 0, NULL, 0}
 };
 
-typedef struct {
-  const dBGraph *db_graph;
-  uint64_t **matrices;
-} DistMatrixThreads;
+// Load all graph files into a hash table then count
+static void dist_from_graph(GraphFileReader *gfiles, size_t num_gfiles,
+                            size_t ncols, struct MemArgs memargs,
+                            size_t ctx_max_kmers, size_t ctx_sum_kmers,
+                            size_t nthreads, DistMatrix *matrix)
+{
+  size_t i;
+
+  //
+  // Decide on memory
+  //
+  size_t bits_per_kmer, kmers_in_hash, graph_mem;
 
-static bool dist_matrix_thread(hkey_t hkey, size_t threadid, void *arg)
+  // edges(1bytes) + kmer_paths(8bytes) + in_colour(1bit/col) +
+
+  bits_per_kmer = sizeof(BinaryKmer)*8 + ncols; // kmer + in colour
+
+  kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
+                                        memargs.mem_to_use_set,
+                                        memargs.num_kmers,
+                                        memargs.num_kmers_set,
+                                        bits_per_kmer,
+                                        ctx_max_kmers, ctx_sum_kmers,
+                                        true, &graph_mem);
+
+  // Each thread has a matrix and a block of colour vectors
+  size_t thread_mem = ncols*ncols*sizeof(uint64_t) +
+                      ncols*(DIST_BLOCK_WORDS*sizeof(uint64_t) + sizeof(size_t));
+
+  size_t total_mem = graph_mem + thread_mem * nthreads;
+  cmd_check_mem_limit(memargs.mem_to_use, total_mem);
+
+  // Allocate memory
+  dBGraph db_graph;
+  db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, ncols, 0, kmers_in_hash,
+                 DBG_ALLOC_NODE_IN_COL);
+
+  //
+  // Load graphs
+  //
+  GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.empty_colours = true;
+
+  for(i = 0; i < num_gfiles; i++) {
+    graph_load(&gfiles[i], gprefs, NULL);
+    gprefs.empty_colours = false;
+  }
+
+  hash_table_print_stats(&db_graph.ht);
+
+  // Generate matrix
+  status("[dist_matrix] Generating matrix between %zu colours with %zu thread%s",
+         ncols, nthreads, util_plural_str(nthreads));
+
+  double t0 = util_wall_secs();
+  dist_matrix_count_graph(&db_graph, nthreads, matrix);
+  dist_matrix_print_stats(matrix, util_wall_secs() - t0);
+
+  db_graph_dealloc(&db_graph);
+}
+
+// Merge sorted graph files, counting kmers in blocks as they are read
+static void dist_from_stream(GraphFileReader *gfiles, size_t num_gfiles,
+                             size_t ncols, size_t nthreads, DistMatrix *matrix)
 {
-  DistMatrixThreads *workers = (DistMatrixThreads*)arg;
-  const dBGraph *db_graph = workers->db_graph;
-  const size_t ncols = db_graph->num_of_cols;
-  uint64_t *matrix = workers->matrices[threadid];
-  size_t i, j;
-  for(i = 0; i < ncols; i++) {
-    if(db_node_has_col(db_graph, hkey, i)) {
-      matrix[ncols*i+i]++; // colour with self
-      for(j = i+1; j < ncols; j++) {
-        if(db_node_has_col(db_graph, hkey, j)) {
-          matrix[ncols*i+j]++;
-        }
-      }
-    }
+  size_t blocks_mem = nthreads * 2 * ncols * DIST_BLOCK_WORDS * sizeof(uint64_t);
+  size_t thread_mem = nthreads * ncols * ncols * sizeof(uint64_t);
+  char mem_str[50];
+  bytes_to_str(blocks_mem + thread_mem, 1, mem_str);
+
+  status("[dist_matrix] Streaming %zu sorted graph file%s into %zu colours "
+         "with %zu thread%s, using %s", num_gfiles, util_plural_str(num_gfiles),
+         ncols, nthreads, util_plural_str(nthreads), mem_str);
+
+  GraphFileMerge gfm;
+  graph_file_merge_alloc(&gfm, gfiles, num_gfiles, ncols);
+  double t0 = util_wall_secs();
+  dist_matrix_count_stream(&gfm, nthreads, matrix);
+  dist_matrix_print_stats(matrix, util_wall_secs() - t0);
+  graph_file_merge_dealloc(&gfm);
+}
+
+// Estimate from sketches of each colour, one sketch per row/column
+static void dist_from_sketches(char **paths, size_t num_paths, size_t nthreads,
+                               DistNorm norm, const char *out_path)
+{
+  size_t i, n, kmer_size = 0, ksize;
+
+  KmerSketchBuffer sks;
+  kmer_sketch_buf_alloc(&sks, 64);
+
+  for(i = 0; i < num_paths; i++) {
+    ksize = kmer_sketch_file_load(paths[i], &sks);
+    if(kmer_size && ksize != kmer_size)
+      die("Sketches have different kmer sizes: %zu vs %zu", kmer_size, ksize);
+    kmer_size = ksize;
   }
 
-  return false; // keep iterating
+  n = sks.len;
+  if(n == 0) die("No sketches loaded");
+
+  FILE *fout = futil_fopen_create(!out_path ? "-" : out_path, "w");
+  double *jaccard = ctx_calloc(n*n, sizeof(double));
+
+  status("[dist_matrix] Comparing %zu sketches with %zu thread%s",
+         n, nthreads, util_plural_str(nthreads));
+
+  double t0 = util_wall_secs(), secs;
+  kmer_sketch_dist(sks.b, n, nthreads, jaccard);
+  secs = util_wall_secs() - t0;
+
+  char pairs_rate_str[50];
+  num_to_str(safe_frac(n*(n+1)/2, secs), 1, pairs_rate_str);
+  status("[dist_matrix] %.2f secs: %s pairs/sec", secs, pairs_rate_str);
+
+  kmer_sketch_dist_print(sks.b, n, jaccard, norm, fout);
+
+  status("[dist_matrix]   written to %s", futil_outpath_str(out_path));
+  fclose(fout);
+
+  for(i = 0; i < n; i++) kmer_sketch_dealloc(&sks.b[i]);
+  kmer_sketch_buf_dealloc(&sks);
+  ctx_free(jaccard);
 }
 
 int ctx_dist_matrix(int argc, char **argv)
@@ -65,6 +181,8 @@ int ctx_dist_matrix(int argc, char **argv)
   struct MemArgs memargs = MEM_ARGS_INIT;
 
   char *out_path = NULL;
+  bool jaccard = false, containment = false, stream = false, sketch = false;
+  DistNorm norm = DIST_NORM_NONE;
 
   // Arg parsing
   char cmd[100];
@@ -85,6 +203,10 @@ int ctx_dist_matrix(int argc, char **argv)
       case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
       case 'f': cmd_check(!futil_get_force(), cmd); futil_set_force(true); break;
       case 'o': cmd_check(!out_path, cmd); out_path = optarg; break;
+      case 'J': cmd_check(!jaccard, cmd); jaccard = true; break;
+      case 'C': cmd_check(!containment, cmd); containment = true; break;
+      case 'S': cmd_check(!stream, cmd); stream = true; break;
+      case 'K': cmd_check(!sketch, cmd); sketch = true; break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -98,6 +220,23 @@ int ctx_dist_matrix(int argc, char **argv)
 
   if(optind >= argc) cmd_print_usage("Require input graph files (.ctx)");
 
+  if(jaccard && containment)
+    cmd_print_usage("Cannot use --jaccard and --containment together");
+
+  if(stream && sketch)
+    cmd_print_usage("Cannot use --stream and --sketch together");
+
+  if((stream || sketch) && cmd_mem_get_plan())
+    cmd_print_usage("--stream and --sketch do not support --plan");
+
+  if(jaccard) norm = DIST_NORM_JACCARD;
+  if(containment) norm = DIST_NORM_CONTAINMENT;
+
+  if(sketch) {
+    dist_from_sketches(argv + optind, argc - optind, nthreads, norm, out_path);
+    return EXIT_SUCCESS;
+  }
+
   //
   // Open graph files
   //
@@ -106,7 +245,7 @@ int ctx_dist_matrix(int argc, char **argv)
   ctx_assert(num_gfiles > 0);
 
   GraphFileReader *gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
-  size_t i, j, ncols, ctx_max_kmers = 0, ctx_sum_kmers = 0;
+  size_t i, ncols, ctx_max_kmers = 0, ctx_sum_kmers = 0;
 
   ncols = graph_files_open(graph_paths, gfiles, num_gfiles,
                            &ctx_max_kmers, &ctx_sum_kmers);
@@ -114,92 +253,32 @@ int ctx_dist_matrix(int argc, char **argv)
   // Check graph + paths are compatible
   graphs_gpaths_compatible(gfiles, num_gfiles, NULL, 0, -1);
 
-  //
-  // Decide on memory
-  //
-  size_t bits_per_kmer, kmers_in_hash, graph_mem;
-
-  // edges(1bytes) + kmer_paths(8bytes) + in_colour(1bit/col) +
-
-  bits_per_kmer = sizeof(BinaryKmer)*8 + ncols; // kmer + in colour
-
-  kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
-                                        memargs.mem_to_use_set,
-                                        memargs.num_kmers,
-                                        memargs.num_kmers_set,
-                                        bits_per_kmer,
-                                        ctx_max_kmers, ctx_sum_kmers,
-                                        true, &graph_mem);
-
-  size_t total_mem = graph_mem;
-  cmd_check_mem_limit(memargs.mem_to_use, total_mem);
-
-
-  // Allocate memory
-  dBGraph db_graph;
-  db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, ncols, 0, kmers_in_hash,
-                 DBG_ALLOC_NODE_IN_COL);
-
-  // Allocate thread memory
-  uint64_t **matrices = ctx_calloc(nthreads, sizeof(DistMatrixThreads));
-  DistMatrixThreads workers = {.db_graph = &db_graph, .matrices = matrices};
-  for(i = 0; i < nthreads; i++)
-    workers.matrices[i] = ctx_calloc(ncols*ncols, sizeof(uint64_t));
+  if(stream && memargs.mem_to_use_set)
+    warn("-m, --memory is not used with --stream");
 
   // Open output file
   // Print to stdout unless --out <out> is specified
   FILE *fout = futil_fopen_create(!out_path ? "-" : out_path, "w");
 
+  DistMatrix matrix;
+  dist_matrix_alloc(&matrix, ncols);
 
-  //
-  // Load graphs
-  //
-  GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
-  gprefs.empty_colours = true;
-
-  for(i = 0; i < num_gfiles; i++) {
-    graph_load(&gfiles[i], gprefs, NULL);
-    graph_file_close(&gfiles[i]);
-    gprefs.empty_colours = false;
+  if(stream) {
+    dist_from_stream(gfiles, num_gfiles, ncols, nthreads, &matrix);
+  } else {
+    dist_from_graph(gfiles, num_gfiles, ncols, memargs,
+                    ctx_max_kmers, ctx_sum_kmers, nthreads, &matrix);
   }
-  ctx_free(gfiles);
 
-  hash_table_print_stats(&db_graph.ht);
+  for(i = 0; i < num_gfiles; i++) graph_file_close(&gfiles[i]);
+  ctx_free(gfiles);
 
-  // Generate matrix
-  status("[dist_matrix] Generating matrix between %zu colours with %zu thread%s",
-         ncols, nthreads, util_plural_str(nthreads));
-  hash_table_iterate(&db_graph.ht, nthreads, dist_matrix_thread, &workers);
-
-  // Merge matrices
-  for(i = 1; i < nthreads; i++)
-    for(j = 0; j < ncols*ncols; j++)
-      matrices[0][j] += matrices[i][j];
-
-  size_t row, col;
-  uint64_t *mat = matrices[0];
-
-  // Print matrix
-  fprintf(fout, ".");// top left column empty
-  for(row = 0; row < ncols; row++) fprintf(fout, "\tcol%zu", row);
-  fprintf(fout, "\n");
-  for(row = 0; row < ncols; row++) {
-    fprintf(fout, "col%zu", row);
-    for(col = 0; col < ncols; col++) {
-      if(col < row) fprintf(fout, "\t.");
-      else fprintf(fout, "\t%zu", (size_t)mat[ncols*row+col]);
-    }
-    fprintf(fout, "\n");
-  }
+  dist_matrix_print(&matrix, norm, fout);
 
   status("[dist_matrix]   written to %s", futil_outpath_str(out_path));
   fclose(fout);
 
-  for(i = 0; i < nthreads; i++)
-    ctx_free(workers.matrices[i]);
-  ctx_free(workers.matrices);
-
-  db_graph_dealloc(&db_graph);
+  dist_matrix_dealloc(&matrix);
 
   return EXIT_SUCCESS;
 }
@@ -8,6 +8,8 @@ const char exp_hashtest_usage[] =
 "usage: "CMD" hashtest [options] <num_ops>\n"
 "\n"
 "  Test hash table speed. If threads is set to 0, use single-threaded code.\n"
+"  Always reports performance counters as if --perf was given. Probe lengths\n"
+"  and bucket lock waits per thread are reported when compiled with PERF=1.\n"
 "\n"
 "  -h, --help        This help message\n"
 "  -m, --memory <M>  Memory to use\n"
@@ -97,6 +99,8 @@ int ctx_exp_hashtest(int argc, char **argv)
     }
   }
 
+  perf_set_report(true);
+
   bool single_threaded = false;
   if(nthreads == 0) { single_threaded = true; nthreads = 1; }
 
@@ -110,6 +114,9 @@ int ctx_exp_hashtest(int argc, char **argv)
 
   if(optind+1 != argc) cmd_print_usage(NULL);
 
+  if(!store_kmers && cmd_mem_get_plan())
+    cmd_print_usage("--func-only does not support --plan");
+
   size_t i, num_ops;
   if(!parse_entire_size(argv[optind], &num_ops))
     cmd_print_usage("Invalid <num_ops>");
@@ -151,7 +158,9 @@ int ctx_exp_hashtest(int argc, char **argv)
                                    .start = start, .end = end, .hash = 0};
   }
 
+  perf_phase_start("hashtest");
   util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, hash_loop);
+  perf_phase_end("hashtest");
 
   for(i = 0; i < nthreads; i++) hash += jobs[i].hash;
 
@@ -83,6 +83,8 @@ static size_t inferedges_on_mmap(const dBGraph *db_graph, bool add_all_edges,
   bool updated;
   size_t i, num_kmers = file->num_of_kmers, num_kmers_edited = 0;
   size_t filekmersize = sizeof(BinaryKmer) + (sizeof(Edges)+sizeof(Covg)) * ncols;
+  InferEdgesStats stats = {.num_lookups = 0, .num_first_bckt = 0};
+  double start = util_wall_secs();
 
   char *ptr = (char*)mmap_ptr + file->hdr_size;
 
@@ -95,7 +97,8 @@ static size_t inferedges_on_mmap(const dBGraph *db_graph, bool add_all_edges,
     memcpy(covgs,   fh_covgs, ncols * sizeof(Covg));
     memcpy(edges,   fh_edges, ncols * sizeof(Edges));
 
-    updated = infer_kmer_edges(bkmer, !add_all_edges, edges, covgs, db_graph);
+    updated = infer_kmer_edges(bkmer, !add_all_edges, edges, covgs, db_graph,
+                               &stats);
 
     if(updated) {
       memcpy(fh_covgs, covgs, ncols * sizeof(Covg));
@@ -104,6 +107,8 @@ static size_t inferedges_on_mmap(const dBGraph *db_graph, bool add_all_edges,
     }
   }
 
+  infer_edges_print_stats(&stats, util_wall_secs() - start);
+
   if(munmap(mmap_ptr, file->file_size) == -1)
     die("Cannot release mmap file: %s [%s]", file->fltr.path.b, strerror(errno));
 
@@ -137,15 +142,20 @@ static size_t inferedges_on_file(const dBGraph *db_graph, bool add_all_edges,
 
   size_t num_kmers_edited = 0;
   bool updated;
+  InferEdgesStats stats = {.num_lookups = 0, .num_first_bckt = 0};
+  double start = util_wall_secs();
 
   while(graph_file_read_reset(file, &bkmer, covgs, edges))
   {
-    updated = infer_kmer_edges(bkmer, !add_all_edges, edges, covgs, db_graph);
+    updated = infer_kmer_edges(bkmer, !add_all_edges, edges, covgs, db_graph,
+                               &stats);
     graph_write_kmer(fout, file_ncols, bkmer, covgs, edges);
 
     num_kmers_edited += updated;
   }
 
+  infer_edges_print_stats(&stats, util_wall_secs() - start);
+
   return num_kmers_edited;
 }
 
@@ -222,17 +232,6 @@ int ctx_infer_edges(int argc, char **argv)
   if(!file_filter_from_direct(&file.fltr))
     cmd_print_usage("Inferedges with filter not implemented - sorry");
 
-  FILE *fout = NULL;
-
-  // Editing input file or writing a new file
-  if(!editing_file)
-    fout = futil_fopen_create(out_ctx_path ? out_ctx_path : "-", "w");
-
-  // Print output status
-  if(fout == stdout) status("Writing to STDOUT");
-  else if(fout != NULL) status("Writing to: %s", out_ctx_path);
-  else status("Editing file in place: %s", graph_path);
-
   status("Inferring all missing %sedges", add_pop_edges ? "population " : "");
 
   //
@@ -261,6 +260,17 @@ int ctx_infer_edges(int argc, char **argv)
 
   cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
 
+  FILE *fout = NULL;
+
+  // Editing input file or writing a new file
+  if(!editing_file)
+    fout = futil_fopen_create(out_ctx_path ? out_ctx_path : "-", "w");
+
+  // Print output status
+  if(fout == stdout) status("Writing to STDOUT");
+  else if(fout != NULL) status("Writing to: %s", out_ctx_path);
+  else status("Editing file in place: %s", graph_path);
+
   //
   // Allocate memory
   //
@@ -182,9 +182,6 @@ int ctx_join(int argc, char **argv)
     use_ncols = output_to_stdout ? ctx_max_cols : 1;
   }
 
-  // Check out_path is writable
-  futil_create_output(out_path);
-
   status("Output %zu cols; from %zu files; intersecting %zu graphs; ",
          ctx_max_cols, num_gfiles, num_igfiles);
 
@@ -194,6 +191,11 @@ int ctx_join(int argc, char **argv)
     // Don't need to store a graph in memory, can filter as stream
     // Don't actually store anything in the de Bruijn graph, but we need to
     // pass it, so mock one up
+    if(cmd_mem_get_plan())
+      cmd_print_usage("Streaming one graph without --intersect does not support --plan");
+
+    futil_create_output(out_path);
+
     dBGraph db_graph;
     db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size,
                    file_filter_into_ncols(&gfiles[0].fltr), 0, 1024, 0);
@@ -248,6 +250,9 @@ int ctx_join(int argc, char **argv)
 
   cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
 
+  // Check out_path is writable
+  futil_create_output(out_path);
+
   // Create db_graph
   dBGraph db_graph;
   Edges *intersect_edges = NULL;
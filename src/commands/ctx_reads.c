@@ -9,6 +9,7 @@
 #include "graphs_load.h"
 #include "seqout.h"
 #include "async_read_io.h"
+#include "kmer_bloom.h"
 
 const char reads_usage[] =
 "usage: "CMD" reads [options] <in.ctx>[:cols] [in2.ctx ...]\n"
@@ -24,6 +25,8 @@ const char reads_usage[] =
 //
 "  -F, --format <f>            Output format may be: FASTA, FASTQ [default: FASTQ]\n"
 "  -v, --invert                Print reads/read pairs with no kmer in graph\n"
+"  -B, --bloom <bits>          Check kmers against a Bloom filter of the graph\n"
+"                              first, using <bits> bits per kmer (e.g. 12)\n"
 "  -1, --seq  <in>:<O>         Writes output to <O>.fq.gz\n"
 "  -2, --seq2 <in1>:<in2>:<O>  Writes output to <O>.{1,2}.fq.gz\n"
 "  -i, --seqi <in>:<O>         Writes output to <O>.{1,2}.fq.gz\n"
@@ -34,6 +37,9 @@ const char reads_usage[] =
 "\n"
 "  User can specify --seq/--seq2/--seqi multiple times. If either read of a\n"
 "  pair touches the graph, both are printed.\n"
+"\n"
+"  --bloom saves time when most reads do not touch the graph, for example when\n"
+"  removing contamination. It uses (bits/8) bytes per graph kmer.\n"
 "\n";
 
 static struct option longopts[] =
@@ -47,6 +53,7 @@ static struct option longopts[] =
 // command specific
   {"format",       required_argument, NULL, 'F'},
   {"invert",       no_argument,       NULL, 'v'},
+  {"bloom",        required_argument, NULL, 'B'},
   {"seq",          required_argument, NULL, '1'},
   {"seq2",         required_argument, NULL, '2'},
   {"seqi",         required_argument, NULL, 'i'},
@@ -66,6 +73,7 @@ typedef struct
 
   // Global settings
   dBGraph *db_graph;
+  const KmerBloom *bloom; // NULL unless --bloom
   volatile size_t *rcounter;
   SeqLoadingStats *stats;
   bool invert;
@@ -87,6 +95,19 @@ static char **gfile_paths = NULL;
 
 static volatile size_t read_counter = 0;
 
+static size_t bloom_bits = 0;
+
+// Number of kmers of a read that are looked up together
+#define READS_KMER_BATCH 32
+
+typedef struct
+{
+  volatile uint64_t num_bloom_queries, num_bloom_passed;
+  volatile uint64_t num_ht_lookups, num_ht_found;
+} ReadFilterStats;
+
+static ReadFilterStats filter_stats;
+
 
 static void parse_args(int argc, char **argv)
 {
@@ -116,6 +137,7 @@ static void parse_args(int argc, char **argv)
       case 'n': cmd_mem_args_set_nkmers(&memargs, optarg); break;
       case 'F': cmd_check(fmt==SEQ_FMT_FASTQ, cmd); fmt = cmd_parse_format(cmd, optarg); break;
       case 'v': cmd_check(!invert,cmd); invert = true; break;
+      case 'B': cmd_check(!bloom_bits,cmd); bloom_bits = cmd_uint32_nonzero(cmd, optarg); break;
       case '1':
       case '2':
       case 'i':
@@ -163,7 +185,7 @@ static void inputs_attempt_open()
     AlignReadsData *input = &inputs.b[i];
     err_occurred = !seqout_open(&input->seqout, input->out_base, input->fmt,
                                 // input->use_fq ? SEQ_FMT_FASTQ : SEQ_FMT_FASTQ,
-                                asyncio_task_is_pe(&files.b[i]));
+                                asyncio_task_is_pe(&files.b[i]), false);
   }
 
   if(err_occurred) {
@@ -173,19 +195,52 @@ static void inputs_attempt_open()
   }
 }
 
+// Look up a batch of kmer keys, checking the Bloom filter first if we have one
+// Returns true if any kmer is in the graph
+static bool kmer_batch_in_graph(BinaryKmer *bkeys, size_t n,
+                                const dBGraph *db_graph,
+                                const KmerBloom *bloom)
+{
+  uint64_t h[READS_KMER_BATCH];
+  hkey_t hkeys[READS_KMER_BATCH];
+  size_t i, m = n, nfound = 0;
+
+  if(bloom != NULL) {
+    for(i = 0; i < n; i++) {
+      h[i] = kmer_bloom_hash(bkeys[i]);
+      kmer_bloom_prefetch(bloom, h[i]);
+    }
+    for(i = m = 0; i < n; i++)
+      if(kmer_bloom_contains(bloom, h[i]))
+        bkeys[m++] = bkeys[i];
+
+    __sync_fetch_and_add(&filter_stats.num_bloom_queries, n);
+    __sync_fetch_and_add(&filter_stats.num_bloom_passed, m);
+  }
+
+  if(m > 0) {
+    hash_table_find_batch(&db_graph->ht, bkeys, m, hkeys);
+    for(i = 0; i < m; i++) nfound += (hkeys[i] != HASH_NOT_FOUND);
+    __sync_fetch_and_add(&filter_stats.num_ht_lookups, m);
+    __sync_fetch_and_add(&filter_stats.num_ht_found, nfound);
+  }
+
+  return (nfound > 0);
+}
+
 static bool read_touches_graph(const read_t *r, const dBGraph *db_graph,
-                               SeqLoadingStats *stats)
+                               const KmerBloom *bloom, SeqLoadingStats *stats)
 {
   bool found = false;
-  BinaryKmer bkmer; Nucleotide nuc; dBNode node;
+  BinaryKmer bkmer, bkeys[READS_KMER_BATCH]; Nucleotide nuc;
   const size_t kmer_size = db_graph->kmer_size;
-  size_t i, num_contigs = 0, num_kmers_loaded = 0;
+  size_t i, num_contigs = 0, num_kmers_loaded = 0, nbatch = 0;
   size_t search_pos = 0, start, end = 0, contig_len;
 
   if(r->seq.end >= kmer_size)
   {
-    while((start = seq_contig_start(r, search_pos, kmer_size, 0,0)) < r->seq.end &&
-          !found)
+    while(!found &&
+          (start = seq_contig_start(r, search_pos, kmer_size, 0,0)) < r->seq.end)
     {
       end = seq_contig_end(r, start, kmer_size, 0, 0, &search_pos);
       contig_len = end - start;
@@ -194,19 +249,26 @@ static bool read_touches_graph(const read_t *r, const dBGraph *db_graph,
       num_contigs++;
 
       bkmer = binary_kmer_from_str(r->seq.b + start, kmer_size);
-      num_kmers_loaded++;
-      node = db_graph_find(db_graph, bkmer);
-      if(node.key != HASH_NOT_FOUND) { found = true; break; }
+      bkmer = binary_kmer_right_shift_one_base(bkmer);
 
-      for(i = start+kmer_size; i < end; i++)
+      // Look up kmers in batches, stopping after the first batch with a hit
+      for(i = start+kmer_size-1; i < end && !found; i++)
       {
         nuc = dna_char_to_nuc(r->seq.b[i]);
         bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
-        num_kmers_loaded++;
-        node = db_graph_find(db_graph, bkmer);
-        if(node.key != HASH_NOT_FOUND) { found = true; break; }
+        bkeys[nbatch++] = binary_kmer_get_key(bkmer, kmer_size);
+        if(nbatch == READS_KMER_BATCH) {
+          found = kmer_batch_in_graph(bkeys, nbatch, db_graph, bloom);
+          num_kmers_loaded += nbatch;
+          nbatch = 0;
+        }
       }
     }
+
+    if(!found && nbatch > 0) {
+      found = kmer_batch_in_graph(bkeys, nbatch, db_graph, bloom);
+      num_kmers_loaded += nbatch;
+    }
   }
 
   // Update stats
@@ -219,19 +281,43 @@ static bool read_touches_graph(const read_t *r, const dBGraph *db_graph,
   return found;
 }
 
+static void filter_stats_print(const ReadFilterStats *fstats, bool used_bloom,
+                               double seconds)
+{
+  char lookups_str[50], queries_str[50];
+  ulong_to_str(fstats->num_ht_lookups, lookups_str);
+  status("[reads] %s hash table lookups in %.2f secs", lookups_str, seconds);
+
+  if(used_bloom) {
+    // Every kmer found passed the filter, the rest of those that passed are
+    // false positives
+    uint64_t nfp = fstats->num_bloom_passed - fstats->num_ht_found;
+    uint64_t nabsent = fstats->num_bloom_queries - fstats->num_ht_found;
+    ulong_to_str(fstats->num_bloom_queries, queries_str);
+    status("[reads] Bloom filter: %s queries, %.2f%% passed, "
+           "false positive rate %.3f%%, %.2f%% of hash table lookups avoided",
+           queries_str,
+           100.0 * safe_frac(fstats->num_bloom_passed, fstats->num_bloom_queries),
+           100.0 * safe_frac(nfp, nabsent),
+           100.0 * (1.0 - safe_frac(fstats->num_bloom_passed,
+                                    fstats->num_bloom_queries)));
+  }
+}
+
 void filter_reads(AsyncIOData *data, size_t threadid, void *arg)
 {
   (void)arg; (void)threadid;
   read_t *r1 = (read_t*)&data->r1, *r2 = data->r2.seq.end ? (read_t*)&data->r2 : NULL;
   AlignReadsData *input = (AlignReadsData*)data->ptr;
   const dBGraph *db_graph = input->db_graph;
+  const KmerBloom *bloom = input->bloom;
   SeqLoadingStats *stats = input->stats;
 
   ctx_assert2(r2 == NULL || input->seqout.is_pe,
               "Were not expecting r2: %p %i", r2, (int)input->seqout.is_pe);
 
-  bool touches_graph = read_touches_graph(r1, db_graph, stats) ||
-                       (r2 != NULL && read_touches_graph(r2, db_graph, stats));
+  bool touches_graph = read_touches_graph(r1, db_graph, bloom, stats) ||
+                       (r2 != NULL && read_touches_graph(r2, db_graph, bloom, stats));
 
   if(touches_graph != input->invert)
   {
@@ -259,9 +345,6 @@ int ctx_reads(int argc, char **argv)
   graph_files_open(gfile_paths, gfiles, num_gfiles,
                    &ctx_max_kmers, &ctx_sum_kmers);
 
-  // Will exit and remove output files on error
-  inputs_attempt_open();
-
   //
   // Calculate memory use
   //
@@ -275,8 +358,13 @@ int ctx_reads(int argc, char **argv)
                                         ctx_max_kmers, ctx_sum_kmers,
                                         true, &graph_mem);
 
+  if(bloom_bits) graph_mem += kmer_bloom_mem(kmers_in_hash, bloom_bits);
+
   cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
 
+  // Will exit and remove output files on error
+  inputs_attempt_open();
+
   //
   // Set up graph
   //
@@ -295,6 +383,12 @@ int ctx_reads(int argc, char **argv)
   }
   ctx_free(gfiles);
 
+  KmerBloom bloom;
+  if(bloom_bits) {
+    kmer_bloom_alloc(&bloom, db_graph.ht.num_kmers, bloom_bits);
+    kmer_bloom_add_all(&bloom, &db_graph.ht, nthreads);
+  }
+
   status("Printing reads that do %stouch the graph\n",
          inputs.b[0].invert ? "not " : "");
 
@@ -307,8 +401,11 @@ int ctx_reads(int argc, char **argv)
   for(i = 0; i < inputs.len; i++) {
     inputs.b[i].stats = &seq_stats;
     inputs.b[i].db_graph = &db_graph;
+    inputs.b[i].bloom = bloom_bits ? &bloom : NULL;
   }
 
+  double start_secs = util_wall_secs();
+
   // Deal with a set of files at once
   size_t start, end;
   for(start = 0; start < inputs.len; start += MAX_IO_THREADS)
@@ -318,6 +415,9 @@ int ctx_reads(int argc, char **argv)
     asyncio_run_pool(files.b+start, end-start, filter_reads, NULL, nthreads, 0);
   }
 
+  filter_stats_print(&filter_stats, bloom_bits > 0,
+                     util_wall_secs() - start_secs);
+
   size_t total_reads_printed = 0;
   size_t total_reads = seq_stats.num_se_reads + seq_stats.num_pe_reads;
 
@@ -336,6 +436,7 @@ int ctx_reads(int argc, char **argv)
          total_reads_printed, total_reads,
          total_reads ? (100.0 * total_reads_printed) / total_reads : 0.0);
 
+  if(bloom_bits) kmer_bloom_dealloc(&bloom);
   db_graph_dealloc(&db_graph);
 
   return EXIT_SUCCESS;
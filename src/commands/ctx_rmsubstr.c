@@ -4,6 +4,7 @@
 #include "file_util.h"
 #include "seq_reader.h"
 #include "kmer_occur.h"
+#include "minimizer_index.h"
 #include "seqout.h"
 
 const char rmsubstr_usage[] =
@@ -22,6 +23,12 @@ const char rmsubstr_usage[] =
 "  -k, --kmer <kmer>     Kmer size must be odd ("QUOTE_VALUE(MAX_KMER_SIZE)" >= k >= "QUOTE_VALUE(MIN_KMER_SIZE)")\n"
 "  -F, --format <f>      Output format may be: FASTA, FASTQ [default: FASTQ]\n"
 "  -v, --invert          Only print strings that are substrings\n"
+"  -e, --engine <E>      Index to find matches: minimizer or kmer [default: minimizer]\n"
+"\n"
+"  The minimizer engine stores about 2 in every "QUOTE_VALUE(MINIMIZER_DEFAULT_WINDOW)" kmers of the input and\n"
+"  checks each sequence against those sharing its rarest minimizer. The kmer\n"
+"  engine stores every kmer. The minimizer window is reduced to the length in\n"
+"  kmers of the shortest sequence.\n"
 "\n";
 
 static struct option longopts[] =
@@ -37,6 +44,7 @@ static struct option longopts[] =
   {"kmer",         required_argument, NULL, 'k'},
   {"format",       required_argument, NULL, 'F'},
   {"invert",       no_argument,       NULL, 'v'},
+  {"engine",       required_argument, NULL, 'e'},
   {NULL, 0, NULL, 0}
 };
 
@@ -46,6 +54,44 @@ static struct option longopts[] =
 #  define DEFAULT_KMER MIN_KMER_SIZE
 #endif
 
+#define ENGINE_MINIMIZER 0
+#define ENGINE_KMER 1
+
+// A read is a duplicate if it is a substring of ANY read in the list or a
+// complete match with a read before it in the list. Kmer at `pos` in read `r`
+// (index `idx`) matches the kmer at `pos2` in read `r2` (index `idx2`).
+// Returns true if `r` is a duplicate due to `r2`.
+static inline bool _is_substr_at(const read_t *r, size_t idx,
+                                 size_t pos, int orient,
+                                 const read_t *r2, size_t idx2,
+                                 size_t pos2, int orient2,
+                                 size_t kmer_size)
+{
+  if(idx2 == idx) return false;
+
+  // Identical strings have equal length, so we have:
+  // (idx2 < idx || r->seq.end < r2->seq.end)
+  if(!(r->seq.end < r2->seq.end || (r->seq.end == r2->seq.end && idx > idx2)))
+    return false;
+
+  if(orient == orient2) {
+    // potential FORWARD match
+    return (pos2 >= pos &&
+            pos2 - pos + r->seq.end <= r2->seq.end &&
+            strncasecmp(r->seq.b, r2->seq.b+pos2-pos, r->seq.end) == 0);
+  }
+  else {
+    // potential REVERSE match
+    // if read is '<NNNN>[kmer]<rem>' rX_rem is the number of chars after
+    // the kmer
+    size_t r1_rem = r->seq.end - (pos + kmer_size);
+    size_t r2_rem = r2->seq.end - (pos2 + kmer_size);
+
+    return (r1_rem <= pos2 && r2_rem >= pos &&
+            dna_revncasecmp(r->seq.b, r2->seq.b+pos2-r1_rem, r->seq.end) == 0);
+  }
+}
+
 // Returns 1 if a read is a substring of ANY read in the list or a complete
 // match with a read before it in the list. Returns <= 0 otherwise.
 //  1 => is substr
@@ -55,7 +101,7 @@ static int _is_substr(const ReadBuffer *rbuf, size_t idx,
                       const KOGraph *kograph, const dBGraph *db_graph)
 {
   const size_t kmer_size = db_graph->kmer_size;
-  const read_t *r = &rbuf->b[idx], *r2;
+  const read_t *r = &rbuf->b[idx];
   size_t contig_start;
 
   contig_start = seq_contig_start(r, 0, kmer_size, 0, 0);
@@ -70,38 +116,10 @@ static int _is_substr(const ReadBuffer *rbuf, size_t idx,
 
   for(hit = kograph_get(kograph, node.key); 1; hit++)
   {
-    if(hit->chrom != idx)
-    {
-      r2 = &rbuf->b[hit->chrom];
-
-      // A read is a duplicate (i.e. return 1) if it is a substring of ANY
-      // read in the list or a complete match with a read before it in the list.
-      // That is why we have: (hit->chrom < idx || r->seq.end < r2->seq.end)
-      // since identical strings have equal length
-      if(r->seq.end < r2->seq.end || (r->seq.end == r2->seq.end && idx > hit->chrom)) {
-        if(hit->orient == node.orient) {
-          // potential FORWARD match
-          if(hit->offset >= contig_start &&
-             hit->offset + r->seq.end <= r2->seq.end &&
-             strncasecmp(r->seq.b, r2->seq.b+hit->offset-contig_start, r->seq.end) == 0)
-          {
-            return 1;
-          }
-        }
-        else {
-          // potential REVERSE match
-          // if read is '<NNNN>[kmer]<rem>' rX_rem is the number of chars after
-          // the first valid kmer
-          size_t r1_rem = r->seq.end - (contig_start + kmer_size);
-          size_t r2_rem = r2->seq.end - (hit->offset + kmer_size);
-
-          if(r1_rem <= hit->offset && r2_rem >= contig_start &&
-             dna_revncasecmp(r->seq.b, r2->seq.b+hit->offset-r1_rem, r->seq.end) == 0)
-          {
-            return 1;
-          }
-        }
-      }
+    if(_is_substr_at(r, idx, contig_start, node.orient,
+                     &rbuf->b[hit->chrom], hit->chrom, hit->offset, hit->orient,
+                     kmer_size)) {
+      return 1;
     }
 
     if(!hit->next) break;
@@ -110,6 +128,87 @@ static int _is_substr(const ReadBuffer *rbuf, size_t idx,
   return 0;
 }
 
+// Same as _is_substr() but using a minimizer index. Only reads that share the
+// rarest minimizer of the read are checked.
+static int _is_substr_minim(const ReadBuffer *rbuf, size_t idx,
+                            const MinimizerIndex *mindex,
+                            MinimKmerBuffer *kmers, MinimOccurBuffer *occurs)
+{
+  const size_t kmer_size = mindex->kmer_size;
+  const read_t *r = &rbuf->b[idx];
+  const MinimOccur *hits = NULL, *tmp, *best = NULL;
+  size_t i, n, nhits = SIZE_MAX;
+
+  if(seq_contig_start(r, 0, kmer_size, 0, 0) >= r->seq.end)
+    return -1; // No kmers in this sequence
+
+  minim_occur_buf_reset(occurs);
+  minimizers_get(r, idx, kmer_size, mindex->window, kmers, occurs);
+  ctx_assert(occurs->len > 0);
+
+  for(i = 0; i < occurs->len && nhits > 1; i++) {
+    n = minimizer_index_find(mindex, occurs->b[i].bkey,
+                             minimizer_hash(occurs->b[i].bkey), &tmp);
+    if(n < nhits) { nhits = n; hits = tmp; best = &occurs->b[i]; }
+  }
+
+  // expect at least one hit (for this read!)
+  ctx_assert(nhits > 0);
+
+  for(i = 0; i < nhits; i++) {
+    if(_is_substr_at(r, idx, best->pos, best->orient,
+                     &rbuf->b[hits[i].read], hits[i].read,
+                     hits[i].pos, hits[i].orient, kmer_size)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+//
+// Check reads in parallel, results are printed in order afterwards
+//
+
+#define RMSUBSTR_CHUNK 256
+
+typedef struct
+{
+  const ReadBuffer *rbuf;
+  const KOGraph *kograph;
+  const dBGraph *db_graph;
+  const MinimizerIndex *mindex;
+  int8_t *results;
+  volatile size_t next_read;
+} SubstrChecker;
+
+static void substr_check_thread(void *arg, size_t tid)
+{
+  (void)tid;
+  SubstrChecker *chk = (SubstrChecker*)arg;
+  const size_t nreads = chk->rbuf->len;
+  size_t i, start, end;
+  MinimKmerBuffer kmers;
+  MinimOccurBuffer occurs;
+
+  minim_kmer_buf_alloc(&kmers, 1024);
+  minim_occur_buf_alloc(&occurs, 256);
+
+  while((start = __sync_fetch_and_add(&chk->next_read, RMSUBSTR_CHUNK)) < nreads)
+  {
+    end = MIN2(start + RMSUBSTR_CHUNK, nreads);
+    for(i = start; i < end; i++) {
+      chk->results[i] = chk->mindex != NULL
+                        ? _is_substr_minim(chk->rbuf, i, chk->mindex,
+                                           &kmers, &occurs)
+                        : _is_substr(chk->rbuf, i, chk->kograph, chk->db_graph);
+    }
+  }
+
+  minim_kmer_buf_dealloc(&kmers);
+  minim_occur_buf_dealloc(&occurs);
+}
+
 int ctx_rmsubstr(int argc, char **argv)
 {
   struct MemArgs memargs = MEM_ARGS_INIT;
@@ -117,6 +216,7 @@ int ctx_rmsubstr(int argc, char **argv)
   const char *output_file = NULL;
   seq_format fmt = SEQ_FMT_FASTA;
   bool invert = false;
+  int engine = -1;
 
   // Arg parsing
   char cmd[100], shortopts[100];
@@ -136,6 +236,12 @@ int ctx_rmsubstr(int argc, char **argv)
       case 'k': cmd_check(!kmer_size,cmd); kmer_size = cmd_uint32(cmd, optarg); break;
       case 'F': cmd_check(fmt==SEQ_FMT_FASTA, cmd); fmt = cmd_parse_format(cmd, optarg); break;
       case 'v': cmd_check(!invert,cmd); invert = true; break;
+      case 'e':
+        cmd_check(engine < 0, cmd);
+        if(!strcasecmp(optarg,"minimizer")) engine = ENGINE_MINIMIZER;
+        else if(!strcasecmp(optarg,"kmer")) engine = ENGINE_KMER;
+        else cmd_print_usage("--engine must be minimizer or kmer: %s", optarg);
+        break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -147,6 +253,7 @@ int ctx_rmsubstr(int argc, char **argv)
   // Defaults
   if(!nthreads) nthreads = DEFAULT_NTHREADS;
   if(!kmer_size) kmer_size = DEFAULT_KMER;
+  if(engine < 0) engine = ENGINE_MINIMIZER;
 
   if(!(kmer_size&1)) cmd_print_usage("Kmer size must be odd");
   if(kmer_size < MIN_KMER_SIZE) cmd_print_usage("Kmer size too small (recompile)");
@@ -178,12 +285,9 @@ int ctx_rmsubstr(int argc, char **argv)
   //
   // Decide on memory
   //
-  size_t bits_per_kmer, kmers_in_hash, graph_mem;
+  size_t bits_per_kmer, kmers_in_hash = 0, graph_mem, index_mem;
   size_t mem_to_use = memargs.mem_to_use;
 
-  bits_per_kmer = sizeof(BinaryKmer)*8 +
-                  sizeof(KONodeList) + sizeof(KOccur); // see kmer_occur.h
-
   if(mem_to_use < (size_t)est_num_bases) {
     warn("You probably need at least %zu bytes (> %zu)",
          (size_t)est_num_bases, memargs.mem_to_use);
@@ -192,16 +296,30 @@ int ctx_rmsubstr(int argc, char **argv)
     mem_to_use -= est_num_bases;
   }
 
-  kmers_in_hash = cmd_get_kmers_in_hash(mem_to_use,
-                                        memargs.mem_to_use_set,
-                                        memargs.num_kmers,
-                                        memargs.num_kmers_set,
-                                        bits_per_kmer,
-                                        0, est_num_bases,
-                                        true, &graph_mem);
+  if(engine == ENGINE_KMER)
+  {
+    bits_per_kmer = sizeof(BinaryKmer)*8 +
+                    sizeof(KONodeList) + sizeof(KOccur); // see kmer_occur.h
+
+    kmers_in_hash = cmd_get_kmers_in_hash(mem_to_use,
+                                          memargs.mem_to_use_set,
+                                          memargs.num_kmers,
+                                          memargs.num_kmers_set,
+                                          bits_per_kmer,
+                                          0, est_num_bases,
+                                          true, &graph_mem);
+
+    index_mem = kmers_in_hash*bits_per_kmer/8;
+  }
+  else
+  {
+    // Expect 2/(window+1) of kmers to be minimizers
+    index_mem = (size_t)est_num_bases * 2 / (MINIMIZER_DEFAULT_WINDOW+1) *
+                sizeof(MinimOccur);
+  }
 
   // 1 byte per kmer for each base to load sequence files
-  size_t total_mem = kmers_in_hash*bits_per_kmer/8 + est_num_bases;
+  size_t total_mem = index_mem + est_num_bases;
 
   char memstr[50];
   bytes_to_str(total_mem, 1, memstr);
@@ -219,7 +337,8 @@ int ctx_rmsubstr(int argc, char **argv)
   // Set up memory
   //
   dBGraph db_graph;
-  db_graph_alloc(&db_graph, kmer_size, 1, 0, kmers_in_hash, DBG_ALLOC_BKTLOCKS);
+  if(engine == ENGINE_KMER)
+    db_graph_alloc(&db_graph, kmer_size, 1, 0, kmers_in_hash, DBG_ALLOC_BKTLOCKS);
 
   //
   // Load reference sequence into a read buffer
@@ -233,15 +352,60 @@ int ctx_rmsubstr(int argc, char **argv)
   if(i < rbuf.len)
     warn("Reads shorter than kmer size (%zu) will not be filtered", kmer_size);
 
-  KOGraph kograph = kograph_create(rbuf.b, rbuf.len, true, 0,
-                                   nthreads, &db_graph);
+  //
+  // Build index
+  //
+  KOGraph kograph;
+  MinimizerIndex mindex;
+  size_t window = 0;
+  double secs, start_secs = util_wall_secs();
+
+  if(engine == ENGINE_KMER) {
+    kograph = kograph_create(rbuf.b, rbuf.len, true, 0, nthreads, &db_graph);
+    // Hash table, plus one KOccur per kmer in the sequences
+    size_t num_occurs = 0;
+    for(i = 0; i < rbuf.len; i++)
+      if(rbuf.b[i].seq.end >= kmer_size)
+        num_occurs += rbuf.b[i].seq.end - kmer_size + 1;
+    index_mem = db_graph.ht.capacity * (sizeof(BinaryKmer) + sizeof(KONodeList)) +
+                num_occurs * sizeof(KOccur);
+  }
+  else {
+    window = minimizer_index_window(rbuf.b, rbuf.len, kmer_size,
+                                    MINIMIZER_DEFAULT_WINDOW);
+    if(window < MINIMIZER_DEFAULT_WINDOW)
+      status("Using minimizer window of %zu kmers (shortest sequence)", window);
+    minimizer_index_build(&mindex, rbuf.b, rbuf.len, kmer_size,
+                          MAX2(window, 1), nthreads);
+    index_mem = minimizer_index_mem(&mindex);
+  }
+
+  secs = util_wall_secs() - start_secs;
+  bytes_to_str(index_mem, 1, memstr);
+  status("[%s engine] Index built in %.2f secs using %s",
+         engine == ENGINE_KMER ? "kmer" : "minimizer", secs, memstr);
+
+  //
+  // Check reads
+  //
+  int8_t *results = ctx_calloc(rbuf.len, sizeof(int8_t));
+  SubstrChecker checker = {.rbuf = &rbuf, .results = results, .next_read = 0,
+                           .kograph = engine == ENGINE_KMER ? &kograph : NULL,
+                           .db_graph = engine == ENGINE_KMER ? &db_graph : NULL,
+                           .mindex = engine == ENGINE_KMER ? NULL : &mindex};
+
+  start_secs = util_wall_secs();
+  util_multi_thread(&checker, nthreads, substr_check_thread);
+  status("[%s engine] Checked %zu sequences in %.2f secs with %zu threads",
+         engine == ENGINE_KMER ? "kmer" : "minimizer", rbuf.len,
+         util_wall_secs() - start_secs, nthreads);
 
   size_t num_reads = rbuf.len, num_reads_printed = 0, num_bad_reads = 0;
 
   // Loop over reads printing those that are not substrings
   int ret;
   for(i = 0; i < rbuf.len; i++) {
-    ret = _is_substr(&rbuf, i, &kograph, &db_graph);
+    ret = results[i];
     if(ret == -1) num_bad_reads++;
     else if((ret && invert) || (!ret && !invert)) {
       seqout_print_read(&rbuf.b[i], fmt, fout);
@@ -267,14 +431,20 @@ int ctx_rmsubstr(int argc, char **argv)
   }
 
   fclose(fout);
-  kograph_dealloc(&kograph);
+  ctx_free(results);
+
+  if(engine == ENGINE_KMER) {
+    kograph_dealloc(&kograph);
+    db_graph_dealloc(&db_graph);
+  }
+  else {
+    minimizer_index_dealloc(&mindex);
+  }
 
   // Free sequence memory
   for(i = 0; i < rbuf.len; i++) seq_read_dealloc(&rbuf.b[i]);
   read_buf_dealloc(&rbuf);
   ctx_free(seq_files);
 
-  db_graph_dealloc(&db_graph);
-
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,308 @@
+#include "global.h"
+#include "commands.h"
+#include "util.h"
+#include "file_util.h"
+#include "binary_kmer.h"
+#include "graph_file_reader.h"
+#include "seq_reader.h"
+#include "async_read_io.h"
+#include "kmer_sketch.h"
+
+const char sketch_usage[] =
+"usage: "CMD" sketch [options] [in.ctx[:cols] ...]\n"
+"\n"
+"  Make bottom-k MinHash sketches of kmer sets, for fast approximate distances\n"
+"  between many samples with `"CMD" dist --sketch`. One sketch is made for each\n"
+"  graph colour and for each sequence input (-1, -2, -i).\n"
+"\n"
+"  -h, --help                This help message\n"
+"  -q, --quiet               Silence status output normally printed to STDERR\n"
+"  -f, --force               Overwrite output files\n"
+"  -o, --out <out.sk>        Save sketches (gzipped) [default: STDOUT]\n"
+"  -t, --threads <T>         Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
+"  -k, --kmer <k>            Kmer size for reads [default: graph kmer size or 31]\n"
+"  -s, --size <S>            Number of hashes per sketch [default: "QUOTE_VALUE(SKETCH_DEFAULT_SIZE)"]\n"
+"  -1, --seq <in.fa>         Sketch kmers in reads\n"
+"  -2, --seq2 <in1>:<in2>    Sketch kmers in paired end reads\n"
+"  -i, --seqi <in.bam>       Sketch kmers in interleaved paired end reads\n"
+"\n"
+"  Larger sketches give more accurate estimates. Sketches must be made with the\n"
+"  same kmer size to be compared.\n"
+"\n";
+
+static struct option longopts[] =
+{
+// General options
+  {"help",         no_argument,       NULL, 'h'},
+  {"force",        no_argument,       NULL, 'f'},
+  {"out",          required_argument, NULL, 'o'},
+  {"threads",      required_argument, NULL, 't'},
+// command specific
+  {"kmer",         required_argument, NULL, 'k'},
+  {"size",         required_argument, NULL, 's'},
+  {"seq",          required_argument, NULL, '1'},
+  {"seq2",         required_argument, NULL, '2'},
+  {"seqi",         required_argument, NULL, 'i'},
+  {NULL, 0, NULL, 0}
+};
+
+#if MAX_KMER_SIZE == 31
+#  define DEFAULT_KMER 31
+#else
+#  define DEFAULT_KMER MIN_KMER_SIZE
+#endif
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(asyncio_buf, AsyncIOInputBuffer, AsyncIOInput);
+
+//
+// Sketch graph colours, one job per graph file
+//
+typedef struct {
+  GraphFileReader *file;
+  KmerSketch *sketches; // one per colour loaded from this file
+} SketchGraphJob;
+
+static void _sketch_graph_file(void *arg, size_t threadid)
+{
+  (void)threadid;
+  SketchGraphJob *job = (SketchGraphJob*)arg;
+  GraphFileReader *file = job->file;
+  const FileFilter *fltr = &file->fltr;
+  size_t i, from, ncols = file->hdr.num_of_cols;
+  Covg covgs[ncols];
+  Edges edges[ncols];
+  BinaryKmer bkey;
+
+  // Graph files store kmer keys
+  while(graph_file_read_raw(file, &bkey, covgs, edges)) {
+    for(i = 0; i < file_filter_num(fltr); i++) {
+      from = file_filter_fromcol(fltr, i);
+      if(covgs[from] || edges[from]) kmer_sketch_add(&job->sketches[i], bkey);
+    }
+  }
+
+  for(i = 0; i < file_filter_num(fltr); i++)
+    kmer_sketch_finish(&job->sketches[i]);
+}
+
+static void sketch_graphs(GraphFileReader *gfiles, size_t num_gfiles,
+                          size_t ncols, size_t size, size_t nthreads,
+                          KmerSketch *sketches)
+{
+  size_t i, j, from, into;
+  SketchGraphJob *jobs = ctx_calloc(num_gfiles, sizeof(SketchGraphJob));
+  const FileFilter *fltr;
+
+  for(i = 0; i < num_gfiles; i++) {
+    fltr = &gfiles[i].fltr;
+    jobs[i].file = &gfiles[i];
+    jobs[i].sketches = ctx_calloc(file_filter_num(fltr), sizeof(KmerSketch));
+    for(j = 0; j < file_filter_num(fltr); j++) {
+      from = file_filter_fromcol(fltr, j);
+      into = file_filter_intocol(fltr, j);
+      const char *name = gfiles[i].hdr.ginfo[from].sample_name.b;
+      kmer_sketch_alloc(&jobs[i].sketches[j], size, name);
+      if(sketches[into].name == NULL) kmer_sketch_alloc(&sketches[into], size, name);
+    }
+  }
+
+  // Colours not loaded from any file have empty sketches
+  for(i = 0; i < ncols; i++)
+    if(sketches[i].name == NULL) kmer_sketch_alloc(&sketches[i], size, "");
+
+  status("[sketch] Sketching %zu colour%s from %zu graph file%s with %zu thread%s",
+         ncols, util_plural_str(ncols), num_gfiles, util_plural_str(num_gfiles),
+         nthreads, util_plural_str(nthreads));
+
+  util_run_threads(jobs, num_gfiles, sizeof(SketchGraphJob),
+                   nthreads, _sketch_graph_file);
+
+  // Merge sketches for colours loaded from more than one file
+  for(i = 0; i < num_gfiles; i++) {
+    fltr = &gfiles[i].fltr;
+    for(j = 0; j < file_filter_num(fltr); j++) {
+      into = file_filter_intocol(fltr, j);
+      kmer_sketch_merge(&sketches[into], &jobs[i].sketches[j]);
+      kmer_sketch_dealloc(&jobs[i].sketches[j]);
+    }
+    ctx_free(jobs[i].sketches);
+  }
+
+  ctx_free(jobs);
+}
+
+//
+// Sketch reads, one sketch per thread merged after each input
+//
+typedef struct {
+  size_t kmer_size;
+  KmerSketch sketch;
+  SeqLoadingStats stats;
+} SketchReadsWorker;
+
+static inline void _sketch_bkmer(BinaryKmer bkmer, KmerSketch *sketch,
+                                 size_t kmer_size)
+{
+  kmer_sketch_add(sketch, binary_kmer_get_key(bkmer, kmer_size));
+}
+
+static void _sketch_reads(AsyncIOData *data, size_t threadid, void *arg)
+{
+  (void)threadid;
+  SketchReadsWorker *wrkr = (SketchReadsWorker*)arg;
+  const size_t kmer_size = wrkr->kmer_size;
+
+  READ_TO_BKMERS(&data->r1, kmer_size, 0, 0, &wrkr->stats,
+                 _sketch_bkmer, &wrkr->sketch, kmer_size);
+
+  if(data->r2.seq.end) {
+    READ_TO_BKMERS(&data->r2, kmer_size, 0, 0, &wrkr->stats,
+                   _sketch_bkmer, &wrkr->sketch, kmer_size);
+    wrkr->stats.num_pe_reads += 2;
+  }
+  else wrkr->stats.num_se_reads++;
+}
+
+static void sketch_reads(AsyncIOInput *input, size_t kmer_size, size_t size,
+                         size_t nthreads, KmerSketch *sketch)
+{
+  const char *name = input->file1->path;
+  SketchReadsWorker *wrkrs = ctx_calloc(nthreads, sizeof(SketchReadsWorker));
+  SeqLoadingStats stats;
+  size_t i;
+
+  status("[sketch] Sketching reads from %s", futil_inpath_str(name));
+
+  kmer_sketch_alloc(sketch, size, name);
+  seq_loading_stats_init(&stats);
+
+  for(i = 0; i < nthreads; i++) {
+    wrkrs[i].kmer_size = kmer_size;
+    kmer_sketch_alloc(&wrkrs[i].sketch, size, name);
+  }
+
+  asyncio_run_pool(input, 1, _sketch_reads, wrkrs, nthreads,
+                   sizeof(SketchReadsWorker));
+
+  for(i = 0; i < nthreads; i++) {
+    kmer_sketch_merge(sketch, &wrkrs[i].sketch);
+    seq_loading_stats_merge(&stats, &wrkrs[i].stats);
+    kmer_sketch_dealloc(&wrkrs[i].sketch);
+  }
+
+  ctx_free(wrkrs);
+
+  char nreads_str[50], nkmers_str[50];
+  ulong_to_str(stats.num_se_reads + stats.num_pe_reads, nreads_str);
+  ulong_to_str(stats.num_kmers_loaded, nkmers_str);
+  status("[sketch]   %s reads, %s kmers", nreads_str, nkmers_str);
+}
+
+int ctx_sketch(int argc, char **argv)
+{
+  size_t nthreads = 0, kmer_size = 0, size = 0;
+  const char *out_path = NULL;
+
+  AsyncIOInputBuffer inputs;
+  asyncio_buf_alloc(&inputs, 8);
+  AsyncIOInput task;
+
+  // Arg parsing
+  char cmd[100], shortopts[100];
+  cmd_long_opts_to_short(longopts, shortopts, sizeof(shortopts));
+  int c;
+
+  while((c = getopt_long_only(argc, argv, shortopts, longopts, NULL)) != -1) {
+    cmd_get_longopt_str(longopts, c, cmd, sizeof(cmd));
+    switch(c) {
+      case 0: /* flag set */ break;
+      case 'h': cmd_print_usage(NULL); break;
+      case 'f': cmd_check(!futil_get_force(), cmd); futil_set_force(true); break;
+      case 'o': cmd_check(!out_path, cmd); out_path = optarg; break;
+      case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
+      case 'k': cmd_check(!kmer_size, cmd); kmer_size = cmd_uint32(cmd, optarg); break;
+      case 's': cmd_check(!size, cmd); size = cmd_uint32_nonzero(cmd, optarg); break;
+      case '1':
+      case '2':
+      case 'i':
+        memset(&task, 0, sizeof(task));
+        asyncio_task_parse(&task, c, optarg, 0, NULL);
+        asyncio_buf_push(&inputs, &task, 1);
+        break;
+      case ':': /* BADARG */
+      case '?': /* BADCH getopt_long has already printed error */
+        // cmd_print_usage(NULL);
+        die("`"CMD" sketch -h` for help. Bad option: %s", argv[optind-1]);
+      default: abort();
+    }
+  }
+
+  // Defaults
+  if(!nthreads) nthreads = DEFAULT_NTHREADS;
+  if(!size) size = SKETCH_DEFAULT_SIZE;
+
+  if(optind >= argc && inputs.len == 0)
+    cmd_print_usage("Please give graph files (.ctx) and/or reads (-1, -2, -i)");
+
+  //
+  // Open graph files
+  //
+  const size_t num_gfiles = argc - optind;
+  char **graph_paths = argv + optind;
+  GraphFileReader *gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
+  size_t i, ncols = 0, ctx_max_kmers = 0, ctx_sum_kmers = 0;
+
+  if(num_gfiles > 0) {
+    ncols = graph_files_open(graph_paths, gfiles, num_gfiles,
+                             &ctx_max_kmers, &ctx_sum_kmers);
+
+    if(kmer_size && kmer_size != gfiles[0].hdr.kmer_size) {
+      cmd_print_usage("-k %zu doesn't match graph kmer size %u",
+                      kmer_size, gfiles[0].hdr.kmer_size);
+    }
+    kmer_size = gfiles[0].hdr.kmer_size;
+  }
+
+  if(!kmer_size) kmer_size = DEFAULT_KMER;
+  if(!(kmer_size&1)) cmd_print_usage("Kmer size must be odd");
+  if(kmer_size < MIN_KMER_SIZE) cmd_print_usage("Kmer size too small (recompile)");
+  if(kmer_size > MAX_KMER_SIZE) cmd_print_usage("Kmer size too large (recompile?)");
+
+  // Open output file
+  gzFile gzout = futil_gzopen_create(out_path ? out_path : "-", "w");
+
+  const size_t nsketches = ncols + inputs.len;
+  KmerSketch *sketches = ctx_calloc(nsketches, sizeof(KmerSketch));
+
+  status("[sketch] Making %zu sketch%s of %zu hashes, k=%zu",
+         nsketches, nsketches == 1 ? "" : "es", size, kmer_size);
+
+  double t0 = util_wall_secs();
+
+  if(num_gfiles > 0)
+    sketch_graphs(gfiles, num_gfiles, ncols, size, nthreads, sketches);
+
+  for(i = 0; i < num_gfiles; i++) graph_file_close(&gfiles[i]);
+  ctx_free(gfiles);
+
+  for(i = 0; i < inputs.len; i++) {
+    sketch_reads(&inputs.b[i], kmer_size, size, nthreads, &sketches[ncols+i]);
+    asyncio_task_close(&inputs.b[i]);
+  }
+
+  asyncio_buf_dealloc(&inputs);
+
+  status("[sketch] Sketching took %.2f secs", util_wall_secs() - t0);
+
+  kmer_sketch_file_write(sketches, nsketches, kmer_size, gzout, out_path);
+  gzclose(gzout);
+
+  status("[sketch] Written %zu sketch%s to %s", nsketches,
+         nsketches == 1 ? "" : "es", futil_outpath_str(out_path));
+
+  for(i = 0; i < nsketches; i++) kmer_sketch_dealloc(&sketches[i]);
+  ctx_free(sketches);
+
+  return EXIT_SUCCESS;
+}
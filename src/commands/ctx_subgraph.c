@@ -18,8 +18,8 @@ const char subgraph_usage[] =
 "\n"
 "  Loads graphs (in.ctx) and dumps a graph (out.ctx) that contains all kmers within\n"
 "  <dist> edges of kmers in <seeds.fa>.  Maintains number of colours / covgs etc.\n"
-"  Loads seed files twice: 1) get seed; 2) extend;  This lowers memory requirement\n"
-"  for large (seed) graphs but means seed files cannot be pipes / sockets.\n"
+"  Seed files are read once, then the search is extended one level at a time\n"
+"  using all threads.\n"
 "\n"
 "  -h, --help            This help message\n"
 "  -q, --quiet           Silence status output normally printed to STDERR\n"
@@ -8,6 +8,7 @@
 #include "build_graph.h"
 #include "seqout.h"
 #include "seq_reader.h"
+#include "graph_render.h" // ChunkWriter
 
 const char uniqkmers_usage[] =
 "usage: "CMD" uniqkmers [options] <N>\n"
@@ -20,6 +21,7 @@ const char uniqkmers_usage[] =
 "  -o, --out <bub.fa>      Output file [default: STDOUT]\n"
 "  -m, --memory <mem>      Memory to use\n"
 "  -n, --nkmers <kmers>    Number of hash table entries (e.g. 1G ~ 1 billion)\n"
+"  -t, --threads <T>       Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 //
 "  -k, --kmer <K>          Kmer size (required if only giving --seq input)\n"
 "  -g, --graph <in.ctx>    Load kmers from the graph file\n"
@@ -45,6 +47,12 @@ static struct option longopts[] =
   {NULL, 0, NULL, 0}
 };
 
+// Number of kmers a thread generates and writes at a time
+#define UNIQ_BLOCK_KMERS 4096
+
+// Give up after this many candidate kmers in a row are already in the graph
+#define UNIQ_MAX_ATTEMPTS 1000
+
 static inline dBNode db_graph_add_random_node(dBGraph *db_graph,
                                               BinaryKmer *bkmer_ptr)
 {
@@ -169,6 +177,115 @@ static inline void _add_uniq_flanks(read_t *r, const char *path,
     die("Unknown format: %i", (int)fmt);
 }
 
+//
+// Generate random kmers with multiple threads. Each thread has its own random
+// number stream and takes blocks of output kmers. Candidates are reserved in
+// batches with a threadsafe find-or-insert that prefetches their buckets; a
+// candidate already in the graph (or added by another thread) is rejected.
+// Blocks are written out in order so kmers are numbered from zero.
+//
+
+typedef struct
+{
+  dBGraph *db_graph;
+  size_t num_kmers, nthreads;
+  volatile size_t next_block;
+  uint64_t *seeds; // one random number stream per thread
+  volatile size_t num_rejected;
+  ChunkWriter writer;
+} UniqKmerGen;
+
+static void uniq_kmers_thread(void *arg, size_t threadid)
+{
+  UniqKmerGen *gen = (UniqKmerGen*)arg;
+  dBGraph *db_graph = gen->db_graph;
+  const size_t kmer_size = db_graph->kmer_size;
+  const size_t nblocks = (gen->num_kmers + UNIQ_BLOCK_KMERS - 1) / UNIQ_BLOCK_KMERS;
+  uint64_t state = gen->seeds[threadid];
+
+  BinaryKmer bkmers[HASH_BATCH_SIZE], bkeys[HASH_BATCH_SIZE];
+  hkey_t hkeys[HASH_BATCH_SIZE];
+  bool found[HASH_BATCH_SIZE];
+  char *str;
+  size_t b, i, j, n, end, nrejected = 0, attempts = 0;
+
+  StrBuf sbuf;
+  strbuf_alloc(&sbuf, UNIQ_BLOCK_KMERS * (kmer_size + 16));
+
+  while((b = __sync_fetch_and_add(&gen->next_block, 1)) < nblocks)
+  {
+    strbuf_reset(&sbuf);
+    i = b * UNIQ_BLOCK_KMERS;
+    end = MIN2(i + UNIQ_BLOCK_KMERS, gen->num_kmers);
+
+    while(i < end)
+    {
+      n = MIN2(end - i, HASH_BATCH_SIZE);
+      for(j = 0; j < n; j++) {
+        bkmers[j] = binary_kmer_random_r(kmer_size, &state);
+        bkeys[j] = binary_kmer_get_key(bkmers[j], kmer_size);
+      }
+
+      hash_table_find_or_insert_batch_mt(&db_graph->ht, bkeys, n, hkeys, found,
+                                         db_graph->bktlocks);
+
+      for(j = 0; j < n; j++)
+      {
+        if(found[j]) {
+          nrejected++;
+          if(++attempts == UNIQ_MAX_ATTEMPTS)
+            die("Ran %i times but couldn't find a unique binary kmer",
+                UNIQ_MAX_ATTEMPTS);
+          continue;
+        }
+
+        attempts = 0;
+        strbuf_sprintf(&sbuf, ">kmer%zu\n", i++);
+        strbuf_ensure_capacity(&sbuf, sbuf.end + kmer_size + 1);
+        str = sbuf.b + sbuf.end;
+        binary_kmer_to_str(bkmers[j], kmer_size, str);
+        str[kmer_size] = '\n';
+        sbuf.end += kmer_size + 1;
+        sbuf.b[sbuf.end] = '\0';
+      }
+    }
+
+    chunk_writer_write(&gen->writer, b, sbuf.b, sbuf.end);
+  }
+
+  __sync_fetch_and_add(&gen->num_rejected, nrejected);
+  strbuf_dealloc(&sbuf);
+}
+
+static void uniq_kmers_generate(dBGraph *db_graph, size_t num_kmers,
+                                size_t nthreads, FILE *fout)
+{
+  size_t i;
+  UniqKmerGen gen = {.db_graph = db_graph, .num_kmers = num_kmers,
+                     .nthreads = nthreads, .next_block = 0, .num_rejected = 0};
+
+  gen.seeds = ctx_malloc(nthreads * sizeof(uint64_t));
+  for(i = 0; i < nthreads; i++)
+    gen.seeds[i] = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^ i;
+
+  chunk_writer_alloc(&gen.writer, fout);
+
+  double start = util_wall_secs();
+  util_multi_thread(&gen, nthreads, uniq_kmers_thread);
+  double secs = util_wall_secs() - start;
+
+  chunk_writer_dealloc(&gen.writer);
+  ctx_free(gen.seeds);
+
+  char num_kmers_str[50], rate_str[50], rejected_str[50];
+  ulong_to_str(num_kmers, num_kmers_str);
+  ulong_to_str(secs > 0 ? num_kmers / secs : num_kmers, rate_str);
+  ulong_to_str(gen.num_rejected, rejected_str);
+  status("[uniqkmers] Generated %s kmers in %.2f secs with %zu threads "
+         "(%s kmers/sec, %s candidates already in graph)",
+         num_kmers_str, secs, nthreads, rate_str, rejected_str);
+}
+
 int ctx_uniqkmers(int argc, char **argv)
 {
   size_t nthreads = 0;
@@ -309,10 +426,6 @@ int ctx_uniqkmers(int argc, char **argv)
   if(sfilebuf.len > 0 || flankbuf.len > 0)
     hash_table_print_stats(&db_graph.ht);
 
-  // Print random kmers
-  BinaryKmer bkmer;
-  char bkmerstr[MAX_KMER_SIZE+1];
-
   seq_format fmt = SEQ_FMT_FASTA;
 
   // Add random kmers to flank input sequences
@@ -339,14 +452,7 @@ int ctx_uniqkmers(int argc, char **argv)
   }
 
   // Generate random kmers not in the graph
-  char sname[100];
-  for(i = 0; i < num_uniqkmers; i++)
-  {
-    db_graph_add_random_node(&db_graph, &bkmer);
-    binary_kmer_to_str(bkmer, kmer_size, bkmerstr);
-    sprintf(sname, ">kmer%zu", i);
-    seqout_print_strs(sname, bkmerstr, kmer_size, NULL, 0, fmt, fout);
-  }
+  uniq_kmers_generate(&db_graph, num_uniqkmers, nthreads, fout);
 
   char num_kmers_str[100];
   ulong_to_str(num_uniqkmers, num_kmers_str);
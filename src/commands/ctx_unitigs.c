@@ -9,11 +9,17 @@
 #include "graphs_load.h"
 #include "gpath_checks.h"
 #include "unitig_graph.h"
+#include "compact_graph.h"
+#include "graph_render.h"
+#include "sorted_graph.h"
 
 const char unitigs_usage[] =
 "usage: "CMD" unitigs [options] <in.ctx> [<in2.ctx> ...]\n"
+"       "CMD" unitigs [options] <in.ctu|in.gfa>\n"
 "\n"
-"  Print unitigs with k-1 bases of overlap.\n"
+"  Print unitigs with k-1 bases of overlap. Input can be graph files or a\n"
+"  compacted graph (.ctu) saved with --ctu, which does not need a hash table.\n"
+"  A GFA file of unitigs (e.g. from --gfa) can be converted to a .ctu file.\n"
 "\n"
 "  -h, --help            This help message\n"
 "  -q, --quiet           Silence status output normally printed to STDERR\n"
@@ -27,6 +33,15 @@ const char unitigs_usage[] =
 "  -g, --gfa             Print in Graphical Fragment Assembly (GFA) format\n"
 "  -d, --dot             Print in graphviz (DOT) format\n"
 "  -P, --points          Used with --dot, print contigs as points\n"
+"  -u, --ctu             Save compacted graph with coverage of each colour (.ctu)\n"
+"  -D, --disk            Read a sorted graph on disk without loading it\n"
+"\n"
+"  --disk takes one sorted graph file (see `"CMD" sort`) and walks unitigs by\n"
+"  searching the file, using a bit per kmer instead of a hash table.\n"
+"\n"
+"  .ctu files can be memory mapped: arrays of kmer and sequence offsets, links\n"
+"  in CSR form, mean coverage with one column per colour and 2-bit packed\n"
+"  sequence. GFA printed from a .ctu file has coverage in a "CTU_GFA_COVG_TAG" tag.\n"
 "\n"
 "  e.g. "CMD" unitigs --dot in.ctx | dot -Tpdf > in.pdf\n"
 "\n";
@@ -45,6 +60,8 @@ static struct option longopts[] =
   {"gfa",          no_argument,       NULL, 'g'},
   {"dot",          no_argument,       NULL, 'd'},
   {"points",       no_argument,       NULL, 'P'},
+  {"ctu",          no_argument,       NULL, 'u'},
+  {"disk",         no_argument,       NULL, 'D'},
   {NULL, 0, NULL, 0}
 };
 
@@ -52,24 +69,82 @@ static struct option longopts[] =
 typedef enum {
   PRINT_FASTA = 0,
   PRINT_GFA = 1,
-  PRINT_DOT = 2
+  PRINT_DOT = 2,
+  PRINT_CTU = 3
 } UnitigSyntax;
 
-const char *syntax_strs[3] = {"FASTA", "GFA", "DOT (Graphviz)"};
+const char *syntax_strs[4] = {"FASTA", "GFA", "DOT (Graphviz)",
+                              "compacted graph (.ctu)"};
+
 
+// Each thread renders output into its own buffer, which is written out
+// whenever it grows past UNITIG_FLUSH_BYTES
+#define UNITIG_FLUSH_BYTES ONE_MEGABYTE
 
+// End of a unitig in a sorted graph file, identified by file index
+typedef struct
+{
+  hkey_t key;
+  UnitigEnd end;
+} SortedUnitigEnd;
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(sorted_uend_buf, SortedUnitigEndBuffer, SortedUnitigEnd);
+
+// Prints from a hash table (db_graph) or a sorted file on disk (sg)
 typedef struct
 {
   const dBGraph *db_graph;
-  size_t nthreads;
+  const SortedGraph *sg;
+  size_t kmer_size, nthreads;
   uint8_t *visited;
   UnitigSyntax syntax;
   FILE *fout;
   pthread_mutex_t outlock;
+  StrBuf *bufs; // one per thread
   UnitigKmerGraph ugraph;
+  // Unitig ends when printing from disk, sorted by key
+  SortedUnitigEndBuffer *ebufs; // one per thread
+  SortedUnitigEnd *ends;
+  size_t num_ends;
   volatile size_t num_unitigs;
 } UnitigPrinter;
 
+static void _printer_flush(UnitigPrinter *p, StrBuf *sbuf)
+{
+  if(sbuf->end == 0) return;
+  pthread_mutex_lock(&p->outlock);
+  if(fwrite(sbuf->b, 1, sbuf->end, p->fout) != sbuf->end)
+    die("Cannot write output");
+  pthread_mutex_unlock(&p->outlock);
+  strbuf_reset(sbuf);
+}
+
+static inline void _printer_done(UnitigPrinter *p, StrBuf *sbuf)
+{
+  if(sbuf->end >= UNITIG_FLUSH_BYTES) _printer_flush(p, sbuf);
+}
+
+// Write out remaining output, call after all threads have finished
+static void _printer_flush_all(UnitigPrinter *p)
+{
+  size_t i;
+  for(i = 0; i < p->nthreads; i++) _printer_flush(p, &p->bufs[i]);
+}
+
+// Binary search for the end of a unitig in a sorted file
+static inline UnitigEnd _sorted_unitig_end(const UnitigPrinter *p, hkey_t key)
+{
+  size_t lo = 0, hi = p->num_ends, mid;
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(p->ends[mid].key == key) return p->ends[mid].end;
+    if(p->ends[mid].key < key) lo = mid+1;
+    else hi = mid;
+  }
+  return (UnitigEnd){.assigned = 0};
+}
+
 /**
  * @param right_edge is true iff we this kmer is the last in a unitig, and we
  *                   are leaving by the forward strand
@@ -77,7 +152,7 @@ typedef struct
 static inline void _print_edge(hkey_t node, bool right_edge,
                                BinaryKmer bkey, Edges edges,
                                UnitigEnd uend0,
-                               UnitigPrinter *p)
+                               UnitigPrinter *p, StrBuf *sbuf)
 {
   // DOT: leave from east end if +, west end if -
   //      connect to west end if +, east end if -
@@ -87,8 +162,11 @@ static inline void _print_edge(hkey_t node, bool right_edge,
   Nucleotide next_nucs[4];
   Orientation orient = right_edge ? uend0.rorient : !uend0.lorient;
 
-  n = db_graph_next_nodes(p->db_graph, bkey, orient, edges,
-                          next_nodes, next_nucs);
+  if(p->sg != NULL)
+    n = sorted_graph_next_nodes(p->sg, bkey, orient, edges, next_nodes, next_nucs);
+  else
+    n = db_graph_next_nodes(p->db_graph, bkey, orient, edges,
+                            next_nodes, next_nucs);
 
   // Unitig orientations
   Orientation ut_or0, ut_or1;
@@ -96,10 +174,11 @@ static inline void _print_edge(hkey_t node, bool right_edge,
 
   for(i = 0; i < n; i++)
   {
-    UnitigEnd uend1 = p->ugraph.unitig_ends[next_nodes[i].key];
+    UnitigEnd uend1 = p->sg != NULL ? _sorted_unitig_end(p, next_nodes[i].key)
+                                    : p->ugraph.unitig_ends[next_nodes[i].key];
 
     // Debugging
-    if(!uend1.assigned) {
+    if(!uend1.assigned && p->db_graph != NULL) {
       char tmpstr[100];
       db_node_to_str(p->db_graph, next_nodes[i], tmpstr);
       status(" -> node %zu [%s]", (size_t)uend1.unitigid, tmpstr);
@@ -117,24 +196,20 @@ static inline void _print_edge(hkey_t node, bool right_edge,
     if(node < next_nodes[i].key ||
        (node == next_nodes[i].key && ut_or0 + ut_or1 < 2))
     {
-      pthread_mutex_lock(&p->outlock);
-
       switch(p->syntax) {
         case PRINT_DOT:
-          fprintf(p->fout, "  node%zu:%c -> node%zu:%c\n",
+          strbuf_sprintf(sbuf, "  node%zu:%c -> node%zu:%c\n",
                   (size_t)uend0.unitigid, dot_exit[ut_or0],
                   (size_t)uend1.unitigid, dot_join[ut_or1]);
           break;
         case PRINT_GFA:
-          fprintf(p->fout, "L\tnode%zu\t%c\tnode%zu\t%c\t%zuM\n",
+          strbuf_sprintf(sbuf, "L\tnode%zu\t%c\tnode%zu\t%c\t%zuM\n",
                   (size_t)uend0.unitigid, gfa_orient[ut_or0],
                   (size_t)uend1.unitigid, gfa_orient[ut_or1],
-                  p->db_graph->kmer_size - 1);
+                  p->kmer_size - 1);
           break;
         default: die("Bad syntax: %i", p->syntax);
       }
-
-      pthread_mutex_unlock(&p->outlock);
     }
   }
 }
@@ -142,8 +217,8 @@ static inline void _print_edge(hkey_t node, bool right_edge,
 // For every kmer in the graph, we run this function
 static inline bool print_edges(hkey_t hkey, size_t threadid, void *arg)
 {
-  (void)threadid;
   UnitigPrinter *p = (UnitigPrinter*)arg;
+  StrBuf *sbuf = &p->bufs[threadid];
   UnitigEnd uend = p->ugraph.unitig_ends[hkey];
 
   // Check if node is an end of a unitig
@@ -152,32 +227,49 @@ static inline bool print_edges(hkey_t hkey, size_t threadid, void *arg)
     Edges edges = db_node_get_edges(p->db_graph, hkey, 0);
 
     if(uend.left) {
-      _print_edge(hkey, false, bkey, edges, uend, p);
+      _print_edge(hkey, false, bkey, edges, uend, p, sbuf);
     }
     if(uend.right) {
-      _print_edge(hkey, true, bkey, edges, uend, p);
+      _print_edge(hkey, true, bkey, edges, uend, p, sbuf);
     }
+    _printer_done(p, sbuf);
   }
 
   return false; // keep iterating
 }
 
 // Does not allocate ugraph
+// One of `db_graph` and `sg` should be NULL
 void unitig_printer_init(UnitigPrinter *printer, const dBGraph *db_graph,
+                         const SortedGraph *sg,
                          size_t nthreads, UnitigSyntax syntax, FILE *fout)
 {
+  size_t i, nkmers = db_graph ? db_graph->ht.capacity : sg->nkmers;
   memset(printer, 0, sizeof(UnitigPrinter));
   printer->db_graph = db_graph;
+  printer->sg = sg;
+  printer->kmer_size = db_graph ? db_graph->kmer_size : sg->kmer_size;
   printer->syntax = syntax;
   printer->fout = fout;
   printer->nthreads = nthreads;
   printer->num_unitigs = 0;
-  printer->visited = ctx_calloc(roundup_bits2bytes(db_graph->ht.capacity), 1);
+  printer->visited = ctx_calloc(roundup_bits2bytes(nkmers), 1);
+  printer->bufs = ctx_calloc(nthreads, sizeof(StrBuf));
+  for(i = 0; i < nthreads; i++) strbuf_alloc(&printer->bufs[i], 1024);
   if(pthread_mutex_init(&printer->outlock, NULL) != 0) die("Mutex init failed");
 }
 
 void unitig_printer_destroy(UnitigPrinter *printer)
 {
+  size_t i;
+  for(i = 0; i < printer->nthreads; i++) strbuf_dealloc(&printer->bufs[i]);
+  ctx_free(printer->bufs);
+  if(printer->ebufs != NULL) {
+    for(i = 0; i < printer->nthreads; i++)
+      sorted_uend_buf_dealloc(&printer->ebufs[i]);
+    ctx_free(printer->ebufs);
+  }
+  ctx_free(printer->ends);
   pthread_mutex_destroy(&printer->outlock);
   unitig_graph_dealloc(&printer->ugraph);
   ctx_free(printer->visited);
@@ -185,8 +277,8 @@ void unitig_printer_destroy(UnitigPrinter *printer)
 
 static void print_unitig_fasta(dBNodeBuffer nbuf, size_t threadid, void *arg)
 {
-  (void)threadid;
   UnitigPrinter *p = (UnitigPrinter*)arg;
+  StrBuf *sbuf = &p->bufs[threadid];
 
   // get edges as string
   char prev[5], next[5];
@@ -198,23 +290,22 @@ static void print_unitig_fasta(dBNodeBuffer nbuf, size_t threadid, void *arg)
   edges_get_str(rev_nibble_lookup(e0), prev);
   edges_get_str(en, next);
 
-  pthread_mutex_lock(&p->outlock);
-  size_t idx = p->num_unitigs++;
-  fprintf(p->fout, ">unitig%zu prev=%s next=%s\n", idx, prev, next);
-  db_nodes_print(nbuf.b, nbuf.len, p->db_graph, p->fout);
-  fputc('\n', p->fout);
-  pthread_mutex_unlock(&p->outlock);
+  size_t idx = __sync_fetch_and_add(&p->num_unitigs, 1);
+  strbuf_sprintf(sbuf, ">unitig%zu prev=%s next=%s\n", idx, prev, next);
+  graph_render_nodes(sbuf, nbuf.b, nbuf.len, p->db_graph);
+  strbuf_append_char(sbuf, '\n');
+  _printer_done(p, sbuf);
 }
 
 static void print_unitig_dot(const dBNode *nodes, size_t num_nodes,
-                             size_t unitig_idx, void *arg)
+                             size_t unitig_idx, size_t threadid, void *arg)
 {
   UnitigPrinter *p = (UnitigPrinter*)arg;
-  pthread_mutex_lock(&p->outlock);
-  fprintf(p->fout, "  node%zu [label=", unitig_idx);
-  db_nodes_print(nodes, num_nodes, p->db_graph, p->fout);
-  fputs("]\n", p->fout);
-  pthread_mutex_unlock(&p->outlock);
+  StrBuf *sbuf = &p->bufs[threadid];
+  strbuf_sprintf(sbuf, "  node%zu [label=", unitig_idx);
+  graph_render_nodes(sbuf, nodes, num_nodes, p->db_graph);
+  strbuf_append_strn(sbuf, "]\n", 2);
+  _printer_done(p, sbuf);
 }
 
 static void print_dot_syntax(UnitigPrinter *p, bool dot_use_points)
@@ -226,25 +317,27 @@ static void print_dot_syntax(UnitigPrinter *p, bool dot_use_points)
 
   unitig_graph_create(&p->ugraph, p->nthreads, p->visited,
                       print_unitig_dot, p);
+  _printer_flush_all(p);
 
   p->num_unitigs = p->ugraph.num_unitigs;
 
   // Now print edges
   fputc('\n', p->fout);
   hash_table_iterate(&p->db_graph->ht, p->nthreads, print_edges, p);
+  _printer_flush_all(p);
   fputs("}\n", p->fout);
 }
 
 
 static void print_unitig_gfa(const dBNode *nodes, size_t num_nodes,
-                             size_t unitig_idx, void *arg)
+                             size_t unitig_idx, size_t threadid, void *arg)
 {
   UnitigPrinter *p = (UnitigPrinter*)arg;
-  pthread_mutex_lock(&p->outlock);
-  fprintf(p->fout, "S\tnode%zu\t", unitig_idx);
-  db_nodes_print(nodes, num_nodes, p->db_graph, p->fout);
-  fputc('\n', p->fout);
-  pthread_mutex_unlock(&p->outlock);
+  StrBuf *sbuf = &p->bufs[threadid];
+  strbuf_sprintf(sbuf, "S\tnode%zu\t", unitig_idx);
+  graph_render_nodes(sbuf, nodes, num_nodes, p->db_graph);
+  strbuf_append_char(sbuf, '\n');
+  _printer_done(p, sbuf);
 }
 
 static void print_gfa_syntax(UnitigPrinter *p)
@@ -253,10 +346,290 @@ static void print_gfa_syntax(UnitigPrinter *p)
 
   unitig_graph_create(&p->ugraph, p->nthreads, p->visited,
                       print_unitig_gfa, p);
+  _printer_flush_all(p);
 
   p->num_unitigs = p->ugraph.num_unitigs;
   // Now print edges
   hash_table_iterate(&p->db_graph->ht, p->nthreads, print_edges, p);
+  _printer_flush_all(p);
+}
+
+static void print_ctu_file(UnitigPrinter *p, const char *out_path)
+{
+  CompactGraph cgraph;
+  compact_graph_build(&cgraph, p->nthreads, p->db_graph);
+  compact_graph_save(&cgraph, out_path, NULL, 0, p->db_graph, p->nthreads);
+  p->num_unitigs = cgraph.num_unitigs;
+  compact_graph_dealloc(&cgraph);
+}
+
+//
+// Print from a sorted graph file on disk
+//
+
+static void print_sorted_unitig_fasta(dBNodeBuffer nbuf, size_t threadid,
+                                      void *arg)
+{
+  UnitigPrinter *p = (UnitigPrinter*)arg;
+  StrBuf *sbuf = &p->bufs[threadid];
+
+  // get edges as string
+  char prev[5], next[5];
+  Edges e0 = sorted_graph_edges(p->sg, nbuf.b[0].key);
+  Edges en = sorted_graph_edges(p->sg, nbuf.b[nbuf.len-1].key);
+  e0 = edges_with_orientation(e0, !nbuf.b[0].orient);
+  en = edges_with_orientation(en, nbuf.b[nbuf.len-1].orient);
+  edges_get_str(rev_nibble_lookup(e0), prev);
+  edges_get_str(en, next);
+
+  size_t idx = __sync_fetch_and_add(&p->num_unitigs, 1);
+  strbuf_sprintf(sbuf, ">unitig%zu prev=%s next=%s\n", idx, prev, next);
+  graph_render_sorted_nodes(sbuf, nbuf.b, nbuf.len, p->sg);
+  strbuf_append_char(sbuf, '\n');
+  _printer_done(p, sbuf);
+}
+
+// Same as unitig_graph_store_end_mt(), print node and store ends of the unitig
+static void print_sorted_unitig_node(dBNodeBuffer nbuf, size_t threadid,
+                                     void *arg)
+{
+  UnitigPrinter *p = (UnitigPrinter*)arg;
+  StrBuf *sbuf = &p->bufs[threadid];
+  SortedUnitigEndBuffer *ebuf = &p->ebufs[threadid];
+  const dBNode *nodes = nbuf.b;
+  size_t n = nbuf.len;
+
+  sorted_unitig_normalise(nbuf.b, nbuf.len, p->sg);
+  size_t idx = __sync_fetch_and_add(&p->num_unitigs, 1);
+
+  UnitigEnd end0 = {.unitigid = idx, .assigned = 1,
+                    .left = 1, .right = (n == 1),
+                    .lorient = nodes[0].orient,
+                    .rorient = nodes[n-1].orient};
+
+  UnitigEnd end1 = {.unitigid = idx, .assigned = 1,
+                    .left = (n == 1), .right = 1,
+                    .lorient = nodes[0].orient,
+                    .rorient = nodes[n-1].orient};
+
+  sorted_uend_buf_add(ebuf, (SortedUnitigEnd){.key = nodes[0].key, .end = end0});
+  if(nodes[n-1].key != nodes[0].key)
+    sorted_uend_buf_add(ebuf, (SortedUnitigEnd){.key = nodes[n-1].key, .end = end1});
+
+  if(p->syntax == PRINT_DOT) {
+    strbuf_sprintf(sbuf, "  node%zu [label=", idx);
+    graph_render_sorted_nodes(sbuf, nodes, n, p->sg);
+    strbuf_append_strn(sbuf, "]\n", 2);
+  } else {
+    strbuf_sprintf(sbuf, "S\tnode%zu\t", idx);
+    graph_render_sorted_nodes(sbuf, nodes, n, p->sg);
+    strbuf_append_char(sbuf, '\n');
+  }
+  _printer_done(p, sbuf);
+}
+
+static int _sorted_uend_cmp(const void *aa, const void *bb)
+{
+  const SortedUnitigEnd *a = (const SortedUnitigEnd*)aa;
+  const SortedUnitigEnd *b = (const SortedUnitigEnd*)bb;
+  return cmp(a->key, b->key);
+}
+
+// Merge ends from each thread and sort by file index
+static void _sorted_unitig_ends_merge(UnitigPrinter *p)
+{
+  size_t i, n = 0;
+  for(i = 0; i < p->nthreads; i++) n += p->ebufs[i].len;
+  p->ends = ctx_malloc(n * sizeof(SortedUnitigEnd));
+  for(i = 0, n = 0; i < p->nthreads; i++) {
+    memcpy(p->ends + n, p->ebufs[i].b, p->ebufs[i].len * sizeof(SortedUnitigEnd));
+    n += p->ebufs[i].len;
+    sorted_uend_buf_dealloc(&p->ebufs[i]);
+  }
+  ctx_free(p->ebufs);
+  p->ebufs = NULL;
+  p->num_ends = n;
+  qsort(p->ends, n, sizeof(SortedUnitigEnd), _sorted_uend_cmp);
+}
+
+static void print_sorted_edges_thread(void *arg, size_t threadid)
+{
+  UnitigPrinter *p = (UnitigPrinter*)arg;
+  StrBuf *sbuf = &p->bufs[threadid];
+  size_t i, start, end;
+
+  start = p->num_ends * threadid / p->nthreads;
+  end = p->num_ends * (threadid+1) / p->nthreads;
+
+  for(i = start; i < end; i++) {
+    hkey_t key = p->ends[i].key;
+    UnitigEnd uend = p->ends[i].end;
+    BinaryKmer bkey = sorted_graph_bkey(p->sg, key);
+    Edges edges = sorted_graph_edges(p->sg, key);
+    if(uend.left) _print_edge(key, false, bkey, edges, uend, p, sbuf);
+    if(uend.right) _print_edge(key, true, bkey, edges, uend, p, sbuf);
+    _printer_done(p, sbuf);
+  }
+}
+
+static void print_sorted_graph(UnitigPrinter *p, bool dot_use_points)
+{
+  size_t i;
+
+  if(p->syntax == PRINT_FASTA) {
+    sorted_unitigs_iterate(p->nthreads, p->visited, p->sg,
+                           print_sorted_unitig_fasta, p);
+    _printer_flush_all(p);
+    return;
+  }
+
+  if(p->syntax == PRINT_GFA) {
+    fputs("H\tVN:Z:1.0\n", p->fout);
+  } else {
+    fputs("digraph G {\n", p->fout);
+    fputs("  edge [dir=both arrowhead=none arrowtail=none color=\"blue\"]\n", p->fout);
+    fprintf(p->fout, "  node [%s, fontname=courier, fontsize=9]\n",
+            dot_use_points ? "shape=point, label=none" : "shape=none");
+  }
+
+  p->ebufs = ctx_calloc(p->nthreads, sizeof(SortedUnitigEndBuffer));
+  for(i = 0; i < p->nthreads; i++) sorted_uend_buf_alloc(&p->ebufs[i], 1024);
+
+  sorted_unitigs_iterate(p->nthreads, p->visited, p->sg,
+                         print_sorted_unitig_node, p);
+  _printer_flush_all(p);
+  _sorted_unitig_ends_merge(p);
+
+  // Now print edges
+  if(p->syntax == PRINT_DOT) fputc('\n', p->fout);
+  util_multi_thread(p, p->nthreads, print_sorted_edges_thread);
+  _printer_flush_all(p);
+  if(p->syntax == PRINT_DOT) fputs("}\n", p->fout);
+}
+
+static void ctx_unitigs_disk(const char *path, UnitigSyntax syntax,
+                             bool dot_use_points, size_t nthreads,
+                             const char *out_path)
+{
+  GraphFileReader gfile;
+  memset(&gfile, 0, sizeof(gfile));
+  graph_file_open(&gfile, path);
+
+  if(gfile.num_of_kmers < 0)
+    cmd_print_usage("--disk cannot read a graph from a stream");
+
+  size_t nkmers = graph_file_nkmers(&gfile), kmer_size = gfile.hdr.kmer_size;
+  char nkmers_str[50], mem_str[50];
+  ulong_to_str(nkmers, nkmers_str);
+  bytes_to_str(sorted_graph_mem(nkmers, kmer_size) +
+               roundup_bits2bytes(nkmers), 1, mem_str);
+  status("[unitigs] Reading %s kmers from disk using %s", nkmers_str, mem_str);
+
+  SortedGraph sg;
+  sorted_graph_open(&sg, &gfile);
+
+  status("Output in %s format to %s\n", syntax_strs[syntax],
+         futil_outpath_str(out_path));
+
+  FILE *fout = futil_fopen_create(out_path, "w");
+
+  UnitigPrinter printer;
+  unitig_printer_init(&printer, NULL, &sg, nthreads, syntax, fout);
+  print_sorted_graph(&printer, dot_use_points);
+
+  char num_unitigs_str[50];
+  ulong_to_str(printer.num_unitigs, num_unitigs_str);
+  status("Dumped %s unitigs\n", num_unitigs_str);
+
+  fclose(fout);
+  unitig_printer_destroy(&printer);
+  sorted_graph_close(&sg);
+  graph_file_close(&gfile);
+}
+
+//
+// Print from a compacted graph (.ctu)
+//
+
+// Get nucleotides we can add after leaving through end `e`
+static Edges _cg_next_nucs(const CompactGraph *cg, uint64_t e)
+{
+  const uint64_t *links = compact_graph_links(cg, e);
+  size_t i, n = compact_graph_nlinks(cg, e);
+  Edges edges = 0;
+  for(i = 0; i < n; i++) edges |= 1 << compact_graph_entry_nuc(cg, links[i]);
+  return edges;
+}
+
+static void print_compact_graph(const CompactGraph *cg, UnitigSyntax syntax,
+                                bool dot_use_points, FILE *fout)
+{
+  const char dot_exit[2] = "we", dot_join[2] = "we", gfa_orient[2] = "-+";
+  char prev[5], next[5];
+  size_t u, i, n;
+  uint64_t e, f;
+  const uint64_t *links;
+
+  switch(syntax) {
+    case PRINT_GFA: fputs("H\tVN:Z:1.0\n", fout); break;
+    case PRINT_DOT:
+      fputs("digraph G {\n", fout);
+      fputs("  edge [dir=both arrowhead=none arrowtail=none color=\"blue\"]\n", fout);
+      fprintf(fout, "  node [%s, fontname=courier, fontsize=9]\n",
+              dot_use_points ? "shape=point, label=none" : "shape=none");
+      break;
+    default: break;
+  }
+
+  for(u = 0; u < cg->num_unitigs; u++) {
+    switch(syntax) {
+      case PRINT_FASTA:
+        // prev edges are on the reverse strand
+        edges_get_str(rev_nibble_lookup(_cg_next_nucs(cg, 2*u)), prev);
+        edges_get_str(_cg_next_nucs(cg, 2*u+1), next);
+        fprintf(fout, ">unitig%zu prev=%s next=%s\n", u, prev, next);
+        binary_seq_print(compact_graph_seq(cg,u), compact_graph_nbases(cg,u), fout);
+        fputc('\n', fout);
+        break;
+      case PRINT_GFA:
+        fprintf(fout, "S\tnode%zu\t", u);
+        binary_seq_print(compact_graph_seq(cg,u), compact_graph_nbases(cg,u), fout);
+        fputs("\t"CTU_GFA_COVG_TAG, fout);
+        for(i = 0; i < cg->num_of_cols; i++)
+          fprintf(fout, ",%u", compact_graph_covg(cg, u, i));
+        fputc('\n', fout);
+        break;
+      case PRINT_DOT:
+        fprintf(fout, "  node%zu [label=", u);
+        binary_seq_print(compact_graph_seq(cg,u), compact_graph_nbases(cg,u), fout);
+        fputs("]\n", fout);
+        break;
+      default: die("Bad syntax: %i", syntax);
+    }
+  }
+
+  if(syntax == PRINT_FASTA) return;
+  if(syntax == PRINT_DOT) fputc('\n', fout);
+
+  // Print each link once: leaving through end e, entering through end f
+  for(e = 0; e < 2*cg->num_unitigs; e++) {
+    links = compact_graph_links(cg, e);
+    n = compact_graph_nlinks(cg, e);
+    for(i = 0; i < n; i++) {
+      f = links[i];
+      if(e > f) continue;
+      if(syntax == PRINT_DOT) {
+        fprintf(fout, "  node%zu:%c -> node%zu:%c\n",
+                (size_t)e/2, dot_exit[e&1], (size_t)f/2, dot_join[f&1]);
+      } else {
+        fprintf(fout, "L\tnode%zu\t%c\tnode%zu\t%c\t%zuM\n",
+                (size_t)e/2, gfa_orient[e&1], (size_t)f/2, gfa_orient[!(f&1)],
+                cg->kmer_size - 1);
+      }
+    }
+  }
+
+  if(syntax == PRINT_DOT) fputs("}\n", fout);
 }
 
 // Returns 0 on success, otherwise != 0
@@ -266,7 +639,7 @@ int ctx_unitigs(int argc, char **argv)
   struct MemArgs memargs = MEM_ARGS_INIT;
   const char *out_path = NULL;
   UnitigSyntax syntax = PRINT_FASTA;
-  bool dot_use_points = false;
+  bool dot_use_points = false, disk = false;
 
   // Arg parsing
   char cmd[100];
@@ -291,6 +664,8 @@ int ctx_unitigs(int argc, char **argv)
       case 'g': cmd_check(!syntax, cmd); syntax = PRINT_GFA; break;
       case 'd': cmd_check(!syntax, cmd); syntax = PRINT_DOT; break;
       case 'P': cmd_check(!dot_use_points, cmd); dot_use_points = true; break;
+      case 'u': cmd_check(!syntax, cmd); syntax = PRINT_CTU; break;
+      case 'D': cmd_check(!disk, cmd); disk = true; break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         die("`"CMD" unitigs -h` for help. Bad option: %s", argv[optind-1]);
@@ -315,12 +690,72 @@ int ctx_unitigs(int argc, char **argv)
 
   ctx_assert(num_gfiles > 0);
 
+  if(syntax == PRINT_CTU && strcmp(out_path, "-") == 0)
+    cmd_print_usage("--ctu requires --out <out.ctu>");
+
+  //
+  // Print from a compacted graph or GFA
+  //
+  bool is_ctu = futil_path_has_extension(gfile_paths[0], ".ctu");
+  bool is_gfa = futil_path_has_extension(gfile_paths[0], ".gfa") ||
+                futil_path_has_extension(gfile_paths[0], ".gfa.gz");
+
+  if(is_ctu || is_gfa)
+  {
+    if(num_gfiles > 1) cmd_print_usage("Only one .ctu or .gfa file can be loaded");
+    if(disk) cmd_print_usage("--disk reads a sorted graph file (.ctx)");
+    if(cmd_mem_get_plan()) cmd_print_usage(".ctu and .gfa input do not support --plan");
+    if(is_ctu && syntax == PRINT_CTU) cmd_print_usage("Input is already a .ctu file");
+
+    status("Output in %s format to %s\n", syntax_strs[syntax],
+           futil_outpath_str(out_path));
+
+    CompactGraph cgraph;
+    if(is_ctu) compact_graph_mmap(&cgraph, gfile_paths[0]);
+    else compact_graph_load_gfa(&cgraph, gfile_paths[0]);
+
+    if(syntax == PRINT_CTU) {
+      // Graph is only used for the file header
+      dBGraph db_graph;
+      db_graph_alloc(&db_graph, cgraph.kmer_size, cgraph.num_of_cols, 1, 1024, 0);
+      futil_create_output(out_path);
+      compact_graph_save(&cgraph, out_path, NULL, 0, &db_graph, nthreads);
+      db_graph_dealloc(&db_graph);
+    } else {
+      FILE *fout = futil_fopen_create(out_path, "w");
+      print_compact_graph(&cgraph, syntax, dot_use_points, fout);
+      fclose(fout);
+    }
+
+    char num_unitigs_str[50];
+    ulong_to_str(cgraph.num_unitigs, num_unitigs_str);
+    status("Dumped %s unitigs\n", num_unitigs_str);
+
+    compact_graph_dealloc(&cgraph);
+    return EXIT_SUCCESS;
+  }
+
+  //
+  // Print from a sorted graph on disk
+  //
+  if(disk)
+  {
+    if(num_gfiles > 1) cmd_print_usage("--disk takes one sorted graph file");
+    if(syntax == PRINT_CTU) cmd_print_usage("--disk cannot save a .ctu file");
+    if(cmd_mem_get_plan()) cmd_print_usage("--disk does not support --plan");
+    ctx_unitigs_disk(gfile_paths[0], syntax, dot_use_points, nthreads, out_path);
+    return EXIT_SUCCESS;
+  }
+
   // Open graph files
   GraphFileReader *gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
   size_t ctx_max_kmers = 0, ctx_sum_kmers = 0;
 
-  graph_files_open(gfile_paths, gfiles, num_gfiles,
-                   &ctx_max_kmers, &ctx_sum_kmers);
+  size_t ncols = graph_files_open(gfile_paths, gfiles, num_gfiles,
+                                  &ctx_max_kmers, &ctx_sum_kmers);
+
+  // Only keep colours if saving coverage to a .ctu file
+  if(syntax != PRINT_CTU) ncols = 1;
 
   //
   // Decide on memory
@@ -329,6 +764,7 @@ int ctx_unitigs(int argc, char **argv)
 
   bits_per_kmer = sizeof(BinaryKmer)*8 + sizeof(Edges)*8 + 1;
   if(syntax != PRINT_FASTA) bits_per_kmer += sizeof(UnitigEnd) * 8;
+  if(syntax == PRINT_CTU) bits_per_kmer += sizeof(Covg) * 8 * ncols;
 
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
@@ -348,17 +784,19 @@ int ctx_unitigs(int argc, char **argv)
   //
 
   // Print to stdout unless --out <out> is specified
-  FILE *fout = futil_fopen_create(out_path, "w");
+  FILE *fout = NULL;
+  if(syntax == PRINT_CTU) futil_create_output(out_path);
+  else fout = futil_fopen_create(out_path, "w");
 
   //
   // Allocate memory
   //
   dBGraph db_graph;
-  db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, 1, 1, kmers_in_hash,
-                 DBG_ALLOC_EDGES);
+  db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, ncols, 1, kmers_in_hash,
+                 DBG_ALLOC_EDGES | (syntax == PRINT_CTU ? DBG_ALLOC_COVGS : 0));
 
   UnitigPrinter printer;
-  unitig_printer_init(&printer, &db_graph, nthreads, syntax, fout);
+  unitig_printer_init(&printer, &db_graph, NULL, nthreads, syntax, fout);
 
   if(syntax == PRINT_DOT || syntax == PRINT_GFA)
     unitig_graph_alloc(&printer.ugraph, &db_graph);
@@ -367,7 +805,7 @@ int ctx_unitigs(int argc, char **argv)
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
 
   for(i = 0; i < num_gfiles; i++) {
-    file_filter_flatten(&gfiles[i].fltr, 0);
+    if(syntax != PRINT_CTU) file_filter_flatten(&gfiles[i].fltr, 0);
     graph_load(&gfiles[i], gprefs, NULL);
     graph_file_close(&gfiles[i]);
   }
@@ -381,6 +819,7 @@ int ctx_unitigs(int argc, char **argv)
       status("Printing unitgs in FASTA using %zu threads", nthreads);
       db_unitigs_iterate(nthreads, printer.visited, &db_graph,
                          print_unitig_fasta, &printer);
+      _printer_flush_all(&printer);
       break;
     case PRINT_GFA:
       print_gfa_syntax(&printer);
@@ -388,6 +827,9 @@ int ctx_unitigs(int argc, char **argv)
     case PRINT_DOT:
       print_dot_syntax(&printer, dot_use_points);
       break;
+    case PRINT_CTU:
+      print_ctu_file(&printer, out_path);
+      break;
     default:
       die("Invalid print syntax: %i", syntax);
   }
@@ -396,7 +838,7 @@ int ctx_unitigs(int argc, char **argv)
   ulong_to_str(printer.num_unitigs, num_unitigs_str);
   status("Dumped %s unitigs\n", num_unitigs_str);
 
-  fclose(fout);
+  if(fout != NULL) fclose(fout);
 
   unitig_printer_destroy(&printer);
   db_graph_dealloc(&db_graph);
@@ -10,6 +10,7 @@
 #include "graph_info.h"
 #include "graphs_load.h"
 #include "hash_mem.h" // for calculating mem usage
+#include "graph_render.h"
 
 #define SUBCMD "view"
 
@@ -24,12 +25,16 @@ const char view_usage[] =
 "  -k, --kmers  Print kmers\n"
 "  -c, --check  Check kmers\n"
 "  -i, --info   Print info\n"
+"  -t, --threads <T>  Threads to read kmers with [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 // "\n"
 // "  -r, --readlen  Print mean read length\n"
 // "  -b, --nbases   Print number of bases read\n"
 // "  -n, --nkmers   Print number of kmers\n"
 "\n"
 " Default is [--info --check]\n"
+"\n"
+" When reading from a file (not STDIN), threads read and format separate\n"
+" blocks of kmers; output is the same as with one thread.\n"
 "\n";
 
 int print_info = 0, parse_kmers = 0, print_kmers = 0;
@@ -40,6 +45,7 @@ static struct option longopts[] =
   {"kmers", no_argument, &print_kmers,  1},
   {"check", no_argument, &parse_kmers,  1},
   {"info",  no_argument, &print_info,   1},
+  {"threads", required_argument, NULL, 't'},
   // {"help",    no_argument, NULL, 'h'},
   // {"kmers",   no_argument, NULL, 'k'},
   // {"check",   no_argument, NULL, 'c'},
@@ -107,6 +113,244 @@ static void print_header(GraphFileHeader *h, size_t num_of_kmers)
 #define loading_warning(fmt,...) { num_warnings++; warn(fmt, ##__VA_ARGS__);}
 #define loading_error(fmt,...) { num_errors++; warn(fmt, ##__VA_ARGS__);}
 
+typedef struct
+{
+  uint64_t nkmers_read, nkmers_loaded;
+  uint64_t num_all_zero_kmers, num_zero_covg_kmers;
+  uint64_t *col_nkmers, *col_sum_covgs;
+} ViewStats;
+
+static void view_stats_alloc(ViewStats *stats, size_t ncols)
+{
+  memset(stats, 0, sizeof(ViewStats));
+  stats->col_nkmers = ctx_calloc(ncols, sizeof(stats->col_nkmers[0]));
+  stats->col_sum_covgs = ctx_calloc(ncols, sizeof(stats->col_sum_covgs[0]));
+}
+
+static void view_stats_dealloc(ViewStats *stats)
+{
+  ctx_free(stats->col_nkmers);
+  ctx_free(stats->col_sum_covgs);
+}
+
+static void view_stats_merge(ViewStats *dst, const ViewStats *src, size_t ncols)
+{
+  size_t col;
+  dst->nkmers_read += src->nkmers_read;
+  dst->nkmers_loaded += src->nkmers_loaded;
+  dst->num_all_zero_kmers += src->num_all_zero_kmers;
+  dst->num_zero_covg_kmers += src->num_zero_covg_kmers;
+  for(col = 0; col < ncols; col++) {
+    dst->col_nkmers[col] += src->col_nkmers[col];
+    dst->col_sum_covgs[col] += src->col_sum_covgs[col];
+  }
+}
+
+// Update stats with a kmer that has been read
+// Returns true if the kmer would be loaded (and should be printed)
+static inline bool view_stats_add(ViewStats *stats, BinaryKmer bkmer,
+                                  const Covg *covgs, size_t ncols,
+                                  bool direct_read)
+{
+  size_t i, col;
+  Covg keep_kmer = 0;
+
+  stats->nkmers_read++;
+
+  // If kmer has no covg in any samples -> don't load
+  for(col = 0; col < ncols; col++) {
+    stats->col_nkmers[col] += (covgs[col] > 0);
+    stats->col_sum_covgs[col] += covgs[col];
+    keep_kmer |= covgs[col];
+  }
+
+  if(!direct_read && !keep_kmer) return false;
+  stats->nkmers_loaded++;
+
+  /* Kmer Checks */
+  // graph_file_read_reset() already checks for:
+  // 1. oversized kmers
+  // 2. kmers with covg 0 in all colours
+  // 3. edges without coverage in a colour
+
+  // Check for all-zeros (i.e. all As kmer: AAAAAA)
+  uint64_t kmer_words_or = 0;
+  for(i = 0; i < NUM_BKMER_WORDS; i++) kmer_words_or |= bkmer.b[i];
+  stats->num_all_zero_kmers += (kmer_words_or == 0);
+
+  // Check covg is 0 for all colours
+  for(i = 0; i < ncols && covgs[i] == 0; i++);
+  stats->num_zero_covg_kmers += (i == ncols);
+
+  return true;
+}
+
+//
+// Read kmers with multiple threads
+// Each thread reads a block of kmers from the file with pread(), formats them
+// and writes them out in order with a ChunkWriter
+//
+
+#define VIEW_BLOCK_KMERS 16384
+
+typedef struct
+{
+  GraphFileReader *gfile;
+  int fd;
+  size_t ncols;
+  bool direct_read, print_kmers;
+  uint64_t nkmers, nblocks;
+  volatile uint64_t next_block;
+  volatile bool error_zero_covg, error_missing_covg;
+  ChunkWriter writer;
+  ViewStats *stats; // one per thread
+} ViewReader;
+
+static void _view_pread(const ViewReader *rdr, void *buf, size_t len,
+                        off_t offset)
+{
+  const char *path = file_filter_path(&rdr->gfile->fltr);
+  char *ptr = (char*)buf;
+  ssize_t n;
+
+  while(len > 0) {
+    n = pread(rdr->fd, ptr, len, offset);
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0) die("Cannot read file [%s]: %s", path, strerror(errno));
+    if(n == 0) die("Unexpected end of file: %s", path);
+    ptr += n; len -= (size_t)n; offset += n;
+  }
+}
+
+// Same checks as graph_file_read_raw()
+static inline void _view_check_kmer(ViewReader *rdr, BinaryKmer bkmer,
+                                    const Covg *covgs, const Edges *edges)
+{
+  const GraphFileHeader *h = &rdr->gfile->hdr;
+  const char *path = file_filter_path(&rdr->gfile->fltr);
+  char kstr[MAX_KMER_SIZE+1];
+  size_t i;
+
+  if(binary_kmer_oversized(bkmer, h->kmer_size))
+    die("Oversized kmer in path [kmer: %u]: %s", h->kmer_size, path);
+
+  for(i = 0; i < h->num_of_cols && covgs[i] == 0; i++) {}
+  if(i == h->num_of_cols && !rdr->error_zero_covg &&
+     __sync_bool_compare_and_swap(&rdr->error_zero_covg, false, true)) {
+    binary_kmer_to_str(bkmer, h->kmer_size, kstr);
+    warn("Kmer has zero covg in all colours [kmer: %s; path: %s]", kstr, path);
+  }
+
+  for(i = 0; i < h->num_of_cols && (!edges[i] || covgs[i]); i++) {}
+  if(i < h->num_of_cols && !rdr->error_missing_covg &&
+     __sync_bool_compare_and_swap(&rdr->error_missing_covg, false, true)) {
+    binary_kmer_to_str(bkmer, h->kmer_size, kstr);
+    warn("Kmer has edges but no coverage [kmer: %s; path: %s]", kstr, path);
+  }
+}
+
+static void view_reader_thread(void *arg, size_t threadid)
+{
+  ViewReader *rdr = (ViewReader*)arg;
+  const GraphFileReader *gfile = rdr->gfile;
+  const FileFilter *fltr = &gfile->fltr;
+  ViewStats *stats = &rdr->stats[threadid];
+  size_t i, srcncols = gfile->hdr.num_of_cols, ncols = rdr->ncols;
+  size_t kmer_size = gfile->hdr.kmer_size;
+  size_t from, into, recsize = graph_file_offset(gfile, 1) - gfile->hdr_size;
+  uint64_t b, k, start, n;
+
+  BinaryKmer bkmer;
+  Covg srccovgs[srcncols], covgs[ncols];
+  Edges srcedges[srcncols], edges[ncols];
+  uint8_t *buf = ctx_malloc(VIEW_BLOCK_KMERS * recsize), *ptr;
+  StrBuf sbuf;
+  strbuf_alloc(&sbuf, ONE_MEGABYTE);
+
+  while((b = __sync_fetch_and_add(&rdr->next_block, 1)) < rdr->nblocks)
+  {
+    start = b * VIEW_BLOCK_KMERS;
+    n = MIN2(VIEW_BLOCK_KMERS, rdr->nkmers - start);
+    _view_pread(rdr, buf, n * recsize, graph_file_offset(gfile, start));
+    strbuf_reset(&sbuf);
+
+    for(k = 0, ptr = buf; k < n; k++)
+    {
+      memcpy(bkmer.b, ptr, sizeof(BinaryKmer));
+      ptr += sizeof(BinaryKmer);
+      memcpy(srccovgs, ptr, srcncols * sizeof(Covg));
+      ptr += srcncols * sizeof(Covg);
+      memcpy(srcedges, ptr, srcncols * sizeof(Edges));
+      ptr += srcncols * sizeof(Edges);
+
+      _view_check_kmer(rdr, bkmer, srccovgs, srcedges);
+
+      // Apply filter as in graph_file_read()
+      memset(covgs, 0, ncols * sizeof(Covg));
+      memset(edges, 0, ncols * sizeof(Edges));
+      for(i = 0; i < file_filter_num(fltr); i++) {
+        from = file_filter_fromcol(fltr, i);
+        into = file_filter_intocol(fltr, i);
+        covgs[into] = SAFE_ADD_COVG(covgs[into], srccovgs[from]);
+        edges[into] |= srcedges[from];
+      }
+
+      if(view_stats_add(stats, bkmer, covgs, ncols, rdr->direct_read) &&
+         rdr->print_kmers) {
+        graph_render_kmer(&sbuf, bkmer, covgs, edges, ncols, kmer_size);
+      }
+    }
+
+    if(rdr->print_kmers) chunk_writer_write(&rdr->writer, b, sbuf.b, sbuf.end);
+  }
+
+  strbuf_dealloc(&sbuf);
+  ctx_free(buf);
+}
+
+// Read all kmers in the file, merging stats into `stats`
+static void view_read_kmers_mt(GraphFileReader *gfile, size_t ncols,
+                               bool print, size_t nthreads,
+                               ViewStats *stats)
+{
+  size_t i;
+  ViewReader rdr;
+  memset(&rdr, 0, sizeof(rdr));
+  rdr.gfile = gfile;
+  rdr.fd = fileno(gfile->fh);
+  rdr.ncols = ncols;
+  rdr.direct_read = file_filter_direct(&gfile->fltr);
+  rdr.print_kmers = print;
+  rdr.nkmers = graph_file_nkmers(gfile);
+  rdr.nblocks = (rdr.nkmers + VIEW_BLOCK_KMERS - 1) / VIEW_BLOCK_KMERS;
+  rdr.next_block = 0;
+  rdr.stats = ctx_calloc(nthreads, sizeof(ViewStats));
+  for(i = 0; i < nthreads; i++) view_stats_alloc(&rdr.stats[i], ncols);
+
+  fflush(stdout);
+  chunk_writer_alloc(&rdr.writer, stdout);
+  util_multi_thread(&rdr, nthreads, view_reader_thread);
+  chunk_writer_dealloc(&rdr.writer);
+
+  for(i = 0; i < nthreads; i++) {
+    view_stats_merge(stats, &rdr.stats[i], ncols);
+    view_stats_dealloc(&rdr.stats[i]);
+  }
+  ctx_free(rdr.stats);
+
+  gfile->error_zero_covg = rdr.error_zero_covg;
+  gfile->error_missing_covg = rdr.error_missing_covg;
+}
+
+// Blocks are read with pread(), which needs a regular file. stat() gives a
+// size for pipes and process substitution (<(...)) too, so check the fd.
+static bool view_can_pread(GraphFileReader *gfile)
+{
+  struct stat st;
+  return gfile->file_size != -1 &&
+         fstat(fileno(gfile->fh), &st) == 0 && S_ISREG(st.st_mode);
+}
+
 // Print tab separated cer colour
 // summary => human readable
 typedef enum _print_action {
@@ -120,6 +364,7 @@ int ctx_view(int argc, char **argv)
   char shortopts[300];
   cmd_long_opts_to_short(longopts, shortopts, sizeof(shortopts));
   int c;
+  size_t nthreads = 0;
 
   // TODO:
   // print_action actions[argc];
@@ -133,6 +378,7 @@ int ctx_view(int argc, char **argv)
     switch(c) {
       case 0: /* flag set */ break;
       case 'h': cmd_print_usage(NULL); break;
+      case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -143,6 +389,7 @@ int ctx_view(int argc, char **argv)
   }
 
   if(print_kmers) parse_kmers = 1;
+  if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
 
   bool no_flags = (!print_info && !parse_kmers && !print_kmers);
   if(no_flags) { print_info = parse_kmers = 1; }
@@ -166,7 +413,7 @@ int ctx_view(int argc, char **argv)
     printf("----\n");
   }
 
-  size_t i, col, ncols = file_filter_into_ncols(&gfile.fltr);
+  size_t col, ncols = file_filter_into_ncols(&gfile.fltr);
   size_t kmer_size = gfile.hdr.kmer_size;
   ctx_assert(ncols > 0);
 
@@ -174,17 +421,14 @@ int ctx_view(int argc, char **argv)
   memset(&hdr, 0, sizeof(hdr));
   graph_file_merge_header(&hdr, &gfile);
 
-  uint64_t nkmers_read = 0, nkmers_loaded = 0;
-  uint64_t num_all_zero_kmers = 0, num_zero_covg_kmers = 0;
-  uint64_t *col_nkmers, *col_sum_covgs;
-  col_nkmers = ctx_calloc(ncols, sizeof(col_nkmers[0]));
-  col_sum_covgs = ctx_calloc(ncols, sizeof(col_sum_covgs[0]));
+  ViewStats stats;
+  view_stats_alloc(&stats, ncols);
 
   // Print header
   if(print_info) print_header(&hdr, gfile.num_of_kmers);
 
   BinaryKmer bkmer;
-  Covg covgs[ncols], keep_kmer;
+  Covg covgs[ncols];
   Edges edges[ncols];
 
   bool direct_read = file_filter_direct(&gfile.fltr);
@@ -193,49 +437,32 @@ int ctx_view(int argc, char **argv)
   {
     if(print_info && print_kmers) printf("----\n");
 
-    for(; graph_file_read_reset(&gfile, &bkmer, covgs, edges); nkmers_read++)
+    // Can only read blocks of kmers in parallel from a regular file
+    if(nthreads > 1 && view_can_pread(&gfile))
     {
-      // If kmer has no covg in any samples -> don't load
-      keep_kmer = 0;
-      for(col = 0; col < ncols; col++) {
-        col_nkmers[col] += (covgs[col] > 0);
-        col_sum_covgs[col] += covgs[col];
-        keep_kmer |= covgs[col];
-      }
-
-      if(!direct_read && !keep_kmer) continue;
-      nkmers_loaded++;
-
-      /* Kmer Checks */
-      // graph_file_read_reset() already checks for:
-      // 1. oversized kmers
-      // 2. kmers with covg 0 in all colours
-      // 3. edges without coverage in a colour
-
-      // Check for all-zeros (i.e. all As kmer: AAAAAA)
-      uint64_t kmer_words_or = 0;
+      view_read_kmers_mt(&gfile, ncols, print_kmers, nthreads, &stats);
+      if(stats.num_all_zero_kmers > 1)
+        loading_error("more than one all 'A's kmers seen\n");
+    }
+    else
+    {
+      while(graph_file_read_reset(&gfile, &bkmer, covgs, edges))
+      {
+        uint64_t num_all_zero_kmers = stats.num_all_zero_kmers;
 
-      for(i = 0; i < hdr.num_of_bitfields; i++)
-        kmer_words_or |= bkmer.b[i];
+        if(!view_stats_add(&stats, bkmer, covgs, ncols, direct_read))
+          continue;
 
-      if(kmer_words_or == 0)
-      {
-        if(num_all_zero_kmers == 1)
+        if(num_all_zero_kmers == 1 && stats.num_all_zero_kmers == 2)
         {
           loading_error("more than one all 'A's kmers seen [index: %"PRIu64"]\n",
-                        nkmers_read);
+                        stats.nkmers_read-1);
         }
 
-        num_all_zero_kmers++;
+        // Print
+        if(print_kmers)
+          db_graph_print_kmer2(bkmer, covgs, edges, ncols, kmer_size, stdout);
       }
-
-      // Check covg is 0 for all colours
-      for(i = 0; i < ncols && covgs[i] == 0; i++);
-      num_zero_covg_kmers += (i == ncols);
-
-      // Print
-      if(print_kmers)
-        db_graph_print_kmer2(bkmer, covgs, edges, ncols, kmer_size, stdout);
     }
   }
 
@@ -253,21 +480,21 @@ int ctx_view(int argc, char **argv)
   {
     // file_size is set to -1 if we are reading from a stream,
     // therefore won't be able to check number of kmers read
-    if(gfile.file_size != -1 && nkmers_read != (uint64_t)gfile.num_of_kmers) {
+    if(gfile.file_size != -1 && stats.nkmers_read != (uint64_t)gfile.num_of_kmers) {
       loading_warning("Expected %zu kmers, read %zu\n",
-                      (size_t)gfile.num_of_kmers, (size_t)nkmers_read);
+                      (size_t)gfile.num_of_kmers, (size_t)stats.nkmers_read);
     }
 
-    if(num_all_zero_kmers > 1)
+    if(stats.num_all_zero_kmers > 1)
     {
       loading_error("%s all-zero-kmers seen\n",
-                    ulong_to_str(num_all_zero_kmers, nstr));
+                    ulong_to_str(stats.num_all_zero_kmers, nstr));
     }
 
-    if(num_zero_covg_kmers > 0)
+    if(stats.num_zero_covg_kmers > 0)
     {
       loading_warning("%s kmers have no coverage in any colour\n",
-                      ulong_to_str(num_zero_covg_kmers, nstr));
+                      ulong_to_str(stats.num_zero_covg_kmers, nstr));
     }
   }
 
@@ -282,25 +509,25 @@ int ctx_view(int argc, char **argv)
     printf("\n---- Per colour stats\n");
     printf("num. kmers:");
     for(col = 0; col < ncols; col++)
-      printf("\t%s", ulong_to_str(col_nkmers[col], nstr));
+      printf("\t%s", ulong_to_str(stats.col_nkmers[col], nstr));
     printf("\n");
     printf("sum coverage:");
     for(col = 0; col < ncols; col++)
-      printf("\t%s", ulong_to_str(col_sum_covgs[col], nstr));
+      printf("\t%s", ulong_to_str(stats.col_sum_covgs[col], nstr));
     printf("\n");
     printf("kmer coverage:");
     for(col = 0; col < ncols; col++)
-      printf("\t%.2f", safe_frac(col_sum_covgs[col], col_nkmers[col]));
+      printf("\t%.2f", safe_frac(stats.col_sum_covgs[col], stats.col_nkmers[col]));
     printf("\n");
 
     // Overall stats
     uint64_t sum_covgs = 0;
     double mean_kmer_covg = 0.0;
-    for(col = 0; col < ncols; col++) sum_covgs += col_sum_covgs[col];
-    mean_kmer_covg = nkmers_loaded ? (double)sum_covgs / nkmers_loaded : 0.0;
+    for(col = 0; col < ncols; col++) sum_covgs += stats.col_sum_covgs[col];
+    mean_kmer_covg = stats.nkmers_loaded ? (double)sum_covgs / stats.nkmers_loaded : 0.0;
 
     printf("\n---- Overall stats\n");
-    printf("Total kmers:    %s\n", ulong_to_str(nkmers_loaded, nstr));
+    printf("Total kmers:    %s\n", ulong_to_str(stats.nkmers_loaded, nstr));
     printf("Total coverage: %s\n", ulong_to_str(sum_covgs, nstr));
     printf("Mean coverage:  %s\n", double_to_str(mean_kmer_covg, 2, nstr));
   }
@@ -343,8 +570,7 @@ int ctx_view(int argc, char **argv)
       printf(num_warnings ? "Graph may be ok\n" : "Graph is valid\n");
   }
 
-  ctx_free(col_nkmers);
-  ctx_free(col_sum_covgs);
+  view_stats_dealloc(&stats);
 
   // Close file (which zeros it)
   graph_file_close(&gfile);
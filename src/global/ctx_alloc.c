@@ -2,8 +2,49 @@
 #include "ctx_alloc.h"
 #include "util.h"
 
+const char *alloc_tag_names[ALLOC_NUM_TAGS] = {"other", "hash_table", "colours",
+                                               "links", "walkers", "io_buffers"};
+
 static volatile size_t ctx_num_allocs = 0, ctx_num_frees = 0;
 
+// Current and peak bytes for each tag, last entry is the total over all tags
+static volatile size_t alloc_cur[ALLOC_NUM_TAGS+1] = {0};
+static volatile size_t alloc_peak[ALLOC_NUM_TAGS+1] = {0};
+
+// Header before each allocation: [size][tag]
+// 16 bytes keeps the memory we return 16 byte aligned, same as malloc
+#define ALLOC_HDR_BYTES 16
+
+typedef struct
+{
+  size_t size, tag;
+} AllocHeader;
+
+static inline AllocHeader* _alloc_hdr(void *ptr)
+{
+  return (AllocHeader*)((char*)ptr - ALLOC_HDR_BYTES);
+}
+
+static inline void _update_peak(volatile size_t *peak, size_t val)
+{
+  size_t p = *peak;
+  while(val > p && !__sync_bool_compare_and_swap(peak, p, val)) p = *peak;
+}
+
+static inline void _alloc_add(size_t tag, size_t bytes)
+{
+  size_t cur = __sync_add_and_fetch(&alloc_cur[tag], bytes);
+  size_t tot = __sync_add_and_fetch(&alloc_cur[ALLOC_NUM_TAGS], bytes);
+  _update_peak(&alloc_peak[tag], cur);
+  _update_peak(&alloc_peak[ALLOC_NUM_TAGS], tot);
+}
+
+static inline void _alloc_sub(size_t tag, size_t bytes)
+{
+  __sync_sub_and_fetch(&alloc_cur[tag], bytes);
+  __sync_sub_and_fetch(&alloc_cur[ALLOC_NUM_TAGS], bytes);
+}
+
 static inline void _oom(void *ptr, size_t nel, size_t elsize,
                         const char *file, const char *func, int line)
 __attribute__((noreturn));
@@ -21,30 +62,47 @@ static inline void _oom(void *ptr, size_t nel, size_t elsize,
 
 // If `zero` is true and ptr is NULL call calloc, otherwise realloc
 // Prints error message and calls exit() if out of memory / cannot alloc
-void* alloc_mem(void *ptr, size_t nel, size_t elsize, bool zero,
+void* alloc_mem(void *ptr, size_t nel, size_t elsize, bool zero, AllocTag tag,
                 const char *file, const char *func, int line)
 {
-  void *ptr2;
-  if(nel && elsize && SIZE_MAX / elsize < nel)
+  char *base;
+  size_t bytes, oldsize = 0;
+
+  if(nel && elsize && (SIZE_MAX - ALLOC_HDR_BYTES) / elsize < nel)
     _oom(ptr, nel, elsize, file, func, line);
 
-  if(ptr || !zero)
-    ptr2 = realloc(ptr, nel*elsize);
+  bytes = nel * elsize;
+
+  if(ptr) {
+    // Keep original tag
+    oldsize = _alloc_hdr(ptr)->size;
+    tag = _alloc_hdr(ptr)->tag;
+    base = realloc(_alloc_hdr(ptr), ALLOC_HDR_BYTES + bytes);
+  }
+  else if(zero)
+    base = calloc(1, ALLOC_HDR_BYTES + bytes);
   else
-    ptr2 = calloc(nel, elsize);
+    base = malloc(ALLOC_HDR_BYTES + bytes);
 
-  if(ptr2 == NULL) _oom(ptr, nel, elsize, file, func, line);
+  if(base == NULL) _oom(ptr, nel, elsize, file, func, line);
   if(ptr == NULL) __sync_add_and_fetch(&ctx_num_allocs, 1); // ++ctx_num_allocs
 
-  return ptr2;
+  ctx_assert(tag < ALLOC_NUM_TAGS);
+  *(AllocHeader*)base = (AllocHeader){.size = bytes, .tag = tag};
+
+  if(bytes > oldsize) _alloc_add(tag, bytes - oldsize);
+  else _alloc_sub(tag, oldsize - bytes);
+
+  return base + ALLOC_HDR_BYTES;
 }
 
 // Allocate / resize memory, ensure all new memory is zero'ed
 void* alloc_recallocarray(void *ptr, size_t oldnel, size_t newnel, size_t elsize,
+                          AllocTag tag,
                           const char *file, const char *func, int line)
 {
   ctx_assert(newnel > 0);
-  void *ptr2 = alloc_mem(ptr, newnel, elsize, true, file, func, line);
+  void *ptr2 = alloc_mem(ptr, newnel, elsize, true, tag, file, func, line);
   if(ptr != NULL && newnel > oldnel)
     memset((char*)ptr2+oldnel*elsize, 0, (newnel-oldnel)*elsize);
   return ptr2;
@@ -53,9 +111,24 @@ void* alloc_recallocarray(void *ptr, size_t oldnel, size_t newnel, size_t elsize
 // `ptr` can be NULL
 void alloc_free(void *ptr)
 {
-  free(ptr);
-  if(ptr != NULL)
+  if(ptr != NULL) {
+    AllocHeader *hdr = _alloc_hdr(ptr);
+    _alloc_sub(hdr->tag, hdr->size);
+    free(hdr);
     __sync_add_and_fetch(&ctx_num_frees, 1); // ++ctx_num_frees
+  }
+}
+
+void alloc_track(AllocTag tag, size_t bytes)
+{
+  ctx_assert(tag < ALLOC_NUM_TAGS);
+  _alloc_add(tag, bytes);
+}
+
+void alloc_untrack(AllocTag tag, size_t bytes)
+{
+  ctx_assert(tag < ALLOC_NUM_TAGS);
+  _alloc_sub(tag, bytes);
 }
 
 size_t alloc_get_num_allocs()
@@ -67,3 +140,29 @@ size_t alloc_get_num_frees()
 {
   return (size_t)ctx_num_frees;
 }
+
+size_t alloc_get_cur_bytes(AllocTag tag)
+{
+  ctx_assert(tag <= ALLOC_NUM_TAGS);
+  return alloc_cur[tag];
+}
+
+size_t alloc_get_peak_bytes(AllocTag tag)
+{
+  ctx_assert(tag <= ALLOC_NUM_TAGS);
+  return alloc_peak[tag];
+}
+
+void alloc_print_report()
+{
+  size_t i;
+  char cur_str[50], peak_str[50];
+
+  status("[memory] %-12s %12s %12s", "subsystem", "current", "peak");
+  for(i = 0; i <= ALLOC_NUM_TAGS; i++) {
+    bytes_to_str(alloc_cur[i], 1, cur_str);
+    bytes_to_str(alloc_peak[i], 1, peak_str);
+    status("[memory] %-12s %12s %12s",
+           i < ALLOC_NUM_TAGS ? alloc_tag_names[i] : "total", cur_str, peak_str);
+  }
+}
@@ -11,30 +11,76 @@
 // etc. have returned NULL and exit with an informative message with line number
 // of offending call.
 //
+// Bytes allocated are counted by subsystem (tag), we keep current and peak
+// bytes for each. Each allocation is prefixed with a small header holding its
+// size and tag, so memory from ctx_malloc() etc. must only be passed to
+// ctx_realloc() / ctx_free() and never to realloc() / free().
+//
+// A source file sets the tag for its allocations by defining CTX_ALLOC_TAG
+// before including global.h, e.g.:
+//
+//   #define CTX_ALLOC_TAG ALLOC_TAG_HASH_TABLE
+//   #include "global.h"
+//
+
+typedef enum
+{
+  ALLOC_TAG_OTHER,
+  ALLOC_TAG_HASH_TABLE, // kmers, buckets and bucket locks
+  ALLOC_TAG_COLOURS,    // per kmer arrays: coverage, edges, colour bits
+  ALLOC_TAG_LINKS,      // link (gpath) store and hash
+  ALLOC_TAG_WALKERS,    // graph walkers, crawlers and per thread workers
+  ALLOC_TAG_IO,         // file and sequence I/O buffers
+  ALLOC_NUM_TAGS
+} AllocTag;
+
+extern const char *alloc_tag_names[ALLOC_NUM_TAGS];
+
+#ifndef CTX_ALLOC_TAG
+#  define CTX_ALLOC_TAG ALLOC_TAG_OTHER
+#endif
 
 // Macros for memory management
 // `ptr` can be NULL
-#define ctx_malloc(mem) alloc_mem(NULL,1,mem,false,__FILE__,__func__,__LINE__)
-#define ctx_calloc(nel,elsize) alloc_mem(NULL,nel,elsize,true,__FILE__,__func__,__LINE__)
-#define ctx_realloc(ptr,mem) alloc_mem(ptr,1,mem,false,__FILE__,__func__,__LINE__)
-#define ctx_reallocarray(ptr,nel,elsize) alloc_mem(ptr,nel,elsize,false,__FILE__,__func__,__LINE__)
-#define ctx_recallocarray(ptr,oldnel,newnel,elsize) alloc_recallocarray(ptr,oldnel,newnel,elsize,__FILE__,__func__,__LINE__)
+#define ctx_malloc(mem) alloc_mem(NULL,1,mem,false,CTX_ALLOC_TAG,__FILE__,__func__,__LINE__)
+#define ctx_calloc(nel,elsize) alloc_mem(NULL,nel,elsize,true,CTX_ALLOC_TAG,__FILE__,__func__,__LINE__)
+#define ctx_realloc(ptr,mem) alloc_mem(ptr,1,mem,false,CTX_ALLOC_TAG,__FILE__,__func__,__LINE__)
+#define ctx_reallocarray(ptr,nel,elsize) alloc_mem(ptr,nel,elsize,false,CTX_ALLOC_TAG,__FILE__,__func__,__LINE__)
+#define ctx_recallocarray(ptr,oldnel,newnel,elsize) alloc_recallocarray(ptr,oldnel,newnel,elsize,CTX_ALLOC_TAG,__FILE__,__func__,__LINE__)
 #define ctx_free(ptr) alloc_free(ptr)
 
+// Allocate with a tag other than this file's CTX_ALLOC_TAG
+#define ctx_calloc_tag(nel,elsize,tag) alloc_mem(NULL,nel,elsize,true,tag,__FILE__,__func__,__LINE__)
+
 // Allocate / reallocate memory. `ptr` can be NULL
 // Prints error message and calls exit() if out of memory / cannot alloc
-void* alloc_mem(void *ptr, size_t nel, size_t elsize, bool zero,
+// On realloc, memory keeps the tag it was first allocated with
+void* alloc_mem(void *ptr, size_t nel, size_t elsize, bool zero, AllocTag tag,
                 const char *file, const char *func, int line);
 
 // Allocate / resize memory, ensure all new memory is zero'ed
 void* alloc_recallocarray(void *ptr, size_t oldnel, size_t newnel, size_t elsize,
+                          AllocTag tag,
                           const char *file, const char *func, int line);
 
 // Free allocated memory, `ptr` is allowed to be NULL
 void alloc_free(void *ptr);
 
+// Count memory that was not allocated with ctx_malloc() etc.
+// e.g. buffers allocated by libraries
+void alloc_track(AllocTag tag, size_t bytes);
+void alloc_untrack(AllocTag tag, size_t bytes);
+
 // Get number of allocations / frees
 size_t alloc_get_num_allocs();
 size_t alloc_get_num_frees();
 
+// Bytes currently allocated and the most allocated at any one time
+// Use ALLOC_NUM_TAGS to get totals over all tags
+size_t alloc_get_cur_bytes(AllocTag tag);
+size_t alloc_get_peak_bytes(AllocTag tag);
+
+// Print current and peak bytes for each tag (--mem-report)
+void alloc_print_report();
+
 #endif /* CTX_ALLOC_H_ */
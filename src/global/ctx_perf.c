@@ -0,0 +1,436 @@
+#include "global.h"
+#include "ctx_perf.h"
+#include "util.h"
+#include "cJSON/cJSON.h"
+
+#define PERF_MAX_PHASES 64
+#define PERF_MAX_DEPTH 16
+
+const char *perf_counter_names[PERF_NUM_COUNTERS] = {
+  "hash_probes", "rehash_steps", "lock_spins", "bytes_read", "bytes_written",
+  "reads", "kmers"
+};
+
+const char *perf_hash_op_names[PERF_HT_NUM_OPS] = {
+  "find_hit", "find_miss", "insert"
+};
+
+typedef struct
+{
+  const char *name;
+  double secs;
+  size_t calls;
+} PerfPhase;
+
+typedef struct
+{
+  size_t idx;
+  double start;
+} PerfPhaseStart;
+
+__thread PerfThreadCounts *perf_local = NULL;
+
+// Hash table probes are only counted with CTXPERF, don't report zeros
+static bool _perf_counter_on(size_t c)
+{
+  #ifndef CTXPERF
+    if(c == PERF_HASH_PROBES || c == PERF_REHASH_STEPS) return false;
+  #endif
+  (void)c;
+  return true;
+}
+
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t perf_key;
+
+// Counters of the main thread and list of running threads
+static PerfThreadCounts perf_main;
+static PerfThreadCounts *perf_threads = NULL;
+
+// Counts from threads that have exited
+static uint64_t perf_totals[PERF_NUM_COUNTERS];
+
+#ifdef CTXPERF
+// Telemetry from threads that have exited, by thread id
+static PerfTelemetry perf_tel_totals[PERF_MAX_THREADS];
+#endif
+
+static PerfPhase perf_phases[PERF_MAX_PHASES];
+static PerfPhaseStart perf_stack[PERF_MAX_DEPTH];
+static size_t perf_nphases = 0, perf_depth = 0;
+
+static double perf_start_secs = 0;
+static bool perf_report = false;
+
+void perf_set_report(bool report) { perf_report = report; }
+bool perf_get_report() { return perf_report; }
+
+// Called with perf_lock held
+static void _perf_link(PerfThreadCounts *p)
+{
+  p->prev = NULL;
+  p->next = perf_threads;
+  if(perf_threads) perf_threads->prev = p;
+  perf_threads = p;
+}
+
+// Called with perf_lock held
+static void _perf_unlink(PerfThreadCounts *p)
+{
+  if(p->prev) p->prev->next = p->next;
+  else perf_threads = p->next;
+  if(p->next) p->next->prev = p->prev;
+}
+
+#ifdef CTXPERF
+static void _perf_tel_merge(PerfTelemetry *dst, const PerfTelemetry *src)
+{
+  size_t i, j;
+  for(i = 0; i < PERF_HT_NUM_OPS; i++)
+    for(j = 0; j < PERF_PROBE_BINS; j++)
+      dst->probes[i][j] += __atomic_load_n(&src->probes[i][j], __ATOMIC_RELAXED);
+  dst->lock_acquires += __atomic_load_n(&src->lock_acquires, __ATOMIC_RELAXED);
+  dst->lock_waits += __atomic_load_n(&src->lock_waits, __ATOMIC_RELAXED);
+  dst->lock_spins += __atomic_load_n(&src->lock_spins, __ATOMIC_RELAXED);
+  dst->lock_wait_ns += __atomic_load_n(&src->lock_wait_ns, __ATOMIC_RELAXED);
+}
+#endif
+
+// Merge counts into the totals when a thread exits
+static void perf_thread_exit(void *ptr)
+{
+  PerfThreadCounts *p = (PerfThreadCounts*)ptr;
+  size_t c;
+  pthread_mutex_lock(&perf_lock);
+  for(c = 0; c < PERF_NUM_COUNTERS; c++) perf_totals[c] += p->counts[c];
+  #ifdef CTXPERF
+    _perf_tel_merge(&perf_tel_totals[MIN2(p->threadid, PERF_MAX_THREADS-1)],
+                    &p->tel);
+  #endif
+  _perf_unlink(p);
+  pthread_mutex_unlock(&perf_lock);
+  perf_local = NULL;
+  ctx_free(p);
+}
+
+static void perf_key_create()
+{
+  if(pthread_key_create(&perf_key, perf_thread_exit) != 0)
+    die("Cannot create thread key");
+}
+
+PerfThreadCounts* perf_thread_register()
+{
+  pthread_once(&perf_key_once, perf_key_create);
+  PerfThreadCounts *p = ctx_calloc(1, sizeof(PerfThreadCounts));
+  pthread_mutex_lock(&perf_lock);
+  _perf_link(p);
+  pthread_mutex_unlock(&perf_lock);
+  if(pthread_setspecific(perf_key, p) != 0) die("Cannot set thread key");
+  perf_local = p;
+  return p;
+}
+
+// Called by the main thread, which is never merged since it doesn't exit
+void perf_init()
+{
+  perf_start_secs = util_wall_secs();
+  memset(&perf_main, 0, sizeof(perf_main));
+  pthread_mutex_lock(&perf_lock);
+  _perf_link(&perf_main);
+  pthread_mutex_unlock(&perf_lock);
+  perf_local = &perf_main;
+}
+
+void perf_set_thread_id(size_t threadid)
+{
+  perf_get_local()->threadid = threadid;
+}
+
+void perf_destroy()
+{
+  pthread_mutex_lock(&perf_lock);
+  _perf_unlink(&perf_main);
+  pthread_mutex_unlock(&perf_lock);
+  perf_local = NULL;
+}
+
+//
+// Phases
+//
+
+void perf_phase_start(const char *name)
+{
+  size_t i;
+  pthread_mutex_lock(&perf_lock);
+
+  for(i = 0; i < perf_nphases && strcmp(perf_phases[i].name, name) != 0; i++) {}
+
+  if(i == perf_nphases && perf_nphases < PERF_MAX_PHASES)
+    perf_phases[perf_nphases++] = (PerfPhase){.name = name, .secs = 0, .calls = 0};
+
+  // Too many phases or nested too deeply: time goes to the parent phase
+  if(i < perf_nphases && perf_depth < PERF_MAX_DEPTH) {
+    perf_phases[i].calls++;
+    perf_stack[perf_depth] = (PerfPhaseStart){.idx = i,
+                                              .start = util_wall_secs()};
+  }
+  perf_depth++;
+
+  pthread_mutex_unlock(&perf_lock);
+}
+
+void perf_phase_end(const char *name)
+{
+  pthread_mutex_lock(&perf_lock);
+  ctx_assert(perf_depth > 0);
+  perf_depth--;
+  if(perf_depth < PERF_MAX_DEPTH) {
+    PerfPhase *phase = &perf_phases[perf_stack[perf_depth].idx];
+    ctx_assert2(strcmp(phase->name, name) == 0,
+                "ending '%s' in '%s'", name, phase->name);
+    phase->secs += util_wall_secs() - perf_stack[perf_depth].start;
+  }
+  pthread_mutex_unlock(&perf_lock);
+  (void)name;
+}
+
+const char* perf_phase_current()
+{
+  const char *name = NULL;
+  pthread_mutex_lock(&perf_lock);
+  if(perf_depth > 0) {
+    size_t d = MIN2(perf_depth, PERF_MAX_DEPTH);
+    name = perf_phases[perf_stack[d-1].idx].name;
+  }
+  pthread_mutex_unlock(&perf_lock);
+  return name;
+}
+
+//
+// Reporting
+//
+
+void perf_get_counts(uint64_t counts[PERF_NUM_COUNTERS])
+{
+  size_t c;
+  PerfThreadCounts *p;
+  pthread_mutex_lock(&perf_lock);
+  memcpy(counts, perf_totals, sizeof(perf_totals));
+  for(p = perf_threads; p != NULL; p = p->next)
+    for(c = 0; c < PERF_NUM_COUNTERS; c++)
+      counts[c] += __atomic_load_n(&p->counts[c], __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&perf_lock);
+}
+
+#ifdef CTXPERF
+// Sum telemetry of exited and running threads
+static void perf_get_telemetry(PerfTelemetry tel[PERF_MAX_THREADS])
+{
+  PerfThreadCounts *p;
+  pthread_mutex_lock(&perf_lock);
+  memcpy(tel, perf_tel_totals, sizeof(perf_tel_totals));
+  for(p = perf_threads; p != NULL; p = p->next)
+    _perf_tel_merge(&tel[MIN2(p->threadid, PERF_MAX_THREADS-1)], &p->tel);
+  pthread_mutex_unlock(&perf_lock);
+}
+
+// Sum probe histograms over threads, return number of reads and writes
+static void _perf_tel_sum(const PerfTelemetry tel[PERF_MAX_THREADS],
+                          uint64_t probes[PERF_HT_NUM_OPS][PERF_PROBE_BINS],
+                          uint64_t *nreads, uint64_t *nwrites)
+{
+  size_t t, i, j;
+  memset(probes, 0, sizeof(uint64_t) * PERF_HT_NUM_OPS * PERF_PROBE_BINS);
+  for(t = 0; t < PERF_MAX_THREADS; t++)
+    for(i = 0; i < PERF_HT_NUM_OPS; i++)
+      for(j = 0; j < PERF_PROBE_BINS; j++)
+        probes[i][j] += tel[t].probes[i][j];
+
+  *nreads = *nwrites = 0;
+  for(j = 0; j < PERF_PROBE_BINS; j++) {
+    *nreads += probes[PERF_HT_FIND_HIT][j] + probes[PERF_HT_FIND_MISS][j];
+    *nwrites += probes[PERF_HT_INSERT][j];
+  }
+}
+
+// {"probes": {"find_hit": [n1,n2,..], ..}, "reads": .., "writes": ..,
+//  "threads": [{"thread": .., "lock_acquires": .., ..}, ..]}
+static cJSON* perf_tel_json()
+{
+  size_t t, i;
+  uint64_t probes[PERF_HT_NUM_OPS][PERF_PROBE_BINS], nreads, nwrites;
+  PerfTelemetry *tel = ctx_calloc(PERF_MAX_THREADS, sizeof(PerfTelemetry));
+  perf_get_telemetry(tel);
+  _perf_tel_sum(tel, probes, &nreads, &nwrites);
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON *jprobes = cJSON_CreateObject();
+  for(i = 0; i < PERF_HT_NUM_OPS; i++) {
+    cJSON *hist = cJSON_CreateArray();
+    for(t = 0; t < PERF_PROBE_BINS; t++)
+      cJSON_AddItemToArray(hist, cJSON_CreateNumber(probes[i][t]));
+    cJSON_AddItemToObject(jprobes, perf_hash_op_names[i], hist);
+  }
+  cJSON_AddItemToObject(json, "probes", jprobes);
+  cJSON_AddNumberToObject(json, "reads", nreads);
+  cJSON_AddNumberToObject(json, "writes", nwrites);
+
+  cJSON *threads = cJSON_CreateArray();
+  for(t = 0; t < PERF_MAX_THREADS; t++) {
+    if(!tel[t].lock_acquires) continue;
+    cJSON *thread = cJSON_CreateObject();
+    cJSON_AddNumberToObject(thread, "thread", t);
+    cJSON_AddNumberToObject(thread, "lock_acquires", tel[t].lock_acquires);
+    cJSON_AddNumberToObject(thread, "lock_waits", tel[t].lock_waits);
+    cJSON_AddNumberToObject(thread, "lock_spins", tel[t].lock_spins);
+    cJSON_AddNumberToObject(thread, "lock_wait_secs", tel[t].lock_wait_ns / 1e9);
+    cJSON_AddItemToArray(threads, thread);
+  }
+  cJSON_AddItemToObject(json, "threads", threads);
+
+  ctx_free(tel);
+  return json;
+}
+#endif
+
+// Current and peak bytes by subsystem
+cJSON* perf_memory_json()
+{
+  size_t i;
+  cJSON *memory = cJSON_CreateObject();
+  for(i = 0; i <= ALLOC_NUM_TAGS; i++) {
+    cJSON *mem = cJSON_CreateObject();
+    cJSON_AddNumberToObject(mem, "cur_bytes", alloc_get_cur_bytes(i));
+    cJSON_AddNumberToObject(mem, "peak_bytes", alloc_get_peak_bytes(i));
+    cJSON_AddItemToObject(memory, i < ALLOC_NUM_TAGS ? alloc_tag_names[i] : "total",
+                          mem);
+  }
+  return memory;
+}
+
+cJSON* perf_json()
+{
+  size_t i;
+  uint64_t counts[PERF_NUM_COUNTERS];
+  perf_get_counts(counts);
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "wall_secs", util_wall_secs() - perf_start_secs);
+
+  cJSON *phases = cJSON_CreateArray();
+  pthread_mutex_lock(&perf_lock);
+  for(i = 0; i < perf_nphases; i++) {
+    cJSON *phase = cJSON_CreateObject();
+    cJSON_AddStringToObject(phase, "name", perf_phases[i].name);
+    cJSON_AddNumberToObject(phase, "secs", perf_phases[i].secs);
+    cJSON_AddNumberToObject(phase, "calls", perf_phases[i].calls);
+    cJSON_AddItemToArray(phases, phase);
+  }
+  pthread_mutex_unlock(&perf_lock);
+  cJSON_AddItemToObject(json, "phases", phases);
+
+  cJSON *counters = cJSON_CreateObject();
+  for(i = 0; i < PERF_NUM_COUNTERS; i++)
+    if(_perf_counter_on(i))
+      cJSON_AddNumberToObject(counters, perf_counter_names[i], counts[i]);
+  cJSON_AddItemToObject(json, "counters", counters);
+
+  cJSON_AddItemToObject(json, "memory", perf_memory_json());
+
+  #ifdef CTXPERF
+    cJSON_AddItemToObject(json, "hash_table", perf_tel_json());
+  #endif
+
+  return json;
+}
+
+void perf_print_status()
+{
+  size_t i;
+  uint64_t counts[PERF_NUM_COUNTERS];
+  char num_str[50];
+  perf_get_counts(counts);
+
+  pthread_mutex_lock(&perf_lock);
+  for(i = 0; i < perf_nphases; i++) {
+    status("[perf] phase %s: %.2f secs (%zu call%s)", perf_phases[i].name,
+           perf_phases[i].secs, perf_phases[i].calls,
+           util_plural_str(perf_phases[i].calls));
+  }
+  pthread_mutex_unlock(&perf_lock);
+
+  for(i = 0; i < PERF_NUM_COUNTERS; i++) {
+    if(!_perf_counter_on(i)) continue;
+    ulong_to_str(counts[i], num_str);
+    status("[perf] %s: %s", perf_counter_names[i], num_str);
+  }
+
+  perf_print_telemetry();
+}
+
+void perf_print_telemetry()
+{
+#ifdef CTXPERF
+  size_t t, i, j, maxbin;
+  uint64_t probes[PERF_HT_NUM_OPS][PERF_PROBE_BINS], nreads, nwrites, nops;
+  char num_str[50], num_str2[50];
+  StrBuf line;
+  strbuf_alloc(&line, 256);
+
+  PerfTelemetry *tel = ctx_calloc(PERF_MAX_THREADS, sizeof(PerfTelemetry));
+  perf_get_telemetry(tel);
+  _perf_tel_sum(tel, probes, &nreads, &nwrites);
+
+  // Probe length histograms: "1:90.12% 2:9.10% ..."
+  for(i = 0; i < PERF_HT_NUM_OPS; i++) {
+    for(j = nops = maxbin = 0; j < PERF_PROBE_BINS; j++) {
+      nops += probes[i][j];
+      if(probes[i][j]) maxbin = j+1;
+    }
+    if(!nops) continue;
+    strbuf_reset(&line);
+    for(j = 0; j < maxbin; j++) {
+      strbuf_sprintf(&line, " %zu%s:%.2f%%", j+1,
+                     j+1 == PERF_PROBE_BINS ? "+" : "",
+                     (100.0 * probes[i][j]) / nops);
+    }
+    status("[perf] %s probes (%s ops):%s", perf_hash_op_names[i],
+           ulong_to_str(nops, num_str), line.b);
+  }
+
+  status("[perf] hash table reads: %s writes: %s (%.2f reads per write)",
+         ulong_to_str(nreads, num_str), ulong_to_str(nwrites, num_str2),
+         nwrites ? (double)nreads / nwrites : 0.0);
+
+  for(t = 0; t < PERF_MAX_THREADS; t++) {
+    if(!tel[t].lock_acquires) continue;
+    status("[perf] thread %zu%s: %s bucket locks, %.3f%% contended, "
+           "%"PRIu64" yields, %.3f secs waiting",
+           t, t+1 == PERF_MAX_THREADS ? "+" : "",
+           ulong_to_str(tel[t].lock_acquires, num_str),
+           (100.0 * tel[t].lock_waits) / tel[t].lock_acquires,
+           tel[t].lock_spins, tel[t].lock_wait_ns / 1e9);
+  }
+
+  ctx_free(tel);
+  strbuf_dealloc(&line);
+#else
+  status("[perf] Hash table telemetry not compiled in, recompile with PERF=1");
+#endif
+}
+
+void perf_write_json(const char *path)
+{
+  FILE *fout = fopen(path, "w");
+  if(fout == NULL) die("Cannot open perf output: %s [%s]", path, strerror(errno));
+  cJSON *json = perf_json();
+  char *jstr = cJSON_Print(json);
+  fputs(jstr, fout);
+  fputc('\n', fout);
+  free(jstr);
+  cJSON_Delete(json);
+  if(fclose(fout) != 0) die("Cannot close perf output: %s", path);
+  status("[perf] Written to %s", path);
+}
@@ -0,0 +1,188 @@
+#ifndef CTX_PERF_H_
+#define CTX_PERF_H_
+
+#include <sched.h> // sched_yield()
+#include <time.h> // clock_gettime()
+
+//
+// Performance counters and named phases
+//
+// Each thread counts into its own block of counters so that counting never
+// writes to a shared cache line. A block is registered the first time a thread
+// counts something and is merged into the global totals when the thread exits.
+// Counters are always on, they cost one thread-local add per event. Hash table
+// probes are the exception: there is one per lookup, so they are only counted
+// when compiled with CTXPERF (see below).
+//
+// Phases (e.g. "load_graph", "build", "clean") are timed by the wall clock.
+// They are pushed and popped by the main thread and may nest, time spent in a
+// nested phase also counts towards its parent.
+//
+// Totals are reported with --perf: in the JSON header of output files, as
+// status lines at the end of a command and, with --perf-out <file>, as a
+// standalone JSON file.
+//
+
+typedef enum
+{
+  PERF_HASH_PROBES,   // hash table buckets searched (CTXPERF only)
+  PERF_REHASH_STEPS,  // buckets searched after the first for a kmer (CTXPERF)
+  PERF_LOCK_SPINS,    // times a thread yielded waiting for a bucket lock
+  PERF_BYTES_READ,    // bytes of sequence, graph and link input
+  PERF_BYTES_WRITTEN, // bytes of graph and text output
+  PERF_READS,         // reads parsed from sequence input
+  PERF_KMERS,         // kmers loaded or looked up from graph and read input
+  PERF_NUM_COUNTERS
+} PerfCounter;
+
+extern const char *perf_counter_names[PERF_NUM_COUNTERS];
+
+//
+// Hash table telemetry, only compiled in with CTXPERF=1 (make PERF=1)
+// Records probe length histograms by outcome of hash table operations and,
+// per thread, how long we wait to acquire bucket locks. When compiled out the
+// perf_tel_*() hooks are empty and cost nothing.
+//
+
+#if defined(CTXPERF) && CTXPERF == 0
+#  undef CTXPERF
+#endif
+
+typedef enum
+{
+  PERF_HT_FIND_HIT,  // lookup found kmer (read)
+  PERF_HT_FIND_MISS, // lookup did not find kmer (read)
+  PERF_HT_INSERT,    // kmer added (write)
+  PERF_HT_NUM_OPS
+} PerfHashOp;
+
+extern const char *perf_hash_op_names[PERF_HT_NUM_OPS];
+
+// Probe lengths >= PERF_PROBE_BINS are counted in the last bin
+#define PERF_PROBE_BINS 20
+// Threads with id >= PERF_MAX_THREADS share the last slot
+#define PERF_MAX_THREADS 64
+
+typedef struct
+{
+  uint64_t probes[PERF_HT_NUM_OPS][PERF_PROBE_BINS];
+  uint64_t lock_acquires, lock_waits, lock_spins, lock_wait_ns;
+} PerfTelemetry;
+
+typedef struct PerfThreadCounts PerfThreadCounts;
+
+struct PerfThreadCounts
+{
+  uint64_t counts[PERF_NUM_COUNTERS];
+  #ifdef CTXPERF
+    PerfTelemetry tel;
+  #endif
+  size_t threadid;
+  PerfThreadCounts *prev, *next;
+};
+
+extern __thread PerfThreadCounts *perf_local;
+
+// Register counters for the calling thread
+PerfThreadCounts* perf_thread_register();
+
+// Only the owning thread writes its counters, other threads may read them
+#define perf_add(x,n) __atomic_store_n(&(x), (x)+(n), __ATOMIC_RELAXED)
+
+static inline PerfThreadCounts* perf_get_local()
+{
+  return perf_local ? perf_local : perf_thread_register();
+}
+
+static inline void perf_count(PerfCounter c, uint64_t n)
+{
+  perf_add(perf_get_local()->counts[c], n);
+}
+
+// Set by util_multi_thread() workers, used to report per thread telemetry
+void perf_set_thread_id(size_t threadid);
+
+#ifdef CTXPERF
+
+static inline void perf_tel_probe(PerfHashOp op, size_t nprobes)
+{
+  size_t bin = (nprobes < PERF_PROBE_BINS ? nprobes : PERF_PROBE_BINS) - 1;
+  perf_add(perf_get_local()->tel.probes[op][bin], 1);
+}
+
+static inline uint64_t perf_tel_clock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+static inline void perf_tel_lock(uint64_t nspins, uint64_t wait_ns)
+{
+  PerfTelemetry *tel = &perf_get_local()->tel;
+  perf_add(tel->lock_acquires, 1);
+  if(nspins) {
+    perf_add(tel->lock_waits, 1);
+    perf_add(tel->lock_spins, nspins);
+    perf_add(tel->lock_wait_ns, wait_ns);
+  }
+}
+
+#else
+
+#define perf_tel_probe(op,nprobes) do {} while(0)
+#define perf_tel_clock() 0
+#define perf_tel_lock(nspins,wait_ns) do {} while(0)
+
+#endif
+
+// Same as bitlock_yield_acquire() but counts the number of times we yield
+#define perf_bitlock_acquire(arr,pos) do {                                     \
+  bool _got_lock = false;                                                      \
+  uint64_t _nspins = 0, _t0 = 0;                                               \
+  bitlock_try_acquire(arr, pos, &_got_lock);                                   \
+  if(!_got_lock) {                                                             \
+    _t0 = perf_tel_clock();                                                    \
+    do {                                                                       \
+      _nspins++; sched_yield();                                                \
+      bitlock_try_acquire(arr, pos, &_got_lock);                               \
+    } while(!_got_lock);                                                       \
+    perf_count(PERF_LOCK_SPINS, _nspins);                                      \
+  }                                                                            \
+  perf_tel_lock(_nspins, _nspins ? perf_tel_clock() - _t0 : 0);                \
+  (void)_t0;                                                                   \
+} while(0)
+
+void perf_init();
+void perf_destroy();
+
+// Report performance (--perf)
+void perf_set_report(bool report);
+bool perf_get_report();
+
+// Phases must be started and finished by the main thread
+void perf_phase_start(const char *name);
+void perf_phase_end(const char *name);
+
+// Name of the innermost phase running, or NULL if none
+// Returned string is static
+const char* perf_phase_current();
+
+// Sum of counters over exited and running threads
+void perf_get_counts(uint64_t counts[PERF_NUM_COUNTERS]);
+
+// {"wall_secs": .., "phases": [{"name": .., "secs": .., "calls": ..}, ..],
+//  "counters": {"hash_probes": .., ..}}
+struct cJSON* perf_json();
+
+// {"other": {"cur_bytes": .., "peak_bytes": ..}, .., "total": {..}}
+struct cJSON* perf_memory_json();
+
+void perf_print_status();
+
+// Print probe length histograms and per thread lock waits, or a note that
+// telemetry was not compiled in
+void perf_print_telemetry();
+void perf_write_json(const char *path);
+
+#endif /* CTX_PERF_H_ */
@@ -0,0 +1,255 @@
+#include "global.h"
+#include "ctx_progress.h"
+#include "util.h"
+#include "cmd.h"
+#include "cJSON/cJSON.h"
+
+#include <time.h>
+
+ProgressInput progress_inputs[PROGRESS_MAX_INPUTS];
+static size_t progress_ninputs = 1; // id 0 is reserved for untracked
+
+static pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t progress_thread;
+
+static char *progress_path = NULL, *progress_tmp_path = NULL;
+static double progress_secs = PROGRESS_DEFAULT_SECS;
+static volatile bool progress_on = false, progress_stopping = false;
+static bool progress_warned = false;
+
+// Hash table we report occupancy for, protected by progress_lock
+static const uint64_t *progress_ht_nkmers = NULL;
+static uint64_t progress_ht_capacity = 0;
+
+// Counters from the last report, used to give rates over the last interval
+static double progress_start_secs = 0, progress_last_secs = 0;
+static uint64_t progress_last_counts[PERF_NUM_COUNTERS];
+
+bool progress_running() { return progress_on; }
+
+size_t progress_input_add(const char *path, int64_t file_size)
+{
+  if(!progress_on) return 0;
+  size_t id = 0;
+  pthread_mutex_lock(&progress_lock);
+  if(progress_ninputs < PROGRESS_MAX_INPUTS) {
+    id = progress_ninputs;
+    ProgressInput *input = &progress_inputs[id];
+    input->path = strdup(path);
+    input->file_size = file_size;
+    input->bytes_read = input->num_reads = 0;
+    input->done = false;
+    __atomic_store_n(&progress_ninputs, id+1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&progress_lock);
+  return id;
+}
+
+void progress_input_done(size_t id)
+{
+  if(id) __atomic_store_n(&progress_inputs[id].done, true, __ATOMIC_RELAXED);
+}
+
+void progress_set_hash_table(const uint64_t *num_kmers, uint64_t capacity)
+{
+  pthread_mutex_lock(&progress_lock);
+  progress_ht_nkmers = num_kmers;
+  progress_ht_capacity = capacity;
+  pthread_mutex_unlock(&progress_lock);
+}
+
+void progress_clear_hash_table(const uint64_t *num_kmers)
+{
+  pthread_mutex_lock(&progress_lock);
+  if(progress_ht_nkmers == num_kmers) {
+    progress_ht_nkmers = NULL;
+    progress_ht_capacity = 0;
+  }
+  pthread_mutex_unlock(&progress_lock);
+}
+
+static cJSON* _rate_json(uint64_t count, uint64_t prev, double secs, double dt)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "total", count);
+  cJSON_AddNumberToObject(json, "per_sec", dt > 0 ? (count - prev) / dt : 0);
+  cJSON_AddNumberToObject(json, "per_sec_avg", secs > 0 ? count / secs : 0);
+  return json;
+}
+
+// Build report, called by the progress thread or when stopping
+static cJSON* progress_json(const char *state)
+{
+  size_t i, ninputs;
+  uint64_t counts[PERF_NUM_COUNTERS];
+  perf_get_counts(counts);
+
+  double now = util_wall_secs();
+  double secs = now - progress_start_secs, dt = now - progress_last_secs;
+  const char *phase = perf_phase_current();
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "command", cmd_get_cmdline());
+  cJSON_AddStringToObject(json, "state", state);
+  cJSON_AddNumberToObject(json, "updated", (double)time(NULL));
+  cJSON_AddNumberToObject(json, "wall_secs", secs);
+  cJSON_AddNumberToObject(json, "interval_secs", dt);
+  if(phase) cJSON_AddStringToObject(json, "phase", phase);
+  else cJSON_AddNullToObject(json, "phase");
+
+  cJSON_AddItemToObject(json, "reads",
+    _rate_json(counts[PERF_READS], progress_last_counts[PERF_READS], secs, dt));
+  cJSON_AddItemToObject(json, "kmers",
+    _rate_json(counts[PERF_KMERS], progress_last_counts[PERF_KMERS], secs, dt));
+  cJSON_AddItemToObject(json, "bytes_read",
+    _rate_json(counts[PERF_BYTES_READ], progress_last_counts[PERF_BYTES_READ],
+               secs, dt));
+  cJSON_AddItemToObject(json, "bytes_written",
+    _rate_json(counts[PERF_BYTES_WRITTEN],
+               progress_last_counts[PERF_BYTES_WRITTEN], secs, dt));
+
+  memcpy(progress_last_counts, counts, sizeof(counts));
+  progress_last_secs = now;
+
+  // Hash table may be freed once we release the lock
+  pthread_mutex_lock(&progress_lock);
+  if(progress_ht_nkmers != NULL) {
+    uint64_t nkmers = __atomic_load_n(progress_ht_nkmers, __ATOMIC_RELAXED);
+    cJSON *ht = cJSON_CreateObject();
+    cJSON_AddNumberToObject(ht, "kmers", nkmers);
+    cJSON_AddNumberToObject(ht, "capacity", progress_ht_capacity);
+    cJSON_AddNumberToObject(ht, "occupancy",
+                            (double)nkmers / progress_ht_capacity);
+    cJSON_AddItemToObject(json, "hash_table", ht);
+  }
+  pthread_mutex_unlock(&progress_lock);
+
+  cJSON_AddItemToObject(json, "memory", perf_memory_json());
+
+  cJSON *inputs = cJSON_CreateArray();
+  ninputs = __atomic_load_n(&progress_ninputs, __ATOMIC_ACQUIRE);
+  for(i = 1; i < ninputs; i++) {
+    const ProgressInput *in = &progress_inputs[i];
+    cJSON *input = cJSON_CreateObject();
+    cJSON_AddStringToObject(input, "path", in->path);
+    cJSON_AddNumberToObject(input, "file_size", in->file_size);
+    cJSON_AddNumberToObject(input, "bytes_read",
+                            __atomic_load_n(&in->bytes_read, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(input, "reads",
+                            __atomic_load_n(&in->num_reads, __ATOMIC_RELAXED));
+    cJSON_AddBoolToObject(input, "done",
+                          __atomic_load_n(&in->done, __ATOMIC_RELAXED));
+    cJSON_AddItemToArray(inputs, input);
+  }
+  cJSON_AddItemToObject(json, "inputs", inputs);
+
+  return json;
+}
+
+// Write to a temporary file then rename, so the report is never half written
+static void progress_write(const char *state)
+{
+  cJSON *json = progress_json(state);
+  char *str = cJSON_Print(json);
+  cJSON_Delete(json);
+
+  FILE *fh = fopen(progress_tmp_path, "w");
+  bool ok = (fh != NULL);
+  if(fh) {
+    ok = (fputs(str, fh) >= 0 && fputc('\n', fh) != EOF);
+    ok = (fclose(fh) == 0) && ok;
+    ok = ok && (rename(progress_tmp_path, progress_path) == 0);
+  }
+  free(str);
+
+  if(!ok && !progress_warned) {
+    warn("Cannot write progress file: %s [%s]", progress_path, strerror(errno));
+    progress_warned = true;
+  }
+}
+
+static void* progress_run(void *arg)
+{
+  (void)arg;
+  struct timespec wake;
+  long every_ns = (long)(progress_secs * 1e9) % 1000000000L;
+  time_t every_s = (time_t)progress_secs;
+
+  pthread_mutex_lock(&progress_lock);
+  while(!progress_stopping)
+  {
+    clock_gettime(CLOCK_REALTIME, &wake);
+    wake.tv_sec += every_s;
+    wake.tv_nsec += every_ns;
+    if(wake.tv_nsec >= 1000000000L) { wake.tv_sec++; wake.tv_nsec -= 1000000000L; }
+
+    while(!progress_stopping &&
+          pthread_cond_timedwait(&progress_cond, &progress_lock, &wake) == 0) {}
+
+    if(progress_stopping) break;
+
+    pthread_mutex_unlock(&progress_lock);
+    progress_write("running");
+    pthread_mutex_lock(&progress_lock);
+  }
+  pthread_mutex_unlock(&progress_lock);
+  return NULL;
+}
+
+// If we exit with die() write a final report
+static void progress_atexit()
+{
+  if(progress_on) progress_stop(false);
+}
+
+void progress_start(const char *path, double every_secs)
+{
+  ctx_assert(!progress_on);
+  ctx_assert(every_secs > 0);
+
+  progress_path = ctx_malloc(strlen(path)+5);
+  progress_tmp_path = ctx_malloc(strlen(path)+5);
+  strcpy(progress_path, path);
+  sprintf(progress_tmp_path, "%s.tmp", path);
+  progress_secs = every_secs;
+  progress_stopping = false;
+  progress_warned = false;
+
+  progress_start_secs = progress_last_secs = util_wall_secs();
+  perf_get_counts(progress_last_counts);
+
+  progress_write("running");
+
+  progress_on = true;
+  int rc = pthread_create(&progress_thread, NULL, progress_run, NULL);
+  if(rc != 0) die("Creating thread failed: %s", strerror(rc));
+
+  static bool registered = false;
+  if(!registered) { atexit(progress_atexit); registered = true; }
+}
+
+void progress_stop(bool success)
+{
+  if(!progress_on) return;
+
+  pthread_mutex_lock(&progress_lock);
+  progress_stopping = true;
+  pthread_cond_signal(&progress_cond);
+  pthread_mutex_unlock(&progress_lock);
+
+  // If called from the progress thread (via exit) don't wait for ourselves
+  if(!pthread_equal(pthread_self(), progress_thread))
+    pthread_join(progress_thread, NULL);
+
+  progress_on = false;
+  progress_write(success ? "done" : "failed");
+
+  size_t i;
+  for(i = 1; i < progress_ninputs; i++) free(progress_inputs[i].path);
+  progress_ninputs = 1;
+
+  ctx_free(progress_path);
+  ctx_free(progress_tmp_path);
+  progress_path = progress_tmp_path = NULL;
+}
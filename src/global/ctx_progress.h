@@ -0,0 +1,57 @@
+#ifndef CTX_PROGRESS_H_
+#define CTX_PROGRESS_H_
+
+//
+// Live progress file (--progress <file>, --progress-secs <N>)
+//
+// A background thread rewrites a JSON file every N seconds with throughput
+// (reads/sec, kmers/sec), hash table occupancy, bytes consumed from each input
+// file, memory in use and the current phase. The file is written to a
+// temporary file and renamed into place, so readers always see a whole report.
+//
+// The thread only reads counters that are already kept (perf counters, alloc
+// counters, hash table size), it never takes ctx_biglock. Worker threads add
+// bytes to their input with a relaxed atomic add, input id 0 means untracked
+// and is used when no progress file was requested.
+//
+
+#define PROGRESS_MAX_INPUTS 1024
+#define PROGRESS_DEFAULT_SECS 10
+
+typedef struct
+{
+  char *path;
+  int64_t file_size; // -1 if unknown (e.g. stream)
+  uint64_t bytes_read, num_reads;
+  bool done;
+} ProgressInput;
+
+extern ProgressInput progress_inputs[PROGRESS_MAX_INPUTS];
+
+// Start writing progress to `path` every `every_secs` seconds
+void progress_start(const char *path, double every_secs);
+
+// Stop thread and write final report with "state": "done" or "failed"
+void progress_stop(bool success);
+
+bool progress_running();
+
+// Register an input file, returns id to pass to progress_input_read()
+// Returns 0 if not writing progress or too many inputs
+size_t progress_input_add(const char *path, int64_t file_size);
+void progress_input_done(size_t id);
+
+static inline void progress_input_read(size_t id, size_t nbytes, size_t nreads)
+{
+  if(id) {
+    __atomic_fetch_add(&progress_inputs[id].bytes_read, nbytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&progress_inputs[id].num_reads, nreads, __ATOMIC_RELAXED);
+  }
+}
+
+// Report occupancy of this hash table, pass a pointer to its kmer count
+// progress_clear_hash_table() must be called before the table is freed
+void progress_set_hash_table(const uint64_t *num_kmers, uint64_t capacity);
+void progress_clear_hash_table(const uint64_t *num_kmers);
+
+#endif /* CTX_PROGRESS_H_ */
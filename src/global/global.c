@@ -34,9 +34,11 @@ void cortex_init()
   ctx_output_init();
   // Now safe to use die/warn/message/timestamp methods
   // since mutex and cmdcode have been set
+  perf_init();
 }
 
 void cortex_destroy()
 {
+  perf_destroy();
   ctx_output_destroy();
 }
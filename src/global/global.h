@@ -45,6 +45,7 @@
 #include "ctx_assert.h"
 #include "ctx_alloc.h" // Wrappers for malloc, calloc etc.
 #include "ctx_output.h" // Printing status messages
+#include "ctx_perf.h" // Performance counters and phases
 
 #include "htslib/version.h"
 #define LIBS_VERSION "zlib="ZLIB_VERSION" htslib="HTS_VERSION
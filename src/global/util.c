@@ -2,6 +2,7 @@
 #include "util.h"
 
 #include <math.h>
+#include <sys/time.h> // gettimeofday()
 
 #include "sort_r/sort_r.h"
 
@@ -537,6 +538,14 @@ size_t seconds_to_str(unsigned long seconds, char *str)
   return (size_t)(ptr - str);
 }
 
+// Wall clock time in seconds, used to time sections of code
+double util_wall_secs()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
 //
 // Multi-threading
 //
@@ -571,6 +580,7 @@ static void threaded_worker_sub(ThreadedWorker *wrkr)
 static __attribute__((noreturn)) void *threaded_worker(void *arg)
 {
   ThreadedWorker *wrkr = (ThreadedWorker*)arg;
+  perf_set_thread_id(wrkr->threadid);
   threaded_worker_sub(wrkr);
   pthread_exit(NULL);
 }
@@ -634,6 +644,7 @@ typedef struct {
 static __attribute__((noreturn)) void *shared_arg_worker(void *arg)
 {
   SharedArgWorker *wrkr = (SharedArgWorker*)arg;
+  perf_set_thread_id(wrkr->threadid);
   wrkr->func(wrkr->arg, wrkr->threadid);
   pthread_exit(NULL);
 }
@@ -170,6 +170,9 @@ size_t calc_N50(const size_t *sorted_arr, size_t n, size_t total);
 // returns number of bytes written
 size_t seconds_to_str(unsigned long seconds, char *str);
 
+// Wall clock time in seconds, take the difference of two calls to time a job
+double util_wall_secs();
+
 //
 // Multi-threading
 //
@@ -149,6 +149,24 @@ BinaryKmer binary_kmer_random(size_t kmer_size)
   return bkmer;
 }
 
+// splitmix64 generator
+static inline uint64_t _bkmer_rand64(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+BinaryKmer binary_kmer_random_r(size_t kmer_size, uint64_t *state)
+{
+  BinaryKmer bkmer;
+  size_t i;
+  for(i = 0; i < NUM_BKMER_WORDS; i++) bkmer.b[i] = _bkmer_rand64(state);
+  bkmer.b[0] >>= 64 - BKMER_TOP_BITS(kmer_size);
+  return bkmer;
+}
+
 //
 // Functions operating on strings
 //
@@ -185,6 +203,16 @@ BinaryKmer binary_kmer_from_str(const char *seq, size_t kmer_size)
   return bkmer;
 }
 
+// Four bases for each byte of a binary kmer word, first base in the top bits
+#define BKSTR1(p) p"A", p"C", p"G", p"T"
+#define BKSTR2(p) BKSTR1(p"A"), BKSTR1(p"C"), BKSTR1(p"G"), BKSTR1(p"T")
+#define BKSTR3(p) BKSTR2(p"A"), BKSTR2(p"C"), BKSTR2(p"G"), BKSTR2(p"T")
+static const char bkmer_byte_str[256][5] = {BKSTR3("A"), BKSTR3("C"),
+                                            BKSTR3("G"), BKSTR3("T")};
+#undef BKSTR1
+#undef BKSTR2
+#undef BKSTR3
+
 // Caller passes in allocated char* as 3rd argument which is then returned
 // Note that the allocated space has to be kmer_size+1;
 char *binary_kmer_to_str(const BinaryKmer bkmer, size_t kmer_size, char *seq)
@@ -193,20 +221,26 @@ char *binary_kmer_to_str(const BinaryKmer bkmer, size_t kmer_size, char *seq)
   uint64_t word;
 
 #if NUM_BKMER_WORDS > 1
-  // All but the top word
+  // All but the top word, four bases at a time
   size_t i;
   for(i = NUM_BKMER_WORDS-1; i > 0; i--) {
     word = bkmer.b[i];
-    for(j = 0; j < 32; j++) {
-      seq[--k] = dna_nuc_to_char(word & 0x3);
-      word >>= 2;
+    for(j = 0; j < 8; j++) {
+      k -= 4;
+      memcpy(seq+k, bkmer_byte_str[word & 0xff], 4);
+      word >>= 8;
     }
   }
 #endif
 
   // Top word
   word = bkmer.b[0];
-  for(j = 0; j < topbases; j++) {
+  for(j = 0; j+4 <= topbases; j += 4) {
+    k -= 4;
+    memcpy(seq+k, bkmer_byte_str[word & 0xff], 4);
+    word >>= 8;
+  }
+  for(; j < topbases; j++) {
     seq[--k] = dna_nuc_to_char(word & 0x3);
     word >>= 2;
   }
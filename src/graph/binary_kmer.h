@@ -181,6 +181,10 @@ BinaryKmer binary_kmer_reverse_complement(const BinaryKmer bkmer, size_t kmer_si
 // Get a random binary kmer -- useful for testing
 BinaryKmer binary_kmer_random(size_t kmer_size);
 
+// Threadsafe binary_kmer_random(), each thread keeps its own `state`
+// which can be seeded with any value
+BinaryKmer binary_kmer_random_r(size_t kmer_size, uint64_t *state);
+
 // BinaryKmer <-> String functions
 char* binary_kmer_to_str(const BinaryKmer kmer, size_t kmer_size, char *seq);
 BinaryKmer binary_kmer_from_str(const char *seq, size_t kmer_size);
@@ -2,9 +2,68 @@
 #include "cmd_mem.h"
 #include "util.h"
 #include "hash_mem.h" // for calculating mem usage
+#include "binary_kmer.h"
+#include "ctx_progress.h"
 
 #include "misc/mem_size.h" // in libs/misc/
 
+//
+// Memory plan, printed with --plan
+// Each entry is a named block of memory that the command intends to allocate.
+// Entries with the same name replace earlier ones.
+//
+#define PLAN_MAX_ENTRIES 32
+
+typedef struct
+{
+  char name[64];
+  size_t bytes;
+} MemPlanEntry;
+
+static bool plan_only = false;
+static MemPlanEntry plan_entries[PLAN_MAX_ENTRIES];
+static size_t plan_nentries = 0;
+
+void cmd_mem_set_plan(bool plan) { plan_only = plan; }
+bool cmd_mem_get_plan() { return plan_only; }
+
+static void _plan_add(const char *name, size_t bytes)
+{
+  size_t i;
+  for(i = 0; i < plan_nentries && strcmp(plan_entries[i].name, name); i++) {}
+  if(i == PLAN_MAX_ENTRIES) return;
+  if(i == plan_nentries) {
+    strncpy(plan_entries[i].name, name, sizeof(plan_entries[i].name)-1);
+    plan_entries[i].name[sizeof(plan_entries[i].name)-1] = '\0';
+    plan_nentries++;
+  }
+  plan_entries[i].bytes = bytes;
+}
+
+static void _plan_print_row(FILE *fh, const char *name, size_t bytes)
+{
+  char mem_str[50], bytes_str[50];
+  bytes_to_str(bytes, 1, mem_str);
+  ulong_to_str(bytes, bytes_str);
+  fprintf(fh, "  %-32s %10s  %20s bytes\n", name, mem_str, bytes_str);
+}
+
+// Print table of memory we plan to allocate
+static void _plan_print(FILE *fh, size_t mem_to_use, size_t mem_requested,
+                        size_t ram)
+{
+  size_t i, sum = 0;
+  fprintf(fh, "Memory plan for %s:\n", cmd_get_cmdline());
+  for(i = 0; i < plan_nentries; i++) {
+    _plan_print_row(fh, plan_entries[i].name, plan_entries[i].bytes);
+    sum += plan_entries[i].bytes;
+  }
+  if(sum < mem_requested) _plan_print_row(fh, "other", mem_requested - sum);
+  _plan_print_row(fh, "total", mem_requested);
+  _plan_print_row(fh, "memory limit (-m)", mem_to_use);
+  _plan_print_row(fh, "RAM", ram);
+}
+
 void cmd_mem_args_set_memory(struct MemArgs *mem, const char *arg)
 {
   if(mem->mem_to_use_set)
@@ -30,6 +89,7 @@ void cmd_print_mem(size_t mem_bytes, const char *name)
   char mem_str[100];
   bytes_to_str(mem_bytes, 1, mem_str);
   status("[memory] %s: %s", name, mem_str);
+  _plan_add(name, mem_bytes);
 }
 
 // If your command accepts -n <kmers> and -m <mem> this may be useful
@@ -122,7 +182,23 @@ size_t cmd_get_kmers_in_hash(size_t mem_to_use, bool mem_to_use_set,
         graph_mem_str, mem_to_use_str);
   }
 
-  cmd_print_mem(graph_mem, "graph");
+  // Don't add "graph" to the plan, split it into kmers+buckets and kmer data
+  char mem_str[100];
+  bytes_to_str(graph_mem, 1, mem_str);
+  status("[memory] graph: %s", mem_str);
+
+  uint64_t num_of_buckets; uint8_t bucket_size;
+  hash_table_cap(kmers_in_hash, &num_of_buckets, &bucket_size);
+  size_t ht_bytes = ht_mem(bucket_size, num_of_buckets, sizeof(BinaryKmer)*8);
+  char name[64];
+  snprintf(name, sizeof(name), "hash table (%s kmers)", kmers_in_hash_str);
+  plan_nentries = 0; // graph is always the first thing we plan
+  _plan_add(name, ht_bytes);
+  if(graph_mem > ht_bytes) {
+    snprintf(name, sizeof(name), "kmer data (%zu bits/kmer)",
+             entry_bits - sizeof(BinaryKmer)*8);
+    _plan_add(name, graph_mem - ht_bytes);
+  }
 
   if(graph_mem_ptr != NULL) *graph_mem_ptr = graph_mem;
 
@@ -135,17 +211,26 @@ void cmd_check_mem_limit(size_t mem_to_use, size_t mem_requested)
   char memstr[50], ramstr[50];
   bytes_to_str(mem_requested, 1, memstr);
 
-  if(mem_requested > mem_to_use)
-    die("Need to set higher memory limit [ at least -m %s ]", memstr);
-
   // Get memory
   size_t ram = getMemorySize();
   bytes_to_str(ram, 1, ramstr);
 
+  if(plan_only) _plan_print(stdout, mem_to_use, mem_requested, ram);
+
+  if(mem_requested > mem_to_use)
+    die("Need to set higher memory limit [ at least -m %s ]", memstr);
+
   if(mem_requested > ram) {
     die("Requesting more memory than is available [ Reqeusted: -m %s RAM: %s ]",
         memstr, ramstr);
   }
 
   status("[memory] total: %s of %s RAM\n", memstr, ramstr);
+
+  if(plan_only) {
+    fflush(stdout);
+    status("Plan only (--plan), exiting without running.");
+    progress_stop(true); // otherwise reported as failed on exit
+    exit(EXIT_SUCCESS);
+  }
 }
@@ -30,9 +30,16 @@ size_t cmd_get_kmers_in_hash(size_t mem_to_use, bool mem_to_use_set,
                              bool use_mem_limit, size_t *graph_mem_ptr);
 
 // Check memory against args->mem_to_use and total RAM
+// With --plan, prints the memory plan to STDOUT and exits before we allocate.
+// Commands must not create output files before calling this. Commands that
+// never call it are marked in mccortex.c and reject --plan.
 void cmd_check_mem_limit(size_t mem_to_use, size_t mem_requested);
 
-// Print memory being used
+// Print memory being used, also adds it to the memory plan
 void cmd_print_mem(size_t mem_bytes, const char *name);
 
+// Set by --plan: print allocation plan and exit before running a command
+void cmd_mem_set_plan(bool plan);
+bool cmd_mem_get_plan();
+
 #endif /* CMD_MEM_H_ */
@@ -0,0 +1,842 @@
+#include "global.h"
+#include "compact_graph.h"
+#include "db_node.h"
+#include "db_unitig.h"
+#include "unitig_graph.h"
+#include "json_hdr.h"
+#include "file_util.h"
+#include "common_buffers.h"
+#include "util.h"
+#include "sort_r/sort_r.h" // sort_r()
+
+#include <unistd.h> // pwrite()
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// Construction
+//
+
+// Unitig stored by a thread during construction
+typedef struct
+{
+  dBNode first, last;
+  uint64_t nkmers, seq_offset, covg_offset; // offsets in thread buffers
+} CGUnitig;
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(cg_unitig_buf, CGUnitigBuffer, CGUnitig);
+
+typedef struct
+{
+  CGUnitigBuffer unitigs;
+  ByteBuffer seq;
+  Uint32Buffer covgs;
+} CGThread;
+
+typedef struct
+{
+  const dBGraph *db_graph;
+  UnitigKmerGraph ugraph;
+  CGThread *threads;
+  size_t nthreads;
+  // Unitig with ID from unitig_graph_store_end_mt() is
+  // threads[uthread[id]].unitigs.b[uindex[id]]
+  uint32_t *uthread;
+  uint64_t *uindex;
+  // order[u] is the ID of unitig u, unitig_ids[order[u]] == u
+  uint64_t *order, *unitig_ids;
+  CompactGraph *cg;
+} CGBuilder;
+
+static void _cg_add_unitig(dBNodeBuffer nbuf, size_t threadid, void *arg)
+{
+  CGBuilder *builder = (CGBuilder*)arg;
+  const dBGraph *db_graph = builder->db_graph;
+  const size_t kmer_size = db_graph->kmer_size, ncols = db_graph->num_of_cols;
+  CGThread *thread = &builder->threads[threadid];
+  const dBNode *nodes = nbuf.b;
+  size_t i, col, nbases = nbuf.len + kmer_size - 1;
+  uint64_t sum;
+  char kmer_str[MAX_KMER_SIZE+1];
+
+  db_unitig_normalise(nbuf.b, nbuf.len, db_graph);
+  unitig_graph_store_end_mt(nbuf.b, nbuf.len, &builder->ugraph);
+
+  CGUnitig unitig = {.first = nodes[0], .last = nodes[nbuf.len-1],
+                     .nkmers = nbuf.len,
+                     .seq_offset = thread->seq.len,
+                     .covg_offset = thread->covgs.len};
+  cg_unitig_buf_add(&thread->unitigs, unitig);
+
+  // Pack sequence
+  size_t seq_offset = byte_buf_push_zero(&thread->seq, binary_seq_mem(nbases));
+  uint8_t *seq = thread->seq.b + seq_offset;
+  BinaryKmer bkmer = db_node_oriented_bkmer(db_graph, nodes[0]);
+  binary_kmer_to_str(bkmer, kmer_size, kmer_str);
+  for(i = 0; i < kmer_size; i++)
+    binary_seq_set(seq, i, dna_char_to_nuc(kmer_str[i]));
+  for(i = 1; i < nbuf.len; i++)
+    binary_seq_set(seq, kmer_size-1+i, db_node_get_last_nuc(nodes[i], db_graph));
+
+  // Mean coverage in each colour
+  if(db_graph->col_covgs != NULL) {
+    for(col = 0; col < ncols; col++) {
+      for(i = 0, sum = 0; i < nbuf.len; i++)
+        sum += db_node_get_covg(db_graph, nodes[i].key, col);
+      uint32_buf_add(&thread->covgs, (sum + nbuf.len/2) / nbuf.len);
+    }
+  } else {
+    uint32_buf_push_zero(&thread->covgs, ncols);
+  }
+}
+
+static const CGUnitig* _cg_get_unitig(const CGBuilder *builder, size_t uid)
+{
+  return &builder->threads[builder->uthread[uid]].unitigs.b[builder->uindex[uid]];
+}
+
+// Sort unitig IDs by first kmer
+static int _cg_unitig_cmp(const void *aa, const void *bb, void *arg)
+{
+  const CGBuilder *builder = (const CGBuilder*)arg;
+  const dBGraph *db_graph = builder->db_graph;
+  const CGUnitig *a = _cg_get_unitig(builder, *(const uint64_t*)aa);
+  const CGUnitig *b = _cg_get_unitig(builder, *(const uint64_t*)bb);
+  return binary_kmers_compare(db_node_get_bkey(db_graph, a->first.key),
+                              db_node_get_bkey(db_graph, b->first.key));
+}
+
+// Get the end we enter when walking into `node`
+static inline uint64_t _cg_entry_end(const CGBuilder *builder,
+                                     const uint64_t *unitig_ids, dBNode node)
+{
+  UnitigEnd uend = builder->ugraph.unitig_ends[node.key];
+  ctx_assert(uend.assigned);
+  ctx_assert((uend.left  && node.orient ==  uend.lorient) ||
+             (uend.right && node.orient == !uend.rorient));
+  bool left = uend.left && node.orient == uend.lorient;
+  return 2*unitig_ids[uend.unitigid] + !left;
+}
+
+// Get ends linked to the left (side=0) or right (side=1) end of a unitig
+static size_t _cg_next_ends(const CGBuilder *builder, const uint64_t *unitig_ids,
+                            const CGUnitig *unitig, int side, uint64_t ends[4])
+{
+  const dBGraph *db_graph = builder->db_graph;
+  dBNode node = side ? unitig->last : db_node_reverse(unitig->first);
+  dBNode next_nodes[4];
+  Nucleotide next_nucs[4];
+  size_t i, n;
+
+  n = db_graph_next_nodes_union(db_graph, node, next_nodes, next_nucs);
+  for(i = 0; i < n; i++)
+    ends[i] = _cg_entry_end(builder, unitig_ids, next_nodes[i]);
+
+  return n;
+}
+
+#define _cg_thread_range(builder,tid,start,end) do { \
+  (start) = (builder)->cg->num_unitigs * (tid) / (builder)->nthreads; \
+  (end) = (builder)->cg->num_unitigs * ((tid)+1) / (builder)->nthreads; \
+} while(0)
+
+// Store size of unitig u in offset arrays at u+1, to be summed
+static void _cg_count_thread(void *arg, size_t threadid)
+{
+  const CGBuilder *builder = (const CGBuilder*)arg;
+  CompactGraph *cg = builder->cg;
+  const CGUnitig *unitig;
+  uint64_t ends[4];
+  size_t u, start, end, side;
+
+  _cg_thread_range(builder, threadid, start, end);
+
+  for(u = start; u < end; u++) {
+    unitig = _cg_get_unitig(builder, builder->order[u]);
+    cg->kmer_offset[u+1] = unitig->nkmers;
+    cg->seq_offset[u+1] = binary_seq_mem(unitig->nkmers + cg->kmer_size - 1);
+    for(side = 0; side < 2; side++) {
+      cg->link_offset[2*u+side+1] = _cg_next_ends(builder, builder->unitig_ids,
+                                                  unitig, side, ends);
+    }
+  }
+}
+
+static void _cg_copy_thread(void *arg, size_t threadid)
+{
+  const CGBuilder *builder = (const CGBuilder*)arg;
+  CompactGraph *cg = builder->cg;
+  const size_t ncols = cg->num_of_cols;
+  const CGThread *thread;
+  const CGUnitig *unitig;
+  uint64_t ends[4];
+  size_t u, start, end, side, col, i, n, nends;
+
+  _cg_thread_range(builder, threadid, start, end);
+
+  for(u = start; u < end; u++) {
+    thread = &builder->threads[builder->uthread[builder->order[u]]];
+    unitig = _cg_get_unitig(builder, builder->order[u]);
+    memcpy(cg->seq + cg->seq_offset[u], thread->seq.b + unitig->seq_offset,
+           cg->seq_offset[u+1] - cg->seq_offset[u]);
+    for(col = 0; col < ncols; col++)
+      compact_graph_covg(cg, u, col) = thread->covgs.b[unitig->covg_offset+col];
+    for(side = 0; side < 2; side++) {
+      nends = _cg_next_ends(builder, builder->unitig_ids, unitig, side, ends);
+      for(i = 0, n = cg->link_offset[2*u+side]; i < nends; i++, n++)
+        cg->links[n] = ends[i];
+    }
+  }
+}
+
+/**
+ * Build from a graph, using the union of edges of all colours
+ * Coverage is only stored if db_graph has coverages
+ */
+void compact_graph_build(CompactGraph *cg, size_t nthreads,
+                         const dBGraph *db_graph)
+{
+  const size_t ncols = db_graph->num_of_cols;
+  const size_t capacity = db_graph->ht.capacity;
+  size_t i, t, u;
+
+  status("[CompactGraph] Compacting graph with %zu threads", nthreads);
+
+  CGBuilder builder;
+  memset(&builder, 0, sizeof(builder));
+  builder.db_graph = db_graph;
+  builder.nthreads = nthreads;
+  builder.threads = ctx_calloc(nthreads, sizeof(CGThread));
+  unitig_graph_alloc(&builder.ugraph, db_graph);
+
+  for(t = 0; t < nthreads; t++) {
+    cg_unitig_buf_alloc(&builder.threads[t].unitigs, 1024);
+    byte_buf_alloc(&builder.threads[t].seq, 4096);
+    uint32_buf_alloc(&builder.threads[t].covgs, 1024);
+  }
+
+  uint8_t *visited = ctx_calloc(roundup_bits2bytes(capacity), 1);
+  db_unitigs_iterate(nthreads, visited, db_graph, _cg_add_unitig, &builder);
+  ctx_free(visited);
+
+  const size_t num_unitigs = builder.ugraph.num_unitigs;
+
+  // Find unitigs by ID
+  builder.uthread = ctx_malloc(num_unitigs * sizeof(uint32_t));
+  builder.uindex = ctx_malloc(num_unitigs * sizeof(uint64_t));
+
+  for(t = 0; t < nthreads; t++) {
+    for(i = 0; i < builder.threads[t].unitigs.len; i++) {
+      hkey_t hkey = builder.threads[t].unitigs.b[i].first.key;
+      u = builder.ugraph.unitig_ends[hkey].unitigid;
+      builder.uthread[u] = t;
+      builder.uindex[u] = i;
+    }
+  }
+
+  // Number unitigs in order of first kmer
+  uint64_t *order = ctx_malloc(num_unitigs * sizeof(uint64_t));
+  uint64_t *unitig_ids = ctx_malloc(num_unitigs * sizeof(uint64_t));
+  for(u = 0; u < num_unitigs; u++) order[u] = u;
+  sort_r(order, num_unitigs, sizeof(uint64_t), _cg_unitig_cmp, &builder);
+  for(u = 0; u < num_unitigs; u++) unitig_ids[order[u]] = u;
+
+  memset(cg, 0, sizeof(CompactGraph));
+  cg->kmer_size = db_graph->kmer_size;
+  cg->num_of_cols = ncols;
+  cg->num_unitigs = num_unitigs;
+  cg->kmer_offset = ctx_malloc((num_unitigs+1) * sizeof(uint64_t));
+  cg->seq_offset = ctx_malloc((num_unitigs+1) * sizeof(uint64_t));
+  cg->covgs = ctx_malloc(num_unitigs * ncols * sizeof(Covg));
+  cg->link_offset = ctx_malloc((2*num_unitigs+1) * sizeof(uint64_t));
+
+  builder.order = order;
+  builder.unitig_ids = unitig_ids;
+  builder.cg = cg;
+
+  // Count kmers, bytes and links of each unitig, then sum to get offsets
+  util_multi_thread(&builder, nthreads, _cg_count_thread);
+
+  cg->kmer_offset[0] = cg->seq_offset[0] = cg->link_offset[0] = 0;
+  for(u = 0; u < num_unitigs; u++) {
+    cg->kmer_offset[u+1] += cg->kmer_offset[u];
+    cg->seq_offset[u+1] += cg->seq_offset[u];
+  }
+  for(i = 0; i < 2*num_unitigs; i++) cg->link_offset[i+1] += cg->link_offset[i];
+
+  const uint64_t nkmers = cg->num_kmers = cg->kmer_offset[num_unitigs];
+  const uint64_t nlinks = cg->num_links = cg->link_offset[2*num_unitigs];
+  cg->seq = ctx_malloc(cg->seq_offset[num_unitigs]);
+  cg->links = ctx_malloc(nlinks * sizeof(uint64_t));
+
+  // Copy sequence, coverage and links
+  util_multi_thread(&builder, nthreads, _cg_copy_thread);
+
+  ctx_free(order);
+  ctx_free(unitig_ids);
+
+  for(t = 0; t < nthreads; t++) {
+    cg_unitig_buf_dealloc(&builder.threads[t].unitigs);
+    byte_buf_dealloc(&builder.threads[t].seq);
+    uint32_buf_dealloc(&builder.threads[t].covgs);
+  }
+  ctx_free(builder.threads);
+  ctx_free(builder.uthread);
+  ctx_free(builder.uindex);
+  unitig_graph_dealloc(&builder.ugraph);
+
+  char nunitigs_str[50], nkmers_str[50], nlinks_str[50];
+  ulong_to_str(num_unitigs, nunitigs_str);
+  ulong_to_str(nkmers, nkmers_str);
+  ulong_to_str(nlinks, nlinks_str);
+  status("[CompactGraph] %s unitigs, %s kmers, %s links",
+         nunitigs_str, nkmers_str, nlinks_str);
+}
+
+void compact_graph_dealloc(CompactGraph *cg)
+{
+  if(cg->mmap_ptr != NULL) {
+    if(munmap(cg->mmap_ptr, cg->mmap_len) == -1)
+      die("Cannot release mmap .ctu file [%s]", strerror(errno));
+  } else {
+    ctx_free(cg->kmer_offset);
+    ctx_free(cg->seq_offset);
+    ctx_free(cg->seq);
+    ctx_free(cg->covgs);
+    ctx_free(cg->link_offset);
+    ctx_free(cg->links);
+  }
+  memset(cg, 0, sizeof(CompactGraph));
+}
+
+//
+// .ctu files
+//
+
+// Arrays start at an offset that is a multiple of this
+#define CTU_DATA_ALIGN 8
+
+// Array sections of a .ctu file in the order they are written
+#define CTU_NUM_SECTIONS 6
+
+typedef struct
+{
+  void *ptr;
+  size_t len;
+} CTUSection;
+
+static void _ctu_sections(const CompactGraph *cg, size_t seq_bytes,
+                          CTUSection sections[CTU_NUM_SECTIONS])
+{
+  const size_t n = cg->num_unitigs;
+  sections[0] = (CTUSection){cg->kmer_offset, (n+1)*sizeof(uint64_t)};
+  sections[1] = (CTUSection){cg->seq_offset, (n+1)*sizeof(uint64_t)};
+  sections[2] = (CTUSection){cg->link_offset, (2*n+1)*sizeof(uint64_t)};
+  sections[3] = (CTUSection){cg->links, cg->num_links*sizeof(uint64_t)};
+  sections[4] = (CTUSection){cg->covgs, n*cg->num_of_cols*sizeof(Covg)};
+  sections[5] = (CTUSection){cg->seq, seq_bytes};
+}
+
+typedef struct
+{
+  CTUSection sections[CTU_NUM_SECTIONS];
+  off_t data_offset;
+  int fd;
+  size_t nthreads;
+  const char *path;
+} CTUWriter;
+
+static void _ctu_pwrite(int fd, const void *buf, size_t len, off_t offset,
+                        const char *path)
+{
+  const char *ptr = (const char*)buf;
+  ssize_t n;
+
+  while(len > 0) {
+    n = pwrite(fd, ptr, len, offset);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) die("Cannot write: %s [%s]", path, strerror(errno));
+    ptr += n; len -= (size_t)n; offset += n;
+  }
+}
+
+// Each thread writes a slice of each section
+static void _ctu_write_thread(void *arg, size_t threadid)
+{
+  const CTUWriter *wtr = (const CTUWriter*)arg;
+  off_t offset = wtr->data_offset;
+  size_t i, start, end;
+
+  for(i = 0; i < CTU_NUM_SECTIONS; i++) {
+    const CTUSection *sec = &wtr->sections[i];
+    start = sec->len * threadid / wtr->nthreads;
+    end = sec->len * (threadid+1) / wtr->nthreads;
+    if(end > start) {
+      _ctu_pwrite(wtr->fd, (const char*)sec->ptr + start, end - start,
+                  offset + start, wtr->path);
+    }
+    offset += sec->len;
+  }
+}
+
+void compact_graph_save(const CompactGraph *cg, const char *path,
+                        cJSON **hdrs, size_t nhdrs,
+                        const dBGraph *db_graph, size_t nthreads)
+{
+  const size_t n = cg->num_unitigs;
+
+  cJSON *jsonhdr = cJSON_CreateObject();
+  cJSON_AddStringToObject(jsonhdr, "file_format", CTU_FILE_FORMAT);
+  cJSON_AddNumberToObject(jsonhdr, "format_version", CTU_FORMAT_VERSION);
+  json_hdr_make_std(jsonhdr, path, hdrs, nhdrs, db_graph, cg->num_kmers);
+
+  cJSON *unitigs = cJSON_CreateObject();
+  cJSON_AddItemToObject(jsonhdr, "unitigs", unitigs);
+  cJSON_AddNumberToObject(unitigs, "num_unitigs", n);
+  cJSON_AddNumberToObject(unitigs, "num_kmers", cg->num_kmers);
+  cJSON_AddNumberToObject(unitigs, "num_links", cg->num_links);
+  cJSON_AddNumberToObject(unitigs, "seq_bytes", cg->seq_offset[n]);
+
+  FILE *fout = futil_fopen(path, "w");
+  json_hdr_fprint(jsonhdr, fout);
+  cJSON_Delete(jsonhdr);
+
+  // Pad header so arrays are aligned
+  const char zeros[CTU_DATA_ALIGN] = {0};
+  long hdr_len = ftell(fout);
+  if(hdr_len < 0) die("Cannot get file position: %s [%s]", path, strerror(errno));
+  size_t pad = (CTU_DATA_ALIGN - hdr_len % CTU_DATA_ALIGN) % CTU_DATA_ALIGN;
+  if(pad && fwrite(zeros, 1, pad, fout) != pad)
+    die("Cannot write: %s [%s]", path, strerror(errno));
+  if(fflush(fout) != 0) die("Cannot write: %s [%s]", path, strerror(errno));
+
+  CTUWriter wtr = {.data_offset = hdr_len + pad, .fd = fileno(fout),
+                   .nthreads = nthreads, .path = path};
+  _ctu_sections(cg, cg->seq_offset[n], wtr.sections);
+  util_multi_thread(&wtr, nthreads, _ctu_write_thread);
+
+  futil_fclose(fout);
+}
+
+// Read JSON header and set sizes in `cg`
+// Returns offset of the first array in the file
+static size_t _ctu_read_hdr(CompactGraph *cg, FILE *fin, const char *path,
+                            size_t *seq_bytes)
+{
+  StrBuf hdrstr;
+  strbuf_alloc(&hdrstr, 1024);
+  json_hdr_read(fin, NULL, path, &hdrstr);
+  cJSON *jsonhdr = cJSON_Parse(hdrstr.b);
+  if(jsonhdr == NULL) die("Invalid JSON header: %s", path);
+  strbuf_dealloc(&hdrstr);
+
+  // Header is followed by an empty line
+  if(fgetc(fin) != '\n') die("Bad .ctu file, expected empty line: %s", path);
+
+  cJSON *fmt = json_hdr_get(jsonhdr, "file_format", cJSON_String, path);
+  if(strcmp(fmt->valuestring, CTU_FILE_FORMAT) != 0)
+    die("Not a .ctu file: %s", path);
+
+  size_t version = json_hdr_demand_uint(jsonhdr, "format_version", path);
+  if(version != CTU_FORMAT_VERSION)
+    die("Unsupported .ctu format version %zu: %s", version, path);
+
+  memset(cg, 0, sizeof(CompactGraph));
+  cg->kmer_size = json_hdr_get_kmer_size(jsonhdr, path);
+  cg->num_of_cols = json_hdr_get_ncols(jsonhdr, path);
+
+  cJSON *unitigs = json_hdr_get(jsonhdr, "unitigs", cJSON_Object, path);
+  cg->num_unitigs = json_hdr_demand_uint(unitigs, "num_unitigs", path);
+  cg->num_kmers = json_hdr_demand_uint(unitigs, "num_kmers", path);
+  cg->num_links = json_hdr_demand_uint(unitigs, "num_links", path);
+  *seq_bytes = json_hdr_demand_uint(unitigs, "seq_bytes", path);
+  cJSON_Delete(jsonhdr);
+
+  long hdr_len = ftell(fin);
+  if(hdr_len < 0) die("Cannot get file position: %s [%s]", path, strerror(errno));
+  return ((size_t)hdr_len + CTU_DATA_ALIGN - 1) / CTU_DATA_ALIGN * CTU_DATA_ALIGN;
+}
+
+static void _ctu_check(const CompactGraph *cg, size_t seq_bytes,
+                       const char *path)
+{
+  const size_t n = cg->num_unitigs;
+  if(cg->kmer_offset[n] != cg->num_kmers || cg->seq_offset[n] != seq_bytes ||
+     cg->link_offset[2*n] != cg->num_links) {
+    die("Corrupt .ctu file: %s", path);
+  }
+}
+
+void compact_graph_mmap(CompactGraph *cg, const char *path)
+{
+  FILE *fin = futil_fopen(path, "r");
+  size_t i, seq_bytes, data_offset, file_len;
+  CTUSection sections[CTU_NUM_SECTIONS];
+  struct stat st;
+
+  data_offset = _ctu_read_hdr(cg, fin, path, &seq_bytes);
+
+  // Sections are contiguous so we only need their lengths to find them
+  _ctu_sections(cg, seq_bytes, sections);
+  for(i = 0, file_len = data_offset; i < CTU_NUM_SECTIONS; i++)
+    file_len += sections[i].len;
+
+  if(fstat(fileno(fin), &st) != 0 || (size_t)st.st_size != file_len)
+    die("Corrupt .ctu file, expected %zu bytes: %s", file_len, path);
+
+  uint8_t *ptr = mmap(NULL, file_len, PROT_READ, MAP_SHARED, fileno(fin), 0);
+  if(ptr == MAP_FAILED)
+    die("Cannot memory map file: %s [%s]", path, strerror(errno));
+
+  cg->mmap_ptr = ptr;
+  cg->mmap_len = file_len;
+
+  ptr += data_offset;
+  cg->kmer_offset = (uint64_t*)ptr; ptr += sections[0].len;
+  cg->seq_offset = (uint64_t*)ptr;  ptr += sections[1].len;
+  cg->link_offset = (uint64_t*)ptr; ptr += sections[2].len;
+  cg->links = (uint64_t*)ptr;       ptr += sections[3].len;
+  cg->covgs = (Covg*)ptr;           ptr += sections[4].len;
+  cg->seq = ptr;
+
+  _ctu_check(cg, seq_bytes, path);
+  futil_fclose(fin); // mapping stays valid after closing
+}
+
+//
+// GFA
+//
+
+typedef struct
+{
+  uint64_t name, seq; // offsets into names and seqs buffers
+  uint64_t nbases;
+  BinaryKmer first; // key of first kmer once normalised
+  bool flip; // reverse complement to normalise
+} GFASeg;
+
+madcrow_buffer(gfa_seg_buf, GFASegBuffer, GFASeg);
+
+typedef struct
+{
+  uint64_t from, to; // ends
+} GFALink;
+
+madcrow_buffer(gfa_link_buf, GFALinkBuffer, GFALink);
+
+typedef struct
+{
+  GFASegBuffer segs;
+  GFALinkBuffer links;
+  StrBuf names; // '\0' separated segment names
+  ByteBuffer seqs; // packed sequences
+  Uint32Buffer covgs; // ncovgs per segment
+  size_t ncovgs, kmer_size;
+  uint64_t *byname; // segment indices sorted by name
+  const char *path;
+} GFALoader;
+
+// Split a line on tabs, returns number of fields
+static size_t _gfa_split(char *line, char **fields, size_t max)
+{
+  size_t n = 0;
+  char *tab;
+  while(n < max) {
+    fields[n++] = line;
+    if((tab = strchr(line, '\t')) == NULL) break;
+    *tab = '\0';
+    line = tab+1;
+  }
+  return n;
+}
+
+// Returns number of coverage values parsed from a segment tag
+static size_t _gfa_parse_covgs(GFALoader *ldr, const char *tag)
+{
+  const size_t taglen = strlen(CTU_GFA_COVG_TAG);
+  const char *str = tag + taglen;
+  char *end;
+  size_t n = 0;
+  unsigned long covg;
+
+  while(*str == ',') {
+    covg = strtoul(str+1, &end, 10);
+    if(end == str+1 || covg > UINT32_MAX)
+      die("Bad coverage tag '%s': %s", tag, ldr->path);
+    uint32_buf_add(&ldr->covgs, covg);
+    str = end;
+    n++;
+  }
+
+  if(*str != '\0') die("Bad coverage tag '%s': %s", tag, ldr->path);
+  return n;
+}
+
+static void _gfa_add_segment(GFALoader *ldr, char **fields, size_t nfields)
+{
+  if(nfields < 3) die("Bad GFA segment line: %s", ldr->path);
+
+  const char *name = fields[1], *seq = fields[2];
+  size_t i, nbases = strlen(seq), ncovgs = 0;
+
+  for(i = 0; i < nbases && char_is_acgt(seq[i]); i++) {}
+  if(nbases == 0 || i < nbases)
+    die("Segment %s does not have an ACGT sequence: %s", name, ldr->path);
+
+  GFASeg seg = {.name = ldr->names.end, .seq = ldr->seqs.len, .nbases = nbases};
+  gfa_seg_buf_add(&ldr->segs, seg);
+
+  strbuf_append_str(&ldr->names, name);
+  strbuf_append_char(&ldr->names, '\0');
+
+  size_t offset = byte_buf_push_zero(&ldr->seqs, binary_seq_mem(nbases));
+  binary_seq_from_str(seq, nbases, ldr->seqs.b + offset);
+
+  for(i = 3; i < nfields; i++)
+    if(strncmp(fields[i], CTU_GFA_COVG_TAG",", strlen(CTU_GFA_COVG_TAG)+1) == 0)
+      ncovgs += _gfa_parse_covgs(ldr, fields[i]);
+
+  if(ldr->segs.len == 1) ldr->ncovgs = ncovgs;
+  else if(ncovgs != ldr->ncovgs)
+    die("Segments have different numbers of colours: %s", ldr->path);
+}
+
+static int _gfa_name_cmp(const void *aa, const void *bb, void *arg)
+{
+  const GFALoader *ldr = (const GFALoader*)arg;
+  const GFASeg *a = &ldr->segs.b[*(const uint64_t*)aa];
+  const GFASeg *b = &ldr->segs.b[*(const uint64_t*)bb];
+  return strcmp(ldr->names.b + a->name, ldr->names.b + b->name);
+}
+
+static uint64_t _gfa_find_segment(const GFALoader *ldr, const char *name)
+{
+  size_t lo = 0, hi = ldr->segs.len, mid;
+  int c;
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    c = strcmp(ldr->names.b + ldr->segs.b[ldr->byname[mid]].name, name);
+    if(c == 0) return ldr->byname[mid];
+    if(c < 0) lo = mid+1;
+    else hi = mid;
+  }
+
+  die("Link to unknown segment %s: %s", name, ldr->path);
+}
+
+static void _gfa_add_link(GFALoader *ldr, char **fields, size_t nfields)
+{
+  if(nfields < 6 || !strchr("+-", fields[2][0]) || !strchr("+-", fields[4][0]))
+    die("Bad GFA link line: %s", ldr->path);
+
+  char *end;
+  unsigned long overlap = strtoul(fields[5], &end, 10);
+  if(end == fields[5] || strcmp(end, "M") != 0)
+    die("Links must have an overlap of k-1 bases (e.g. 30M): %s", ldr->path);
+
+  if(ldr->kmer_size == 0) ldr->kmer_size = overlap + 1;
+  else if(ldr->kmer_size != overlap + 1)
+    die("Links have different overlaps: %s", ldr->path);
+
+  // Leave through end `from`, enter through end `to`
+  uint64_t a = _gfa_find_segment(ldr, fields[1]);
+  uint64_t b = _gfa_find_segment(ldr, fields[3]);
+  GFALink link = {.from = 2*a + (fields[2][0] == '+'),
+                  .to   = 2*b + (fields[4][0] == '-')};
+  gfa_link_buf_add(&ldr->links, link);
+}
+
+// Read lines of one record type ('S' or 'L') from a GFA file
+static void _gfa_read(GFALoader *ldr, char type)
+{
+  gzFile gzin = futil_gzopen(ldr->path, "r");
+  StrBuf line;
+  strbuf_alloc(&line, 1024);
+  char *fields[64];
+  size_t nfields;
+
+  while(strbuf_reset(&line),
+        futil_gzcheck(strbuf_gzreadline(&line, gzin), gzin, ldr->path) > 0)
+  {
+    strbuf_chomp(&line);
+    if(line.end < 2 || line.b[0] != type || line.b[1] != '\t') continue;
+    nfields = _gfa_split(line.b, fields, sizeof(fields)/sizeof(fields[0]));
+    if(type == 'S') _gfa_add_segment(ldr, fields, nfields);
+    else _gfa_add_link(ldr, fields, nfields);
+  }
+
+  strbuf_dealloc(&line);
+  gzclose(gzin);
+}
+
+static BinaryKmer _gfa_kmer(const GFALoader *ldr, const GFASeg *seg,
+                            size_t offset)
+{
+  char str[MAX_KMER_SIZE+1];
+  const uint8_t *seq = ldr->seqs.b + seg->seq;
+  size_t i;
+  for(i = 0; i < ldr->kmer_size; i++)
+    str[i] = dna_nuc_to_char(binary_seq_get(seq, offset+i));
+  return binary_kmer_from_str(str, ldr->kmer_size);
+}
+
+// Same as db_unitig_normalise(), except closed cycles are not rotated
+static void _gfa_normalise(const GFALoader *ldr, GFASeg *seg)
+{
+  const size_t k = ldr->kmer_size;
+  BinaryKmer bkmer0 = _gfa_kmer(ldr, seg, 0);
+  BinaryKmer bkey0 = binary_kmer_get_key(bkmer0, k);
+  BinaryKmer bkey1 = binary_kmer_get_key(_gfa_kmer(ldr, seg, seg->nbases-k), k);
+
+  if(seg->nbases == k) seg->flip = !binary_kmer_eq(bkmer0, bkey0);
+  else seg->flip = binary_kmer_lt(bkey1, bkey0);
+
+  seg->first = seg->flip ? bkey1 : bkey0;
+}
+
+static int _gfa_seg_cmp(const void *aa, const void *bb, void *arg)
+{
+  const GFALoader *ldr = (const GFALoader*)arg;
+  const GFASeg *a = &ldr->segs.b[*(const uint64_t*)aa];
+  const GFASeg *b = &ldr->segs.b[*(const uint64_t*)bb];
+  return binary_kmers_compare(a->first, b->first);
+}
+
+// Sort links by end, then by nucleotide added, as in compact_graph_build()
+static int _gfa_link_cmp(const void *aa, const void *bb, void *arg)
+{
+  const CompactGraph *cg = (const CompactGraph*)arg;
+  const GFALink *a = (const GFALink*)aa, *b = (const GFALink*)bb;
+  if(a->from != b->from) return cmp(a->from, b->from);
+  Nucleotide nuca = compact_graph_entry_nuc(cg, a->to);
+  Nucleotide nucb = compact_graph_entry_nuc(cg, b->to);
+  if(nuca != nucb) return cmp(nuca, nucb);
+  return cmp(a->to, b->to);
+}
+
+void compact_graph_load_gfa(CompactGraph *cg, const char *path)
+{
+  GFALoader ldr;
+  memset(&ldr, 0, sizeof(ldr));
+  ldr.path = path;
+  gfa_seg_buf_alloc(&ldr.segs, 1024);
+  gfa_link_buf_alloc(&ldr.links, 1024);
+  strbuf_alloc(&ldr.names, 4096);
+  byte_buf_alloc(&ldr.seqs, 4096);
+  uint32_buf_alloc(&ldr.covgs, 1024);
+
+  // Segments may appear after links that use them, so read file twice
+  _gfa_read(&ldr, 'S');
+
+  const size_t n = ldr.segs.len;
+  size_t i, u, col, nlinks;
+
+  ldr.byname = ctx_malloc(n * sizeof(uint64_t));
+  for(i = 0; i < n; i++) ldr.byname[i] = i;
+  sort_r(ldr.byname, n, sizeof(uint64_t), _gfa_name_cmp, &ldr);
+  for(i = 1; i < n; i++) {
+    if(_gfa_name_cmp(&ldr.byname[i-1], &ldr.byname[i], &ldr) == 0)
+      die("Duplicate segment name: %s", ldr.names.b + ldr.segs.b[ldr.byname[i]].name);
+  }
+
+  _gfa_read(&ldr, 'L');
+
+  // Without links, assume the shortest segment is one kmer
+  if(ldr.kmer_size == 0) {
+    for(i = 0, ldr.kmer_size = MAX_KMER_SIZE; i < n; i++)
+      ldr.kmer_size = MIN2(ldr.kmer_size, ldr.segs.b[i].nbases);
+    warn("No links, guessing kmer size %zu from shortest segment: %s",
+         ldr.kmer_size, path);
+  }
+
+  const size_t kmer_size = ldr.kmer_size;
+  if(kmer_size < MIN_KMER_SIZE || kmer_size > MAX_KMER_SIZE || !(kmer_size&1)) {
+    die("Kmer size %zu is not an odd int between %i..%i: %s",
+        kmer_size, MIN_KMER_SIZE, MAX_KMER_SIZE, path);
+  }
+
+  for(i = 0; i < n; i++) {
+    if(ldr.segs.b[i].nbases < kmer_size) {
+      die("Segment %s is shorter than kmer size %zu: %s",
+          ldr.names.b + ldr.segs.b[i].name, kmer_size, path);
+    }
+    _gfa_normalise(&ldr, &ldr.segs.b[i]);
+  }
+
+  // Number unitigs in order of first kmer, reuse byname for the order
+  uint64_t *order = ldr.byname, *unitig_ids = ctx_malloc(n * sizeof(uint64_t));
+  for(u = 0; u < n; u++) order[u] = u;
+  sort_r(order, n, sizeof(uint64_t), _gfa_seg_cmp, &ldr);
+  for(u = 0; u < n; u++) unitig_ids[order[u]] = u;
+
+  memset(cg, 0, sizeof(CompactGraph));
+  cg->kmer_size = kmer_size;
+  cg->num_of_cols = MAX2(ldr.ncovgs, 1);
+  cg->num_unitigs = n;
+  cg->kmer_offset = ctx_malloc((n+1) * sizeof(uint64_t));
+  cg->seq_offset = ctx_malloc((n+1) * sizeof(uint64_t));
+  cg->covgs = ctx_calloc(n * cg->num_of_cols, sizeof(Covg));
+  cg->link_offset = ctx_calloc(2*n+1, sizeof(uint64_t));
+  cg->seq = ctx_malloc(ldr.seqs.len);
+
+  const GFASeg *seg;
+  uint64_t nkmers = 0, nbytes = 0, nseqbytes;
+
+  for(u = 0; u < n; u++) {
+    seg = &ldr.segs.b[order[u]];
+    nseqbytes = binary_seq_mem(seg->nbases);
+    cg->kmer_offset[u] = nkmers;
+    cg->seq_offset[u] = nbytes;
+    memcpy(cg->seq + nbytes, ldr.seqs.b + seg->seq, nseqbytes);
+    if(seg->flip) binary_seq_reverse_complement(cg->seq + nbytes, seg->nbases);
+    for(col = 0; col < ldr.ncovgs; col++)
+      compact_graph_covg(cg, u, col) = ldr.covgs.b[order[u]*ldr.ncovgs + col];
+    nkmers += seg->nbases - kmer_size + 1;
+    nbytes += nseqbytes;
+  }
+
+  cg->kmer_offset[n] = cg->num_kmers = nkmers;
+  cg->seq_offset[n] = nbytes;
+
+  // Renumber ends, store links in both directions and remove duplicates
+  GFALink link;
+  nlinks = ldr.links.len;
+  for(i = 0; i < nlinks; i++) {
+    link = ldr.links.b[i];
+    link.from = 2*unitig_ids[link.from/2] + ((link.from&1) ^ ldr.segs.b[link.from/2].flip);
+    link.to   = 2*unitig_ids[link.to/2]   + ((link.to&1)   ^ ldr.segs.b[link.to/2].flip);
+    ldr.links.b[i] = link;
+    if(link.from != link.to)
+      gfa_link_buf_add(&ldr.links, (GFALink){.from = link.to, .to = link.from});
+  }
+
+  sort_r(ldr.links.b, ldr.links.len, sizeof(GFALink), _gfa_link_cmp, cg);
+
+  cg->links = ctx_malloc(ldr.links.len * sizeof(uint64_t));
+  for(i = nlinks = 0; i < ldr.links.len; i++) {
+    link = ldr.links.b[i];
+    if(i > 0 && link.from == ldr.links.b[i-1].from &&
+       link.to == ldr.links.b[i-1].to) continue;
+    cg->links[nlinks++] = link.to;
+    cg->link_offset[link.from+1]++;
+  }
+  for(i = 0; i < 2*n; i++) cg->link_offset[i+1] += cg->link_offset[i];
+  cg->num_links = nlinks;
+
+  ctx_free(unitig_ids);
+  ctx_free(ldr.byname);
+  gfa_seg_buf_dealloc(&ldr.segs);
+  gfa_link_buf_dealloc(&ldr.links);
+  strbuf_dealloc(&ldr.names);
+  byte_buf_dealloc(&ldr.seqs);
+  uint32_buf_dealloc(&ldr.covgs);
+
+  char nunitigs_str[50], nkmers_str[50], nlinks_str[50];
+  ulong_to_str(n, nunitigs_str);
+  ulong_to_str(nkmers, nkmers_str);
+  ulong_to_str(nlinks, nlinks_str);
+  status("[CompactGraph] Loaded %s unitigs, %s kmers, %s links (k=%zu) from %s",
+         nunitigs_str, nkmers_str, nlinks_str, kmer_size, path);
+}
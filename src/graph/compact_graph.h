@@ -0,0 +1,111 @@
+#ifndef COMPACT_GRAPH_H_
+#define COMPACT_GRAPH_H_
+
+#include "db_graph.h"
+#include "binary_seq.h"
+#include "cJSON/cJSON.h"
+
+//
+// Compacted de Bruijn graph: one record per unitig instead of one per kmer.
+// Holds the unitig sequences 2-bit packed, a mean coverage per colour for each
+// unitig and the links between unitig ends. Commands that only need topology
+// and coverage can load a .ctu file instead of a full graph.
+//
+// Unitigs are normalised (see db_unitig_normalise()) and numbered in order of
+// their first kmer, so the graph does not depend on the number of threads.
+//
+// Coverage is stored in columns, one per colour, so a tool can read the
+// coverage of one sample without touching the others.
+//
+// Each unitig has two ends: end 2*u is the start (left) of unitig u and end
+// 2*u+1 is the end (right). A link from end e to end f means we can leave
+// unitig e/2 through e and enter unitig f/2 through f. Links are stored in both
+// directions.
+//
+
+#define CTU_FILE_FORMAT "ctu"
+#define CTU_FORMAT_VERSION 2
+
+typedef struct
+{
+  size_t kmer_size, num_of_cols;
+  size_t num_unitigs;
+  uint64_t num_kmers, num_links;
+
+  // Unitig u has kmers [kmer_offset[u], kmer_offset[u+1])
+  uint64_t *kmer_offset; // num_unitigs+1
+  // Sequence of unitig u starts at byte seq_offset[u] of seq, 4 bases per byte
+  uint64_t *seq_offset; // num_unitigs+1
+  uint8_t *seq;
+  // Mean kmer coverage [col*num_unitigs + u]
+  Covg *covgs;
+  // Ends linked to end e are links[link_offset[e] .. link_offset[e+1]]
+  uint64_t *link_offset; // 2*num_unitigs+1
+  uint64_t *links; // num_links
+
+  // Set if arrays point into a read-only memory mapped .ctu file
+  void *mmap_ptr;
+  size_t mmap_len;
+} CompactGraph;
+
+#define compact_graph_nkmers(cg,u) ((cg)->kmer_offset[(u)+1] - (cg)->kmer_offset[u])
+#define compact_graph_nbases(cg,u) (compact_graph_nkmers(cg,u) + (cg)->kmer_size - 1)
+#define compact_graph_seq(cg,u) ((cg)->seq + (cg)->seq_offset[u])
+#define compact_graph_col_covgs(cg,col) ((cg)->covgs + (col)*(cg)->num_unitigs)
+#define compact_graph_covg(cg,u,col) (compact_graph_col_covgs(cg,col)[u])
+
+#define compact_graph_nlinks(cg,e) ((cg)->link_offset[(e)+1] - (cg)->link_offset[e])
+#define compact_graph_links(cg,e) ((cg)->links + (cg)->link_offset[e])
+
+// Build from a graph, using the union of edges of all colours
+// Coverage is only stored if db_graph has coverages
+void compact_graph_build(CompactGraph *cg, size_t nthreads,
+                         const dBGraph *db_graph);
+
+void compact_graph_dealloc(CompactGraph *cg);
+
+// Nucleotide added when entering a unitig through end `e`
+static inline Nucleotide compact_graph_entry_nuc(const CompactGraph *cg,
+                                                 uint64_t e)
+{
+  size_t u = e/2, k = cg->kmer_size;
+  const uint8_t *seq = compact_graph_seq(cg, u);
+  if(e & 1) return dna_nuc_complement(binary_seq_get(seq, compact_graph_nbases(cg,u)-k));
+  else return binary_seq_get(seq, k-1);
+}
+
+//
+// .ctu files: JSON header, zero padding to a multiple of 8 bytes, then the
+// arrays: kmer_offset, seq_offset, link_offset, links, covgs, seq
+// All arrays are aligned so the file can be memory mapped.
+//
+
+/**
+ * Save to a .ctu file. Each thread writes a slice of every array.
+ * @param hdrs JSON headers of input files, may be NULL if nhdrs is 0
+ * @param db_graph used for the header: sample names and cleaning info
+ */
+void compact_graph_save(const CompactGraph *cg, const char *path,
+                        cJSON **hdrs, size_t nhdrs,
+                        const dBGraph *db_graph, size_t nthreads);
+
+// Memory map a .ctu file, arrays are read-only
+// compact_graph_dealloc() releases the mapping
+void compact_graph_mmap(CompactGraph *cg, const char *path);
+
+//
+// GFA
+//
+
+// Optional tag on GFA segments with mean coverage per colour
+#define CTU_GFA_COVG_TAG "cv:B:I"
+
+/**
+ * Load unitigs from a GFA file, e.g. from `ctx unitigs --gfa`. Segments must
+ * be unitigs of one kmer size with links that overlap by k-1 bases. Kmer size
+ * is taken from the links, or the shortest segment if there are none.
+ * Segments are normalised and sorted as in compact_graph_build().
+ */
+void compact_graph_load_gfa(CompactGraph *cg, const char *path);
+
+#endif /* COMPACT_GRAPH_H_ */
@@ -1,9 +1,11 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_COLOURS
 #include "global.h"
 #include "util.h"
 #include "binary_kmer.h"
 #include "db_graph.h"
 #include "db_node.h"
 #include "graph_info.h"
+#include "ctx_progress.h"
 
 static void db_graph_status(const dBGraph *db_graph)
 {
@@ -56,7 +58,8 @@ void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
     tmp.col_covgs = ctx_calloc(tmp.ht.capacity * num_of_cols, sizeof(Covg));
 
   if(alloc_flags & DBG_ALLOC_BKTLOCKS)
-    tmp.bktlocks = ctx_calloc(roundup_bits2bytes(tmp.ht.num_of_buckets), 1);
+    tmp.bktlocks = ctx_calloc_tag(roundup_bits2bytes(tmp.ht.num_of_buckets), 1,
+                                  ALLOC_TAG_HASH_TABLE);
 
   // 1 bit for forward, 1 bit for reverse per kmer
   if(alloc_flags & DBG_ALLOC_READSTRT)
@@ -69,6 +72,8 @@ void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
 
   memcpy(db_graph, &tmp, sizeof(dBGraph));
   db_graph_status(db_graph);
+
+  progress_set_hash_table(&db_graph->ht.num_kmers, db_graph->ht.capacity);
 }
 
 // Free memory used by all fields as well
@@ -76,6 +81,7 @@ void db_graph_dealloc(dBGraph *db_graph)
 {
   size_t i;
 
+  progress_clear_hash_table(&db_graph->ht.num_kmers);
   hash_table_dealloc(&db_graph->ht);
 
   for(i = 0; i < db_graph->num_of_cols; i++)
@@ -232,26 +238,16 @@ uint8_t db_graph_next_nodes(const dBGraph *db_graph, const BinaryKmer node_bkey,
                             Orientation orient, Edges edges,
                             dBNode nodes[4], Nucleotide fw_nucs[4])
 {
-  const size_t kmer_size = db_graph->kmer_size;
-  Edges tmp_edge;
-  Nucleotide nuc;
-  BinaryKmer bkmer;
-  uint8_t count = 0;
-
-  edges = edges_with_orientation(edges, orient);
-  bkmer = (orient == FORWARD ? binary_kmer_left_shift_one_base(node_bkey, kmer_size)
-                             : binary_kmer_right_shift_one_base(node_bkey));
-
-  for(tmp_edge = 0x1, nuc = 0; nuc < 4; tmp_edge <<= 1, nuc++) {
-    if(edges & tmp_edge) {
-      if(orient == FORWARD) binary_kmer_set_last_nuc(&bkmer, nuc);
-      else binary_kmer_set_first_nuc(&bkmer, dna_nuc_complement(nuc), kmer_size);
-      nodes[count] = db_graph_find(db_graph, bkmer);
-      nodes[count].orient ^= orient;
-      fw_nucs[count] = nuc;
-      ctx_assert(nodes[count].key != HASH_NOT_FOUND);
-      count++;
-    }
+  BinaryKmer bkmers[4];
+  uint8_t i, count;
+
+  count = bkmer_next_bkmers(node_bkey, orient, edges, db_graph->kmer_size,
+                            bkmers, fw_nucs);
+
+  for(i = 0; i < count; i++) {
+    nodes[i] = db_graph_find(db_graph, bkmers[i]);
+    nodes[i].orient ^= orient;
+    ctx_assert(nodes[i].key != HASH_NOT_FOUND);
   }
 
   return count;
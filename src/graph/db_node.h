@@ -198,6 +198,37 @@ Edges edges_get_union(const Edges *edges, size_t num);
 bool edges_has_precisely_one_edge(Edges edges, Orientation orientation,
                                   Nucleotide *nucleotide);
 
+// Kmers that follow `bkey` in orientation `orient` given its edges
+// edges are forward+reverse, returned kmers are not keys
+// fw_nucs is the nuc you would add when walking forward
+// returns how many kmers were added to @next
+static inline uint8_t bkmer_next_bkmers(BinaryKmer bkey, Orientation orient,
+                                        Edges edges, size_t kmer_size,
+                                        BinaryKmer next[4],
+                                        Nucleotide fw_nucs[4])
+{
+  Edges tmp_edge;
+  Nucleotide nuc;
+  BinaryKmer bkmer;
+  uint8_t count = 0;
+
+  edges = edges_with_orientation(edges, orient);
+  bkmer = (orient == FORWARD ? binary_kmer_left_shift_one_base(bkey, kmer_size)
+                             : binary_kmer_right_shift_one_base(bkey));
+
+  for(tmp_edge = 0x1, nuc = 0; nuc < 4; tmp_edge <<= 1, nuc++) {
+    if(edges & tmp_edge) {
+      if(orient == FORWARD) binary_kmer_set_last_nuc(&bkmer, nuc);
+      else binary_kmer_set_first_nuc(&bkmer, dna_nuc_complement(nuc), kmer_size);
+      next[count] = bkmer;
+      fw_nucs[count] = nuc;
+      count++;
+    }
+  }
+
+  return count;
+}
+
 // Get edges in hex coding, two characters [0-9a-f] per edge
 // 1=>A, 2=>C, 4=>G, 8=>T
 // "3b" => [AC] AACTA [ACT]
@@ -6,19 +6,14 @@
 #include "db_node.h"
 #include "db_unitig.h"
 
-static bool db_unitig_is_closed_cycle(dBNode n0, BinaryKmer bkey0,
-                                      dBNode n1, BinaryKmer bkey1,
-                                      const dBGraph *db_graph)
+bool db_unitig_is_closed_cycle(dBNode n0, BinaryKmer bkey0, Edges edges0,
+                               dBNode n1, BinaryKmer bkey1, Edges edges1,
+                               size_t kmer_size)
 {
-  Edges edges0, edges1;
   BinaryKmer shiftkmer;
   Nucleotide nuc;
-  const size_t kmer_size = db_graph->kmer_size;
 
-  edges0 = db_node_get_edges_union(db_graph, n0.key);
   if(edges_get_indegree(edges0, n0.orient) != 1) return false;
-
-  edges1 = db_node_get_edges_union(db_graph, n1.key);
   if(edges_get_outdegree(edges1, n1.orient) != 1) return false;
 
   // Check there is forward edge from last to first
@@ -31,6 +26,25 @@ static bool db_unitig_is_closed_cycle(dBNode n0, BinaryKmer bkey0,
   return binary_kmer_eq(bkey0, shiftkmer);
 }
 
+void db_unitig_cycle_rotate(dBNode *nlist, size_t len, size_t lowidx)
+{
+  // If already starting from the lowest kmer no change needed
+  if(lowidx > 0 || nlist[0].orient != FORWARD)
+  {
+    // a->b->c->d->e->f->a
+    // if c is lowest and FORWARD:  c->d->e->f->a->b (keep orientations)
+    // if c is lowest and REVERSE:  c->b->a->f->e->d (reverse orientations)
+
+    if(nlist[lowidx].orient == FORWARD) {
+      // Shift left by lowidx, without affecting orientations
+      db_nodes_left_shift(nlist, len, lowidx);
+    } else {
+      db_nodes_reverse_complement(nlist, lowidx+1);
+      db_nodes_reverse_complement(nlist+lowidx+1, len-lowidx-1);
+    }
+  }
+}
+
 // Orient unitig
 // Once oriented, unitig has lowest possible kmerkey at the beginning,
 // oriented FORWARDs if possible
@@ -47,8 +61,13 @@ void db_unitig_normalise(dBNode *nlist, size_t len, const dBGraph *db_graph)
   BinaryKmer bkey0 = db_node_get_bkey(db_graph, nlist[0].key);
   BinaryKmer bkey1 = db_node_get_bkey(db_graph, nlist[len-1].key);
 
+  Edges edges0 = db_node_get_edges_union(db_graph, nlist[0].key);
+  Edges edges1 = db_node_get_edges_union(db_graph, nlist[len-1].key);
+
   // Check if closed cycle
-  if(db_unitig_is_closed_cycle(nlist[0], bkey0, nlist[len-1], bkey1, db_graph))
+  if(db_unitig_is_closed_cycle(nlist[0], bkey0, edges0,
+                               nlist[len-1], bkey1, edges1,
+                               db_graph->kmer_size))
   {
     // find lowest kmer to start from
     BinaryKmer lowest = bkey0, tmp;
@@ -61,21 +80,7 @@ void db_unitig_normalise(dBNode *nlist, size_t len, const dBGraph *db_graph)
       }
     }
 
-    // If already starting from the lowest kmer no change needed
-    if(lowidx > 0 || nlist[0].orient != FORWARD)
-    {
-      // a->b->c->d->e->f->a
-      // if c is lowest and FORWARD:  c->d->e->f->a->b (keep orientations)
-      // if c is lowest and REVERSE:  c->b->a->f->e->d (reverse orientations)
-
-      if(nlist[lowidx].orient == FORWARD) {
-        // Shift left by lowidx, without affecting orientations
-        db_nodes_left_shift(nlist, len, lowidx);
-      } else {
-        db_nodes_reverse_complement(nlist, lowidx+1);
-        db_nodes_reverse_complement(nlist+lowidx+1, len-lowidx-1);
-      }
-    }
+    db_unitig_cycle_rotate(nlist, len, lowidx);
   }
   else if(binary_kmer_lt(bkey1, bkey0)) {
     db_nodes_reverse_complement(nlist, len);
@@ -5,6 +5,17 @@
 #include "db_graph.h"
 #include "db_node.h"
 
+// Returns true if the unitig n0...n1 is a closed cycle: n1 has one edge out,
+// to n0, and n0 has one edge in. Takes the keys and (union) edges of its ends
+// so it can be used on graphs not held in a hash table (see sorted_graph.h)
+bool db_unitig_is_closed_cycle(dBNode n0, BinaryKmer bkey0, Edges edges0,
+                               dBNode n1, BinaryKmer bkey1, Edges edges1,
+                               size_t kmer_size);
+
+// Rotate a closed cycle to start from its lowest kmer nlist[lowidx],
+// oriented FORWARD if possible
+void db_unitig_cycle_rotate(dBNode *nlist, size_t len, size_t lowidx);
+
 // Orient unitig
 // Once oriented, unitig has lowest poosible kmerkey at the beginning,
 // oriented FORWARDs if possible
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 #include "graph_crawler.h"
 #include "binary_seq.h" // binary_seq_unpack_byte()
@@ -0,0 +1,119 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
+#include "global.h"
+#include "graph_file_merge.h"
+#include "binary_kmer.h"
+#include "cmd.h"
+
+#define gfm_lt(gfm,i,j) binary_kmer_lt((gfm)->bkmers[(gfm)->heap[i]], \
+                                       (gfm)->bkmers[(gfm)->heap[j]])
+
+static void _heap_sift_down(GraphFileMerge *gfm, size_t i)
+{
+  size_t l, r, min;
+  while(1) {
+    l = 2*i+1; r = l+1; min = i;
+    if(l < gfm->nheap && gfm_lt(gfm, l, min)) min = l;
+    if(r < gfm->nheap && gfm_lt(gfm, r, min)) min = r;
+    if(min == i) break;
+    SWAP(gfm->heap[i], gfm->heap[min]);
+    i = min;
+  }
+}
+
+// Read the next kmer from file `f` into its slot
+// Returns false if the file has finished
+static bool _gfm_fetch(GraphFileMerge *gfm, size_t f)
+{
+  GraphFileReader *file = &gfm->files[f];
+  BinaryKmer prev = gfm->bkmers[f];
+
+  if(!graph_file_read_raw(file, &gfm->bkmers[f], gfm->covgs[f], gfm->edges[f]))
+    return false;
+
+  if(gfm->nread[f] > 0 && !binary_kmer_lt(prev, gfm->bkmers[f])) {
+    die("Graph file is not sorted, run `"CMD" sort` first: %s",
+        file_filter_path(&file->fltr));
+  }
+
+  gfm->nread[f]++;
+  return true;
+}
+
+void graph_file_merge_alloc(GraphFileMerge *gfm, GraphFileReader *files,
+                            size_t nfiles, size_t ncols)
+{
+  size_t i;
+
+  gfm->files = files;
+  gfm->nfiles = nfiles;
+  gfm->ncols = ncols;
+  gfm->bkmers = ctx_calloc(nfiles, sizeof(BinaryKmer));
+  gfm->covgs = ctx_calloc(nfiles, sizeof(Covg*));
+  gfm->edges = ctx_calloc(nfiles, sizeof(Edges*));
+  gfm->nread = ctx_calloc(nfiles, sizeof(uint64_t));
+  gfm->heap = ctx_calloc(nfiles, sizeof(size_t));
+  gfm->nheap = 0;
+
+  for(i = 0; i < nfiles; i++) {
+    gfm->covgs[i] = ctx_calloc(files[i].hdr.num_of_cols, sizeof(Covg));
+    gfm->edges[i] = ctx_calloc(files[i].hdr.num_of_cols, sizeof(Edges));
+
+    if(!file_filter_isstdin(&files[i].fltr) &&
+       graph_file_fseek(&files[i], files[i].hdr_size, SEEK_SET) != 0) {
+      die("fseek failed: %s", strerror(errno));
+    }
+
+    if(_gfm_fetch(gfm, i)) gfm->heap[gfm->nheap++] = i;
+  }
+
+  // heapify
+  for(i = gfm->nheap/2; i > 0; i--) _heap_sift_down(gfm, i-1);
+}
+
+void graph_file_merge_dealloc(GraphFileMerge *gfm)
+{
+  size_t i;
+  for(i = 0; i < gfm->nfiles; i++) {
+    ctx_free(gfm->covgs[i]);
+    ctx_free(gfm->edges[i]);
+  }
+  ctx_free(gfm->bkmers);
+  ctx_free(gfm->covgs);
+  ctx_free(gfm->edges);
+  ctx_free(gfm->nread);
+  ctx_free(gfm->heap);
+  memset(gfm, 0, sizeof(GraphFileMerge));
+}
+
+bool graph_file_merge_read(GraphFileMerge *gfm, BinaryKmer *bkmer,
+                           Covg *covgs, Edges *edges)
+{
+  if(gfm->nheap == 0) return false;
+
+  size_t i, f, from, into;
+  const FileFilter *fltr;
+
+  memset(covgs, 0, gfm->ncols * sizeof(Covg));
+  memset(edges, 0, gfm->ncols * sizeof(Edges));
+  *bkmer = gfm->bkmers[gfm->heap[0]];
+
+  // Pop all files with this kmer
+  while(gfm->nheap > 0 && binary_kmer_eq(gfm->bkmers[gfm->heap[0]], *bkmer))
+  {
+    f = gfm->heap[0];
+    fltr = &gfm->files[f].fltr;
+
+    for(i = 0; i < file_filter_num(fltr); i++) {
+      from = file_filter_fromcol(fltr, i);
+      into = file_filter_intocol(fltr, i);
+      covgs[into] = SAFE_ADD_COVG(covgs[into], gfm->covgs[f][from]);
+      edges[into] |= gfm->edges[f][from];
+    }
+
+    // Replace top of the heap with next kmer from this file or the last file
+    if(!_gfm_fetch(gfm, f)) gfm->heap[0] = gfm->heap[--gfm->nheap];
+    _heap_sift_down(gfm, 0);
+  }
+
+  return true;
+}
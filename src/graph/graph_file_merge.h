@@ -0,0 +1,37 @@
+#ifndef GRAPH_FILE_MERGE_H_
+#define GRAPH_FILE_MERGE_H_
+
+#include "graph_file_reader.h"
+
+//
+// Stream the union of sorted graph files without loading them into a hash
+// table. Files are merged k-ways with a heap, returning one kmer at a time in
+// sorted order with coverages and edges from all files loaded into colours
+// according to each file's filter. Memory is independent of graph size.
+// Dies if a file is not sorted (see `ctx sort`).
+//
+
+typedef struct
+{
+  GraphFileReader *files;
+  size_t nfiles, ncols;
+  BinaryKmer *bkmers; // current kmer from each file
+  Covg **covgs; // current coverages from each file [file][srccol]
+  Edges **edges; // current edges from each file [file][srccol]
+  uint64_t *nread; // number of kmers read from each file
+  size_t *heap, nheap; // min-heap of file indices by current kmer
+} GraphFileMerge;
+
+// `files` must be open and sorted, reading starts after the header
+// `ncols` is the number of colours to merge into
+void graph_file_merge_alloc(GraphFileMerge *gfm, GraphFileReader *files,
+                            size_t nfiles, size_t ncols);
+
+void graph_file_merge_dealloc(GraphFileMerge *gfm);
+
+// Read the next kmer, `covgs` and `edges` must be of length ncols
+// Returns true on success, false once all files are finished
+bool graph_file_merge_read(GraphFileMerge *gfm, BinaryKmer *bkmer,
+                           Covg *covgs, Edges *edges);
+
+#endif /* GRAPH_FILE_MERGE_H_ */
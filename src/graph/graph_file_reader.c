@@ -3,6 +3,7 @@
 #include "db_node.h"
 #include "cmd.h"
 #include "file_util.h"
+#include "ctx_progress.h"
 
 // Buffer size `bufsize` is in bytes
 void graph_file_set_buffered(GraphFileReader *file, size_t bufsize)
@@ -44,6 +45,8 @@ size_t graph_file_fread(GraphFileReader *file, void *ptr, size_t n)
   // check for error
   if(ferror(file->fh))
     die("File error: %s [%s]", strerror(errno), file_filter_path(&file->fltr));
+  perf_count(PERF_BYTES_READ, nread);
+  progress_input_read(file->progress_id, nread, 0);
   return nread;
 }
 
@@ -302,6 +305,7 @@ int graph_file_open2(GraphFileReader *file, const char *input, const char *mode,
   }
 
   file->fh = futil_fopen(path, mode);
+  file->progress_id = progress_input_add(path, file->file_size);
   if(usebuf) strm_buf_alloc(&file->strm, ONE_MEGABYTE);
   else memset(&file->strm, 0, sizeof(file->strm));
   file->hdr_size = graph_file_read_header(file);
@@ -338,6 +342,7 @@ int graph_file_open2(GraphFileReader *file, const char *input, const char *mode,
 // Close file
 void graph_file_close(GraphFileReader *file)
 {
+  progress_input_done(file->progress_id);
   strm_buf_dealloc(&file->strm);
   if(file->fh) fclose(file->fh);
   file_filter_close(&file->fltr);
@@ -19,6 +19,7 @@ typedef struct
   off_t hdr_size, file_size;
   int64_t num_of_kmers; // set if reading from file (i.e. not stream) else -1
   bool error_zero_covg, error_missing_covg; // Whether we saw loading errors
+  size_t progress_id; // reports bytes read with --progress, 0 if not tracked
 } GraphFileReader;
 
 #include "madcrowlib/madcrow_buffer.h"
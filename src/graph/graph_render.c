@@ -0,0 +1,90 @@
+#include "global.h"
+#include "graph_render.h"
+
+// Write unsigned int in decimal, returns number of chars written
+static inline size_t _render_uint(uint32_t x, char *str)
+{
+  char tmp[12], *end = tmp + sizeof(tmp), *ptr = end;
+  do { *(--ptr) = '0' + x % 10; x /= 10; } while(x);
+  memcpy(str, ptr, end - ptr);
+  return end - ptr;
+}
+
+void graph_render_kmer(StrBuf *sbuf, BinaryKmer bkmer,
+                       const Covg *covgs, const Edges *edges,
+                       size_t ncols, size_t kmer_size)
+{
+  size_t i;
+  char *str;
+
+  strbuf_ensure_capacity(sbuf, sbuf->end +
+                               graph_render_kmer_maxlen(kmer_size, ncols));
+
+  str = sbuf->b + sbuf->end;
+  binary_kmer_to_str(bkmer, kmer_size, str);
+  str += kmer_size;
+
+  for(i = 0; i < ncols; i++) {
+    *str++ = ' ';
+    str += _render_uint(covgs[i], str);
+  }
+
+  for(i = 0; i < ncols; i++) {
+    *str++ = ' ';
+    db_node_get_edges_str(edges[i], str);
+    str += 8;
+  }
+
+  *str++ = '\n';
+  *str = '\0';
+  sbuf->end = str - sbuf->b;
+}
+
+void graph_render_nodes(StrBuf *sbuf, const dBNode *nodes, size_t num,
+                        const dBGraph *db_graph)
+{
+  strbuf_ensure_capacity(sbuf, sbuf->end + db_graph->kmer_size + num);
+  sbuf->end += db_nodes_to_str(nodes, num, db_graph, sbuf->b + sbuf->end);
+}
+
+void graph_render_sorted_nodes(StrBuf *sbuf, const dBNode *nodes, size_t num,
+                               const SortedGraph *sg)
+{
+  strbuf_ensure_capacity(sbuf, sbuf->end + sg->kmer_size + num);
+  sbuf->end += sorted_nodes_to_str(nodes, num, sg, sbuf->b + sbuf->end);
+}
+
+//
+// Write chunks in order
+//
+
+void chunk_writer_alloc(ChunkWriter *wtr, FILE *fout)
+{
+  wtr->fout = fout;
+  wtr->next = 0;
+  if(pthread_mutex_init(&wtr->lock, NULL) != 0) die("Mutex init failed");
+  if(pthread_cond_init(&wtr->cond, NULL) != 0) die("Cond init failed");
+}
+
+void chunk_writer_dealloc(ChunkWriter *wtr)
+{
+  pthread_cond_destroy(&wtr->cond);
+  pthread_mutex_destroy(&wtr->lock);
+}
+
+void chunk_writer_write(ChunkWriter *wtr, size_t idx,
+                        const char *str, size_t len)
+{
+  pthread_mutex_lock(&wtr->lock);
+  while(wtr->next != idx) pthread_cond_wait(&wtr->cond, &wtr->lock);
+  pthread_mutex_unlock(&wtr->lock);
+
+  // No other thread can write until we increment wtr->next
+  if(len && fwrite(str, 1, len, wtr->fout) != len) die("Cannot write output");
+  perf_count(PERF_BYTES_WRITTEN, len);
+
+  pthread_mutex_lock(&wtr->lock);
+  wtr->next++;
+  pthread_cond_broadcast(&wtr->cond);
+  pthread_mutex_unlock(&wtr->lock);
+}
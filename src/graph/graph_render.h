@@ -0,0 +1,50 @@
+#ifndef GRAPH_RENDER_H_
+#define GRAPH_RENDER_H_
+
+#include "db_graph.h"
+#include "db_node.h"
+#include "sorted_graph.h"
+
+//
+// Render kmers and unitigs as text in memory, so that threads can format
+// output in parallel and only take a lock to write out finished buffers.
+// ChunkWriter writes numbered chunks of text in order.
+//
+
+// Max length of a line printed by graph_render_kmer() including "\n\0"
+// uint32 coverage (10 chars) + edges (8 chars) + two spaces per colour
+#define graph_render_kmer_maxlen(kmer_size,ncols) ((kmer_size)+(ncols)*20+2)
+
+// Append kmer to a buffer, same format as db_graph_print_kmer2()
+void graph_render_kmer(StrBuf *sbuf, BinaryKmer bkmer,
+                       const Covg *covgs, const Edges *edges,
+                       size_t ncols, size_t kmer_size);
+
+// Append sequence of a list of nodes to a buffer, same as db_nodes_print()
+void graph_render_nodes(StrBuf *sbuf, const dBNode *nodes, size_t num,
+                        const dBGraph *db_graph);
+
+// Same as graph_render_nodes() for nodes in a sorted graph file
+void graph_render_sorted_nodes(StrBuf *sbuf, const dBNode *nodes, size_t num,
+                               const SortedGraph *sg);
+
+typedef struct
+{
+  FILE *fout;
+  size_t next; // index of the next chunk to write
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} ChunkWriter;
+
+void chunk_writer_alloc(ChunkWriter *wtr, FILE *fout);
+void chunk_writer_dealloc(ChunkWriter *wtr);
+
+/**
+ * Block until chunks 0..idx-1 have been written, then write chunk `idx`.
+ * Chunk indices must be handed out to threads in increasing order, so that
+ * the thread with the lowest unwritten chunk is never waiting.
+ */
+void chunk_writer_write(ChunkWriter *wtr, size_t idx,
+                        const char *str, size_t len);
+
+#endif /* GRAPH_RENDER_H_ */
@@ -6,7 +6,8 @@
 #include "graph_file_reader.h"
 
 //
-// Search a sorted graph file on disk
+// Search a sorted graph file on disk, a wrapper around SortedGraph
+// (sorted_graph.h) that applies the file filter to coverages and edges
 //
 
 typedef struct GraphFileSearch GraphFileSearch;
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "graph_writer.h"
 #include "graphs_load.h" // need to load, merge then write some graphs
@@ -106,6 +107,7 @@ size_t graph_write_header(FILE *fh, const GraphFileHeader *h)
 
   if(act != b) die("Cannot write file");
 
+  perf_count(PERF_BYTES_WRITTEN, b);
   return b;
 }
 
@@ -123,6 +125,7 @@ size_t graph_write_kmer(FILE *fh, size_t filencols,
   m += fwrite(covgs, 1, sizeof(uint32_t) * filencols, fh);
   m += fwrite(edges, 1, sizeof(uint8_t) * filencols, fh);
   if(m != expm) die("Cannot write to file (%zu, %zu)", m, expm);
+  perf_count(PERF_BYTES_WRITTEN, m);
   return m;
 }
 
@@ -222,6 +225,7 @@ uint64_t graph_writer_save(const char *path, const dBGraph *db_graph,
   uint64_t n_nodes = 0;
   const char *out_name = futil_outpath_str(path);
 
+  perf_phase_start("save_graph");
   status("[graphwriter] Saving file to: %s", path);
   file_filter_status(fltr, true);
 
@@ -243,6 +247,7 @@ uint64_t graph_writer_save(const char *path, const dBGraph *db_graph,
   graph_writer_print_status(n_nodes, hdr->num_of_cols,
                             out_name, hdr->version);
 
+  perf_phase_end("save_graph");
   return n_nodes;
 }
 
@@ -401,6 +406,7 @@ size_t graph_writer_stream(const char *out_ctx_path, GraphFileReader *file,
 {
   const FileFilter *fltr = &file->fltr;
   bool only_load_if_in_graph = (only_load_if_in_edges != NULL);
+  perf_phase_start("save_graph");
   status("Filtering %s to %s with stream filter", fltr->path.b,
          futil_outpath_str(out_ctx_path));
   graph_loading_print_status(file);
@@ -451,6 +457,7 @@ size_t graph_writer_stream(const char *out_ctx_path, GraphFileReader *file,
   graph_writer_print_status(nodes_dumped, hdr->num_of_cols,
                             out_ctx_path, hdr->version);
 
+  perf_phase_end("save_graph");
   return nodes_dumped;
 }
 
@@ -551,6 +558,7 @@ size_t graph_writer_merge(const char *out_ctx_path,
   }
   else
   {
+    perf_phase_start("save_graph");
     ctx_assert2(strcmp(out_ctx_path,"-") != 0,
                 "Cannot use STDOUT for output if not enough colours to load");
 
@@ -641,6 +649,7 @@ size_t graph_writer_merge(const char *out_ctx_path,
     // Print output status
     graph_writer_print_status(hash_table_nkmers(&db_graph->ht), hdr->num_of_cols,
                               out_ctx_path, hdr->version);
+    perf_phase_end("save_graph");
   }
 
   return hash_table_nkmers(&db_graph->ht);
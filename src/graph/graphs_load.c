@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "graphs_load.h"
 #include "util.h"
@@ -93,6 +94,8 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
 
   ctx_assert(file_filter_num(fltr) > 0);
 
+  perf_phase_start("load_graph");
+
   // Print status
   graph_loading_print_status(file);
 
@@ -118,6 +121,8 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
 
   for(; graph_file_read_reset(file, &bkmer, covgs, edges); nkmers_read++)
   {
+    perf_count(PERF_KMERS, 1);
+
     // If kmer has no covg -> don't load
     Covg keep_kmer = 0;
     for(i = 0; i < ncols; i++) keep_kmer |= covgs[i];
@@ -210,6 +215,7 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
          ulong_to_str(nkmers_read, n1),
          safe_percent(nkmers_loaded, nkmers_read));
 
+  perf_phase_end("load_graph");
   return nkmers_loaded;
 }
 
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_HASH_TABLE
 #include "global.h"
 #include "hash_table.h"
 #include "hash_mem.h"
@@ -116,7 +117,20 @@ static inline BinaryKmer* hash_table_insert_in_bucket(HashTable *ht,
   return ptr;
 }
 
+// Count buckets searched by an operation that finished in rehash `i`
+// Only compiled in with CTXPERF, so lookups don't pay for it otherwise
+#ifdef CTXPERF
+#define ht_count_probes(op,i) do {                   \
+  perf_count(PERF_HASH_PROBES, (i)+1);               \
+  if(i) perf_count(PERF_REHASH_STEPS, i);            \
+  perf_tel_probe(op, (i)+1);                         \
+} while(0)
+#else
+#define ht_count_probes(op,i) do {} while(0)
+#endif
+
 #define rehash_error_exit(ht) do { \
+  ht_count_probes(PERF_HT_INSERT, REHASH_LIMIT-1); \
   ctx_msg_out = stderr; \
   hash_table_print_stats(ht); \
   die("Hash table is full"); \
@@ -146,13 +160,64 @@ hkey_t hash_table_find(const HashTable *const ht, const BinaryKmer key)
     #endif
 
     ptr = hash_table_find_in_bucket(ht, h, key);
-    if(ptr != NULL) return (hkey_t)(ptr - ht->table);
+    if(ptr != NULL) {
+      ht_count_probes(PERF_HT_FIND_HIT, i);
+      return (hkey_t)(ptr - ht->table);
+    }
     if(ht->buckets[h][HT_BSIZE] < ht->bucket_size) break;
   }
 
+  ht_count_probes(PERF_HT_FIND_MISS, MIN2(i, REHASH_LIMIT-1));
   return HASH_NOT_FOUND;
 }
 
+// Find `n` kmers, writing their keys (or HASH_NOT_FOUND) to `hkeys`.
+// The first bucket of up to HASH_BATCH_SIZE kmers is prefetched before
+// searching, so their cache misses overlap rather than queue.
+// Returns number of kmers resolved in their first bucket (found or not)
+size_t hash_table_find_batch(const HashTable *const ht,
+                             const BinaryKmer *bkeys, size_t n,
+                             hkey_t *hkeys)
+{
+  uint_fast32_t h[HASH_BATCH_SIZE];
+  const BinaryKmer *ptr;
+  size_t i, j, end, num_first_bckt = 0;
+
+  for(i = 0; i < n; i += HASH_BATCH_SIZE)
+  {
+    end = MIN2(i+HASH_BATCH_SIZE, n);
+
+    for(j = i; j < end; j++) {
+      h[j-i] = binary_kmer_hash(bkeys[j],ht->seed) & ht->hash_mask;
+      __builtin_prefetch(ht->buckets[h[j-i]], 0, 1);
+      __builtin_prefetch(ht_bckt_ptr(ht, h[j-i]), 0, 1);
+    }
+
+    for(j = i; j < end; j++) {
+      ptr = hash_table_find_in_bucket(ht, h[j-i], bkeys[j]);
+      if(ptr != NULL) {
+        hkeys[j] = (hkey_t)(ptr - ht->table);
+        num_first_bckt++;
+        perf_tel_probe(PERF_HT_FIND_HIT, 1);
+      }
+      else if(ht->buckets[h[j-i]][HT_BSIZE] < ht->bucket_size) {
+        hkeys[j] = HASH_NOT_FOUND;
+        num_first_bckt++;
+        perf_tel_probe(PERF_HT_FIND_MISS, 1);
+      }
+      else {
+        // Full bucket, kmer may have been rehashed
+        hkeys[j] = hash_table_find(ht, bkeys[j]);
+      }
+    }
+  }
+
+  #ifdef CTXPERF
+    perf_count(PERF_HASH_PROBES, num_first_bckt);
+  #endif
+  return num_first_bckt;
+}
+
 hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
                           volatile uint8_t *bktlocks)
 {
@@ -163,11 +228,12 @@ hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
   for(i = 0; i < REHASH_LIMIT; i++)
   {
     h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
-    bitlock_yield_acquire(bktlocks, h);
+    perf_bitlock_acquire(bktlocks, h);
     ptr = hash_table_find_in_bucket(ht, h, key);
 
     if(ptr != NULL) {
       bitlock_release(bktlocks, h);
+      ht_count_probes(PERF_HT_FIND_HIT, i);
       return (hkey_t)(ptr - ht->table);
     }
 
@@ -177,6 +243,7 @@ hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
     if(bsize < ht->bucket_size) break;
   }
 
+  ht_count_probes(PERF_HT_FIND_MISS, MIN2(i, REHASH_LIMIT-1));
   return HASH_NOT_FOUND;
 }
 
@@ -198,6 +265,7 @@ hkey_t hash_table_insert(HashTable *const ht, const BinaryKmer key)
       ptr = hash_table_insert_in_bucket(ht, h, key);
       ht->collisions[i]++; // only increment collisions when inserting
       ht->num_kmers++;
+      ht_count_probes(PERF_HT_INSERT, i);
       return (hkey_t)(ptr - ht->table);
     }
   }
@@ -233,6 +301,7 @@ hkey_t hash_table_find_or_insert(HashTable *ht, const BinaryKmer key,
 
     if(ptr != NULL)  {
       *found = true;
+      ht_count_probes(PERF_HT_FIND_HIT, i);
       return (hkey_t)(ptr - ht->table);
     }
     else if(ht->buckets[h][HT_BITEMS] < ht->bucket_size) {
@@ -240,6 +309,7 @@ hkey_t hash_table_find_or_insert(HashTable *ht, const BinaryKmer key,
       ptr = hash_table_insert_in_bucket(ht, h, key);
       ht->collisions[i]++; // only increment collisions when inserting
       ht->num_kmers++;
+      ht_count_probes(PERF_HT_INSERT, i);
       return (hkey_t)(ptr - ht->table);
     }
   }
@@ -257,12 +327,13 @@ hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
   for(i = 0; i < REHASH_LIMIT; i++)
   {
     h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
-    bitlock_yield_acquire(bktlocks, h);
+    perf_bitlock_acquire(bktlocks, h);
     ptr = hash_table_find_in_bucket(ht, h, key);
 
     if(ptr != NULL)  {
       *found = true;
       bitlock_release(bktlocks, h);
+      ht_count_probes(PERF_HT_FIND_HIT, i);
       return (hkey_t)(ptr - ht->table);
     }
     else if(hash_table_bitems(ht, h) < ht->bucket_size) {
@@ -271,6 +342,7 @@ hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
       __sync_add_and_fetch((volatile uint64_t*)&ht->collisions[i], 1);
       __sync_add_and_fetch((volatile uint64_t*)&ht->num_kmers, 1);
       bitlock_release(bktlocks, h);
+      ht_count_probes(PERF_HT_INSERT, i);
       return (hkey_t)(ptr - ht->table);
     }
 
@@ -280,6 +352,32 @@ hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
   rehash_error_exit(ht);
 }
 
+size_t hash_table_find_or_insert_batch_mt(HashTable *ht, const BinaryKmer *bkeys,
+                                          size_t n, hkey_t *hkeys, bool *found,
+                                          volatile uint8_t *bktlocks)
+{
+  uint_fast32_t h;
+  size_t i, j, end, num_inserted = 0;
+
+  for(i = 0; i < n; i += HASH_BATCH_SIZE)
+  {
+    end = MIN2(i+HASH_BATCH_SIZE, n);
+
+    for(j = i; j < end; j++) {
+      h = binary_kmer_hash(bkeys[j],ht->seed) & ht->hash_mask;
+      __builtin_prefetch(ht->buckets[h], 1, 1);
+      __builtin_prefetch(ht_bckt_ptr(ht, h), 1, 1);
+    }
+
+    for(j = i; j < end; j++) {
+      hkeys[j] = hash_table_find_or_insert_mt(ht, bkeys[j], &found[j], bktlocks);
+      num_inserted += !found[j];
+    }
+  }
+
+  return num_inserted;
+}
+
 // Safe to call on different entries at the same time
 // NOT safe to do find() whilst doing delete()
 void hash_table_delete(HashTable *const ht, hkey_t pos)
@@ -318,6 +416,32 @@ void hash_table_print_stats_brief(const HashTable *const ht)
          mem_str, num_entries_str, capacity_str, occupancy);
 }
 
+// Print distribution of bucket fill, in steps of 10% of the bucket size
+void hash_table_print_fill(const HashTable *const ht)
+{
+  size_t i, b, bin, nbins = 12;
+  uint64_t hist[12] = {0}; // empty, (0,10%], .., (90%,100%), full
+
+  for(b = 0; b < ht->num_of_buckets; b++) {
+    size_t n = ht->buckets[b][HT_BITEMS];
+    if(n == 0) bin = 0;
+    else if(n == ht->bucket_size) bin = nbins-1;
+    else bin = 1 + MIN2((10*n-1) / ht->bucket_size, 9);
+    hist[bin]++;
+  }
+
+  StrBuf line;
+  strbuf_alloc(&line, 256);
+  for(i = 0; i < nbins; i++) {
+    if(i == 0) strbuf_append_str(&line, " empty:");
+    else if(i+1 == nbins) strbuf_append_str(&line, " full:");
+    else strbuf_sprintf(&line, " %zu-%zu%%:", (i-1)*10, i*10);
+    strbuf_sprintf(&line, "%.2f%%", (100.0 * hist[i]) / ht->num_of_buckets);
+  }
+  status("[hasht] bucket fill:%s", line.b);
+  strbuf_dealloc(&line);
+}
+
 void hash_table_print_stats(const HashTable *const ht)
 {
   size_t i;
@@ -329,6 +453,7 @@ void hash_table_print_stats(const HashTable *const ht)
         status("[hasht]  collisions %2zu: %zu\n", i, (size_t)ht->collisions[i]);
       }
     }
+    if(perf_get_report()) hash_table_print_fill(ht);
   }
 }
 
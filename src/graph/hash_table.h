@@ -55,6 +55,16 @@ hkey_t hash_table_insert(HashTable *const htable, const BinaryKmer bkmer);
 hkey_t hash_table_find_or_insert(HashTable *htable, const BinaryKmer bkmer,
                                  bool *found);
 
+// Number of kmers whose buckets are prefetched together in a batched find
+#define HASH_BATCH_SIZE 32
+
+// Find `n` kmers, writing their keys (or HASH_NOT_FOUND) to `hkeys`.
+// Prefetches the first bucket of each kmer before searching any of them.
+// Returns number of kmers resolved in their first bucket (found or not)
+size_t hash_table_find_batch(const HashTable *const ht,
+                             const BinaryKmer *bkeys, size_t n,
+                             hkey_t *hkeys);
+
 // Threadsafe find, using bucket level locks
 hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
                           volatile uint8_t *bktlocks);
@@ -63,6 +73,13 @@ hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
 hkey_t hash_table_find_or_insert_mt(HashTable *htable, const BinaryKmer key,
                                     bool *found, volatile uint8_t *bktlocks);
 
+// Threadsafe find or insert of `n` kmers, prefetching buckets as in
+// hash_table_find_batch(). Sets hkeys[i] and found[i] for each kmer.
+// Returns number of kmers inserted
+size_t hash_table_find_or_insert_batch_mt(HashTable *ht, const BinaryKmer *bkeys,
+                                          size_t n, hkey_t *hkeys, bool *found,
+                                          volatile uint8_t *bktlocks);
+
 // Safe to call on different entries at the same time
 // NOT safe to do find() whilst doing delete()
 void hash_table_delete(HashTable *const htable, hkey_t pos);
@@ -73,6 +90,9 @@ void hash_table_empty(HashTable *const htable);
 void hash_table_print_stats(const HashTable *const htable);
 void hash_table_print_stats_brief(const HashTable *const htable);
 
+// Distribution of bucket fill, printed by hash_table_print_stats() with --perf
+void hash_table_print_fill(const HashTable *const htable);
+
 // Returns sorted array of hkey_t from the hash table, use kmers[i].h
 hkey_t* hash_table_sorted(const HashTable *htable);
 
@@ -147,6 +147,10 @@ cJSON* json_hdr_new_command(const char *path, const char *fileidstr)
   // if(gethostname(hostname, sizeof(hostname)) != -1)
   //   cJSON_AddStringToObject(command, "host", hostname);
 
+  // Phase timings and counters so far (--perf)
+  if(perf_get_report())
+    cJSON_AddItemToObject(command, "perf", perf_json());
+
   cJSON *prev_list = cJSON_CreateArray();
   cJSON_AddItemToObject(command, "prev", prev_list);
 
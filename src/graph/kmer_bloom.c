@@ -0,0 +1,82 @@
+#include "global.h"
+#include "kmer_bloom.h"
+#include "util.h"
+
+#include <math.h> // pow
+
+// Number of hashes that minimises the false positive rate is ln(2) bits/kmer
+static size_t kmer_bloom_nhashes(size_t bits_per_kmer)
+{
+  size_t n = (size_t)(bits_per_kmer * 0.693 + 0.5);
+  return MAX2(1, MIN2(n, KMER_BLOOM_MAX_HASHES));
+}
+
+static size_t kmer_bloom_nblocks(size_t nkmers, size_t bits_per_kmer)
+{
+  size_t nblocks = 1, nbits = MAX2(nkmers, 1) * bits_per_kmer;
+  while(nblocks * KMER_BLOOM_BLOCK_BITS < nbits) nblocks *= 2;
+  return nblocks;
+}
+
+size_t kmer_bloom_mem(size_t nkmers, size_t bits_per_kmer)
+{
+  return kmer_bloom_nblocks(nkmers, bits_per_kmer) * KMER_BLOOM_BLOCK_BITS / 8;
+}
+
+void kmer_bloom_alloc(KmerBloom *bloom, size_t nkmers, size_t bits_per_kmer)
+{
+  ctx_assert(bits_per_kmer > 0);
+  bloom->num_blocks = kmer_bloom_nblocks(nkmers, bits_per_kmer);
+  bloom->nhashes = kmer_bloom_nhashes(bits_per_kmer);
+  bloom->blocks = ctx_calloc(bloom->num_blocks * KMER_BLOOM_BLOCK_WORDS,
+                             sizeof(uint64_t));
+}
+
+void kmer_bloom_dealloc(KmerBloom *bloom)
+{
+  ctx_free(bloom->blocks);
+  memset(bloom, 0, sizeof(KmerBloom));
+}
+
+typedef struct
+{
+  const HashTable *ht;
+  KmerBloom *bloom;
+} KmerBloomBuilder;
+
+static bool kmer_bloom_add_node(hkey_t hkey, size_t threadid, void *arg)
+{
+  (void)threadid;
+  KmerBloomBuilder *builder = (KmerBloomBuilder*)arg;
+  KmerBloom *bloom = builder->bloom;
+  uint64_t h = kmer_bloom_hash(hash_table_fetch(builder->ht, hkey));
+  uint64_t *blk = kmer_bloom_block(bloom, h);
+  size_t i, b;
+
+  for(i = 0; i < bloom->nhashes; i++) {
+    b = kmer_bloom_bit(h, i);
+    __sync_fetch_and_or(&blk[b/64], 1UL << (b%64));
+  }
+
+  return false; // keep iterating
+}
+
+void kmer_bloom_add_all(KmerBloom *bloom, const HashTable *ht, size_t nthreads)
+{
+  KmerBloomBuilder builder = {.ht = ht, .bloom = bloom};
+  hash_table_iterate(ht, nthreads, kmer_bloom_add_node, &builder);
+
+  char num_str[50], mem_str[50];
+  ulong_to_str(ht->num_kmers, num_str);
+  bytes_to_str(bloom->num_blocks * KMER_BLOOM_BLOCK_BITS / 8, 1, mem_str);
+  status("[KmerBloom] Added %s kmers [%s, %zu hashes, est. FPR %.3f%%]",
+         num_str, mem_str, bloom->nhashes, 100.0 * kmer_bloom_fpr(bloom));
+}
+
+// Probability a random kmer is reported: (fraction of bits set)^nhashes
+double kmer_bloom_fpr(const KmerBloom *bloom)
+{
+  size_t i, nwords = bloom->num_blocks * KMER_BLOOM_BLOCK_WORDS, nset = 0;
+  for(i = 0; i < nwords; i++) nset += __builtin_popcountll(bloom->blocks[i]);
+  return pow((double)nset / (nwords * 64), bloom->nhashes);
+}
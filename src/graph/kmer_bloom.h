@@ -0,0 +1,72 @@
+#ifndef KMER_BLOOM_H_
+#define KMER_BLOOM_H_
+
+#include "hash_table.h"
+#include "binary_kmer.h"
+
+//
+// Blocked Bloom filter of the kmers in a hash table. Each kmer hashes to one
+// 512 bit block (a cache line) and sets `nhashes` bits in it, so a query
+// touches one cache line. Used as a prefilter before the hash table when most
+// queries are expected to miss, e.g. in `ctx reads`.
+//
+
+#define KMER_BLOOM_BLOCK_BITS 512
+#define KMER_BLOOM_BLOCK_WORDS (KMER_BLOOM_BLOCK_BITS/64)
+#define KMER_BLOOM_MAX_HASHES 16
+
+typedef struct
+{
+  uint64_t *blocks;
+  size_t num_blocks; // power of two
+  size_t nhashes;
+} KmerBloom;
+
+// Number of bytes used for `nkmers` kmers at `bits_per_kmer` bits each
+size_t kmer_bloom_mem(size_t nkmers, size_t bits_per_kmer);
+
+void kmer_bloom_alloc(KmerBloom *bloom, size_t nkmers, size_t bits_per_kmer);
+void kmer_bloom_dealloc(KmerBloom *bloom);
+
+// Add all kmers in a hash table, using `nthreads` threads
+void kmer_bloom_add_all(KmerBloom *bloom, const HashTable *ht, size_t nthreads);
+
+// Estimated false positive rate, from the fraction of bits set
+double kmer_bloom_fpr(const KmerBloom *bloom);
+
+// Seeds differ from those used by the hash table
+#define KMER_BLOOM_SEED0 0x5bd1e995
+#define KMER_BLOOM_SEED1 0x27d4eb2f
+
+static inline uint64_t kmer_bloom_hash(const BinaryKmer bkey)
+{
+  return ((uint64_t)binary_kmer_hash(bkey, KMER_BLOOM_SEED1) << 32) |
+         binary_kmer_hash(bkey, KMER_BLOOM_SEED0);
+}
+
+static inline uint64_t* kmer_bloom_block(const KmerBloom *bloom, uint64_t h)
+{
+  return bloom->blocks + (h & (bloom->num_blocks-1)) * KMER_BLOOM_BLOCK_WORDS;
+}
+
+// Bits within a block are picked by double hashing on the high half
+#define kmer_bloom_bit(h,i) \
+        ((((h)>>32) + (i) * ((((h)>>48) | 1))) % KMER_BLOOM_BLOCK_BITS)
+
+static inline void kmer_bloom_prefetch(const KmerBloom *bloom, uint64_t h)
+{
+  __builtin_prefetch(kmer_bloom_block(bloom, h), 0, 1);
+}
+
+static inline bool kmer_bloom_contains(const KmerBloom *bloom, uint64_t h)
+{
+  const uint64_t *blk = kmer_bloom_block(bloom, h);
+  size_t i, b;
+  for(i = 0; i < bloom->nhashes; i++) {
+    b = kmer_bloom_bit(h, i);
+    if(!(blk[b/64] & (1UL << (b%64)))) return false;
+  }
+  return true;
+}
+
+#endif /* KMER_BLOOM_H_ */
@@ -0,0 +1,286 @@
+#include "global.h"
+#include "minimizer_index.h"
+#include "util.h"
+#include "dna.h"
+#include "db_node.h" // bkmer_get_orientation()
+
+// Number of buckets per thread, buckets are sorted independently
+#define MINIMIZER_BUCKETS_PER_THREAD 64
+
+static inline bool minim_kmer_lt(const MinimKmer *a, const MinimKmer *b)
+{
+  return a->hash < b->hash ||
+         (a->hash == b->hash && binary_kmer_less_than(a->bkey, b->bkey));
+}
+
+static inline bool minim_kmer_eq(const MinimKmer *a, const MinimKmer *b)
+{
+  return a->hash == b->hash && binary_kmer_eq(a->bkey, b->bkey);
+}
+
+static inline size_t minim_bucket(uint32_t hash, size_t bucket_bits)
+{
+  return (size_t)(hash >> (32 - bucket_bits));
+}
+
+size_t minimizer_index_window(const read_t *reads, size_t num_reads,
+                              size_t kmer_size, size_t max_window)
+{
+  size_t i, start, end, search, nkmers, window = max_window;
+  bool any_kmers = false;
+
+  for(i = 0; i < num_reads; i++) {
+    const read_t *r = &reads[i];
+    search = 0; nkmers = 0;
+    while((start = seq_contig_start(r, search, kmer_size, 0, 0)) < r->seq.end) {
+      end = seq_contig_end(r, start, kmer_size, 0, 0, &search);
+      nkmers = MAX2(nkmers, end - start - kmer_size + 1);
+    }
+    if(nkmers) { window = MIN2(window, nkmers); any_kmers = true; }
+  }
+
+  return any_kmers ? window : 0;
+}
+
+static int minim_occur_cmp_pos(const void *aa, const void *bb)
+{
+  const MinimOccur *a = (const MinimOccur*)aa, *b = (const MinimOccur*)bb;
+  return cmp(a->pos, b->pos);
+}
+
+// Add leftmost and rightmost minimum of every window in kmers[0..n-1]
+static inline void _contig_minimizers(const MinimKmer *kmers, size_t n,
+                                      size_t offset, size_t window,
+                                      uint32_t readid, MinimOccurBuffer *occurs)
+{
+  size_t s, i, m1 = SIZE_MAX, m2 = SIZE_MAX, last1 = SIZE_MAX, last2 = SIZE_MAX;
+  MinimOccur occ = {.read = readid};
+
+  for(s = 0; s + window <= n; s++)
+  {
+    if(m1 == SIZE_MAX || m1 < s) {
+      // Minimum has left the window, search the whole window
+      for(m1 = m2 = s, i = s+1; i < s+window; i++) {
+        if(minim_kmer_lt(&kmers[i], &kmers[m1])) m1 = m2 = i;
+        else if(minim_kmer_eq(&kmers[i], &kmers[m1])) m2 = i;
+      }
+    }
+    else {
+      i = s+window-1;
+      if(minim_kmer_lt(&kmers[i], &kmers[m1])) m1 = m2 = i;
+      else if(minim_kmer_eq(&kmers[i], &kmers[m1])) m2 = i;
+    }
+
+    if(m1 != last1 || m2 != last2) {
+      occ.bkey = kmers[m1].bkey;
+      occ.pos = offset + m1; occ.orient = kmers[m1].orient;
+      minim_occur_buf_add(occurs, occ);
+      if(m2 != m1) {
+        occ.pos = offset + m2; occ.orient = kmers[m2].orient;
+        minim_occur_buf_add(occurs, occ);
+      }
+      last1 = m1; last2 = m2;
+    }
+  }
+}
+
+void minimizers_get(const read_t *r, uint32_t readid,
+                    size_t kmer_size, size_t window,
+                    MinimKmerBuffer *kmers, MinimOccurBuffer *occurs)
+{
+  size_t i, j, start, end, search = 0, first = occurs->len, n;
+  BinaryKmer bkmer;
+  MinimKmer mk;
+
+  while((start = seq_contig_start(r, search, kmer_size, 0, 0)) < r->seq.end)
+  {
+    end = seq_contig_end(r, start, kmer_size, 0, 0, &search);
+    minim_kmer_buf_reset(kmers);
+
+    bkmer = binary_kmer_from_str(r->seq.b + start, kmer_size);
+    bkmer = binary_kmer_right_shift_one_base(bkmer);
+
+    for(i = start+kmer_size-1; i < end; i++) {
+      bkmer = binary_kmer_left_shift_add(bkmer, kmer_size,
+                                         dna_char_to_nuc(r->seq.b[i]));
+      mk.bkey = binary_kmer_get_key(bkmer, kmer_size);
+      mk.orient = bkmer_get_orientation(bkmer, mk.bkey);
+      mk.hash = minimizer_hash(mk.bkey);
+      minim_kmer_buf_add(kmers, mk);
+    }
+
+    _contig_minimizers(kmers->b, kmers->len, start, window, readid, occurs);
+  }
+
+  // Sort by position and remove duplicates
+  n = occurs->len - first;
+  if(n > 1) {
+    MinimOccur *arr = occurs->b + first;
+    qsort(arr, n, sizeof(MinimOccur), minim_occur_cmp_pos);
+    for(i = j = 1; i < n; i++)
+      if(arr[i].pos != arr[j-1].pos) arr[j++] = arr[i];
+    occurs->len = first + j;
+  }
+}
+
+//
+// Build index
+//
+
+typedef struct
+{
+  MinimizerIndex *idx;
+  const read_t *reads;
+  size_t num_reads, nthreads;
+  size_t *counts; // [nthreads][nbuckets], then write positions
+  volatile size_t next_bucket;
+} MinimBuilder;
+
+// Get minimizers of reads assigned to thread `tid` and count or store them
+static void _minim_build_pass(MinimBuilder *builder, size_t tid, bool store)
+{
+  MinimizerIndex *idx = builder->idx;
+  size_t nbuckets = 1UL << idx->bucket_bits;
+  size_t *counts = builder->counts + tid * nbuckets;
+  size_t i, j, b, start, end;
+  MinimKmerBuffer kmers;
+  MinimOccurBuffer occurs;
+
+  minim_kmer_buf_alloc(&kmers, 1024);
+  minim_occur_buf_alloc(&occurs, 256);
+
+  start = builder->num_reads * tid / builder->nthreads;
+  end = builder->num_reads * (tid+1) / builder->nthreads;
+
+  for(i = start; i < end; i++) {
+    minim_occur_buf_reset(&occurs);
+    minimizers_get(&builder->reads[i], i, idx->kmer_size, idx->window,
+                   &kmers, &occurs);
+    for(j = 0; j < occurs.len; j++) {
+      b = minim_bucket(minimizer_hash(occurs.b[j].bkey), idx->bucket_bits);
+      if(store) idx->occurs[counts[b]++] = occurs.b[j];
+      else counts[b]++;
+    }
+  }
+
+  minim_kmer_buf_dealloc(&kmers);
+  minim_occur_buf_dealloc(&occurs);
+}
+
+static void minim_count_thread(void *arg, size_t tid)
+{
+  _minim_build_pass((MinimBuilder*)arg, tid, false);
+}
+
+static void minim_store_thread(void *arg, size_t tid)
+{
+  _minim_build_pass((MinimBuilder*)arg, tid, true);
+}
+
+static int minim_occur_cmp(const void *aa, const void *bb)
+{
+  const MinimOccur *a = (const MinimOccur*)aa, *b = (const MinimOccur*)bb;
+  int c = binary_kmer_cmp(a->bkey, b->bkey);
+  if(c) return c;
+  if(a->read != b->read) return cmp(a->read, b->read);
+  return cmp(a->pos, b->pos);
+}
+
+static void minim_sort_thread(void *arg, size_t tid)
+{
+  (void)tid;
+  MinimBuilder *builder = (MinimBuilder*)arg;
+  MinimizerIndex *idx = builder->idx;
+  size_t b, nbuckets = 1UL << idx->bucket_bits;
+
+  while((b = __sync_fetch_and_add(&builder->next_bucket, 1)) < nbuckets) {
+    qsort(idx->occurs + idx->bucket_start[b],
+          idx->bucket_start[b+1] - idx->bucket_start[b],
+          sizeof(MinimOccur), minim_occur_cmp);
+  }
+}
+
+void minimizer_index_build(MinimizerIndex *idx,
+                           const read_t *reads, size_t num_reads,
+                           size_t kmer_size, size_t window, size_t nthreads)
+{
+  ctx_assert(window > 0);
+  ctx_assert(num_reads <= UINT32_MAX);
+
+  size_t b, t, nbuckets, sum;
+
+  memset(idx, 0, sizeof(MinimizerIndex));
+  idx->kmer_size = kmer_size;
+  idx->window = window;
+  idx->bucket_bits = 1;
+  while((1UL << idx->bucket_bits) < nthreads * MINIMIZER_BUCKETS_PER_THREAD)
+    idx->bucket_bits++;
+  nbuckets = 1UL << idx->bucket_bits;
+
+  MinimBuilder builder = {.idx = idx, .reads = reads, .num_reads = num_reads,
+                          .nthreads = nthreads, .next_bucket = 0};
+  builder.counts = ctx_calloc(nthreads * nbuckets, sizeof(size_t));
+
+  double start = util_wall_secs();
+
+  // Count minimizers per bucket, per thread
+  util_multi_thread(&builder, nthreads, minim_count_thread);
+
+  // Convert counts to write positions
+  idx->bucket_start = ctx_calloc(nbuckets+1, sizeof(size_t));
+  for(b = sum = 0; b < nbuckets; b++) {
+    idx->bucket_start[b] = sum;
+    for(t = 0; t < nthreads; t++) {
+      size_t n = builder.counts[t*nbuckets+b];
+      builder.counts[t*nbuckets+b] = sum;
+      sum += n;
+    }
+  }
+  idx->bucket_start[nbuckets] = idx->num_occurs = sum;
+
+  idx->occurs = ctx_malloc(sum * sizeof(MinimOccur));
+  util_multi_thread(&builder, nthreads, minim_store_thread);
+  util_multi_thread(&builder, nthreads, minim_sort_thread);
+
+  ctx_free(builder.counts);
+
+  char num_str[50], mem_str[50];
+  ulong_to_str(idx->num_occurs, num_str);
+  bytes_to_str(minimizer_index_mem(idx), 1, mem_str);
+  status("[MinimIndex] %s minimizers (k=%zu, window=%zu) [%s] in %.2f secs",
+         num_str, kmer_size, window, mem_str, util_wall_secs() - start);
+}
+
+void minimizer_index_dealloc(MinimizerIndex *idx)
+{
+  ctx_free(idx->occurs);
+  ctx_free(idx->bucket_start);
+  memset(idx, 0, sizeof(MinimizerIndex));
+}
+
+size_t minimizer_index_mem(const MinimizerIndex *idx)
+{
+  return idx->num_occurs * sizeof(MinimOccur) +
+         ((1UL << idx->bucket_bits) + 1) * sizeof(size_t);
+}
+
+size_t minimizer_index_find(const MinimizerIndex *idx,
+                            BinaryKmer bkey, uint32_t hash,
+                            const MinimOccur **first)
+{
+  size_t b = minim_bucket(hash, idx->bucket_bits);
+  size_t lo = idx->bucket_start[b], hi = idx->bucket_start[b+1], mid, end;
+
+  // Find first occurrence not less than bkey
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(binary_kmer_less_than(idx->occurs[mid].bkey, bkey)) lo = mid+1;
+    else hi = mid;
+  }
+
+  for(end = lo; end < idx->bucket_start[b+1] &&
+                binary_kmer_eq(idx->occurs[end].bkey, bkey); end++) {}
+
+  *first = idx->occurs + lo;
+  return end - lo;
+}
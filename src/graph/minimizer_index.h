@@ -0,0 +1,84 @@
+#ifndef MINIMIZER_INDEX_H_
+#define MINIMIZER_INDEX_H_
+
+#include "seq_reader.h"
+#include "binary_kmer.h"
+
+//
+// Sparse index of the (canonical) kmer minimizers of a set of sequences. For
+// each window of `window` consecutive kmers in a sequence we store the leftmost
+// and rightmost occurrence of the smallest kmer, ordered by hash. A substring
+// of a sequence shares every window, so any minimizer of the substring is
+// found at the aligned position in the sequence, in either orientation.
+// Used by `ctx rmsubstr` instead of a full kmer occurrence index (kmer_occur.h)
+//
+// Occurrences are split into buckets by kmer hash, then sorted by kmer within
+// each bucket. Both steps use multiple threads.
+//
+
+#define MINIMIZER_DEFAULT_WINDOW 10
+
+typedef struct
+{
+  BinaryKmer bkey;
+  uint32_t read, pos:31, orient:1; // pos is index of kmer in the read
+} MinimOccur;
+
+typedef struct
+{
+  BinaryKmer bkey;
+  uint32_t hash, orient;
+} MinimKmer;
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(minim_occur_buf, MinimOccurBuffer, MinimOccur);
+madcrow_buffer(minim_kmer_buf,  MinimKmerBuffer,  MinimKmer);
+
+typedef struct
+{
+  MinimOccur *occurs;
+  size_t *bucket_start; // bucket b is occurs[bucket_start[b]..bucket_start[b+1]]
+  size_t num_occurs, bucket_bits;
+  size_t kmer_size, window;
+} MinimizerIndex;
+
+/**
+ * Largest window <= `max_window` such that every sequence with a kmer has a
+ * run of `window` kmers with no non-ACGT bases. Returns 0 if there are no kmers
+ */
+size_t minimizer_index_window(const read_t *reads, size_t num_reads,
+                              size_t kmer_size, size_t max_window);
+
+/**
+ * Get minimizers of a sequence, sorted by position in the read and with no
+ * duplicates. Results are appended to `occurs` with read index `readid`.
+ * @param kmers temporary memory
+ */
+void minimizers_get(const read_t *r, uint32_t readid,
+                    size_t kmer_size, size_t window,
+                    MinimKmerBuffer *kmers, MinimOccurBuffer *occurs);
+
+void minimizer_index_build(MinimizerIndex *idx,
+                           const read_t *reads, size_t num_reads,
+                           size_t kmer_size, size_t window, size_t nthreads);
+
+void minimizer_index_dealloc(MinimizerIndex *idx);
+
+// Memory used by the index in bytes
+size_t minimizer_index_mem(const MinimizerIndex *idx);
+
+/**
+ * Find all occurrences of a canonical kmer
+ * @param bkey canonical kmer
+ * @param hash as returned by minimizer_hash()
+ * @param first set to point to the first occurrence
+ * @return number of occurrences
+ */
+size_t minimizer_index_find(const MinimizerIndex *idx,
+                            BinaryKmer bkey, uint32_t hash,
+                            const MinimOccur **first);
+
+#define MINIMIZER_HASH_SEED 0x9e3779b9
+#define minimizer_hash(bkey) binary_kmer_hash(bkey, MINIMIZER_HASH_SEED)
+
+#endif /* MINIMIZER_INDEX_H_ */
@@ -0,0 +1,430 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
+#include "global.h"
+#include "sorted_graph.h"
+#include "db_unitig.h"
+#include "util.h"
+
+#include <sys/mman.h>
+
+// Number of kmers per thread work unit in sorted_unitigs_iterate()
+#define SORTED_UNITIG_BLOCK 65536
+
+// log2 of min kmers per prefix. sorted_graph_open_sparse() binary searches
+// for the start of each prefix, reading about 1% of kmers with 1024 per prefix
+#define PREFIX_KMERS_BITS 4
+#define SPARSE_PREFIX_KMERS_BITS 10
+
+// Pick number of prefix bits so there are >= 2^minbits kmers per prefix
+static size_t _sorted_graph_prefix_bits(uint64_t nkmers, size_t kmer_size,
+                                        size_t minbits)
+{
+  size_t bits = 0;
+  while(bits < 32 && bits < 2*kmer_size && (1UL << (bits+minbits)) <= nkmers)
+    bits++;
+  return bits;
+}
+
+size_t sorted_graph_mem(uint64_t nkmers, size_t kmer_size)
+{
+  size_t bits = _sorted_graph_prefix_bits(nkmers, kmer_size, PREFIX_KMERS_BITS);
+  return ((1UL << bits) + 1) * sizeof(uint64_t);
+}
+
+// Top `prefix_bits` bits of a kmer
+static inline uint64_t _sorted_graph_prefix(const SortedGraph *sg,
+                                            BinaryKmer bkey)
+{
+  if(sg->prefix_bits == 0) return 0;
+  const size_t topbits = BKMER_TOP_BITS(sg->kmer_size);
+#if NUM_BKMER_WORDS > 1
+  if(topbits < sg->prefix_bits) {
+    const size_t lowbits = sg->prefix_bits - topbits;
+    return (bkey.b[0] << lowbits) | (bkey.b[1] >> (64 - lowbits));
+  }
+#endif
+  return bkey.b[0] >> (topbits - sg->prefix_bits);
+}
+
+// Memory map the file and allocate the prefix table
+static void _sorted_graph_map(SortedGraph *sg, const GraphFileReader *file,
+                              size_t minbits)
+{
+  const char *path = file_filter_path(&file->fltr);
+  ctx_assert(file->num_of_kmers >= 0);
+  ctx_assert(file->file_size >= 0);
+
+  memset(sg, 0, sizeof(SortedGraph));
+  sg->file = file;
+  sg->kmer_size = file->hdr.kmer_size;
+  sg->entrysize = graph_file_offset(file, 1) - file->hdr_size;
+  sg->nkmers = graph_file_nkmers(file);
+  sg->prefix_bits = _sorted_graph_prefix_bits(sg->nkmers, sg->kmer_size,
+                                              minbits);
+
+  if(file->file_size > 0) {
+    sg->mmap_ptr = mmap(NULL, file->file_size, PROT_READ, MAP_SHARED,
+                        fileno(file->fh), 0);
+    if(sg->mmap_ptr == MAP_FAILED)
+      die("Cannot memory map file: %s [%s]", path, strerror(errno));
+    sg->kmers = (const char*)sg->mmap_ptr + file->hdr_size;
+  }
+
+  const size_t nprefixes = 1UL << sg->prefix_bits;
+  sg->prefix_start = ctx_malloc((nprefixes+1) * sizeof(uint64_t));
+}
+
+void sorted_graph_open(SortedGraph *sg, const GraphFileReader *file)
+{
+  _sorted_graph_map(sg, file, PREFIX_KMERS_BITS);
+
+  // Build prefix table, checking the file is sorted
+  const char *path = file_filter_path(&file->fltr);
+  const size_t nprefixes = 1UL << sg->prefix_bits;
+  uint64_t i, p, next_prefix = 0;
+  BinaryKmer bkey, prev = {.b = {0}};
+
+  for(i = 0; i < sg->nkmers; i++) {
+    bkey = sorted_graph_bkey(sg, i);
+    if(i > 0 && !binary_kmer_lt(prev, bkey))
+      die("File is not sorted: %s", path);
+    p = _sorted_graph_prefix(sg, bkey);
+    while(next_prefix <= p) sg->prefix_start[next_prefix++] = i;
+    prev = bkey;
+  }
+
+  while(next_prefix <= nprefixes) sg->prefix_start[next_prefix++] = sg->nkmers;
+}
+
+// Index of the first kmer in [lo,hi) with prefix >= p, or hi if there is none
+static uint64_t _sorted_graph_prefix_lb(const SortedGraph *sg, uint64_t p,
+                                        uint64_t lo, uint64_t hi)
+{
+  uint64_t mid;
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(_sorted_graph_prefix(sg, sorted_graph_bkey(sg, mid)) < p) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Set prefix_start[p] for plo < p < phi by bisection. Kmers with those
+// prefixes are in [prefix_start[plo], prefix_start[phi]).
+static void _sorted_graph_split(SortedGraph *sg, uint64_t plo, uint64_t phi)
+{
+  if(plo+1 >= phi) return;
+  uint64_t pmid = plo + (phi-plo)/2;
+  sg->prefix_start[pmid] = _sorted_graph_prefix_lb(sg, pmid,
+                                                   sg->prefix_start[plo],
+                                                   sg->prefix_start[phi]);
+  _sorted_graph_split(sg, plo, pmid);
+  _sorted_graph_split(sg, pmid, phi);
+}
+
+void sorted_graph_open_sparse(SortedGraph *sg, const GraphFileReader *file)
+{
+  _sorted_graph_map(sg, file, SPARSE_PREFIX_KMERS_BITS);
+
+  const char *path = file_filter_path(&file->fltr);
+  const size_t nprefixes = 1UL << sg->prefix_bits;
+  uint64_t p, start, end;
+
+  sg->prefix_start[0] = 0;
+  sg->prefix_start[nprefixes] = sg->nkmers;
+  _sorted_graph_split(sg, 0, nprefixes);
+
+  // Check the first and last kmer of each prefix
+  for(p = 0; p < nprefixes; p++) {
+    start = sg->prefix_start[p];
+    end = sg->prefix_start[p+1];
+    if(start < end &&
+       (_sorted_graph_prefix(sg, sorted_graph_bkey(sg, start)) != p ||
+        _sorted_graph_prefix(sg, sorted_graph_bkey(sg, end-1)) != p ||
+        (end-1 > start &&
+         !binary_kmer_lt(sorted_graph_bkey(sg, start),
+                         sorted_graph_bkey(sg, end-1)))))
+      die("File is not sorted: %s", path);
+  }
+}
+
+void sorted_graph_close(SortedGraph *sg)
+{
+  if(sg->mmap_ptr != NULL && munmap(sg->mmap_ptr, sg->file->file_size) == -1) {
+    die("Cannot release mmap file: %s [%s]",
+        file_filter_path(&sg->file->fltr), strerror(errno));
+  }
+  ctx_free(sg->prefix_start);
+  memset(sg, 0, sizeof(SortedGraph));
+}
+
+Covg sorted_graph_covg(const SortedGraph *sg, hkey_t idx)
+{
+  const FileFilter *fltr = &sg->file->fltr;
+  const char *covgs = sorted_graph_entry(sg, idx) + sizeof(BinaryKmer);
+  size_t i;
+  Covg covg, sum = 0;
+
+  for(i = 0; i < file_filter_num(fltr); i++) {
+    memcpy(&covg, covgs + sizeof(Covg)*file_filter_fromcol(fltr, i),
+           sizeof(Covg));
+    sum = SAFE_ADD_COVG(sum, covg);
+  }
+  return sum;
+}
+
+bool sorted_graph_has_covg(const SortedGraph *sg, hkey_t idx)
+{
+  return sorted_graph_covg(sg, idx) > 0;
+}
+
+Edges sorted_graph_edges(const SortedGraph *sg, hkey_t idx)
+{
+  const FileFilter *fltr = &sg->file->fltr;
+  const char *edges = sorted_graph_entry(sg, idx) + sizeof(BinaryKmer) +
+                      sizeof(Covg) * fltr->srcncols;
+  Edges union_edges = 0;
+  size_t i;
+
+  for(i = 0; i < file_filter_num(fltr); i++)
+    union_edges |= (Edges)edges[file_filter_fromcol(fltr, i)];
+
+  return union_edges;
+}
+
+void sorted_graph_fetch(const SortedGraph *sg, hkey_t idx,
+                        Covg *covgs, Edges *edges)
+{
+  const FileFilter *fltr = &sg->file->fltr;
+  const char *allcovgs = sorted_graph_entry(sg, idx) + sizeof(BinaryKmer);
+  const char *alledges = allcovgs + fltr->srcncols*sizeof(Covg);
+  size_t from, into, i;
+  Covg c;
+  Edges e;
+
+  memset(covgs, 0, file_filter_into_ncols(fltr) * sizeof(Covg));
+  memset(edges, 0, file_filter_into_ncols(fltr) * sizeof(Edges));
+
+  for(i = 0; i < file_filter_num(fltr); i++) {
+    from = file_filter_fromcol(fltr, i);
+    into = file_filter_intocol(fltr, i);
+    memcpy(&c, allcovgs+sizeof(Covg)*from, sizeof(Covg));
+    memcpy(&e, alledges+sizeof(Edges)*from, sizeof(Edges));
+    covgs[into] = SAFE_ADD_COVG(covgs[into], c);
+    edges[into] |= e;
+  }
+}
+
+hkey_t sorted_graph_find_entry(const SortedGraph *sg, BinaryKmer bkey)
+{
+  uint64_t p = _sorted_graph_prefix(sg, bkey), mid;
+  uint64_t lo = sg->prefix_start[p], hi = sg->prefix_start[p+1];
+  BinaryKmer bmid;
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    bmid = sorted_graph_bkey(sg, mid);
+    if(binary_kmer_eq(bmid, bkey)) return mid;
+    if(binary_kmer_lt(bmid, bkey)) lo = mid+1;
+    else hi = mid;
+  }
+
+  return HASH_NOT_FOUND;
+}
+
+hkey_t sorted_graph_find_key(const SortedGraph *sg, BinaryKmer bkey)
+{
+  hkey_t idx = sorted_graph_find_entry(sg, bkey);
+  return idx != HASH_NOT_FOUND && sorted_graph_has_covg(sg, idx)
+           ? idx : HASH_NOT_FOUND;
+}
+
+dBNode sorted_graph_find(const SortedGraph *sg, BinaryKmer bkmer)
+{
+  BinaryKmer bkey = binary_kmer_get_key(bkmer, sg->kmer_size);
+  dBNode node = {.key = sorted_graph_find_key(sg, bkey),
+                 .orient = bkmer_get_orientation(bkmer, bkey)};
+  return node;
+}
+
+uint8_t sorted_graph_next_nodes(const SortedGraph *sg, BinaryKmer bkey,
+                                Orientation orient, Edges edges,
+                                dBNode nodes[4], Nucleotide fw_nucs[4])
+{
+  BinaryKmer bkmers[4];
+  Nucleotide nucs[4];
+  uint8_t i, n, count = 0;
+
+  n = bkmer_next_bkmers(bkey, orient, edges, sg->kmer_size, bkmers, nucs);
+
+  for(i = 0; i < n; i++) {
+    nodes[count] = sorted_graph_find(sg, bkmers[i]);
+    if(nodes[count].key == HASH_NOT_FOUND) continue;
+    nodes[count].orient ^= orient;
+    fw_nucs[count] = nucs[i];
+    count++;
+  }
+
+  return count;
+}
+
+size_t sorted_nodes_to_str(const dBNode *nodes, size_t num,
+                           const SortedGraph *sg, char *str)
+{
+  if(num == 0) return 0;
+
+  const size_t kmer_size = sg->kmer_size;
+  BinaryKmer bkmer = sorted_graph_oriented_bkmer(sg, nodes[0]);
+  Nucleotide nuc;
+  size_t i;
+
+  binary_kmer_to_str(bkmer, kmer_size, str);
+
+  for(i = 1; i < num; i++) {
+    nuc = bkmer_get_last_nuc(sorted_graph_bkey(sg, nodes[i].key),
+                             nodes[i].orient, kmer_size);
+    str[kmer_size+i-1] = dna_nuc_to_char(nuc);
+  }
+
+  str[kmer_size+num-1] = '\0';
+  return kmer_size+num-1;
+}
+
+//
+// Unitigs
+//
+
+void sorted_unitig_normalise(dBNode *nlist, size_t len, const SortedGraph *sg)
+{
+  ctx_assert(len > 0);
+
+  if(len == 1) {
+    nlist[0].orient = FORWARD;
+    return;
+  }
+
+  if(db_unitig_is_closed_cycle(nlist[0], sorted_graph_bkey(sg, nlist[0].key),
+                               sorted_graph_edges(sg, nlist[0].key),
+                               nlist[len-1],
+                               sorted_graph_bkey(sg, nlist[len-1].key),
+                               sorted_graph_edges(sg, nlist[len-1].key),
+                               sg->kmer_size))
+  {
+    // Kmers are sorted in the file, so the lowest kmer has the lowest index
+    size_t i, lowidx = 0;
+    for(i = 1; i < len; i++)
+      if(nlist[i].key < nlist[lowidx].key) lowidx = i;
+
+    db_unitig_cycle_rotate(nlist, len, lowidx);
+  }
+  else if(nlist[len-1].key < nlist[0].key) {
+    db_nodes_reverse_complement(nlist, len);
+  }
+}
+
+// Same as db_unitig_extend(), stops at kmers missing from the file
+static void sorted_unitig_extend(dBNodeBuffer *nbuf, const SortedGraph *sg)
+{
+  ctx_assert(nbuf->len > 0);
+
+  const size_t kmer_size = sg->kmer_size;
+  dBNode node0 = nbuf->b[0], node = nbuf->b[nbuf->len-1];
+
+  BinaryKmer bkmer = sorted_graph_oriented_bkmer(sg, node);
+  Edges edges = sorted_graph_edges(sg, node.key);
+  Nucleotide nuc;
+
+  while(edges_has_precisely_one_edge(edges, node.orient, &nuc))
+  {
+    bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
+    node = sorted_graph_find(sg, bkmer);
+    if(node.key == HASH_NOT_FOUND) break;
+    edges = sorted_graph_edges(sg, node.key);
+
+    if(edges_has_precisely_one_edge(edges, rev_orient(node.orient), &nuc))
+    {
+      if(node.key == node0.key || node.key == nbuf->b[nbuf->len-1].key) {
+        // don't create a loop A->B->A or a->b->B->A
+        break;
+      }
+
+      db_node_buf_add(nbuf, node);
+    }
+    else break;
+  }
+}
+
+void sorted_unitig_fetch(hkey_t idx, dBNodeBuffer *nbuf, const SortedGraph *sg)
+{
+  dBNode first = {.key = idx, .orient = REVERSE};
+  size_t offset = nbuf->len;
+  db_node_buf_add(nbuf, first);
+  sorted_unitig_extend(nbuf, sg);
+  db_nodes_reverse_complement(nbuf->b+offset, nbuf->len-offset);
+  sorted_unitig_extend(nbuf, sg);
+}
+
+typedef struct {
+  uint8_t *const visited;
+  const SortedGraph *sg;
+  void (*func)(dBNodeBuffer _nbuf, size_t threadid, void *_arg);
+  void *arg;
+  volatile uint64_t next_block;
+} SortedUnitigIterating;
+
+static void sorted_unitigs_iterate_thread(void *arg, size_t threadid)
+{
+  SortedUnitigIterating *iter = (SortedUnitigIterating*)arg;
+  const SortedGraph *sg = iter->sg;
+  uint8_t *visited = iter->visited;
+  uint64_t b, idx, end, node0;
+  bool got_lock;
+  size_t i;
+
+  dBNodeBuffer nbuf;
+  db_node_buf_alloc(&nbuf, 2048);
+
+  while((b = __sync_fetch_and_add(&iter->next_block, 1)) * SORTED_UNITIG_BLOCK
+        < sg->nkmers)
+  {
+    idx = b * SORTED_UNITIG_BLOCK;
+    end = MIN2(idx + SORTED_UNITIG_BLOCK, sg->nkmers);
+
+    for(; idx < end; idx++)
+    {
+      if(bitset_get_mt(visited, idx) || !sorted_graph_has_covg(sg, idx))
+        continue;
+
+      db_node_buf_reset(&nbuf);
+      sorted_unitig_fetch(idx, &nbuf, sg);
+
+      // Thread that locks the lowest kmer in the unitig prints it
+      node0 = nbuf.b[0].key;
+      for(i = 1; i < nbuf.len; i++) node0 = MIN2(node0, nbuf.b[i].key);
+
+      got_lock = false;
+      bitlock_try_acquire(visited, node0, &got_lock);
+
+      if(got_lock)
+      {
+        for(i = 0; i < nbuf.len; i++)
+          (void)bitset_set_mt(visited, nbuf.b[i].key);
+
+        iter->func(nbuf, threadid, iter->arg);
+      }
+    }
+  }
+
+  db_node_buf_dealloc(&nbuf);
+}
+
+void sorted_unitigs_iterate(size_t nthreads, uint8_t *visited,
+                            const SortedGraph *sg,
+                            void (*func)(dBNodeBuffer nbuf, size_t threadid,
+                                         void *arg),
+                            void *arg)
+{
+  SortedUnitigIterating iter = {.visited = visited, .sg = sg,
+                                .func = func, .arg = arg, .next_block = 0};
+
+  util_multi_thread(&iter, nthreads, sorted_unitigs_iterate_thread);
+}
@@ -0,0 +1,124 @@
+#ifndef SORTED_GRAPH_H_
+#define SORTED_GRAPH_H_
+
+#include "graph_file_reader.h"
+#include "db_node.h"
+
+//
+// Random access to a sorted graph file (see `ctx sort`) through a memory map,
+// without loading it into a hash table. Kmers are identified by their index in
+// the file, which is used as the key of a dBNode. Kmers are partitioned by
+// their top bits (prefix), we keep the index of the first kmer with each
+// prefix so a lookup only has to binary search a handful of kmers. The prefix
+// table takes at most half a byte per kmer. All lookups are threadsafe.
+//
+// Only kmers with coverage in one of the colours loaded by the file filter are
+// in the graph, edges are the union of those colours.
+//
+// This is the lookup used by `ctx clean --disk`, `ctx unitigs --disk` and
+// GraphFileSearch (graph_search.h). Unitigs are walked with
+// sorted_unitig_fetch() and oriented with sorted_unitig_normalise().
+//
+
+typedef struct
+{
+  const GraphFileReader *file;
+  void *mmap_ptr;
+  const char *kmers; // first kmer entry in the file
+  size_t kmer_size, entrysize;
+  uint64_t nkmers;
+  size_t prefix_bits;
+  uint64_t *prefix_start; // kmers with prefix p: [prefix_start[p],prefix_start[p+1])
+} SortedGraph;
+
+/**
+ * Memory map a sorted graph file and build the prefix table.
+ * Calls die() if the file is not sorted or cannot be mapped.
+ * @param file must be a file not a stream, not closed before sorted_graph_close
+ */
+void sorted_graph_open(SortedGraph *sg, const GraphFileReader *file);
+
+/**
+ * Same as sorted_graph_open(), but builds a smaller prefix table by binary
+ * search, reading about 1% of kmers, so large files open quickly. Lookups
+ * binary search more kmers. Only kmers at prefix boundaries are checked to be
+ * sorted.
+ */
+void sorted_graph_open_sparse(SortedGraph *sg, const GraphFileReader *file);
+void sorted_graph_close(SortedGraph *sg);
+
+// Memory needed for the prefix table of a file with `nkmers` kmers
+size_t sorted_graph_mem(uint64_t nkmers, size_t kmer_size);
+
+static inline const char* sorted_graph_entry(const SortedGraph *sg,
+                                             hkey_t idx)
+{
+  return sg->kmers + sg->entrysize * idx;
+}
+
+static inline BinaryKmer sorted_graph_bkey(const SortedGraph *sg, hkey_t idx)
+{
+  BinaryKmer bkey;
+  memcpy(bkey.b, sorted_graph_entry(sg, idx), sizeof(BinaryKmer));
+  return bkey;
+}
+
+// Sum of coverage in loaded colours
+Covg sorted_graph_covg(const SortedGraph *sg, hkey_t idx);
+
+// Returns true if the kmer has coverage in any loaded colour
+bool sorted_graph_has_covg(const SortedGraph *sg, hkey_t idx);
+
+// Union of edges in loaded colours
+Edges sorted_graph_edges(const SortedGraph *sg, hkey_t idx);
+
+// Coverage and edges of a kmer after the file filter is applied,
+// covgs and edges must have file_filter_into_ncols() entries
+void sorted_graph_fetch(const SortedGraph *sg, hkey_t idx,
+                        Covg *covgs, Edges *edges);
+
+// Returns index of a kmer key in the file or HASH_NOT_FOUND, whether or not
+// it has coverage in the loaded colours
+hkey_t sorted_graph_find_entry(const SortedGraph *sg, BinaryKmer bkey);
+
+// Returns index of a kmer key or HASH_NOT_FOUND if not in the graph
+hkey_t sorted_graph_find_key(const SortedGraph *sg, BinaryKmer bkey);
+
+// Same as db_graph_find()
+dBNode sorted_graph_find(const SortedGraph *sg, BinaryKmer bkmer);
+
+// Same as db_graph_next_nodes(), but skips kmers missing from the file
+uint8_t sorted_graph_next_nodes(const SortedGraph *sg, BinaryKmer bkey,
+                                Orientation orient, Edges edges,
+                                dBNode nodes[4], Nucleotide fw_nucs[4]);
+
+#define sorted_graph_oriented_bkmer(sg,node) \
+        bkmer_oriented_bkmer(sorted_graph_bkey(sg,(node).key), (node).orient, \
+                             (sg)->kmer_size)
+
+// Same as db_nodes_to_str(), `str` must have length num+kmer_size
+size_t sorted_nodes_to_str(const dBNode *nodes, size_t num,
+                           const SortedGraph *sg, char *str);
+
+//
+// Unitigs, as in db_unitig.h
+//
+
+// Same as db_unitig_normalise()
+void sorted_unitig_normalise(dBNode *nlist, size_t len, const SortedGraph *sg);
+
+// Same as db_unitig_fetch()
+void sorted_unitig_fetch(hkey_t idx, dBNodeBuffer *nbuf, const SortedGraph *sg);
+
+/**
+ * Call `func` on each unitig once. Threads take blocks of the file and walk
+ * unitigs from the kmers in them. Same as db_unitigs_iterate().
+ * @param visited one bit per kmer in the file, must be initialised to zero
+ **/
+void sorted_unitigs_iterate(size_t nthreads, uint8_t *visited,
+                            const SortedGraph *sg,
+                            void (*func)(dBNodeBuffer nbuf, size_t threadid,
+                                         void *arg),
+                            void *arg);
+
+#endif /* SORTED_GRAPH_H_ */
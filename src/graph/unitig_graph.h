@@ -24,7 +24,8 @@ typedef struct {
   const dBGraph *db_graph;
 
   // If set, during construction function is called on each unitig
-  void (*per_untig)(const dBNode *nodes, size_t n, size_t uidx, void *arg);
+  void (*per_untig)(const dBNode *nodes, size_t n, size_t uidx,
+                    size_t threadid, void *arg);
   void *per_untig_arg;
 } UnitigKmerGraph;
 
@@ -40,7 +41,8 @@ void unitig_graph_create(UnitigKmerGraph *ugraph,
                          size_t nthreads,
                          uint8_t *visited,
                          void (*per_untig)(const dBNode *nodes, size_t n,
-                                           size_t uidx, void *arg),
+                                           size_t uidx, size_t threadid,
+                                           void *arg),
                         void *per_untig_arg);
 
 void unitig_graph_alloc(UnitigKmerGraph *ugraph, const dBGraph *db_graph);
@@ -1,7 +1,9 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_IO
 #include "global.h"
 #include "gpath_reader.h"
 #include "file_util.h"
 #include "util.h"
+#include "ctx_progress.h"
 #include "hash_mem.h"
 #include "common_buffers.h"
 #include "str_parsing.h" // comma_list_to_array()
@@ -168,6 +170,9 @@ void gpath_reader_open2(GPathReader *file, const char *path, const char *mode,
 
   file->gz = futil_gzopen(fltr->path.b, mode);
   strm_buf_alloc(&file->strmbuf, 4*ONE_MEGABYTE);
+  file->progress_id = progress_running() ?
+                        progress_input_add(fltr->path.b,
+                                           futil_get_file_size(fltr->path.b)) : 0;
 
   // Temporary variable for loading
   strbuf_alloc(&file->line, 1024);
@@ -207,6 +212,7 @@ void gpath_reader_open(GPathReader *file, const char *path)
 
 void gpath_reader_close(GPathReader *file)
 {
+  progress_input_done(file->progress_id);
   if(file->gz) gzclose(file->gz);
   strm_buf_dealloc(&file->strmbuf);
   strbuf_dealloc(&file->line);
@@ -264,6 +270,8 @@ bool gpath_reader_read_kmer(GPathReader *file, StrBuf *kmer, size_t *num_links)
       strbuf_append_char(kmer, c);
       strbuf_gzreadline_buf(kmer, file->gz, &file->strmbuf);
       futil_gzcheck(0, file->gz, path);
+      perf_count(PERF_BYTES_READ, kmer->end);
+      progress_input_read(file->progress_id, kmer->end, 0);
       strbuf_chomp(kmer);
       if(!char_is_acgt(c) ||
          (space = strchr(kmer->b, ' ')) == NULL ||
@@ -437,6 +445,8 @@ bool gpath_reader_read_link(GPathReader *file,
       strbuf_append_char(line, c);
       strbuf_gzreadline_buf(line, file->gz, &file->strmbuf);
       futil_gzcheck(0, file->gz, path);
+      perf_count(PERF_BYTES_READ, line->end);
+      progress_input_read(file->progress_id, line->end, 0);
       strbuf_chomp(line);
       link_line_parse(line, file->version, &file->fltr,
                       fw, njuncs, countbuf, juncs,
@@ -531,6 +541,7 @@ void gpath_reader_load(GPathReader *file, int kmer_flags, dBGraph *db_graph)
 {
   const char *path = file_filter_path(&file->fltr);
 
+  perf_phase_start("load_links");
   file_filter_status(&file->fltr, false);
 
   size_t into_ncols = file_filter_into_ncols(&file->fltr);
@@ -645,6 +656,7 @@ void gpath_reader_load(GPathReader *file, int kmer_flags, dBGraph *db_graph)
   gpath_subset_dealloc(&subset1);
   gpath_set_dealloc(&gpset);
   byte_buf_dealloc(&seqbuf);
+  perf_phase_end("load_links");
 }
 
 void gpath_reader_load_sample_names(const GPathReader *file, dBGraph *db_graph)
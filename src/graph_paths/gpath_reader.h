@@ -27,6 +27,8 @@ typedef struct
   int version;
   size_t ncolours;
   cJSON **colours_json;
+
+  size_t progress_id; // reports bytes read with --progress, 0 if not tracked
 } GPathReader;
 
 #define GPATH_ADD_MISSING_KMERS   0
@@ -117,6 +117,7 @@ static inline void _gpath_save_flush(gzFile gzout, StrBuf *sbuf,
   pthread_mutex_lock(outlock);
   gzwrite(gzout, sbuf->b, sbuf->end);
   pthread_mutex_unlock(outlock);
+  perf_count(PERF_BYTES_WRITTEN, sbuf->end);
   strbuf_reset(sbuf);
 }
 
@@ -303,6 +304,7 @@ void gpath_save(gzFile gzout, const char *path,
   char npaths_str[50];
   ulong_to_str(db_graph->gpstore.num_paths, npaths_str);
 
+  perf_phase_start("save_links");
   status("Saving %s paths to: %s", npaths_str, path);
   status("  using %zu threads", nthreads);
 
@@ -329,4 +331,5 @@ void gpath_save(gzFile gzout, const char *path,
   util_multi_thread(&save, nthreads, gpath_save_thread);
   pthread_mutex_destroy(&outlock);
   status("[GPathSave] Graph paths saved to %s", path);
+  perf_phase_end("save_links");
 }
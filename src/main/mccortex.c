@@ -5,6 +5,7 @@
 #include "util.h"
 #include "file_util.h"
 #include "hash.h"
+#include "ctx_progress.h"
 
 // To add a new command to mccortex31 <cmd>:
 // 0. create a file src/commands/ctx_X.c
@@ -17,12 +18,13 @@ typedef struct
   const char *cmd, *blurb, *usage, *optargs, *reqargs;
   int minargs, maxargs; // counts AFTER standard args taken
   int hide; // set hide to >0 to remove from listings
+  int plan; // set >0 if command sizes its memory with cmd_check_mem_limit()
   int (*func)(int argc, char **argv);
 } CtxCmd;
 
 CtxCmd cmdobjs[] = {
 {
-  .cmd = "build", .func = ctx_build, .hide = false,
+  .cmd = "build", .func = ctx_build, .hide = false, .plan = true,
   .blurb = "construct cortex graph from FASTA/FASTQ/BAM",
   .usage = build_usage
 },
@@ -42,87 +44,87 @@ CtxCmd cmdobjs[] = {
   .usage = view_usage
 },
 {
-  .cmd = "pview", .func = ctx_pview, .hide = false,
+  .cmd = "pview", .func = ctx_pview, .hide = false, .plan = true,
   .blurb = "text view of a cortex link file (.ctp)",
   .usage = pview_usage
 },
 {
-  .cmd = "check", .func = ctx_health_check, .hide = false,
+  .cmd = "check", .func = ctx_health_check, .hide = false, .plan = true,
   .blurb = "load and check graph (.ctx) and path (.ctp) files",
   .usage = health_usage
 },
 {
-  .cmd = "clean", .func = ctx_clean, .hide = false,
+  .cmd = "clean", .func = ctx_clean, .hide = false, .plan = true,
   .blurb = "clean errors from a graph",
   .usage = clean_usage
 },
 {
-  .cmd = "join", .func = ctx_join, .hide = false,
+  .cmd = "join", .func = ctx_join, .hide = false, .plan = true,
   .blurb = "combine graphs, filter graph intersections",
   .usage = join_usage
 },
 {
-  .cmd = "unitigs", .func = ctx_unitigs, .hide = false,
-  .blurb = "pull out unitigs in FASTA, DOT or GFA format",
+  .cmd = "unitigs", .func = ctx_unitigs, .hide = false, .plan = true,
+  .blurb = "pull out unitigs in FASTA, DOT, GFA or compacted (.ctu) format",
   .usage = unitigs_usage
 },
 {
-  .cmd = "subgraph", .func = ctx_subgraph, .hide = false,
+  .cmd = "subgraph", .func = ctx_subgraph, .hide = false, .plan = true,
   .blurb = "filter a subgraph using seed kmers",
   .usage = subgraph_usage
 },
 {
-  .cmd = "reads", .func = ctx_reads, .hide = false,
+  .cmd = "reads", .func = ctx_reads, .hide = false, .plan = true,
   .blurb = "filter reads against a graph",
   .usage = reads_usage
 },
 {
-  .cmd = "contigs", .func = ctx_contigs, .hide = false,
+  .cmd = "contigs", .func = ctx_contigs, .hide = false, .plan = true,
   .blurb = "assemble contigs for a sample",
   .usage = contigs_usage
 },
 {
-  .cmd = "inferedges", .func = ctx_infer_edges, .hide = false,
+  .cmd = "inferedges", .func = ctx_infer_edges, .hide = false, .plan = true,
   .blurb = "infer graph edges between kmers before calling `thread`",
   .usage = inferedges_usage
 },
 {
-  .cmd = "thread", .func = ctx_thread, .hide = false,
+  .cmd = "thread", .func = ctx_thread, .hide = false, .plan = true,
   .blurb = "thread reads through cleaned graph to make links",
   .usage = thread_usage,
 },
 {
-  .cmd = "correct", .func = ctx_correct, .hide = false,
+  .cmd = "correct", .func = ctx_correct, .hide = false, .plan = true,
   .blurb = "error correct reads",
   .usage = correct_usage
 },
 {
-  .cmd = "pjoin", .func = ctx_pjoin, .hide = false,
+  .cmd = "pjoin", .func = ctx_pjoin, .hide = false, .plan = true,
   .blurb = "merge link files (.ctp)",
   .usage = pjoin_usage
 },
 {
-  .cmd = "bubbles", .func = ctx_bubbles, .hide = false,
+  .cmd = "bubbles", .func = ctx_bubbles, .hide = false, .plan = true,
   .blurb = "find bubbles in graph which are potential variants",
   .usage = bubbles_usage
 },
 {
-  .cmd = "breakpoints", .func = ctx_breakpoints, .hide = false,
+  .cmd = "breakpoints", .func = ctx_breakpoints, .hide = false, .plan = true,
   .blurb = "use a trusted assembled genome to call large events",
   .usage = breakpoints_usage
 },
 {
-  .cmd = "coverage", .func = ctx_coverage, .hide = false,
+  .cmd = "coverage", .func = ctx_coverage, .hide = false, .plan = true,
   .blurb = "print contig coverage",
   .usage = coverage_usage
 },
 {
-  .cmd = "rmsubstr", .func = ctx_rmsubstr, .hide = false,
+  .cmd = "rmsubstr", .func = ctx_rmsubstr, .hide = false, .plan = true,
   .blurb = "reduce set of strings to remove substrings",
   .usage = rmsubstr_usage
 },
 {
-  .cmd = "uniqkmers", .func = ctx_uniqkmers, .hide = false,
+  .cmd = "uniqkmers", .func = ctx_uniqkmers, .hide = false, .plan = true,
   .blurb = "generate random unique kmers",
   .usage = uniqkmers_usage
 },
@@ -132,7 +134,7 @@ CtxCmd cmdobjs[] = {
   .usage = links_usage
 },
 {
-  .cmd = "popbubbles", .func = ctx_pop_bubbles, .hide = false,
+  .cmd = "popbubbles", .func = ctx_pop_bubbles, .hide = false, .plan = true,
   .blurb = "pop bubbles in the population graph",
   .usage = pop_bubbles_usage
 },
@@ -142,17 +144,22 @@ CtxCmd cmdobjs[] = {
   .usage = calls2vcf_usage
 },
 {
-  .cmd = "server", .func = ctx_server, .hide = false,
+  .cmd = "server", .func = ctx_server, .hide = false, .plan = true,
   .blurb = "interactively query the graph",
   .usage = server_usage
 },
 {
-  .cmd = "dist", .func = ctx_dist_matrix, .hide = false,
+  .cmd = "dist", .func = ctx_dist_matrix, .hide = false, .plan = true,
   .blurb = "make colour kmer distance matrix",
   .usage = dist_matrix_usage
 },
 {
-  .cmd = "vcfcov", .func = ctx_vcfcov, .hide = false,
+  .cmd = "sketch", .func = ctx_sketch, .hide = false,
+  .blurb = "MinHash sketch colours or reads for dist --sketch",
+  .usage = sketch_usage
+},
+{
+  .cmd = "vcfcov", .func = ctx_vcfcov, .hide = false, .plan = true,
   .blurb = "coverage of a VCF against cortex graphs",
   .usage = vcfcov_usage
 },
@@ -163,12 +170,12 @@ CtxCmd cmdobjs[] = {
 },
 /* Experiments */
 {
-  .cmd = "exp_abc", .func = ctx_exp_abc, .hide = true,
+  .cmd = "exp_abc", .func = ctx_exp_abc, .hide = true, .plan = true,
   .blurb = "run experiment on traversal properties",
   .usage = exp_abc_usage
 },
 {
-  .cmd = "hashtest", .func = ctx_exp_hashtest, .hide = true,
+  .cmd = "hashtest", .func = ctx_exp_hashtest, .hide = true, .plan = true,
   .blurb = "test hash table speed",
   .usage = exp_hashtest_usage
 }
@@ -191,6 +198,12 @@ static const char options[] =
 "  -t, --threads <T>     Limit on proccessing threads [default: 2]\n"
 "  -o, --out <file>      Output file\n"
 "  -p, --paths <in.ctp>  Links file to load (can specify multiple times)\n"
+"  --perf                Report phase timings and performance counters\n"
+"  --perf-out <out.json> Also write performance report to a JSON file\n"
+"  --mem-report          Report current and peak memory by subsystem\n"
+"  --plan                Print memory allocation plan and exit\n"
+"  --progress <out.json> Write progress and throughput to a JSON file\n"
+"  --progress-secs <N>   Seconds between --progress updates [default: 10]\n"
 "\n";
 
 static int ctxcmd_cmp(const void *aa, const void *bb)
@@ -276,6 +289,61 @@ static bool remove_quiet_flags(int *argcp, char **argv)
   return qfound;
 }
 
+// remove --perf and --perf-out <file> arguments
+// returns true iff either was found, sets *perf_out if --perf-out given
+static bool remove_perf_flags(int *argcp, char **argv, const char **perf_out)
+{
+  bool pfound = false;
+  int i, j, argc = *argcp;
+  for(i = j = 1; i < argc; i++) {
+    if(strcmp(argv[i],"--perf") == 0) pfound = true;
+    else if(strcmp(argv[i],"--perf-out") == 0) {
+      if(i+1 == argc) cmd_print_usage("--perf-out <out.json> requires an argument");
+      *perf_out = argv[++i];
+      pfound = true;
+    }
+    else argv[j++] = argv[i];
+  }
+
+  *argcp = j;
+  return pfound;
+}
+
+// remove all occurrences of a flag that takes no argument e.g. --plan
+// returns true iff flag was found
+static bool remove_flag(int *argcp, char **argv, const char *flag)
+{
+  bool found = false;
+  int i, j, argc = *argcp;
+  for(i = j = 1; i < argc; i++) {
+    if(strcmp(argv[i],flag) == 0) found = true;
+    else argv[j++] = argv[i];
+  }
+
+  *argcp = j;
+  return found;
+}
+
+// remove flag that takes an argument e.g. --progress <file>
+// returns true iff flag was found, sets *value to the last argument given
+static bool remove_flag_arg(int *argcp, char **argv, const char *flag,
+                            const char *desc, const char **value)
+{
+  bool found = false;
+  int i, j, argc = *argcp;
+  for(i = j = 1; i < argc; i++) {
+    if(strcmp(argv[i],flag) == 0) {
+      if(i+1 == argc) cmd_print_usage("%s requires an argument", desc);
+      *value = argv[++i];
+      found = true;
+    }
+    else argv[j++] = argv[i];
+  }
+
+  *argcp = j;
+  return found;
+}
+
 int main(int argc, char **argv)
 {
   time_t start, end;
@@ -298,13 +366,49 @@ int main(int argc, char **argv)
   // Look for -q, --quiet argument, if given silence output
   if(remove_quiet_flags(&argc, argv)) { ctx_msg_out = NULL; }
 
+  // Look for --perf, --perf-out <file>
+  const char *perf_out = NULL;
+  perf_set_report(remove_perf_flags(&argc, argv, &perf_out));
+
+  // Look for --mem-report, --plan
+  bool mem_report = remove_flag(&argc, argv, "--mem-report");
+  cmd_mem_set_plan(remove_flag(&argc, argv, "--plan"));
+  if(cmd_mem_get_plan() && !cmd->plan)
+    cmd_print_usage("--plan is not supported by '%s'", cmd->cmd);
+
+  // Look for --progress <file>, --progress-secs <N>
+  const char *progress_path = NULL, *progress_secs_str = NULL;
+  double progress_secs = PROGRESS_DEFAULT_SECS;
+  remove_flag_arg(&argc, argv, "--progress", "--progress <out.json>",
+                  &progress_path);
+  if(remove_flag_arg(&argc, argv, "--progress-secs", "--progress-secs <N>",
+                     &progress_secs_str) &&
+     (!parse_entire_double(progress_secs_str, &progress_secs) ||
+      !(progress_secs > 0)))
+  {
+    cmd_print_usage("--progress-secs <N> must be a positive number: %s",
+                    progress_secs_str);
+  }
+
   // Print status header
   cmd_print_status_header();
 
+  if(progress_path != NULL) progress_start(progress_path, progress_secs);
+
   SWAP(argv[1],argv[0]);
   int ret = cmd->func(argc-1, argv+1);
 
   time(&end);
+
+  progress_stop(ret == 0);
+
+  if(perf_get_report()) {
+    perf_print_status();
+    if(perf_out != NULL) perf_write_json(perf_out);
+  }
+
+  if(mem_report) alloc_print_report();
+
   cmd_destroy();
 
   // Warn if more allocations than deallocations
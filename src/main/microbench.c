@@ -0,0 +1,81 @@
+#include "global.h"
+#include "microbench.h"
+#include "cmd.h"
+#include "util.h"
+
+#include <getopt.h>
+
+static const char usage[] =
+"usage: microbench [options] [<name-prefix>]\n"
+"\n"
+"  Time hot inner loops. Prints nanoseconds per operation over repetitions.\n"
+"  Only benchmarks whose name starts with <name-prefix> are run, if given.\n"
+"\n"
+"  -n <N>    Operations per repetition [default: 1000000]\n"
+"  -r <R>    Timed repetitions [default: 10]\n"
+"  -w <W>    Untimed warm-up runs [default: 2]\n"
+"  -t <T>    Max threads for multi-threaded benchmarks [default: 4]\n"
+"  -k <K>    Kmer size [default: "QUOTE_VALUE(MAX_KMER_SIZE)"]\n"
+"  -o <f>    Also write results to CSV file\n"
+"\n";
+
+static size_t parse_size_arg(char opt, const char *arg, bool allow_zero)
+{
+  size_t x;
+  if(!parse_entire_size(arg, &x) || (!allow_zero && !x))
+    print_usage(usage, "Invalid -%c argument: %s", opt, arg);
+  return x;
+}
+
+int main(int argc, char **argv)
+{
+  cortex_init();
+  cmd_init(argc, argv);
+
+  ctx_msg_out = NULL;
+
+  MicroBenchArgs args = {.warmup = 2, .reps = 10, .nops = 1000000,
+                         .max_threads = 4, .kmer_size = MAX_KMER_SIZE,
+                         .filter = NULL, .csv = NULL};
+  const char *csv_path = NULL;
+  int c;
+
+  while((c = getopt(argc, argv, "hn:r:w:t:k:o:")) != -1) {
+    switch(c) {
+      case 'h': print_usage(usage, NULL); break;
+      case 'n': args.nops = parse_size_arg(c, optarg, false); break;
+      case 'r': args.reps = parse_size_arg(c, optarg, false); break;
+      case 'w': args.warmup = parse_size_arg(c, optarg, true); break;
+      case 't': args.max_threads = parse_size_arg(c, optarg, false); break;
+      case 'k': args.kmer_size = parse_size_arg(c, optarg, false); break;
+      case 'o': csv_path = optarg; break;
+      default: print_usage(usage, NULL);
+    }
+  }
+
+  if(optind+1 < argc) print_usage(usage, "Too many arguments");
+  if(optind < argc) args.filter = argv[optind];
+
+  if(args.kmer_size < MIN_KMER_SIZE || args.kmer_size > MAX_KMER_SIZE ||
+     !(args.kmer_size & 1)) {
+    print_usage(usage, "Kmer size must be odd and within compiled range");
+  }
+
+  if(csv_path && (args.csv = fopen(csv_path, "w")) == NULL)
+    die("Cannot open file: %s", csv_path);
+
+  // Fixed seed so that runs are comparable
+  srand(1);
+
+  fprintf(stderr, "[microbench] k=%zu ops=%zu reps=%zu warmup=%zu threads<=%zu\n",
+          args.kmer_size, args.nops, args.reps, args.warmup, args.max_threads);
+
+  size_t nrun = microbench_run_all(&args);
+
+  if(args.csv) fclose(args.csv);
+  if(!nrun) fprintf(stderr, "[microbench] No benchmarks match '%s'\n", args.filter);
+
+  cmd_destroy();
+  cortex_destroy();
+  return nrun ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -29,6 +29,7 @@ int main(int argc, char **argv)
     test_db_node();
     test_build_graph();
     test_db_unitig();
+    test_compact_graph();
     test_subgraph();
     test_cleaning();
     test_paths();
@@ -40,6 +41,8 @@ int main(int argc, char **argv)
     test_bubble_caller();
     test_kmer_occur();
     test_infer_edges_tests();
+    test_dist_matrix();
+    test_kmer_sketch();
   #endif
 
   cmd_destroy();
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_LINKS
 #include "global.h"
 #include "gpath_hash.h"
 #include "hash_mem.h"
@@ -71,6 +72,7 @@ void gpath_hash_reset(GPathHash *gphash)
 {
   gphash->num_entries = 0;
   memset(gphash->table, 0xff, gphash->capacity * sizeof(GPEntry));
+  memset(gphash->bucket_nitems, 0, gphash->num_of_buckets * sizeof(uint8_t));
 }
 
 void gpath_hash_print_stats(const GPathHash *gphash)
@@ -112,7 +114,7 @@ static inline GPath* _find_or_add_in_bucket_mt(GPathHash *gphash, uint64_t hash,
 
   // Add GPath within a lock to ensure we do not add the same path more than
   // once
-  bitlock_yield_acquire(gphash->bktlocks, hash);
+  perf_bitlock_acquire(gphash->bktlocks, hash);
 
         GPEntry *start = gphash->table + hash * gphash->bucket_size;
   const GPEntry *end   = start + gphash->bucket_size;
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_LINKS
 #include "global.h"
 #include "gpath_set.h"
 #include "util.h"
@@ -6,6 +7,14 @@
 // This is relied on by GPathFollow
 #define SEQ_STORE_PADDING 16
 
+// Bytes held by buffers, these are allocated by madcrowlib rather than
+// ctx_malloc() so we count them with alloc_track()
+static size_t _gpset_mem(const GPathSet *gpset)
+{
+  return gpset->entries.size * sizeof(GPath) +
+         gpset->seqs.size + gpset->nseen_buf.size;
+}
+
 // If resize true, cannot do multithreaded but can resize array
 // If resize false, die if out of mem, but can multithread
 void gpath_set_alloc2(GPathSet *gpset, size_t ncols,
@@ -52,6 +61,7 @@ void gpath_set_alloc2(GPathSet *gpset, size_t ncols,
   }
 
   memcpy(gpset, &tmp, sizeof(GPathSet));
+  alloc_track(ALLOC_TAG_LINKS, _gpset_mem(gpset));
 }
 
 // If resize true, cannot do multithreaded but can resize array
@@ -71,6 +81,7 @@ void gpath_set_alloc(GPathSet *gpset, size_t ncols, size_t initmem,
 
 void gpath_set_dealloc(GPathSet *gpset)
 {
+  alloc_untrack(ALLOC_TAG_LINKS, _gpset_mem(gpset));
   gpath_buf_dealloc(&gpset->entries);
   byte_buf_dealloc(&gpset->seqs);
   byte_buf_dealloc(&gpset->nseen_buf);
@@ -125,7 +136,7 @@ void gpath_set_nseen_sum_mt(const GPath *dst, GPathSet *dstset,
 void _check_resize(GPathSet *gpset, size_t req_num_bytes)
 {
   const size_t ncols = gpset->ncols;
-  size_t i;
+  size_t i, old_mem = _gpset_mem(gpset);
 
   GPath *old_entries = gpset->entries.b;
   size_t old_num_entries = gpset->entries.size;
@@ -161,6 +172,9 @@ void _check_resize(GPathSet *gpset, size_t req_num_bytes)
       }
     }
   }
+
+  size_t new_mem = _gpset_mem(gpset);
+  if(new_mem > old_mem) alloc_track(ALLOC_TAG_LINKS, new_mem - old_mem);
 }
 
 // Always adds new path. If newpath could be a duplicate, use gpathhash
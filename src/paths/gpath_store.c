@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_LINKS
 #include "global.h"
 #include "gpath_store.h"
 #include "util.h"
@@ -174,7 +175,7 @@ GPath* gpath_store_find_add_mt(GPathStore *gpstore,
   *found = true;
 
   // Get lock for kmer
-  bitlock_yield_acquire(gpstore->kmer_locks, hkey);
+  perf_bitlock_acquire(gpstore->kmer_locks, hkey);
 
   // Add if not found
   if((gpath = gpstore_find(gpstore, hkey, newgpath)) == NULL) {
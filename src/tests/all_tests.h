@@ -118,6 +118,9 @@ void test_build_graph();
 // db_unitig_tests.c
 void test_db_unitig();
 
+// compact_graph_tests.c
+void test_compact_graph();
+
 // cleaning_tests.c
 void test_cleaning();
 
@@ -151,4 +154,10 @@ void test_graph_crawler();
 // infer_edges_tests.c
 void test_infer_edges_tests();
 
+// dist_matrix_tests.c
+void test_dist_matrix();
+
+// kmer_sketch_tests.c
+void test_kmer_sketch();
+
 #endif  /* ALL_TESTS_H_ */
@@ -134,9 +134,135 @@ void _test_graph_cleaning()
   db_graph_dealloc(&graph);
 }
 
+void _test_fused_cleaning()
+{
+  test_status("Testing fused graph cleaning...");
+
+  // Construct 1 colour graph with kmer-size=19
+  dBGraph graph;
+  const size_t kmer_size = 19, ncols = 1, nthreads = 2;
+  size_t i;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 2000,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_BKTLOCKS);
+
+  uint8_t *visited = ctx_calloc(roundup_bits2bytes(graph.ht.capacity), 1);
+  uint8_t *keep    = ctx_calloc(roundup_bits2bytes(graph.ht.capacity), 1);
+
+  // 200 bases seen 3 times
+  char seq[] =
+"GGCTACCTAACCAGATATCTCTGTATACAGCTGCATTGTGTTTAGTCTACAACGACAGAAATCCCCTTCGACGCCCGC"
+"GACCTCTCTTAACGGACGACGCCTTCCGGTTGCGATATCGATGGATCGACAGAACAAGCCGCTTCCCTAACAACTGCG"
+"CATGAAATCCAAAGTGCGCCGATGCTTGCTTGACGATTCCAAAT";
+
+  // SNP at base 60 seen twice creates a bubble,
+  // SNP 5 bases from the end of a read creates a tip
+  char snp[101], tip[156];
+  memcpy(snp, seq, 100); snp[100] = '\0'; snp[59] = 'T';
+  memcpy(tip, seq, 155); tip[155] = '\0'; tip[150] = 'T';
+
+  for(i = 0; i < 3; i++)
+    build_graph_from_str_mt(&graph, 0, seq, strlen(seq), false);
+  build_graph_from_str_mt(&graph, 0, snp, strlen(snp), false);
+  build_graph_from_str_mt(&graph, 0, snp, strlen(snp), false);
+  build_graph_from_str_mt(&graph, 0, tip, strlen(tip), false);
+
+  size_t nkmers = strlen(seq)-kmer_size+1;
+  TASSERT2(hash_table_nkmers(&graph.ht) == nkmers + 19 + 5,
+           "%zu kmers", (size_t)hash_table_nkmers(&graph.ht));
+
+  // Same threshold whether we walk unitigs or not
+  int thresh0 = cleaning_get_threshold(nthreads, NULL, NULL, visited, &graph);
+  int thresh1 = cleaning_get_kmer_threshold(nthreads, &graph);
+  TASSERT2(thresh0 == thresh1, "%i vs %i", thresh0, thresh1);
+
+  // Clip tip only, bubble branch has coverage 2 so is kept
+  clean_graph_fused(nthreads, 2, 2*19-1, NULL, NULL, NULL, NULL, NULL,
+                    visited, keep, &graph);
+  TASSERT2(hash_table_nkmers(&graph.ht) == nkmers + 19,
+           "%zu kmers", (size_t)hash_table_nkmers(&graph.ht));
+  TASSERT(hash_table_nkmers(&graph.ht) == hash_table_count_kmers(&graph.ht));
+
+  // Pop bubble, keeping the higher coverage branch
+  PopBubblesPrefs prefs = {.max_rmv_covg = -1, .max_rmv_klen = -1,
+                           .max_rmv_kdiff = -1};
+  clean_graph_fused(nthreads, 0, 0, &prefs, NULL, NULL, NULL, NULL,
+                    visited, keep, &graph);
+  TASSERT2(hash_table_nkmers(&graph.ht) == nkmers,
+           "%zu kmers", (size_t)hash_table_nkmers(&graph.ht));
+  TASSERT(hash_table_nkmers(&graph.ht) == hash_table_count_kmers(&graph.ht));
+  TASSERT(db_graph_find_str(&graph, seq).key != HASH_NOT_FOUND);
+
+  ctx_free(visited);
+  ctx_free(keep);
+
+  db_graph_dealloc(&graph);
+}
+
+void _test_per_colour_cleaning()
+{
+  test_status("Testing per-colour graph cleaning...");
+
+  // Construct 2 colour graph with kmer-size=11
+  dBGraph graph;
+  const size_t kmer_size = 11, ncols = 2, nthreads = 2;
+  size_t i;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_BKTLOCKS);
+
+  uint8_t *visited = ctx_calloc(roundup_bits2bytes(graph.ht.capacity), 1);
+  uint8_t *keep    = ctx_calloc(roundup_bits2bytes(graph.ht.capacity), 1);
+
+  // Shared stem that forks into two branches
+  const char seq0[] = "CTTGCAGAAGACTCCGATGA""ACGTTAGCCATTGAG";
+  const char seq1[] = "CTTGCAGAAGACTCCGATGA""TAGGCTCACTTGCTT";
+
+  // colour 0: branch 0 x5
+  // colour 1: branch 0 x1, branch 1 x5
+  for(i = 0; i < 5; i++) {
+    build_graph_from_str_mt(&graph, 0, seq0, strlen(seq0), false);
+    build_graph_from_str_mt(&graph, 1, seq1, strlen(seq1), false);
+  }
+  build_graph_from_str_mt(&graph, 1, seq0, strlen(seq0), false);
+
+  size_t nkmers = hash_table_nkmers(&graph.ht);
+  dBNode stem_end = db_graph_find_str(&graph, "GACTCCGATGA");
+  dBNode branch0 = db_graph_find_str(&graph, "ACGTTAGCCAT");
+  TASSERT(stem_end.key != HASH_NOT_FOUND && branch0.key != HASH_NOT_FOUND);
+  TASSERT(db_node_outdegree_in_col(stem_end, 1, &graph) == 2);
+
+  // Remove branch 0 from colour 1 only
+  size_t thresholds[2] = {2, 2};
+  clean_graph_per_colour(nthreads, thresholds, 0, visited, keep, &graph);
+
+  TASSERT2(hash_table_nkmers(&graph.ht) == nkmers, "%zu kmers",
+           (size_t)hash_table_nkmers(&graph.ht));
+  TASSERT(db_node_get_covg(&graph, branch0.key, 0) == 5);
+  TASSERT(db_node_get_covg(&graph, branch0.key, 1) == 0);
+  TASSERT(db_node_get_edges(&graph, branch0.key, 1) == 0);
+  TASSERT(db_node_get_covg(&graph, stem_end.key, 1) == 6);
+  TASSERT(db_node_outdegree_in_col(stem_end, 0, &graph) == 1);
+  TASSERT(db_node_outdegree_in_col(stem_end, 1, &graph) == 1);
+
+  // Removing branch 0 from colour 0 too removes it from the graph
+  thresholds[0] = 6;
+  clean_graph_per_colour(nthreads, thresholds, 0, visited, keep, &graph);
+  TASSERT(db_graph_find_str(&graph, "ACGTTAGCCAT").key == HASH_NOT_FOUND);
+  TASSERT(hash_table_nkmers(&graph.ht) == hash_table_count_kmers(&graph.ht));
+  TASSERT(db_node_outdegree_in_col(stem_end, 0, &graph) == 0);
+
+  ctx_free(visited);
+  ctx_free(keep);
+
+  db_graph_dealloc(&graph);
+}
+
 void test_cleaning()
 {
   _test_pick_theshold();
   _test_graph_cleaning();
+  _test_fused_cleaning();
+  _test_per_colour_cleaning();
 }
 
@@ -0,0 +1,98 @@
+#include "global.h"
+#include "all_tests.h"
+#include "compact_graph.h"
+#include "db_unitig.h"
+#include "build_graph.h"
+
+// Check sequence of each unitig matches the unitig in the graph
+static void _check_unitig_seqs(const CompactGraph *cg, const dBGraph *graph)
+{
+  char cgstr[200], ustr[200];
+  dBNodeBuffer nbuf;
+  db_node_buf_alloc(&nbuf, 64);
+  size_t u, nbases;
+  dBNode node;
+
+  for(u = 0; u < cg->num_unitigs; u++) {
+    nbases = compact_graph_nbases(cg, u);
+    TASSERT(nbases < sizeof(cgstr));
+    binary_seq_to_str(compact_graph_seq(cg, u), nbases, cgstr);
+
+    node = db_graph_find_str(graph, cgstr);
+    TASSERT(node.key != HASH_NOT_FOUND);
+    db_node_buf_reset(&nbuf);
+    db_unitig_fetch(node.key, &nbuf, graph);
+    db_unitig_normalise(nbuf.b, nbuf.len, graph);
+    db_nodes_to_str(nbuf.b, nbuf.len, graph, ustr);
+
+    TASSERT2(strcmp(cgstr, ustr) == 0, "%s vs %s", cgstr, ustr);
+    TASSERT(nbuf.len == compact_graph_nkmers(cg, u));
+  }
+
+  db_node_buf_dealloc(&nbuf);
+}
+
+// Every link should be stored in both directions
+static void _check_links_symmetric(const CompactGraph *cg)
+{
+  size_t e, i, j;
+  uint64_t f;
+  for(e = 0; e < 2*cg->num_unitigs; e++) {
+    for(i = 0; i < compact_graph_nlinks(cg, e); i++) {
+      f = compact_graph_links(cg, e)[i];
+      for(j = 0; j < compact_graph_nlinks(cg, f); j++)
+        if(compact_graph_links(cg, f)[j] == e) break;
+      TASSERT(j < compact_graph_nlinks(cg, f));
+    }
+  }
+}
+
+void test_compact_graph()
+{
+  test_status("Testing compacted unitig graph");
+
+  // Construct 2 colour graph with kmer-size=11
+  dBGraph graph;
+  size_t kmer_size = 11, ncols = 2;
+  db_graph_alloc(&graph, kmer_size, ncols, 1, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_BKTLOCKS);
+
+  // Shared stem that forks into two branches
+  const char stem[] = "CTTGCAGAAGACTCCGATGA";
+  const char seq0[] = "CTTGCAGAAGACTCCGATGA""ACGTTAGCCATTGAG";
+  const char seq1[] = "CTTGCAGAAGACTCCGATGA""TAGGCTCACTTGCTT";
+
+  build_graph_from_str_mt(&graph, 0, seq0, strlen(seq0), false);
+  build_graph_from_str_mt(&graph, 1, seq1, strlen(seq1), false);
+
+  CompactGraph cg;
+  compact_graph_build(&cg, 2, &graph);
+
+  TASSERT2(cg.num_unitigs == 3, "%zu", cg.num_unitigs);
+  TASSERT(cg.num_kmers == graph.ht.num_kmers);
+  TASSERT(cg.num_of_cols == ncols);
+
+  _check_unitig_seqs(&cg, &graph);
+  _check_links_symmetric(&cg);
+
+  // stem links to both branches, in both directions
+  TASSERT2(cg.num_links == 4, "%zu", (size_t)cg.num_links);
+
+  // Find the stem by its coverage - in both colours
+  size_t u, nstem = 0;
+  const Covg *covgs0 = compact_graph_col_covgs(&cg, 0);
+  const Covg *covgs1 = compact_graph_col_covgs(&cg, 1);
+  for(u = 0; u < cg.num_unitigs; u++) {
+    TASSERT(compact_graph_covg(&cg, u, 1) == covgs1[u]);
+    if(covgs0[u] == 1 && covgs1[u] == 1) {
+      nstem++;
+      TASSERT(compact_graph_nbases(&cg, u) == strlen(stem));
+    } else {
+      TASSERT(covgs0[u] + covgs1[u] == 1);
+    }
+  }
+  TASSERT(nstem == 1);
+
+  compact_graph_dealloc(&cg);
+  db_graph_dealloc(&graph);
+}
@@ -2,6 +2,7 @@
 #include "all_tests.h"
 #include "build_graph.h"
 #include "correct_alignment.h"
+#include "gap_cache.h"
 #include "generate_paths.h"
 #include "db_alignment.h"
 
@@ -103,6 +104,60 @@ static void test_correct_aln_no_paths()
   db_graph_dealloc(&graph);
 }
 
+static void test_correct_aln_gap_cache()
+{
+  test_status("Testing correct_aln with gap cache...");
+
+  // mutations:                            **
+  char seq[] = "ATGCATGTTGACCAAATAAGTCAC""TGTGGGAGCCACGTAAAGCGTTCGCACCGATTTGTG";
+  char mu0[] =     "ATGTTGACCAAATAAGTCAC""TGTCCGAGCCACGTAAAGCGTTCGCACC";
+  char re0[] =     "ATGTTGACCAAATAAGTCAC""TGTGGGAGCCACGTAAAGCGTTCGCACC";
+
+  // Construct 1 colour graph with kmer-size=11
+  dBGraph graph;
+  size_t kmer_size = 11, ncols = 1, t, i;
+
+  CorrectAlnWorker corrector;
+  GapCache gapcache;
+  StrBuf sbuf;
+
+  // No end check, so gaps can be cached
+  CorrectAlnParam params = {.ctpcol = 0, .ctxcol = 0,
+                            .frag_len_min = 0, .frag_len_max = 0,
+                            .one_way_gap_traverse = true, .use_end_check = false,
+                            .max_context = 10,
+                            .gap_variance = 0.1, .gap_wiggle = 5};
+
+  const char *gseqs[1] = {seq};
+  char *alns[1] = {re0};
+
+  all_tests_construct_graph(&graph, kmer_size, ncols, gseqs, 1, params);
+
+  correct_aln_worker_alloc(&corrector, false, &graph);
+  gap_cache_alloc(&gapcache, 64*1024, true);
+  corrector.gapcache = &gapcache;
+  strbuf_alloc(&sbuf, 1024);
+
+  for(t = 0; t < 2; t++)
+  {
+    params.one_way_gap_traverse = (t == 0);
+
+    // First lookup misses, then we get the same result from the cache
+    for(i = 0; i < 3; i++) {
+      correct_aln_stats_reset(&corrector.aln_stats);
+      _check_correct_aln(mu0, NULL, alns, 1, &corrector, &params, &graph, &sbuf);
+      TASSERT(corrector.aln_stats.num_gap_cache_hits == (i > 0));
+      TASSERT(corrector.aln_stats.num_gap_cache_misses == (i == 0));
+      TASSERT(corrector.aln_stats.num_gap_successes == 1);
+    }
+  }
+
+  strbuf_dealloc(&sbuf);
+  gap_cache_dealloc(&gapcache);
+  correct_aln_worker_dealloc(&corrector);
+  db_graph_dealloc(&graph);
+}
+
 static void test_contig_ends_agree()
 {
   test_status("Testing correct_aln with contig end check...");
@@ -206,5 +261,6 @@ void test_corrected_aln()
 {
   test_status("Testing correct_alignment.c");
   test_correct_aln_no_paths();
+  test_correct_aln_gap_cache();
   test_contig_ends_agree();
 }
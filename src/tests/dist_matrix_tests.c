@@ -0,0 +1,91 @@
+#include "global.h"
+#include "all_tests.h"
+
+#include "db_node.h"
+#include "db_graph.h"
+#include "dist_matrix.h"
+
+// Count shared kmers one colour pair at a time
+static void naive_dist_matrix(const dBGraph *db_graph, uint64_t *counts)
+{
+  const size_t ncols = db_graph->num_of_cols;
+  hkey_t hkey;
+  size_t i, j;
+
+  memset(counts, 0, ncols*ncols*sizeof(uint64_t));
+
+  for(hkey = 0; hkey < db_graph->ht.capacity; hkey++) {
+    if(!db_graph_node_assigned(db_graph, hkey)) continue;
+    for(i = 0; i < ncols; i++) {
+      if(!db_node_has_col(db_graph, hkey, i)) continue;
+      for(j = i; j < ncols; j++)
+        if(db_node_has_col(db_graph, hkey, j)) counts[ncols*i+j]++;
+    }
+  }
+}
+
+static void test_dist_matrix_random()
+{
+  test_status("Testing blocked dist matrix against naive counting");
+
+  // More colours than a tile, more kmers than a block
+  const size_t kmer_size = 31, ncols = 2*DIST_TILE_COLS+3, nkmers = 10000;
+  size_t i, col;
+  bool found;
+  dBGraph graph;
+
+  db_graph_alloc(&graph, kmer_size, ncols, 0, 2*nkmers, DBG_ALLOC_NODE_IN_COL);
+
+  // Colour i has roughly 1 in (i+2) kmers, some colours are empty
+  for(i = 0; i < nkmers; i++) {
+    BinaryKmer bkmer = binary_kmer_random(kmer_size);
+    BinaryKmer bkey = binary_kmer_get_key(bkmer, kmer_size);
+    dBNode node = db_graph_find_or_add_node(&graph, bkey, &found);
+    for(col = 0; col < ncols; col++)
+      if(col % 7 != 3 && rand() % (col+2) == 0)
+        db_node_set_col(&graph, node.key, col);
+  }
+
+  uint64_t *truth = ctx_calloc(ncols*ncols, sizeof(uint64_t));
+  naive_dist_matrix(&graph, truth);
+
+  DistMatrix matrix;
+
+  // Count from graph with different numbers of threads
+  for(i = 1; i <= 3; i++) {
+    dist_matrix_alloc(&matrix, ncols);
+    dist_matrix_count_graph(&graph, i, &matrix);
+    TASSERT(matrix.nkmers == graph.ht.num_kmers);
+    TASSERT(memcmp(matrix.counts, truth, ncols*ncols*sizeof(uint64_t)) == 0);
+    dist_matrix_dealloc(&matrix);
+  }
+
+  // Add kmers to blocks one at a time
+  DistBlock blk;
+  uint8_t colset[roundup_bits2bytes(ncols)];
+  dist_matrix_alloc(&matrix, ncols);
+  dist_block_alloc(&blk, ncols);
+
+  for(i = 0; i < graph.ht.capacity; i++) {
+    if(!db_graph_node_assigned(&graph, i)) continue;
+    memset(colset, 0, sizeof(colset));
+    for(col = 0; col < ncols; col++)
+      if(db_node_has_col(&graph, i, col)) bitset_set(colset, col);
+    dist_block_add_kmer(&blk, colset);
+    if(dist_block_is_full(&blk)) dist_matrix_add_block(&matrix, &blk);
+  }
+  if(blk.nkmers) dist_matrix_add_block(&matrix, &blk);
+
+  TASSERT(matrix.nkmers == graph.ht.num_kmers);
+  TASSERT(memcmp(matrix.counts, truth, ncols*ncols*sizeof(uint64_t)) == 0);
+
+  dist_block_dealloc(&blk);
+  dist_matrix_dealloc(&matrix);
+  ctx_free(truth);
+  db_graph_dealloc(&graph);
+}
+
+void test_dist_matrix()
+{
+  test_dist_matrix_random();
+}
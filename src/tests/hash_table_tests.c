@@ -2,6 +2,7 @@
 #include "all_tests.h"
 #include "hash_table.h"
 #include "binary_kmer.h"
+#include "kmer_bloom.h"
 
 #define NTESTS 1024
 
@@ -128,8 +129,82 @@ static void test_hash_table_mt()
   hash_table_dealloc(&bset.ht);
 }
 
+// Batched find should agree with hash_table_find(), including for kmers that
+// have been rehashed out of a full bucket
+static void test_find_batch()
+{
+  test_status("Test batched hash_table find");
+
+  HashTable ht;
+  size_t i, n = 2*NTESTS, kmer_size = MAX_KMER_SIZE, num_first_bckt;
+  bool found;
+
+  hash_table_alloc(&ht, NTESTS);
+
+  BinaryKmer *bkeys = ctx_calloc(n, sizeof(BinaryKmer));
+  hkey_t *hkeys = ctx_calloc(n, sizeof(hkey_t));
+
+  // Fill table so some buckets overflow, other kmers are not in table. Only
+  // fill half the table, so that we do not run out of rehashes
+  for(i = 0; i < n; i++)
+    bkeys[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+  for(i = 0; i < n && hash_table_nkmers(&ht) < ht.capacity/2; i++)
+    hash_table_find_or_insert(&ht, bkeys[i], &found);
+
+  num_first_bckt = hash_table_find_batch(&ht, bkeys, n, hkeys);
+  TASSERT(num_first_bckt <= n);
+  TASSERT(ht.collisions[1] == 0 || num_first_bckt < n);
+
+  for(i = 0; i < n; i++)
+    TASSERT(hkeys[i] == hash_table_find(&ht, bkeys[i]));
+
+  ctx_free(bkeys);
+  ctx_free(hkeys);
+  hash_table_dealloc(&ht);
+}
+
+// Bloom filter must report every kmer in the table, and few that are not
+static void test_kmer_bloom()
+{
+  test_status("Test Bloom filter of hash table kmers");
+
+  HashTable ht;
+  KmerBloom bloom;
+  size_t i, kmer_size = MAX_KMER_SIZE, nfp = 0;
+  BinaryKmer bkey;
+  bool found;
+
+  hash_table_alloc(&ht, NTESTS);
+  for(i = 0; i < NTESTS/2; i++) {
+    bkey = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    hash_table_find_or_insert(&ht, bkey, &found);
+  }
+
+  kmer_bloom_alloc(&bloom, hash_table_nkmers(&ht), 16);
+  kmer_bloom_add_all(&bloom, &ht, 2);
+
+  for(i = 0; i < hash_table_size(&ht); i++) {
+    if(hash_table_assigned(&ht, i))
+      TASSERT(kmer_bloom_contains(&bloom, kmer_bloom_hash(hash_table_fetch(&ht, i))));
+  }
+
+  // Expect ~0.05% false positives with 16 bits per kmer
+  for(i = 0; i < NTESTS; i++) {
+    bkey = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    if(hash_table_find(&ht, bkey) == HASH_NOT_FOUND)
+      nfp += kmer_bloom_contains(&bloom, kmer_bloom_hash(bkey));
+  }
+  TASSERT2(nfp < NTESTS/50, "%zu", nfp);
+  TASSERT(kmer_bloom_fpr(&bloom) < 0.02);
+
+  kmer_bloom_dealloc(&bloom);
+  hash_table_dealloc(&ht);
+}
+
 void test_hash_table()
 {
   test_add_remove();
   test_hash_table_mt();
+  test_find_batch();
+  test_kmer_bloom();
 }
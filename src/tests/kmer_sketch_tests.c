@@ -0,0 +1,96 @@
+#include "global.h"
+#include "all_tests.h"
+
+#include "kmer_sketch.h"
+
+// Add kmers [start, end) to a sketch, kmer i is the number i in binary
+static void _sketch_add_kmers(KmerSketch *sk, size_t start, size_t end,
+                              size_t kmer_size)
+{
+  BinaryKmer bkmer = zero_bkmer;
+  size_t i;
+  for(i = start; i < end; i++) {
+    bkmer.b[NUM_BKMER_WORDS-1] = i;
+    kmer_sketch_add(sk, binary_kmer_get_key(bkmer, kmer_size));
+  }
+}
+
+static void test_sketch_exact()
+{
+  test_status("Testing small sketches give exact Jaccard");
+
+  const size_t kmer_size = 31, size = 1000;
+  KmerSketch a, b;
+  kmer_sketch_alloc(&a, size, "a");
+  kmer_sketch_alloc(&b, size, "b");
+
+  // |A| = 400, |B| = 300, |A&B| = 200, |A|B| = 500
+  _sketch_add_kmers(&a, 0, 400, kmer_size);
+  _sketch_add_kmers(&b, 200, 500, kmer_size);
+  _sketch_add_kmers(&b, 200, 300, kmer_size); // duplicates
+  kmer_sketch_finish(&a);
+  kmer_sketch_finish(&b);
+
+  TASSERT(a.nhashes == 400);
+  TASSERT(b.nhashes == 300);
+  TASSERT(b.nkmers == 400);
+  TASSERT(kmer_sketch_est_nkmers(&a) == 400);
+  TASSERT2(kmer_sketch_jaccard(&a, &b) == 0.4, "%f", kmer_sketch_jaccard(&a, &b));
+  TASSERT(kmer_sketch_jaccard(&a, &a) == 1.0);
+
+  kmer_sketch_dealloc(&a);
+  kmer_sketch_dealloc(&b);
+}
+
+static void test_sketch_estimate()
+{
+  test_status("Testing sketch Jaccard and size estimates");
+
+  const size_t kmer_size = 31, size = 1000, nkmers = 20000;
+  KmerSketch a, b, c, d;
+  kmer_sketch_alloc(&a, size, "a");
+  kmer_sketch_alloc(&b, size, "b");
+  kmer_sketch_alloc(&c, size, "c");
+  kmer_sketch_alloc(&d, size, "d");
+
+  // A and B share half their kmers, J = 1/3
+  _sketch_add_kmers(&a, 0, nkmers, kmer_size);
+  _sketch_add_kmers(&b, nkmers/2, nkmers+nkmers/2, kmer_size);
+  kmer_sketch_finish(&a);
+  kmer_sketch_finish(&b);
+
+  TASSERT(a.nhashes == size);
+  double est = kmer_sketch_est_nkmers(&a), jac = kmer_sketch_jaccard(&a, &b);
+  TASSERT2(est > nkmers*0.9 && est < nkmers*1.1, "%f", est);
+  TASSERT2(jac > 0.28 && jac < 0.39, "%f", jac);
+
+  // Merging sketches of two halves gives the sketch of the whole
+  _sketch_add_kmers(&c, 0, nkmers/2, kmer_size);
+  _sketch_add_kmers(&d, nkmers/2, nkmers, kmer_size);
+  kmer_sketch_finish(&c);
+  kmer_sketch_finish(&d);
+  kmer_sketch_merge(&c, &d);
+
+  TASSERT(c.nkmers == a.nkmers);
+  TASSERT(c.nhashes == a.nhashes);
+  TASSERT(memcmp(c.hashes, a.hashes, size*sizeof(uint64_t)) == 0);
+
+  // Pairwise matrix with threads matches pairwise calls
+  KmerSketch sks[4] = {a, b, c, d};
+  double matrix[16];
+  kmer_sketch_dist(sks, 4, 2, matrix);
+  TASSERT(matrix[0*4+1] == jac);
+  TASSERT(matrix[0*4+2] == 1.0);
+  TASSERT(matrix[2*4+3] == kmer_sketch_jaccard(&c, &d));
+
+  kmer_sketch_dealloc(&a);
+  kmer_sketch_dealloc(&b);
+  kmer_sketch_dealloc(&c);
+  kmer_sketch_dealloc(&d);
+}
+
+void test_kmer_sketch()
+{
+  test_sketch_exact();
+  test_sketch_estimate();
+}
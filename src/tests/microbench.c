@@ -0,0 +1,529 @@
+#include "global.h"
+#include "microbench.h"
+#include "all_tests.h"
+#include "util.h"
+#include "dna.h"
+#include "binary_kmer.h"
+#include "binary_seq.h"
+#include "hash_table.h"
+#include "db_node.h"
+#include "gpath_store.h"
+#include "gpath_hash.h"
+#include "misc/city.h"
+
+#include <math.h>
+#include <time.h>
+
+// Results are xor'd into here so that the compiler cannot remove benchmarks
+static volatile uint64_t mb_sink = 0;
+
+typedef void (*MicroBenchFunc)(void *arg);
+
+typedef struct
+{
+  double mean, sd, min, median, max;
+} MicroBenchStats;
+
+static inline double mb_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int mb_cmp_doubles(const void *aa, const void *bb)
+{
+  double a = *(const double*)aa, b = *(const double*)bb;
+  return (a > b) - (a < b);
+}
+
+static MicroBenchStats mb_summarise(double *x, size_t n)
+{
+  MicroBenchStats s = {.mean = 0, .sd = 0};
+  size_t i;
+  qsort(x, n, sizeof(x[0]), mb_cmp_doubles);
+  for(i = 0; i < n; i++) s.mean += x[i];
+  s.mean /= n;
+  for(i = 0; i < n; i++) s.sd += (x[i] - s.mean) * (x[i] - s.mean);
+  s.sd = n > 1 ? sqrt(s.sd / (n-1)) : 0;
+  s.min = x[0];
+  s.max = x[n-1];
+  s.median = n & 1 ? x[n/2] : (x[n/2-1] + x[n/2]) / 2;
+  return s;
+}
+
+static bool mb_wanted(const MicroBenchArgs *args, const char *name)
+{
+  return args->filter == NULL ||
+         strncmp(name, args->filter, strlen(args->filter)) == 0;
+}
+
+// Check if any benchmark in a group might be wanted, before doing any setup
+static bool mb_group_wanted(const MicroBenchArgs *args, const char *group)
+{
+  return args->filter == NULL ||
+         strncmp(group, args->filter, MIN2(strlen(group), strlen(args->filter))) == 0;
+}
+
+static void mb_print_header(const MicroBenchArgs *args)
+{
+  printf("%-32s %7s %10s %10s %10s %10s %10s\n",
+         "benchmark", "threads", "mean_ns", "sd_ns", "min_ns", "median_ns", "max_ns");
+  if(args->csv)
+    fprintf(args->csv, "benchmark,threads,nops,reps,mean_ns,sd_ns,min_ns,median_ns,max_ns\n");
+}
+
+/**
+ * Time `func(arg)`, which does `nops` operations. `reset(arg)` is called
+ * untimed before each run, if not NULL.
+ * @return 1 if run, 0 if skipped by args->filter
+ */
+static size_t mb_run(const MicroBenchArgs *args, const char *name,
+                     size_t nthreads, size_t nops,
+                     MicroBenchFunc func, MicroBenchFunc reset, void *arg)
+{
+  if(!mb_wanted(args, name)) return 0;
+
+  size_t i;
+  double t0, nsop[args->reps];
+
+  for(i = 0; i < args->warmup; i++) {
+    if(reset) reset(arg);
+    func(arg);
+  }
+
+  for(i = 0; i < args->reps; i++) {
+    if(reset) reset(arg);
+    t0 = mb_now_ns();
+    func(arg);
+    nsop[i] = (mb_now_ns() - t0) / nops;
+  }
+
+  MicroBenchStats s = mb_summarise(nsop, args->reps);
+
+  printf("%-32s %7zu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+         name, nthreads, s.mean, s.sd, s.min, s.median, s.max);
+  fflush(stdout);
+
+  if(args->csv) {
+    fprintf(args->csv, "%s,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+            name, nthreads, nops, args->reps, s.mean, s.sd, s.min, s.median, s.max);
+  }
+
+  return 1;
+}
+
+//
+// Kmers: hashing, reverse complement and rolling
+//
+
+typedef struct
+{
+  BinaryKmer *bkmers;
+  Nucleotide *nucs;
+  size_t n, kmer_size;
+} KmerBench;
+
+static void mb_bkmer_hash(void *arg)
+{
+  const KmerBench *b = (const KmerBench*)arg;
+  uint64_t h = 0;
+  size_t i;
+  for(i = 0; i < b->n; i++) h ^= binary_kmer_hash(b->bkmers[i], 0);
+  mb_sink ^= h;
+}
+
+static void mb_bkmer_revcmp(void *arg)
+{
+  const KmerBench *b = (const KmerBench*)arg;
+  uint64_t h = 0;
+  size_t i;
+  for(i = 0; i < b->n; i++)
+    h ^= binary_kmer_reverse_complement(b->bkmers[i], b->kmer_size).b[0];
+  mb_sink ^= h;
+}
+
+// Roll forward and reverse complement kmers along a sequence, taking the
+// lower of the two as the key, as is done when loading reads
+static void mb_bkmer_roll(void *arg)
+{
+  const KmerBench *b = (const KmerBench*)arg;
+  const size_t kmer_size = b->kmer_size;
+  BinaryKmer bkmer = BINARY_KMER_ZERO_MACRO, bkrev = BINARY_KMER_ZERO_MACRO, bkey;
+  uint64_t h = 0;
+  size_t i;
+
+  for(i = 0; i < b->n; i++) {
+    bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, b->nucs[i]);
+    bkrev = binary_kmer_right_shift_add(bkrev, kmer_size,
+                                        dna_nuc_complement(b->nucs[i]));
+    bkey = binary_kmer_lt(bkmer, bkrev) ? bkmer : bkrev;
+    h ^= bkey.b[NUM_BKMER_WORDS-1];
+  }
+  mb_sink ^= h;
+}
+
+static size_t mb_kmers(const MicroBenchArgs *args)
+{
+  size_t i, n = args->nops, nrun = 0;
+  KmerBench b = {.n = n, .kmer_size = args->kmer_size};
+  b.bkmers = ctx_calloc(n, sizeof(BinaryKmer));
+  b.nucs = ctx_calloc(n, sizeof(Nucleotide));
+
+  for(i = 0; i < n; i++) b.bkmers[i] = binary_kmer_random(args->kmer_size);
+  rand_nucs(b.nucs, n);
+
+  nrun += mb_run(args, "bkmer_hash", 1, n, mb_bkmer_hash, NULL, &b);
+  nrun += mb_run(args, "bkmer_revcmp", 1, n, mb_bkmer_revcmp, NULL, &b);
+  nrun += mb_run(args, "bkmer_roll", 1, n, mb_bkmer_roll, NULL, &b);
+
+  ctx_free(b.bkmers);
+  ctx_free(b.nucs);
+  return nrun;
+}
+
+//
+// Hash table
+//
+
+typedef struct
+{
+  HashTable *ht;
+  uint8_t *bktlocks;
+  const BinaryKmer *bkeys;
+  size_t n, nthreads;
+} HashBench;
+
+typedef struct
+{
+  HashBench *b;
+  size_t start, end;
+} HashBenchJob;
+
+static void mb_ht_reset(void *arg)
+{
+  hash_table_empty(((HashBench*)arg)->ht);
+}
+
+static void mb_ht_insert(void *arg)
+{
+  HashBench *b = (HashBench*)arg;
+  bool found;
+  size_t i;
+  for(i = 0; i < b->n; i++) hash_table_find_or_insert(b->ht, b->bkeys[i], &found);
+}
+
+static void mb_ht_find(void *arg)
+{
+  const HashBench *b = (const HashBench*)arg;
+  uint64_t h = 0;
+  size_t i;
+  for(i = 0; i < b->n; i++) h ^= hash_table_find(b->ht, b->bkeys[i]);
+  mb_sink ^= h;
+}
+
+static void mb_ht_find_mt_thread(void *arg, size_t threadid)
+{
+  (void)threadid;
+  const HashBenchJob *job = (const HashBenchJob*)arg;
+  HashBench *b = job->b;
+  uint64_t h = 0;
+  size_t i;
+  for(i = job->start; i < job->end; i++)
+    h ^= hash_table_find_mt(b->ht, b->bkeys[i], b->bktlocks);
+  __sync_fetch_and_xor(&mb_sink, h);
+}
+
+static void mb_ht_insert_mt_thread(void *arg, size_t threadid)
+{
+  (void)threadid;
+  const HashBenchJob *job = (const HashBenchJob*)arg;
+  HashBench *b = job->b;
+  bool found;
+  size_t i;
+  for(i = job->start; i < job->end; i++)
+    hash_table_find_or_insert_mt(b->ht, b->bkeys[i], &found, b->bktlocks);
+}
+
+static void mb_ht_run_mt(HashBench *b, void (*func)(void *_arg, size_t _tid))
+{
+  size_t i, nthreads = b->nthreads;
+  HashBenchJob jobs[nthreads];
+  for(i = 0; i < nthreads; i++) {
+    jobs[i] = (HashBenchJob){.b = b, .start = (b->n * i) / nthreads,
+                             .end = (b->n * (i+1)) / nthreads};
+  }
+  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, func);
+}
+
+static void mb_ht_find_mt(void *arg) {
+  mb_ht_run_mt((HashBench*)arg, mb_ht_find_mt_thread);
+}
+
+static void mb_ht_insert_mt(void *arg) {
+  mb_ht_run_mt((HashBench*)arg, mb_ht_insert_mt_thread);
+}
+
+static size_t mb_hash_table(const MicroBenchArgs *args)
+{
+  const double loads[] = {0.25, 0.5, 0.75, 0.8};
+  size_t i, l, t, nrun = 0, kmer_size = args->kmer_size;
+  char name[100];
+
+  HashTable ht;
+  hash_table_alloc(&ht, args->nops);
+  uint8_t *bktlocks = ctx_calloc(roundup_bits2bytes(ht.num_of_buckets), 1);
+
+  // Kmers to insert and kmers that are not in the table
+  BinaryKmer *bkeys = ctx_calloc(ht.capacity, sizeof(BinaryKmer));
+  BinaryKmer *missing = ctx_calloc(ht.capacity, sizeof(BinaryKmer));
+  for(i = 0; i < ht.capacity; i++) {
+    bkeys[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    missing[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+  }
+
+  for(l = 0; l < sizeof(loads)/sizeof(loads[0]); l++)
+  {
+    size_t n = ht.capacity * loads[l], pct = loads[l] * 100;
+    HashBench b = {.ht = &ht, .bktlocks = bktlocks, .bkeys = bkeys,
+                   .n = n, .nthreads = 1};
+
+    sprintf(name, "hash_table_insert/load%zu", pct);
+    nrun += mb_run(args, name, 1, n, mb_ht_insert, mb_ht_reset, &b);
+
+    // Fill table to this load for lookups
+    mb_ht_reset(&b);
+    mb_ht_insert(&b);
+
+    sprintf(name, "hash_table_find_hit/load%zu", pct);
+    nrun += mb_run(args, name, 1, n, mb_ht_find, NULL, &b);
+
+    HashBench bmiss = b;
+    bmiss.bkeys = missing;
+    sprintf(name, "hash_table_find_miss/load%zu", pct);
+    nrun += mb_run(args, name, 1, n, mb_ht_find, NULL, &bmiss);
+
+    for(t = 1; t <= args->max_threads; t *= 2) {
+      b.nthreads = t;
+      sprintf(name, "hash_table_find_mt/load%zu", pct);
+      nrun += mb_run(args, name, t, n, mb_ht_find_mt, NULL, &b);
+    }
+
+    for(t = 1; t <= args->max_threads; t *= 2) {
+      b.nthreads = t;
+      sprintf(name, "hash_table_insert_mt/load%zu", pct);
+      nrun += mb_run(args, name, t, n, mb_ht_insert_mt, mb_ht_reset, &b);
+    }
+  }
+
+  ctx_free(bkeys);
+  ctx_free(missing);
+  ctx_free(bktlocks);
+  hash_table_dealloc(&ht);
+  return nrun;
+}
+
+//
+// Packing bases
+//
+
+#define MB_PACK_LEN 100
+#define MB_PACK_OFFSETS 4096
+
+typedef struct
+{
+  const Nucleotide *nucs;
+  uint8_t *packed;
+  size_t n;
+} PackBench;
+
+// Pack MB_PACK_LEN bases from varying offsets
+static void mb_binary_seq_pack(void *arg)
+{
+  PackBench *b = (PackBench*)arg;
+  size_t i;
+  for(i = 0; i < b->n; i++)
+    binary_seq_pack(b->packed, b->nucs + (i & (MB_PACK_OFFSETS-1)), MB_PACK_LEN);
+  mb_sink ^= b->packed[0];
+}
+
+static size_t mb_binary_seq(const MicroBenchArgs *args)
+{
+  Nucleotide *nucs = ctx_calloc(MB_PACK_OFFSETS + MB_PACK_LEN, sizeof(Nucleotide));
+  uint8_t packed[binary_seq_mem(MB_PACK_LEN)+1];
+  rand_nucs(nucs, MB_PACK_OFFSETS + MB_PACK_LEN);
+
+  PackBench b = {.nucs = nucs, .packed = packed, .n = args->nops};
+  size_t nrun = mb_run(args, "binary_seq_pack/len"QUOTE_VALUE(MB_PACK_LEN), 1,
+                       b.n, mb_binary_seq_pack, NULL, &b);
+
+  ctx_free(nucs);
+  return nrun;
+}
+
+//
+// Union of edges over colours
+//
+
+typedef struct
+{
+  const Edges *edges;
+  size_t ncols, nnodes, n;
+} EdgesBench;
+
+static void mb_edges_union(void *arg)
+{
+  const EdgesBench *b = (const EdgesBench*)arg;
+  Edges e = 0;
+  size_t i;
+  for(i = 0; i < b->n; i++)
+    e ^= edges_get_union(b->edges + (i % b->nnodes) * b->ncols, b->ncols);
+  mb_sink ^= e;
+}
+
+static size_t mb_edges(const MicroBenchArgs *args)
+{
+  const size_t ncols[] = {1, 8, 64, 256};
+  size_t i, nrun = 0;
+  char name[100];
+
+  for(i = 0; i < sizeof(ncols)/sizeof(ncols[0]); i++) {
+    EdgesBench b = {.ncols = ncols[i], .n = args->nops,
+                    .nnodes = MIN2(args->nops, (16*ONE_MEGABYTE) / ncols[i])};
+    Edges *edges = ctx_calloc(b.nnodes * b.ncols, sizeof(Edges));
+    rand_bytes(edges, b.nnodes * b.ncols * sizeof(Edges));
+    b.edges = edges;
+    sprintf(name, "edges_union/ncols%zu", ncols[i]);
+    nrun += mb_run(args, name, 1, b.n, mb_edges_union, NULL, &b);
+    ctx_free(edges);
+  }
+
+  return nrun;
+}
+
+//
+// Link (GPath) hashing
+//
+
+typedef struct
+{
+  GPathStore *gpstore;
+  GPathHash *gphash;
+  const uint8_t *seqs;
+  const hkey_t *hkeys;
+  size_t njuncs, n, nthreads;
+} GPathBench;
+
+typedef struct
+{
+  GPathBench *b;
+  size_t start, end;
+} GPathBenchJob;
+
+static inline GPathNew mb_gpath_get(const GPathBench *b, size_t i, uint8_t *colset)
+{
+  return (GPathNew){.seq = (uint8_t*)b->seqs + i * binary_seq_mem(b->njuncs),
+                    .colset = colset, .nseen = NULL,
+                    .num_juncs = b->njuncs, .orient = FORWARD};
+}
+
+// Only the hash function used by the link hash table
+static void mb_gpath_city(void *arg)
+{
+  const GPathBench *b = (const GPathBench*)arg;
+  size_t i, mem = binary_seq_mem(b->njuncs);
+  uint64_t h = 0;
+  for(i = 0; i < b->n; i++)
+    h ^= CityHash64WithSeeds((const char*)b->seqs + i*mem, mem, b->hkeys[i], 0);
+  mb_sink ^= h;
+}
+
+static void mb_gpath_reset(void *arg)
+{
+  GPathBench *b = (GPathBench*)arg;
+  gpath_store_reset(b->gpstore);
+  gpath_hash_reset(b->gphash);
+}
+
+static void mb_gpath_insert_thread(void *arg, size_t threadid)
+{
+  (void)threadid;
+  const GPathBenchJob *job = (const GPathBenchJob*)arg;
+  GPathBench *b = job->b;
+  uint8_t colset = 1;
+  bool found;
+  size_t i;
+  for(i = job->start; i < job->end; i++) {
+    if(!gpath_hash_find_or_insert_mt(b->gphash, b->hkeys[i],
+                                     mb_gpath_get(b, i, &colset), &found))
+      die("Link hash table full");
+  }
+}
+
+static void mb_gpath_insert_mt(void *arg)
+{
+  GPathBench *b = (GPathBench*)arg;
+  size_t i, nthreads = b->nthreads;
+  GPathBenchJob jobs[nthreads];
+  for(i = 0; i < nthreads; i++) {
+    jobs[i] = (GPathBenchJob){.b = b, .start = (b->n * i) / nthreads,
+                              .end = (b->n * (i+1)) / nthreads};
+  }
+  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads,
+                   mb_gpath_insert_thread);
+}
+
+static size_t mb_gpaths(const MicroBenchArgs *args)
+{
+  const size_t njuncs = 16, npaths = args->nops;
+  size_t i, t, nrun = 0, seqmem = binary_seq_mem(njuncs);
+  char name[100];
+
+  uint8_t *seqs = ctx_calloc(npaths, seqmem);
+  hkey_t *hkeys = ctx_calloc(npaths, sizeof(hkey_t));
+  rand_bytes(seqs, npaths * seqmem);
+  for(i = 0; i < npaths; i++) hkeys[i] = rand() % npaths;
+
+  // Paths (+1 byte colset) and padding for the path store, table at 50% load
+  GPathStore gpstore;
+  GPathHash gphash;
+  size_t store_mem = gpath_store_mem(npaths, false) +
+                     npaths * (sizeof(GPath) + 1 + seqmem) + ONE_MEGABYTE;
+  gpath_store_alloc(&gpstore, 1, npaths, npaths, store_mem, false, false);
+  gpath_hash_alloc(&gphash, &gpstore, 2 * npaths * sizeof(GPEntry));
+
+  GPathBench b = {.gpstore = &gpstore, .gphash = &gphash,
+                  .seqs = seqs, .hkeys = hkeys,
+                  .njuncs = njuncs, .n = npaths, .nthreads = 1};
+
+  sprintf(name, "gpath_city_hash/juncs%zu", njuncs);
+  nrun += mb_run(args, name, 1, npaths, mb_gpath_city, NULL, &b);
+
+  for(t = 1; t <= args->max_threads; t *= 2) {
+    b.nthreads = t;
+    sprintf(name, "gpath_hash_insert_mt/juncs%zu", njuncs);
+    nrun += mb_run(args, name, t, npaths, mb_gpath_insert_mt, mb_gpath_reset, &b);
+  }
+
+  gpath_hash_dealloc(&gphash);
+  gpath_store_dealloc(&gpstore);
+  ctx_free(seqs);
+  ctx_free(hkeys);
+  return nrun;
+}
+
+size_t microbench_run_all(const MicroBenchArgs *args)
+{
+  ctx_assert(args->reps > 0);
+  ctx_assert(args->nops > 0);
+  ctx_assert(args->max_threads > 0);
+
+  size_t nrun = 0;
+  mb_print_header(args);
+  if(mb_group_wanted(args, "bkmer")) nrun += mb_kmers(args);
+  if(mb_group_wanted(args, "hash_table")) nrun += mb_hash_table(args);
+  if(mb_group_wanted(args, "binary_seq")) nrun += mb_binary_seq(args);
+  if(mb_group_wanted(args, "edges")) nrun += mb_edges(args);
+  if(mb_group_wanted(args, "gpath")) nrun += mb_gpaths(args);
+  return nrun;
+}
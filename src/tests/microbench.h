@@ -0,0 +1,27 @@
+#ifndef MICROBENCH_H_
+#define MICROBENCH_H_
+
+//
+// Micro-benchmarks of hot inner loops, built with `make microbench`
+//
+// Each benchmark is run `warmup` times untimed, then timed `reps` times. We
+// report nanoseconds per operation over the timed repetitions: mean, standard
+// deviation, min, median and max. Multi-threaded benchmarks report wall time
+// divided by the total number of operations done by all threads.
+//
+
+typedef struct
+{
+  size_t warmup, reps;
+  size_t nops; // operations per repetition
+  size_t max_threads; // run _mt benchmarks with 1,2,4,..,max_threads
+  size_t kmer_size;
+  const char *filter; // only run benchmarks whose name starts with this
+  FILE *csv; // if not NULL, also write results as CSV
+} MicroBenchArgs;
+
+// Run all benchmarks, printing a table of results to stdout
+// Returns number of benchmarks run
+size_t microbench_run_all(const MicroBenchArgs *args);
+
+#endif /* MICROBENCH_H_ */
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 #include "assemble_contigs.h"
 #include "db_node.h"
@@ -11,22 +12,61 @@
 #include "gpath_set.h"
 #include "gpath_subset.h"
 
+// Contigs seeded from a block of ASSEM_BLOCK_KMERS hash table entries are
+// buffered, then written in hash table order by whichever thread completes the
+// next block in order. This makes output independent of the number of threads.
+#define ASSEM_BLOCK_KMERS (1<<14)
+
+// Number of blocks that may be assembled ahead of the writer
+#define ASSEM_BLOCKS_PER_THREAD 4
+
+typedef struct
+{
+  hkey_t seed;
+  size_t offset, len; // position in AssemBlock.nodes
+  struct ContigStats s;
+} AssemContig;
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(assem_contig_buf, AssemContigBuffer, AssemContig);
+
 typedef struct
 {
-  size_t nthreads;
+  dBNodeBuffer nodes; // nodes of all contigs in this block
+  AssemContigBuffer contigs;
+  volatile size_t ncontigs; // contigs.len, read by other threads
+  hkey_t resume; // seeding stopped before this hkey, see _write_blocks()
+  bool done;
+} AssemBlock;
 
+typedef struct
+{
+  AssemBlock *blocks;
+  size_t nblocks, window;
+  volatile size_t next_block; // next block to be assembled
+  volatile size_t next_write; // next block to be written
+  volatile bool stop; // hit contig limit
+
+  volatile size_t num_contigs;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} AssemWriter;
+
+typedef struct
+{
   GraphWalker wlk;
   RepeatWalker rptwlk;
-  dBNodeBuffer nbuf;
+  dBNodeBuffer nbuf, ubuf;
   AssembleContigStats stats;
 
   GPathSet gpset;
   GPathSubset gpsubset;
 
   // Shared data
-  volatile size_t *num_contig_ptr;
+  AssemWriter *writer;
   size_t contig_limit;
   uint8_t *visited;
+  uint8_t *claimed, *canonical; // unitig seed claims, only with `visited`
   bool use_missing_info_check;
   double min_step_confid, min_cumul_confid;
   size_t *used_paths;
@@ -36,7 +76,6 @@ typedef struct
 
   // Output
   FILE *fout;
-  pthread_mutex_t *outlock;
 } Assembler;
 
 static void contig_stats_init(struct ContigStats *stats)
@@ -46,8 +85,15 @@ static void contig_stats_init(struct ContigStats *stats)
   stats->gap_conf[0] = stats->gap_conf[1] = 1.0;
 }
 
-// Returns 0 on success, 1 on failure
-static void _assemble_contig(Assembler *assem, hkey_t hkey, const GPath *gpath,
+// With --no-reseed, a seed that has been covered by a contig already written
+// cannot produce a contig that will be kept
+#define _seed_covered(assem,hkey,gpath) \
+  ((gpath) == NULL && (assem)->visited != NULL && \
+   bitset_get_mt((assem)->visited, hkey))
+
+// Returns false if the seed was covered by another contig whilst walking, in
+// which case the contig is abandoned
+static bool _assemble_contig(Assembler *assem, hkey_t hkey, const GPath *gpath,
                              struct ContigStats *results)
 {
   const dBGraph *db_graph = assem->db_graph;
@@ -92,6 +138,7 @@ static void _assemble_contig(Assembler *assem, hkey_t hkey, const GPath *gpath,
 
     size_t init_junc_count = wlk->fork_count;
     bool hit_cycle = false, low_step_confid = false, low_cumul_confid = false;
+    bool covered = false;
 
     while(graph_walker_next(wlk))
     {
@@ -117,6 +164,17 @@ static void _assemble_contig(Assembler *assem, hkey_t hkey, const GPath *gpath,
       }
 
       if(!rpt_walker_attempt_traverse(rptwlk, wlk)) { hit_cycle = true; break; }
+
+      // Check our claim on the seed is still good
+      if(_seed_covered(assem, hkey, gpath)) { covered = true; break; }
+    }
+
+    if(covered) {
+      graph_walker_finish(wlk);
+      rpt_walker_fast_clear(rptwlk, nbuf->b, nbuf->len);
+      assem->stats.num_wasted_walks++;
+      assem->stats.num_wasted_kmers += nbuf->len;
+      return false;
     }
 
     // Grab some stats
@@ -141,103 +199,310 @@ static void _assemble_contig(Assembler *assem, hkey_t hkey, const GPath *gpath,
 
   s.num_nodes = nbuf->len;
 
+  memcpy(results, &s, sizeof(struct ContigStats));
+  return true;
+}
+
+static void _print_contig(FILE *fout, size_t contig_id, hkey_t seed,
+                          const dBNode *nodes, size_t len,
+                          const struct ContigStats *s, const dBGraph *db_graph)
+{
+  char kmer_str[MAX_KMER_SIZE+1];
+  const char *left_stat, *rght_stat;
+  BinaryKmer seed_bkmer = db_node_get_bkey(db_graph, seed);
+  binary_kmer_to_str(seed_bkmer, db_graph->kmer_size, kmer_str);
+  dna_revcomp_str(kmer_str, kmer_str, db_graph->kmer_size);
+
+  // We have reversed the contig, so left end is now the end we hit when
+  // traversing from the seed node forward... FORWARD == 0, REVERSE == 1
+  left_stat = assem2str(s->stop_causes[0]);
+  rght_stat = assem2str(s->stop_causes[1]);
+
+  // Print in FASTA format with additional info in name
+  fprintf(fout, ">contig%zu len=%zu seed=%s seedkmers=%zu "
+          "lf.status=%s lf.paths.held=%zu lf.paths.cntr=%zu "
+          "lf.max_gap=%zu lf.conf=%f "
+          "rt.status=%s rt.paths.held=%zu rt.paths.cntr=%zu "
+          "rf.max_gap=%zu rf.conf=%f\n",
+          contig_id, len, kmer_str, s->num_seed_kmers,
+          left_stat, s->paths_held[0], s->paths_cntr[0], s->max_step_gap[0], s->gap_conf[0],
+          rght_stat, s->paths_held[1], s->paths_cntr[1], s->max_step_gap[1], s->gap_conf[1]);
+
+  db_nodes_print(nodes, len, db_graph, fout);
+  putc('\n', fout);
+}
+
+// Print a contig and record it in the stats of `assem`
+// Must be holding the writer lock
+// Returns false if we have hit the contig limit
+static bool _commit_contig(Assembler *assem, hkey_t seed,
+                           const dBNode *nodes, size_t len,
+                           const struct ContigStats *s)
+{
+  AssemWriter *writer = assem->writer;
+  size_t i;
+
+  // Seed was covered by a contig written after this one was assembled
+  if(!s->seed_path && assem->visited != NULL && bitset_get(assem->visited, seed)) {
+    assem->stats.num_wasted_walks++;
+    assem->stats.num_wasted_kmers += len;
+    return true;
+  }
+
+  // Generated too many contigs - drop this one without printing or
+  // recording any information/statistics on it
+  if(assem->contig_limit && writer->num_contigs >= assem->contig_limit) {
+    writer->stop = true;
+    return false;
+  }
+
+  if(assem->fout != NULL) {
+    _print_contig(assem->fout, writer->num_contigs, seed, nodes, len, s,
+                  assem->db_graph);
+  }
+
+  writer->num_contigs++;
+
   // If --no-reseed set, mark visited nodes are visited
   // Don't use to seed another contig
-  size_t i;
-  if(gpath == NULL && assem->visited != NULL) {
-    for(i = 0; i < nbuf->len; i++)
-      (void)bitset_set_mt(assem->visited, nbuf->b[i].key);
+  if(!s->seed_path && assem->visited != NULL) {
+    for(i = 0; i < len; i++)
+      (void)bitset_set_mt(assem->visited, nodes[i].key);
   }
 
-  memcpy(results, &s, sizeof(struct ContigStats));
+  assemble_contigs_stats_add(&assem->stats, s);
+
+  if(assem->contig_limit && writer->num_contigs >= assem->contig_limit)
+    writer->stop = true;
+
+  return true;
 }
 
-// returns 0 on success, 1 otherwise
-static int _dump_contig(Assembler *assem, hkey_t hkey,
-                        const struct ContigStats *s)
+//
+// Seeding from the hash table is done in blocks that are written in order
+//
+
+static void _block_add_contig(Assembler *assem, AssemBlock *blk, hkey_t seed,
+                              const struct ContigStats *s)
 {
-  AssembleContigStats *stats = &assem->stats;
-  const dBGraph *db_graph = assem->db_graph;
-  dBNodeBuffer *nbuf = &assem->nbuf;
-  size_t contig_id;
+  AssemContig contig = {.seed = seed, .offset = blk->nodes.len,
+                        .len = assem->nbuf.len, .s = *s};
+  db_node_buf_push(&blk->nodes, assem->nbuf.b, assem->nbuf.len);
+  assem_contig_buf_add(&blk->contigs, contig);
+  blk->ncontigs = blk->contigs.len;
+}
+
+// Returns true if the contigs written plus those held in blocks up to and
+// including block `b` reach the contig limit, in which case block `b` needs no
+// more contigs. Without a lock this may over count, so _write_blocks() resumes
+// seeding a block if it turns out to be short.
+static bool _block_reached_limit(const Assembler *assem, size_t b)
+{
+  const AssemWriter *writer = assem->writer;
+  size_t i, n = writer->num_contigs;
+  for(i = writer->next_write; i <= b && n < assem->contig_limit; i++)
+    n += writer->blocks[i].ncontigs;
+  return n >= assem->contig_limit;
+}
+
+static inline hkey_t _block_end(const Assembler *assem, size_t b)
+{
+  hkey_t end = (hkey_t)(b+1) * ASSEM_BLOCK_KMERS;
+  return MIN2(end, hash_table_size(&assem->db_graph->ht));
+}
 
-  if(assem->fout != NULL)
+// Write contigs from index `start` in block `blk`
+// Must be holding the writer lock
+static void _commit_block(Assembler *assem, AssemBlock *blk, size_t start)
+{
+  AssemContig *contig;
+  size_t i;
+  for(i = start; i < blk->contigs.len && !assem->writer->stop; i++) {
+    contig = &blk->contigs.b[i];
+    _commit_contig(assem, contig->seed, blk->nodes.b + contig->offset,
+                   contig->len, &contig->s);
+  }
+}
+
+// Write all completed blocks that are next in order
+// Must be holding the writer lock
+static void _write_blocks(Assembler *assem,
+                          void (*func)(hkey_t hkey, Assembler *assem,
+                                       AssemBlock *blk))
+{
+  AssemWriter *writer = assem->writer;
+  const HashTable *ht = &assem->db_graph->ht;
+  AssemBlock *blk;
+  hkey_t end;
+  size_t n;
+
+  while(writer->next_write < writer->nblocks &&
+        writer->blocks[writer->next_write].done)
   {
-    // Print contig
-    char kmer_str[MAX_KMER_SIZE+1];
-    const char *left_stat, *rght_stat;
-    BinaryKmer seed_bkmer = db_node_get_bkey(db_graph, hkey);
-    binary_kmer_to_str(seed_bkmer, db_graph->kmer_size, kmer_str);
-    dna_revcomp_str(kmer_str, kmer_str, db_graph->kmer_size);
-
-    // We have reversed the contig, so left end is now the end we hit when
-    // traversing from the seed node forward... FORWARD == 0, REVERSE == 1
-    left_stat = assem2str(s->stop_causes[0]);
-    rght_stat = assem2str(s->stop_causes[1]);
-
-    pthread_mutex_lock(assem->outlock);
-    contig_id = assem->num_contig_ptr[0]++;
-
-    if(!assem->contig_limit || contig_id < assem->contig_limit)
-    {
-      // Print in FASTA format with additional info in name
-      fprintf(assem->fout, ">contig%zu len=%zu seed=%s seedkmers=%zu "
-              "lf.status=%s lf.paths.held=%zu lf.paths.cntr=%zu "
-              "lf.max_gap=%zu lf.conf=%f "
-              "rt.status=%s rt.paths.held=%zu rt.paths.cntr=%zu "
-              "rf.max_gap=%zu rf.conf=%f\n",
-              contig_id, nbuf->len, kmer_str, s->num_seed_kmers,
-              left_stat, s->paths_held[0], s->paths_cntr[0], s->max_step_gap[0], s->gap_conf[0],
-              rght_stat, s->paths_held[1], s->paths_cntr[1], s->max_step_gap[1], s->gap_conf[1]);
-
-      db_nodes_print(nbuf->b, nbuf->len, db_graph, assem->fout);
-      putc('\n', assem->fout);
+    blk = &writer->blocks[writer->next_write];
+    _commit_block(assem, blk, 0);
+
+    // Seeding stopped early since enough contigs were held, but some were
+    // dropped or the count was stale. Carry on from where it stopped, in order
+    end = _block_end(assem, writer->next_write);
+    for(; blk->resume < end && !writer->stop; blk->resume++) {
+      if(hash_table_assigned(ht, blk->resume)) {
+        n = blk->contigs.len;
+        func(blk->resume, assem, blk);
+        _commit_block(assem, blk, n);
+      }
     }
 
-    pthread_mutex_unlock(assem->outlock);
+    db_node_buf_dealloc(&blk->nodes);
+    assem_contig_buf_dealloc(&blk->contigs);
+    writer->next_write++;
   }
-  else {
-    // Lockless update
-    contig_id = __sync_fetch_and_add(assem->num_contig_ptr, 1);
+
+  pthread_cond_broadcast(&writer->cond);
+}
+
+// Worker threads take the next block of the hash table, call `func` on each
+// kmer in it, then pass it to the writer
+static void _assemble_blocks(Assembler *assem,
+                             void (*func)(hkey_t hkey, Assembler *assem,
+                                          AssemBlock *blk))
+{
+  AssemWriter *writer = assem->writer;
+  const HashTable *ht = &assem->db_graph->ht;
+  AssemBlock *blk;
+  hkey_t hkey, end;
+  size_t b;
+  bool limit = (assem->contig_limit > 0);
+
+  while(!writer->stop &&
+        (b = __sync_fetch_and_add(&writer->next_block, 1)) < writer->nblocks)
+  {
+    // Don't get too far ahead of the writer, since contigs are held in memory
+    pthread_mutex_lock(&writer->lock);
+    while(b >= writer->next_write + writer->window && !writer->stop)
+      pthread_cond_wait(&writer->cond, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+
+    blk = &writer->blocks[b];
+    db_node_buf_alloc(&blk->nodes, 1024);
+    assem_contig_buf_alloc(&blk->contigs, 16);
+
+    hkey = (hkey_t)b * ASSEM_BLOCK_KMERS;
+    end = _block_end(assem, b);
+
+    // Stop once the contig limit is reached by contigs written or held in
+    // this block and the blocks before it. Contigs are held in memory.
+    for(; hkey < end && !writer->stop; hkey++) {
+      if(hash_table_assigned(ht, hkey)) {
+        if(limit && _block_reached_limit(assem, b)) break;
+        func(hkey, assem, blk);
+      }
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    blk->resume = hkey;
+    blk->done = true;
+    _write_blocks(assem, func);
+    pthread_mutex_unlock(&writer->lock);
   }
+}
 
-  // Generated too many contigs - drop this one without printing or
-  // recording any information/statistics on it
-  if(assem->contig_limit && contig_id >= assem->contig_limit) {
-    return 1; // => stop iterating
+static void _writer_reset(AssemWriter *writer)
+{
+  size_t i;
+  for(i = 0; i < writer->nblocks; i++) {
+    writer->blocks[i].done = false;
+    writer->blocks[i].ncontigs = 0;
   }
+  writer->next_block = writer->next_write = 0;
+}
+
+// Claim the unitig containing `hkey` as a seed. Only the first node of the
+// normalised unitig that is in our colour seeds a contig, so each unitig seeds
+// at most one contig, whichever thread reaches it first. The first thread to
+// walk a unitig marks all of its nodes as claimed, so that other nodes are
+// rejected without walking the unitig again.
+// Returns true if `hkey` should be used as a seed.
+static bool _claim_unitig_seed(Assembler *assem, hkey_t hkey)
+{
+  const dBGraph *db_graph = assem->db_graph;
+  dBNodeBuffer *ubuf = &assem->ubuf;
+  hkey_t seed = HASH_NOT_FOUND;
+  size_t i;
+
+  // canonical bit is set before claimed bits, so check claimed first
+  if(bitset_get_mt(assem->claimed, hkey))
+    return bitset_get_mt(assem->canonical, hkey);
+
+  db_node_buf_reset(ubuf);
+  db_unitig_fetch(hkey, ubuf, db_graph);
+  db_unitig_normalise(ubuf->b, ubuf->len, db_graph);
 
-  assemble_contigs_stats_add(stats, s);
+  for(i = 0; i < ubuf->len && seed == HASH_NOT_FOUND; i++)
+    if(db_node_has_col(db_graph, ubuf->b[i].key, assem->colour))
+      seed = ubuf->b[i].key;
 
-  return 0; // => keep iterating
+  ctx_assert(seed != HASH_NOT_FOUND);
+
+  // Another thread walked this unitig at the same time
+  if(bitset_set_mt(assem->canonical, seed))
+    assem->stats.num_unitig_rewalks++;
+
+  for(i = 0; i < ubuf->len; i++)
+    (void)bitset_set_mt(assem->claimed, ubuf->b[i].key);
+
+  return seed == hkey;
 }
 
-// Returns 0 if keep iterating, 1 if hit assem->contig_limit
-static int _pulldown_contig(hkey_t hkey, Assembler *assem)
+static void _seed_rnd_kmer(hkey_t hkey, Assembler *assem, AssemBlock *blk)
 {
   struct ContigStats s;
 
   // Don't use a kmer if it is not in the sample we are assembling
-  if(!db_node_has_col(assem->db_graph, hkey, assem->colour)) return 0;
+  if(!db_node_has_col(assem->db_graph, hkey, assem->colour)) return;
 
-  // Don't use a visited kmer as a seed node if --no-reseed passed
-  if(assem->visited != NULL && bitset_get_mt(assem->visited, hkey)) {
-    assem->stats.num_reseed_abort++;
-    return 0;
+  if(assem->visited != NULL)
+  {
+    // Don't use a visited kmer as a seed node if --no-reseed passed
+    if(bitset_get_mt(assem->visited, hkey)) {
+      assem->stats.num_reseed_abort++;
+      return;
+    }
+
+    // Only seed once per unitig
+    if(!_claim_unitig_seed(assem, hkey)) return;
   }
 
-  _assemble_contig(assem, hkey, NULL, &s);
+  if(_assemble_contig(assem, hkey, NULL, &s))
+    _block_add_contig(assem, blk, hkey, &s);
+}
 
-  return _dump_contig(assem, hkey, &s);
+static void _seed_rnd_kmers(void *arg, size_t threadid)
+{
+  (void)threadid;
+  _assemble_blocks((Assembler*)arg, _seed_rnd_kmer);
 }
 
-static inline void _seed_rnd_kmers(void *arg, size_t threadid)
+// Seed kmers from a file are written as soon as they are assembled
+static void _pulldown_contig(hkey_t hkey, Assembler *assem)
 {
-  Assembler *assem = (Assembler*)arg;
-  const dBGraph *db_graph = assem->db_graph;
+  AssemWriter *writer = assem->writer;
+  struct ContigStats s;
+
+  // Don't use a kmer if it is not in the sample we are assembling
+  if(!db_node_has_col(assem->db_graph, hkey, assem->colour)) return;
 
-  HASH_ITERATE_PART(&db_graph->ht, threadid, assem->nthreads,
-                    _pulldown_contig, assem);
+  // Don't use a visited kmer as a seed node if --no-reseed passed
+  if(assem->visited != NULL && bitset_get_mt(assem->visited, hkey)) {
+    assem->stats.num_reseed_abort++;
+    return;
+  }
+
+  if(writer->stop || !_assemble_contig(assem, hkey, NULL, &s)) return;
+
+  pthread_mutex_lock(&writer->lock);
+  _commit_contig(assem, hkey, assem->nbuf.b, assem->nbuf.len, &s);
+  pthread_mutex_unlock(&writer->lock);
 }
 
 static void _seed_from_file(AsyncIOData *data, size_t threadid, void *arg)
@@ -269,7 +534,8 @@ static void _seed_from_file(AsyncIOData *data, size_t threadid, void *arg)
     assem->stats.num_seeds_not_found++;
 }
 
-static int _assemble_from_paths(hkey_t hkey, Assembler *assem)
+static void _assemble_from_paths(hkey_t hkey, Assembler *assem,
+                                 AssemBlock *blk)
 {
   const GPathStore *gpstore = &assem->db_graph->gpstore;
   const size_t ncols = gpstore->gpset.ncols, colour = assem->colour;
@@ -301,15 +567,14 @@ static int _assemble_from_paths(hkey_t hkey, Assembler *assem)
 
   for(i = 0; i < gpsubset->list.len; i++)
   {
-    _assemble_contig(assem, hkey, list[i], &s);
-    _dump_contig(assem, hkey, &s);
+    if(_assemble_contig(assem, hkey, list[i], &s))
+      _block_add_contig(assem, blk, hkey, &s);
   }
-
-  return 0; // 0 => keep iterating
 }
 
 static void assemble_from_paths(void *arg, size_t threadid)
 {
+  (void)threadid;
   Assembler *assem = (Assembler*)arg;
   const dBGraph *db_graph = assem->db_graph;
 
@@ -319,8 +584,7 @@ static void assemble_from_paths(void *arg, size_t threadid)
 
   gpath_subset_alloc(&assem->gpsubset);
 
-  HASH_ITERATE_PART(&db_graph->ht, threadid, assem->nthreads,
-                    _assemble_from_paths, assem);
+  _assemble_blocks(assem, _assemble_from_paths);
 
   gpath_set_dealloc(&assem->gpset);
   gpath_subset_dealloc(&assem->gpsubset);
@@ -329,6 +593,9 @@ static void assemble_from_paths(void *arg, size_t threadid)
 /**
  * Assemble contig for a given sample.
  *
+ * Seeding from the hash table gives the same output for any number of threads.
+ * With `visited` set, each unitig is used as a seed at most once.
+ *
  * @param seed_files If passed, use seed kmers from sequences. If not given,
  *                   iterate through the hash table.
  * @param contig_limit Stop after printing this many contigs, if zero no limit
@@ -359,6 +626,8 @@ void assemble_contigs(size_t nthreads,
   ctx_assert(!num_seed_files || seed_files);
   ctx_assert(!seed_with_unused_paths || num_seed_files == 0);
 
+  perf_phase_start("contigs");
+
   status("[Assemble] Assembling contigs with %zu threads, walking colour %zu",
          nthreads, colour);
   status("[Assemble] Using missing info check: %s",
@@ -379,15 +648,29 @@ void assemble_contigs(size_t nthreads,
   size_t *used_paths = NULL;
   if(seed_with_unused_paths) used_paths = ctx_calloc(npathwords, sizeof(size_t));
 
-  Assembler *workers = ctx_calloc(nthreads, sizeof(Assembler));
-  size_t i, num_contigs = 0;
+  // Bits to claim unitigs as seeds
+  uint8_t *claimed = NULL, *canonical = NULL;
+  if(visited != NULL) {
+    claimed = ctx_calloc(roundup_bits2bytes(db_graph->ht.capacity), 1);
+    canonical = ctx_calloc(roundup_bits2bytes(db_graph->ht.capacity), 1);
+  }
+
+  // Writer to print contigs in order
+  AssemWriter writer;
+  memset(&writer, 0, sizeof(writer));
+  writer.nblocks = (hash_table_size(&db_graph->ht) + ASSEM_BLOCK_KMERS - 1) /
+                   ASSEM_BLOCK_KMERS;
+  writer.blocks = ctx_calloc(writer.nblocks, sizeof(AssemBlock));
+  writer.window = nthreads * ASSEM_BLOCKS_PER_THREAD;
+
+  if(pthread_mutex_init(&writer.lock, NULL) != 0) die("Mutex init failed");
+  if(pthread_cond_init(&writer.cond, NULL) != 0) die("Cond init failed");
 
-  pthread_mutex_t outlock;
-  if(pthread_mutex_init(&outlock, NULL) != 0) die("Mutex init failed");
+  Assembler *workers = ctx_calloc(nthreads, sizeof(Assembler));
+  size_t i;
 
   for(i = 0; i < nthreads; i++) {
-    Assembler tmp = {.nthreads = nthreads,
-                     .num_contig_ptr = &num_contigs,
+    Assembler tmp = {.writer = &writer,
                      .contig_limit = contig_limit,
                      .use_missing_info_check = use_missing_info_check,
                      .min_step_confid = min_step_confid,
@@ -396,9 +679,11 @@ void assemble_contigs(size_t nthreads,
                      .db_graph = db_graph, .colour = colour,
                      .conf_table = conf_table,
                      .visited = visited,
-                     .fout = fout, .outlock = &outlock};
+                     .claimed = claimed, .canonical = canonical,
+                     .fout = fout};
 
     db_node_buf_alloc(&tmp.nbuf, 1024);
+    db_node_buf_alloc(&tmp.ubuf, 1024);
 
     graph_walker_alloc(&tmp.wlk, db_graph);
     graph_walker_setup(&tmp.wlk, use_missing_info_check, colour, colour, db_graph);
@@ -442,6 +727,7 @@ void assemble_contigs(size_t nthreads,
 
       if(i+1 < npathwords || used_paths[npathwords-1] < bitmask64(top_bits)) {
         status("[Assemble] Seeding with unused paths...");
+        _writer_reset(&writer);
         util_run_threads(workers, nthreads, sizeof(workers[0]),
                          nthreads, assemble_from_paths);
       } else {
@@ -452,13 +738,20 @@ void assemble_contigs(size_t nthreads,
 
   for(i = 0; i < nthreads; i++) {
     db_node_buf_dealloc(&workers[i].nbuf);
+    db_node_buf_dealloc(&workers[i].ubuf);
     graph_walker_dealloc(&workers[i].wlk);
     rpt_walker_dealloc(&workers[i].rptwlk);
     assemble_contigs_stats_merge(stats, &workers[i].stats);
     assemble_contigs_stats_destroy(&workers[i].stats);
   }
 
-  pthread_mutex_destroy(&outlock);
+  pthread_mutex_destroy(&writer.lock);
+  pthread_cond_destroy(&writer.cond);
+  ctx_free(writer.blocks);
   ctx_free(workers);
   ctx_free(used_paths);
+  ctx_free(claimed);
+  ctx_free(canonical);
+
+  perf_phase_end("contigs");
 }
@@ -10,6 +10,9 @@
 /**
  * Assemble contig for a given sample.
  *
+ * Seeding from the hash table gives the same output for any number of threads.
+ * With `visited` set, each unitig is used as a seed at most once.
+ *
  * @param seed_files If passed, use seed kmers from sequences. If not given,
  *                   iterate through the hash table.
  * @param contig_limit Stop after printing this many contigs, if zero no limit
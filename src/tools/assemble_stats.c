@@ -142,6 +142,10 @@ void assemble_contigs_stats_merge(AssembleContigStats *dst,
 
   dst->num_reseed_abort    += src->num_reseed_abort;
   dst->num_seeds_not_found += src->num_seeds_not_found;
+
+  dst->num_wasted_walks   += src->num_wasted_walks;
+  dst->num_wasted_kmers   += src->num_wasted_kmers;
+  dst->num_unitig_rewalks += src->num_unitig_rewalks;
 }
 
 #define PREFIX "[Assembled] "
@@ -232,6 +236,13 @@ void assemble_contigs_stats_print(const AssembleContigStats *s)
   status(PREFIX"no-reseed aborted %s times", reseed_str);
   status(PREFIX"seed kmer not found %s times", seed_not_fnd_str);
 
+  char wasted_walks_str[50], wasted_kmers_str[50], rewalks_str[50];
+  ulong_to_str(s->num_wasted_walks, wasted_walks_str);
+  ulong_to_str(s->num_wasted_kmers, wasted_kmers_str);
+  ulong_to_str(s->num_unitig_rewalks, rewalks_str);
+  status(PREFIX"wasted %s walks (%s kmers), unitigs walked twice to claim: %s",
+         wasted_walks_str, wasted_kmers_str, rewalks_str);
+
   char len_min_str[50], len_max_str[50], len_total_str[50];
   char len_mean_str[50], len_median_str[50], len_n50_str[50];
 
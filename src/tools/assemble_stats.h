@@ -54,6 +54,10 @@ typedef struct
   uint64_t num_contigs_from_seed_paths;
   uint64_t num_reseed_abort; // aborted - already visited seed
   uint64_t num_seeds_not_found; // seed contig didn't have any matching kmers
+  // Work thrown away by parallel assembly with --no-reseed
+  uint64_t num_wasted_walks; // seed covered by another contig during/after walk
+  uint64_t num_wasted_kmers; // kmers walked in wasted contigs
+  uint64_t num_unitig_rewalks; // unitig walked by two threads claiming a seed
 } AssembleContigStats;
 
 // Results from a single contig
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 #include "breakpoint_caller.h"
 #include "util.h"
@@ -621,6 +622,8 @@ void breakpoints_call(size_t nthreads, size_t ref_col,
                       dBGraph *db_graph)
 {
   ctx_assert(!max_ref_nkmers || min_ref_nkmers <= max_ref_nkmers);
+  perf_phase_start("breakpoints");
+
   // Temporarily hide edges from kograph_create if we don't want to load edges
   Edges *tmp_edges = db_graph->col_edges;
   if(!load_ref_edges) db_graph->col_edges = NULL;
@@ -659,4 +662,5 @@ void breakpoints_call(size_t nthreads, size_t ref_col,
 
   brkpt_callers_destroy(callers, nthreads);
   kograph_dealloc(&kograph);
+  perf_phase_end("breakpoints");
 }
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 #include "bubble_caller.h"
 #include "db_graph.h"
@@ -504,6 +505,7 @@ void invoke_bubble_caller(size_t num_of_threads,
   ctx_assert(db_graph->node_in_cols != NULL);
   size_t i;
 
+  perf_phase_start("bubbles");
   status("Calling bubbles with %zu threads, output: %s", num_of_threads, out_path);
 
   StrBuf tmpstr = {0,0,0};
@@ -545,4 +547,5 @@ void invoke_bubble_caller(size_t num_of_threads,
 
   // Clean up
   bubble_callers_destroy(callers, num_of_threads);
+  perf_phase_end("bubbles");
 }
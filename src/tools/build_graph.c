@@ -172,6 +172,7 @@ static void load_read(const read_t *r, uint8_t qual_cutoff, uint8_t hp_cutoff,
 
     size_t contig_kmers = contig_len + 1 - kmer_size;
     size_t num_novel_kmers = contig_kmers - num_nonnovel_kmers;
+    perf_count(PERF_KMERS, contig_kmers);
 
     stats->total_bases_loaded += contig_len;
     if(must_exist_in_graph) {
@@ -259,6 +260,8 @@ void build_graph(dBGraph *db_graph, BuildGraphTask *files,
 {
   ctx_assert(db_graph->bktlocks != NULL);
 
+  perf_phase_start("build");
+
   // Start async io reading
   AsyncIOInput *async_tasks = ctx_malloc(nfiles * sizeof(AsyncIOInput));
   size_t i, f;
@@ -298,6 +301,8 @@ void build_graph(dBGraph *db_graph, BuildGraphTask *files,
   }
 
   db_graph->num_of_cols_used = MAX2(db_graph->num_of_cols_used, max_col+1);
+
+  perf_phase_end("build");
 }
 
 // One thread used per input file, nthreads used to add reads to graph
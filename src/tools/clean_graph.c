@@ -3,6 +3,7 @@
 #include "file_util.h"
 #include "db_unitig.h"
 #include "prune_nodes.h"
+#include "pop_bubbles.h"
 #include "clean_graph.h"
 
 #include "carrays/carrays.h" // gca_median()
@@ -248,6 +249,7 @@ typedef struct
   uint64_t num_tips, num_tip_kmers;
   uint64_t num_low_covg_unitigs, num_low_covg_unitig_kmers;
   uint64_t num_tip_and_low_unitigs, num_tip_and_low_unitig_kmers;
+  uint64_t num_bubble_unitigs, num_bubble_unitig_kmers;
 } UnitigCleanerStats;
 
 typedef struct
@@ -260,6 +262,10 @@ typedef struct
   const size_t covg_arrsize, len_arrsize;
   uint8_t *keep_flags;
   UnitigCleanerStats *stats; // array, one per thread
+  // Used by the fused cleaner to pop bubbles, NULL otherwise
+  const PopBubblesPrefs *pop_prefs;
+  dBNodeBuffer *alts;
+  Uint32Buffer *alt_cbufs;
   const dBGraph *db_graph;
 } UnitigCleaner;
 
@@ -272,6 +278,8 @@ static void unitig_cleaner_stats_merge(UnitigCleanerStats *dst,
   dst->num_low_covg_unitig_kmers += src->num_low_covg_unitig_kmers;
   dst->num_tip_and_low_unitigs += src->num_tip_and_low_unitigs;
   dst->num_tip_and_low_unitig_kmers += src->num_tip_and_low_unitig_kmers;
+  dst->num_bubble_unitigs += src->num_bubble_unitigs;
+  dst->num_bubble_unitig_kmers += src->num_bubble_unitig_kmers;
 }
 
 // Get coverages from nodes in nbuf, store in cbuf
@@ -340,6 +348,7 @@ static void unitig_cleaner_alloc(UnitigCleaner *cl, size_t nthreads,
                        .len_arrsize     = DUMP_LEN_ARRSIZE,
                        .keep_flags = keep_flags,
                        .stats = stats,
+                       .pop_prefs = NULL, .alts = NULL, .alt_cbufs = NULL,
                        .db_graph = db_graph};
 
   memcpy(cl, &tmp, sizeof(UnitigCleaner));
@@ -358,9 +367,36 @@ static void unitig_cleaner_dealloc(UnitigCleaner *cl)
   ctx_free(cl->len_hist_init);
   ctx_free(cl->len_hist_clean);
   ctx_free(cl->stats);
+  if(cl->alts != NULL) {
+    for(i = 0; i < cl->nthreads; i++) {
+      db_node_buf_dealloc(&cl->alts[i]);
+      uint32_buf_dealloc(&cl->alt_cbufs[i]);
+    }
+    ctx_free(cl->alts);
+    ctx_free(cl->alt_cbufs);
+  }
   memset(cl, 0, sizeof(UnitigCleaner));
 }
 
+static void unitig_cleaner_write_hists(const UnitigCleaner *cl, bool init,
+                                       const char *covgs_csv_path,
+                                       const char *lens_csv_path)
+{
+  if(covgs_csv_path != NULL) {
+    cleaning_write_covg_histogram(covgs_csv_path,
+                                  init ? cl->kmer_covgs_init : cl->kmer_covgs_clean,
+                                  init ? cl->unitig_covgs_init : cl->unitig_covg_clean,
+                                  cl->covg_arrsize);
+  }
+
+  if(lens_csv_path != NULL) {
+    cleaning_write_len_histogram(lens_csv_path,
+                                 init ? cl->len_hist_init : cl->len_hist_clean,
+                                 cl->len_arrsize,
+                                 cl->db_graph->kmer_size);
+  }
+}
+
 // Returns unitig coverage
 static inline uint64_t update_kmer_covg_hist(uint64_t *kcovg_hist, size_t covgsize,
                                              uint64_t *ucovg_hist, size_t ucovgsize,
@@ -407,31 +443,43 @@ static inline void unitig_get_covg(dBNodeBuffer nbuf, size_t threadid, void *arg
                         cbuf);
 }
 
-/*
 //
-// We could just iterate over kmers instead of unitigs to get coverage hist
-// Currently we iterate over unitigs instead which is slower.
+// Get the kmer coverage histogram by iterating over kmers instead of unitigs.
+// This is all we need to pick a threshold and is much faster.
 //
 typedef struct {
-  size_t nthreads;
-  UnitigCleaner *cl;
-} KmerCleanerIterator;
+  uint64_t *hists; // one histogram per thread
+  size_t arrsize;
+  const dBGraph *db_graph;
+} KmerCovgHist;
 
-static inline void kmer_get_covg_node(hkey_t hkey, void *arg)
+static bool kmer_covg_hist_add(hkey_t hkey, size_t threadid, void *arg)
 {
-  const UnitigCleaner *cl = (const UnitigCleaner*)arg;
-  size_t covg = db_node_sum_covg(cl->db_graph, hkey);
-  covg = MIN2(covg, cl->covg_arrsize-1);
-  __sync_fetch_and_add((volatile uint64_t *)&cl->kmer_covgs_init[covg], 1);
+  KmerCovgHist *kh = (KmerCovgHist*)arg;
+  size_t covg = db_node_sum_covg(kh->db_graph, hkey);
+  kh->hists[threadid*kh->arrsize + MIN2(covg, kh->arrsize-1)]++;
+  return false; // => keep iterating
 }
 
-static void kmer_get_covg(void *arg, size_t threadid)
+// Pick threshold from kmer coverage histogram and report it
+int cleaning_threshold_from_hist(const uint64_t *kmer_covgs, size_t arrsize)
 {
-  const KmerCleanerIterator *kcl = (const KmerCleanerIterator*)arg;
-  HASH_ITERATE_PART(&kcl->db_graph->ht, threadid, kcl->nthreads,
-                    kmer_get_covg_node, kcl->cl);
+  double alpha = 0, beta = 0, false_pos = 0, false_neg = 0;
+  int threshold_est = cleaning_pick_kmer_threshold(kmer_covgs, arrsize,
+                                                   &alpha, &beta,
+                                                   &false_pos, &false_neg);
+
+  if(threshold_est < 0)
+    warn("Cannot pick a cleaning threshold");
+  else {
+    status("[cleaning] alpha=%f, beta=%f FP=%f FN=%f",
+           alpha, beta, false_pos, false_neg);
+    status("[cleaning] Recommended unitig cleaning threshold: < %i",
+           threshold_est);
+  }
+
+  return threshold_est;
 }
-*/
 
 /**
  * Get coverage threshold for removing unitigs
@@ -468,54 +516,57 @@ int cleaning_get_threshold(size_t num_threads,
   // Wipe visited kmer memory
   memset(visited, 0, roundup_bits2bytes(db_graph->ht.capacity));
 
-  if(covgs_csv_path != NULL) {
-    cleaning_write_covg_histogram(covgs_csv_path,
-                                  cl.kmer_covgs_init,
-                                  cl.unitig_covgs_init,
-                                  cl.covg_arrsize);
-  }
-
-  if(lens_csv_path != NULL) {
-    cleaning_write_len_histogram(lens_csv_path,
-                                 cl.len_hist_init,
-                                 cl.len_arrsize,
-                                 db_graph->kmer_size);
-  }
+  unitig_cleaner_write_hists(&cl, true, covgs_csv_path, lens_csv_path);
 
   // set threshold using histogram and genome size
-  double alpha = 0, beta = 0, false_pos = 0, false_neg = 0;
-  int threshold_est = cleaning_pick_kmer_threshold(cl.kmer_covgs_init,
-                                                   cl.covg_arrsize,
-                                                   &alpha, &beta,
-                                                   &false_pos, &false_neg);
-
-  if(threshold_est < 0)
-    warn("Cannot pick a cleaning threshold");
-  else {
-    status("[cleaning] alpha=%f, beta=%f FP=%f FN=%f",
-           alpha, beta, false_pos, false_neg);
-    status("[cleaning] Recommended unitig cleaning threshold: < %i",
-           threshold_est);
-  }
+  int threshold_est = cleaning_threshold_from_hist(cl.kmer_covgs_init,
+                                                   cl.covg_arrsize);
 
   unitig_cleaner_dealloc(&cl);
 
   return threshold_est;
 }
 
+/**
+ * Get coverage threshold for removing unitigs from kmer coverages only.
+ * Does not walk unitigs, so does not need a `visited` array.
+ * @return threshold to clean or -1 on error
+ */
+int cleaning_get_kmer_threshold(size_t num_threads, const dBGraph *db_graph)
+{
+  status("[cleaning] Calculating kmer coverage with %zu threads...", num_threads);
+  status("[cleaning]   Using kmer gamma method");
+
+  size_t i, j, arrsize = DUMP_COVG_ARRSIZE;
+  KmerCovgHist kh = {.hists = ctx_calloc(num_threads*arrsize, sizeof(uint64_t)),
+                     .arrsize = arrsize,
+                     .db_graph = db_graph};
+
+  hash_table_iterate(&db_graph->ht, num_threads, kmer_covg_hist_add, &kh);
+
+  // Merge histograms into the first
+  for(i = 1; i < num_threads; i++)
+    for(j = 0; j < arrsize; j++)
+      kh.hists[j] += kh.hists[i*arrsize+j];
+
+  int threshold_est = cleaning_threshold_from_hist(kh.hists, arrsize);
+  ctx_free(kh.hists);
+
+  return threshold_est;
+}
+
 /**
  * Mark a unitig to keep or delete. Update stats on decision.
+ * Coverage of the unitig must already be in the thread's coverage buffer.
  */
-static inline void unitig_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
+static inline void unitig_decide(UnitigCleaner *cl, dBNodeBuffer nbuf,
+                                 size_t threadid)
 {
-  UnitigCleaner *cl = (UnitigCleaner*)arg;
-  bool low_covg_unitig = false, removable_tip = false;
+  bool low_covg_unitig = false, removable_tip = false, weak_branch = false;
   size_t i;
 
   UnitigCleanerStats *stats = &cl->stats[threadid];
-
   CovgBuffer *cbuf = &cl->cbufs[threadid];
-  fetch_coverages(nbuf, cbuf, cl->db_graph);
 
   // Covg is mean coverage of all kmers
   // size_t mean_covg, sum_covg = 0;
@@ -530,6 +581,15 @@ static inline void unitig_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
   // Remove tips
   removable_tip = nodes_are_removable_tip(nbuf, cl->min_keep_tip, cl->db_graph);
 
+  // Pop bubbles, only in favour of a branch we are not removing
+  weak_branch = (cl->pop_prefs != NULL && !low_covg_unitig && !removable_tip &&
+                 pop_bubbles_unitig_is_weak_branch(nbuf.b, nbuf.len,
+                                                   *cl->pop_prefs,
+                                                   cl->covg_threshold,
+                                                   &cl->alts[threadid],
+                                                   &cl->alt_cbufs[threadid],
+                                                   cl->db_graph));
+
   if(low_covg_unitig && removable_tip) {
     stats->num_tip_and_low_unitigs++;
     stats->num_tip_and_low_unitig_kmers += nbuf.len;
@@ -539,6 +599,9 @@ static inline void unitig_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
   } else if(removable_tip) {
     stats->num_tips++;
     stats->num_tip_kmers += nbuf.len;
+  } else if(weak_branch) {
+    stats->num_bubble_unitigs++;
+    stats->num_bubble_unitig_kmers += nbuf.len;
   } else {
     // Keeping unitig
     for(i = 0; i < nbuf.len; i ++)
@@ -552,6 +615,81 @@ static inline void unitig_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
   }
 }
 
+static inline void unitig_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
+{
+  UnitigCleaner *cl = (UnitigCleaner*)arg;
+  fetch_coverages(nbuf, &cl->cbufs[threadid], cl->db_graph);
+  unitig_decide(cl, nbuf, threadid);
+}
+
+// Fused cleaning: collect before-cleaning histograms and decide in one pass
+static inline void unitig_fused_mark(dBNodeBuffer nbuf, size_t threadid,
+                                     void *arg)
+{
+  UnitigCleaner *cl = (UnitigCleaner*)arg;
+  unitig_get_covg(nbuf, threadid, arg);
+  unitig_decide(cl, nbuf, threadid);
+}
+
+// Print numbers of kmers that are being removed
+static void unitig_cleaner_print_stats(UnitigCleaner *cl)
+{
+  size_t i;
+  for(i = 1; i < cl->nthreads; i++)
+    unitig_cleaner_stats_merge(&cl->stats[0], &cl->stats[i]);
+  UnitigCleanerStats *stats = &cl->stats[0];
+
+  char num_unitigs_str[50], num_tips_str[50], num_tip_unitigs_str[50];
+  char num_unitig_kmers_str[50], num_tip_kmers_str[50], num_tip_unitig_kmers_str[50];
+  ulong_to_str(stats->num_low_covg_unitigs, num_unitigs_str);
+  ulong_to_str(stats->num_tips, num_tips_str);
+  ulong_to_str(stats->num_tip_and_low_unitigs, num_tip_unitigs_str);
+  ulong_to_str(stats->num_low_covg_unitig_kmers, num_unitig_kmers_str);
+  ulong_to_str(stats->num_tip_kmers, num_tip_kmers_str);
+  ulong_to_str(stats->num_tip_and_low_unitig_kmers, num_tip_unitig_kmers_str);
+
+  status("[cleaning] Removing %s low coverage unitigs [%s kmer%s], "
+         "%s unitig tips [%s kmer%s] "
+         "and %s of both [%s kmer%s]",
+         num_unitigs_str,
+         num_unitig_kmers_str, util_plural_str(stats->num_low_covg_unitig_kmers),
+         num_tips_str,
+         num_tip_kmers_str, util_plural_str(stats->num_tip_kmers),
+         num_tip_unitigs_str,
+         num_tip_unitig_kmers_str, util_plural_str(stats->num_tip_and_low_unitig_kmers));
+
+  if(cl->pop_prefs != NULL) {
+    char num_bubble_str[50], num_bubble_kmers_str[50];
+    ulong_to_str(stats->num_bubble_unitigs, num_bubble_str);
+    ulong_to_str(stats->num_bubble_unitig_kmers, num_bubble_kmers_str);
+    status("[cleaning] Removing %s bubble branches [%s kmer%s]",
+           num_bubble_str, num_bubble_kmers_str,
+           util_plural_str(stats->num_bubble_unitig_kmers));
+  }
+}
+
+// Remove nodes not marked to keep, then wipe bit arrays
+static void unitig_cleaner_prune(size_t num_threads, size_t init_nkmers,
+                                 uint8_t *visited, uint8_t *keep,
+                                 dBGraph *db_graph)
+{
+  prune_nodes_lacking_flag(num_threads, keep, db_graph);
+
+  // Wipe memory
+  memset(visited, 0, roundup_bits2bytes(db_graph->ht.capacity));
+  memset(keep, 0, roundup_bits2bytes(db_graph->ht.capacity));
+
+  // Print status update
+  char remain_nkmers_str[100], removed_nkmers_str[100];
+  size_t remain_nkmers = hash_table_nkmers(&db_graph->ht);
+  size_t removed_nkmers = init_nkmers - remain_nkmers;
+  ulong_to_str(remain_nkmers, remain_nkmers_str);
+  ulong_to_str(removed_nkmers, removed_nkmers_str);
+  status("[cleaning] Remaining kmers: %s removed: %s (%.1f%%)",
+         remain_nkmers_str, removed_nkmers_str,
+         (100.0*removed_nkmers)/init_nkmers);
+}
+
 /**
  * Remove unitigs with coverage < `covg_threshold` and tips shorter than
  * `min_keep_tip`.
@@ -575,7 +713,7 @@ void clean_graph(size_t num_threads,
 {
   ctx_assert(db_graph->num_edge_cols > 0);
 
-  size_t i, init_nkmers = hash_table_nkmers(&db_graph->ht);
+  size_t init_nkmers = hash_table_nkmers(&db_graph->ht);
 
   if(init_nkmers == 0) return;
   if(covg_threshold == 0 && min_keep_tip == 0) {
@@ -583,6 +721,8 @@ void clean_graph(size_t num_threads,
     return;
   }
 
+  perf_phase_start("clean");
+
   if(covg_threshold > 0) {
     status("[cleaning] Removing unitigs with coverage < %zu...", covg_threshold);
     status("[cleaning]   Using kmer gamma method");
@@ -599,63 +739,339 @@ void clean_graph(size_t num_threads,
                           min_keep_tip, keep, db_graph);
   db_unitigs_iterate(num_threads, visited, db_graph, unitig_mark, &cl);
 
-  // Print numbers of kmers that are being removed
+  unitig_cleaner_print_stats(&cl);
+  unitig_cleaner_prune(num_threads, init_nkmers, visited, keep, db_graph);
+  unitig_cleaner_write_hists(&cl, false, covgs_csv_path, lens_csv_path);
+  unitig_cleaner_dealloc(&cl);
+  perf_phase_end("clean");
+}
 
+/**
+ * Fused cleaning: a single pass over unitigs collects the before-cleaning
+ * histograms, and marks low coverage unitigs, tips and (if `pop_prefs` is not
+ * NULL) the weaker branches of bubbles. All are then removed in one sweep.
+ * `covg_threshold` should be picked beforehand with
+ * cleaning_get_kmer_threshold(), which does not need to walk unitigs.
+ *
+ * Bubbles are found on the graph before tips and low coverage unitigs are
+ * removed, so some bubbles that `ctx pop` would find after cleaning are missed.
+ *
+ * `visited`, `keep` should each be at least db_graph.ht.capcity bits long
+ *   and initialised to zero. Both are zero on return.
+ **/
+void clean_graph_fused(size_t num_threads,
+                       size_t covg_threshold, size_t min_keep_tip,
+                       const PopBubblesPrefs *pop_prefs,
+                       const char *covgs_before_path,
+                       const char *lens_before_path,
+                       const char *covgs_after_path,
+                       const char *lens_after_path,
+                       uint8_t *visited, uint8_t *keep, dBGraph *db_graph)
+{
+  ctx_assert(db_graph->num_edge_cols > 0);
+
+  size_t i, init_nkmers = hash_table_nkmers(&db_graph->ht);
+
+  if(init_nkmers == 0) return;
+  if(covg_threshold == 0 && min_keep_tip == 0 && pop_prefs == NULL)
+    warn("[cleaning] No cleaning specified");
+
+  perf_phase_start("clean");
+
+  if(covg_threshold > 0)
+    status("[cleaning] Removing unitigs with coverage < %zu...", covg_threshold);
+  if(min_keep_tip > 0)
+    status("[cleaning] Removing tips shorter than %zu...", min_keep_tip);
+  if(pop_prefs != NULL)
+    status("[cleaning] Popping bubbles...");
+
+  status("[cleaning]   single pass using %zu threads", num_threads);
+
+  UnitigCleaner cl;
+  unitig_cleaner_alloc(&cl, num_threads, covg_threshold,
+                       min_keep_tip, keep, db_graph);
+
+  if(pop_prefs != NULL) {
+    cl.pop_prefs = pop_prefs;
+    cl.alts = ctx_calloc(num_threads, sizeof(dBNodeBuffer));
+    cl.alt_cbufs = ctx_calloc(num_threads, sizeof(Uint32Buffer));
+    for(i = 0; i < num_threads; i++) {
+      db_node_buf_alloc(&cl.alts[i], 256);
+      uint32_buf_alloc(&cl.alt_cbufs[i], 256);
+    }
+  }
+
+  db_unitigs_iterate(num_threads, visited, db_graph, unitig_fused_mark, &cl);
+
+  unitig_cleaner_write_hists(&cl, true, covgs_before_path, lens_before_path);
+  unitig_cleaner_print_stats(&cl);
+  unitig_cleaner_prune(num_threads, init_nkmers, visited, keep, db_graph);
+  unitig_cleaner_write_hists(&cl, false, covgs_after_path, lens_after_path);
+  unitig_cleaner_dealloc(&cl);
+  perf_phase_end("clean");
+}
+
+//
+// Per-colour cleaning
+//
+
+typedef struct {
+  uint64_t *hists; // [threadid][col][covg]
+  size_t arrsize;
+  const dBGraph *db_graph;
+} ColCovgHist;
+
+static bool col_covg_hist_add(hkey_t hkey, size_t threadid, void *arg)
+{
+  ColCovgHist *ch = (ColCovgHist*)arg;
+  size_t col, ncols = ch->db_graph->num_of_cols;
+  uint64_t *hists = ch->hists + threadid*ncols*ch->arrsize;
+  Covg covg;
+
+  for(col = 0; col < ncols; col++) {
+    covg = db_node_covg(ch->db_graph, hkey, col);
+    if(covg > 0) hists[col*ch->arrsize + MIN2(covg, ch->arrsize-1)]++;
+  }
+
+  return false; // => keep iterating
+}
+
+/**
+ * Pick a cleaning threshold for each colour from its own kmer coverage
+ * histogram. All histograms are collected in a single pass over the kmers.
+ * @param thresholds array of length db_graph->num_of_cols, set to -1 where
+ *                   a threshold could not be picked
+ */
+void cleaning_get_col_thresholds(size_t num_threads, int *thresholds,
+                                 const dBGraph *db_graph)
+{
+  size_t i, j, col, ncols = db_graph->num_of_cols;
+  size_t arrsize = DUMP_COVG_ARRSIZE, histsize = ncols * arrsize;
+
+  status("[cleaning] Calculating kmer coverage of %zu colour%s with %zu threads...",
+         ncols, util_plural_str(ncols), num_threads);
+  status("[cleaning]   Using kmer gamma method");
+
+  ColCovgHist ch = {.hists = ctx_calloc(num_threads*histsize, sizeof(uint64_t)),
+                    .arrsize = arrsize,
+                    .db_graph = db_graph};
+
+  hash_table_iterate(&db_graph->ht, num_threads, col_covg_hist_add, &ch);
+
+  // Merge histograms into the first
   for(i = 1; i < num_threads; i++)
-    unitig_cleaner_stats_merge(&cl.stats[0], &cl.stats[i]);
-  UnitigCleanerStats *stats = &cl.stats[0];
+    for(j = 0; j < histsize; j++)
+      ch.hists[j] += ch.hists[i*histsize+j];
 
-  char num_unitigs_str[50], num_tips_str[50], num_tip_unitigs_str[50];
-  char num_unitig_kmers_str[50], num_tip_kmers_str[50], num_tip_unitig_kmers_str[50];
-  ulong_to_str(stats->num_low_covg_unitigs, num_unitigs_str);
-  ulong_to_str(stats->num_tips, num_tips_str);
-  ulong_to_str(stats->num_tip_and_low_unitigs, num_tip_unitigs_str);
-  ulong_to_str(stats->num_low_covg_unitig_kmers, num_unitig_kmers_str);
-  ulong_to_str(stats->num_tip_kmers, num_tip_kmers_str);
-  ulong_to_str(stats->num_tip_and_low_unitig_kmers, num_tip_unitig_kmers_str);
+  for(col = 0; col < ncols; col++)
+    thresholds[col] = cleaning_pick_kmer_threshold(ch.hists + col*arrsize,
+                                                   arrsize,
+                                                   NULL, NULL, NULL, NULL);
 
-  status("[cleaning] Removing %s low coverage unitigs [%s kmer%s], "
-         "%s unitig tips [%s kmer%s] "
-         "and %s of both [%s kmer%s]",
-         num_unitigs_str,
-         num_unitig_kmers_str, util_plural_str(stats->num_low_covg_unitig_kmers),
-         num_tips_str,
-         num_tip_kmers_str, util_plural_str(stats->num_tip_kmers),
-         num_tip_unitigs_str,
-         num_tip_unitig_kmers_str, util_plural_str(stats->num_tip_and_low_unitig_kmers));
+  ctx_free(ch.hists);
+}
 
-  // Remove nodes not marked to keep
-  prune_nodes_lacking_flag(num_threads, keep, db_graph);
+typedef struct
+{
+  const size_t nthreads, ncols, min_keep_tip;
+  const size_t *covg_thresholds; // one per colour
+  CovgBuffer *cbufs; // one per thread, unitig coverages [col][kmer]
+  uint8_t *keep_flags, *end_flags;
+  uint64_t *rm_unitigs, *rm_kmers; // [threadid][col]
+  uint64_t *num_tips, *num_tip_kmers; // [threadid]
+  dBGraph *db_graph;
+} ColCleaner;
 
-  // Wipe memory
-  memset(visited, 0, roundup_bits2bytes(db_graph->ht.capacity));
-  memset(keep, 0, roundup_bits2bytes(db_graph->ht.capacity));
+/**
+ * Decide for every colour whether to keep a population unitig. Dropping a
+ * unitig from a colour zeros its coverage there. Edges are left for
+ * col_cleaner_trim_edges(), as other threads may be walking through them.
+ * Kmers in at least one colour are marked to keep, along with unitig ends.
+ */
+static void unitig_col_mark(dBNodeBuffer nbuf, size_t threadid, void *arg)
+{
+  ColCleaner *cl = (ColCleaner*)arg;
+  dBGraph *db_graph = cl->db_graph;
+  CovgBuffer *cbuf = &cl->cbufs[threadid];
+  uint64_t *rm_unitigs = cl->rm_unitigs + threadid*cl->ncols;
+  uint64_t *rm_kmers = cl->rm_kmers + threadid*cl->ncols;
+  size_t i, col, n = nbuf.len;
+  bool in_col, keep_any = false;
+  Covg *covgs;
+
+  // Tips are removed from all colours
+  if(nodes_are_removable_tip(nbuf, cl->min_keep_tip, db_graph)) {
+    cl->num_tips[threadid]++;
+    cl->num_tip_kmers[threadid] += n;
+    return;
+  }
 
-  // Print status update
-  char remain_nkmers_str[100], removed_nkmers_str[100];
-  size_t remain_nkmers = hash_table_nkmers(&db_graph->ht);
-  size_t removed_nkmers = init_nkmers - remain_nkmers;
-  ulong_to_str(remain_nkmers, remain_nkmers_str);
-  ulong_to_str(removed_nkmers, removed_nkmers_str);
-  status("[cleaning] Remaining kmers: %s removed: %s (%.1f%%)",
-         remain_nkmers_str, removed_nkmers_str,
-         (100.0*removed_nkmers)/init_nkmers);
+  covg_buf_reset(cbuf);
+  covg_buf_capacity(cbuf, n * cl->ncols);
 
-  if(covgs_csv_path != NULL) {
-    cleaning_write_covg_histogram(covgs_csv_path,
-                                  cl.kmer_covgs_clean,
-                                  cl.unitig_covg_clean,
-                                  cl.covg_arrsize);
+  for(col = 0; col < cl->ncols; col++)
+  {
+    covgs = cbuf->b + col*n;
+    for(i = 0, in_col = false; i < n; i++) {
+      covgs[i] = db_node_covg(db_graph, nbuf.b[i].key, col);
+      in_col |= (covgs[i] > 0);
+    }
+
+    if(!in_col) continue;
+
+    if(gca_median_uint32(covgs, n) >= cl->covg_thresholds[col]) {
+      keep_any = true;
+    } else {
+      rm_unitigs[col]++;
+      rm_kmers[col] += n;
+      for(i = 0; i < n; i++)
+        db_node_covg(db_graph, nbuf.b[i].key, col) = 0;
+    }
   }
 
-  if(lens_csv_path != NULL) {
-    cleaning_write_len_histogram(lens_csv_path,
-                                 cl.len_hist_clean,
-                                 cl.len_arrsize,
-                                 db_graph->kmer_size);
+  if(keep_any) {
+    for(i = 0; i < n; i++)
+      (void)bitset_set_mt(cl->keep_flags, nbuf.b[i].key);
+    (void)bitset_set_mt(cl->end_flags, nbuf.b[0].key);
+    (void)bitset_set_mt(cl->end_flags, nbuf.b[n-1].key);
   }
+}
 
-  unitig_cleaner_dealloc(&cl);
+/**
+ * Remove edges from colours a kmer is no longer in. Unitig ends also lose
+ * edges to neighbours no longer in the colour. Unitig interiors share the fate
+ * of their neighbours so need no lookups.
+ */
+static bool col_cleaner_trim_edges(hkey_t hkey, size_t threadid, void *arg)
+{
+  (void)threadid;
+  ColCleaner *cl = (ColCleaner*)arg;
+  dBGraph *db_graph = cl->db_graph;
+  size_t col;
+  Edges edges;
+  BinaryKmer bkmer;
+  dBNode next;
+  Orientation or;
+  Nucleotide nuc;
+  bool is_end = bitset_get(cl->end_flags, hkey);
+
+  for(col = 0; col < cl->ncols; col++)
+  {
+    edges = db_node_edges(db_graph, hkey, col);
+    if(!edges) continue;
+
+    if(db_node_covg(db_graph, hkey, col) == 0) edges = 0;
+    else if(is_end) {
+      bkmer = db_node_get_bkey(db_graph, hkey);
+      for(or = 0; or < 2; or++) {
+        for(nuc = 0; nuc < 4; nuc++) {
+          if(edges_has_edge(edges, nuc, or)) {
+            next = db_graph_next_node(db_graph, bkmer, nuc, or);
+            if(next.key == HASH_NOT_FOUND ||
+               db_node_covg(db_graph, next.key, col) == 0)
+              edges = edges_del_edge(edges, nuc, or);
+          }
+        }
+      }
+    }
+
+    db_node_edges(db_graph, hkey, col) = edges;
+  }
+
+  return false; // => keep iterating
+}
+
+static void col_cleaner_print_stats(const ColCleaner *cl)
+{
+  size_t i, col;
+  uint64_t ntips = 0, ntip_kmers = 0, nunitigs, nkmers;
+  char unitigs_str[50], kmers_str[50];
+
+  for(i = 0; i < cl->nthreads; i++) {
+    ntips += cl->num_tips[i];
+    ntip_kmers += cl->num_tip_kmers[i];
+  }
+
+  ulong_to_str(ntips, unitigs_str);
+  ulong_to_str(ntip_kmers, kmers_str);
+  status("[cleaning] Removing %s unitig tips [%s kmer%s] from all colours",
+         unitigs_str, kmers_str, util_plural_str(ntip_kmers));
+
+  for(col = 0; col < cl->ncols; col++) {
+    for(i = nunitigs = nkmers = 0; i < cl->nthreads; i++) {
+      nunitigs += cl->rm_unitigs[i*cl->ncols+col];
+      nkmers += cl->rm_kmers[i*cl->ncols+col];
+    }
+    ulong_to_str(nunitigs, unitigs_str);
+    ulong_to_str(nkmers, kmers_str);
+    status("[cleaning] Colour %zu: removing %s low coverage unitigs [%s kmer%s] "
+           "with coverage < %zu", col, unitigs_str, kmers_str,
+           util_plural_str(nkmers), cl->covg_thresholds[col]);
+  }
+}
+
+/**
+ * Clean each colour against the population graph. Unitigs of the population
+ * graph are walked once; each colour drops unitigs with median coverage in
+ * that colour < covg_thresholds[col]. Tips shorter than `min_keep_tip` are
+ * removed from all colours. Kmers left in no colour are removed from the graph.
+ *
+ * @param covg_thresholds one per colour, usually picked with
+ *                        cleaning_get_col_thresholds(). 0 to not clean.
+ * `visited`, `keep` should each be at least db_graph.ht.capcity bits long
+ *   and initialised to zero. Both are zero on return.
+ */
+void clean_graph_per_colour(size_t num_threads,
+                            const size_t *covg_thresholds, size_t min_keep_tip,
+                            uint8_t *visited, uint8_t *keep, dBGraph *db_graph)
+{
+  ctx_assert(db_graph->num_edge_cols == db_graph->num_of_cols);
+  ctx_assert(db_graph->col_covgs != NULL);
+
+  size_t i, ncols = db_graph->num_of_cols;
+  size_t init_nkmers = hash_table_nkmers(&db_graph->ht);
+
+  if(init_nkmers == 0) return;
+
+  perf_phase_start("clean");
+
+  status("[cleaning] Cleaning %zu colour%s against the population graph",
+         ncols, util_plural_str(ncols));
+  if(min_keep_tip > 0)
+    status("[cleaning] Removing tips shorter than %zu...", min_keep_tip);
+  status("[cleaning]   using %zu threads", num_threads);
+
+  uint8_t *ends = ctx_calloc(roundup_bits2bytes(db_graph->ht.capacity), 1);
+
+  ColCleaner cl = {.nthreads = num_threads, .ncols = ncols,
+                   .min_keep_tip = min_keep_tip,
+                   .covg_thresholds = covg_thresholds,
+                   .cbufs = ctx_calloc(num_threads, sizeof(CovgBuffer)),
+                   .keep_flags = keep, .end_flags = ends,
+                   .rm_unitigs = ctx_calloc(num_threads*ncols, sizeof(uint64_t)),
+                   .rm_kmers = ctx_calloc(num_threads*ncols, sizeof(uint64_t)),
+                   .num_tips = ctx_calloc(num_threads, sizeof(uint64_t)),
+                   .num_tip_kmers = ctx_calloc(num_threads, sizeof(uint64_t)),
+                   .db_graph = db_graph};
+
+  for(i = 0; i < num_threads; i++)
+    covg_buf_alloc(&cl.cbufs[i], 1024);
+
+  db_unitigs_iterate(num_threads, visited, db_graph, unitig_col_mark, &cl);
+  hash_table_iterate(&db_graph->ht, num_threads, col_cleaner_trim_edges, &cl);
+
+  col_cleaner_print_stats(&cl);
+  unitig_cleaner_prune(num_threads, init_nkmers, visited, keep, db_graph);
+
+  for(i = 0; i < num_threads; i++)
+    covg_buf_dealloc(&cl.cbufs[i]);
+  ctx_free(cl.cbufs);
+  ctx_free(cl.rm_unitigs);
+  ctx_free(cl.rm_kmers);
+  ctx_free(cl.num_tips);
+  ctx_free(cl.num_tip_kmers);
+  ctx_free(ends);
+  perf_phase_end("clean");
 }
 
 static FILE* _open_histogram_file(const char *path, const char *name)
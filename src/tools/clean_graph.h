@@ -2,6 +2,7 @@
 #define CLEAN_GRAPH_H_
 
 #include "db_graph.h"
+#include "pop_bubbles.h"
 
 /**
  * Pick a cleaning threshold from kmer coverage histogram. Assumes low coverage
@@ -21,6 +22,10 @@ int cleaning_pick_kmer_threshold(const uint64_t *kmer_covg, size_t arrlen,
                                  double *alpha_est_ptr, double *beta_est_ptr,
                                  double *false_pos_ptr, double *false_neg_ptr);
 
+// Pick a threshold with cleaning_pick_kmer_threshold() and print it
+// @return threshold to clean or -1 on error
+int cleaning_threshold_from_hist(const uint64_t *kmer_covgs, size_t arrsize);
+
 /**
  * Get coverage threshold for removing unitigs
  *
@@ -38,6 +43,13 @@ int cleaning_get_threshold(size_t num_threads,
                            uint8_t *visited,
                            const dBGraph *db_graph);
 
+/**
+ * Get coverage threshold for removing unitigs from the kmer coverage histogram.
+ * Iterates over kmers rather than unitigs, so does not need a `visited` array.
+ * @return threshold to clean or -1 on error
+ */
+int cleaning_get_kmer_threshold(size_t num_threads, const dBGraph *db_graph);
+
 /**
  * Remove low coverage unitigs and clip tips
  * - Remove unitigs with mean coverage < `covg_threshold`
@@ -53,6 +65,44 @@ void clean_graph(size_t num_threads,
                  const char *covgs_csv_path, const char *lens_csv_path,
                  uint8_t *visited, uint8_t *keep, dBGraph *db_graph);
 
+/**
+ * Fused cleaning: one pass over unitigs collects histograms BEFORE cleaning,
+ * marks low coverage unitigs, tips and weaker bubble branches (if `pop_prefs`
+ * is not NULL), then all are removed in one parallel sweep.
+ * `covg_threshold` is usually from cleaning_get_kmer_threshold().
+ * Histogram paths may be NULL.
+ * `visited`, `keep` should each be at least db_graph.ht.capcity bits long
+ *   and initialised to zero.
+ */
+void clean_graph_fused(size_t num_threads,
+                       size_t covg_threshold, size_t min_keep_tip,
+                       const PopBubblesPrefs *pop_prefs,
+                       const char *covgs_before_path,
+                       const char *lens_before_path,
+                       const char *covgs_after_path,
+                       const char *lens_after_path,
+                       uint8_t *visited, uint8_t *keep, dBGraph *db_graph);
+
+/**
+ * Pick a cleaning threshold for each colour from its own kmer coverage
+ * histogram, in one pass over the kmers.
+ * @param thresholds array of db_graph->num_of_cols, -1 where none was picked
+ */
+void cleaning_get_col_thresholds(size_t num_threads, int *thresholds,
+                                 const dBGraph *db_graph);
+
+/**
+ * Clean each colour against the population graph in one pass over its
+ * unitigs. A colour loses unitigs with median coverage in that colour
+ * < covg_thresholds[col]. Tips shorter than `min_keep_tip` are removed from
+ * all colours. Kmers left in no colour are removed.
+ * `visited`, `keep` should each be at least db_graph.ht.capcity bits long
+ *   and initialised to zero.
+ */
+void clean_graph_per_colour(size_t num_threads,
+                            const size_t *covg_thresholds, size_t min_keep_tip,
+                            uint8_t *visited, uint8_t *keep, dBGraph *db_graph);
+
 void cleaning_write_covg_histogram(const char *path,
                                    const uint64_t *covg_hist,
                                    const uint64_t *kmer_hist,
@@ -0,0 +1,297 @@
+#include "global.h"
+#include "util.h"
+#include "file_util.h"
+#include "db_node.h"
+#include "sorted_graph.h"
+#include "graph_writer.h"
+#include "clean_graph.h"
+#include "clean_graph_disk.h"
+#include "common_buffers.h"
+
+#include "carrays/carrays.h" // gca_median()
+
+#define DUMP_COVG_ARRSIZE 1000
+#define DUMP_LEN_ARRSIZE 1000
+
+typedef struct
+{
+  uint64_t num_tips, num_tip_kmers;
+  uint64_t num_low_covg_unitigs, num_low_covg_unitig_kmers;
+  uint64_t num_tip_and_low_unitigs, num_tip_and_low_unitig_kmers;
+} DiskCleanerStats;
+
+typedef struct
+{
+  const size_t kmer_size, ncols;
+  const size_t covg_threshold, min_keep_tip;
+  const SortedGraph *sg;
+  uint8_t *visited, *keep, *ends; // one bit per kmer in the file
+  dBNodeBuffer nbuf;
+  Uint32Buffer cbuf;
+  uint64_t kmer_covgs_init[DUMP_COVG_ARRSIZE], kmer_covgs_clean[DUMP_COVG_ARRSIZE];
+  uint64_t unitig_covgs_init[DUMP_COVG_ARRSIZE], unitig_covgs_clean[DUMP_COVG_ARRSIZE];
+  uint64_t len_hist_init[DUMP_LEN_ARRSIZE], len_hist_clean[DUMP_LEN_ARRSIZE];
+  DiskCleanerStats stats;
+} DiskCleaner;
+
+// Sum coverage and take union of edges over colours
+static inline void _disk_reduce(size_t ncols, const Covg *covgs,
+                                const Edges *edges,
+                                Covg *covg, Edges *union_edges)
+{
+  size_t i;
+  *covg = 0; *union_edges = 0;
+  for(i = 0; i < ncols; i++) {
+    *covg = SAFE_ADD_COVG(*covg, covgs[i]);
+    *union_edges |= edges[i];
+  }
+}
+
+int cleaning_disk_get_threshold(GraphFileReader *file)
+{
+  status("[cleaning] Streaming kmer coverage from: %s",
+         file_filter_path(&file->fltr));
+  status("[cleaning]   Using kmer gamma method");
+
+  const size_t ncols = file_filter_into_ncols(&file->fltr);
+  uint64_t *hist = ctx_calloc(DUMP_COVG_ARRSIZE, sizeof(uint64_t));
+  BinaryKmer bkmer;
+  Covg covgs[ncols], covg;
+  Edges edges[ncols], union_edges;
+
+  if(graph_file_fseek(file, file->hdr_size, SEEK_SET) != 0)
+    die("fseek failed: %s", strerror(errno));
+
+  while(graph_file_read_reset(file, &bkmer, covgs, edges)) {
+    _disk_reduce(ncols, covgs, edges, &covg, &union_edges);
+    if(covg) hist[MIN2(covg, DUMP_COVG_ARRSIZE-1)]++;
+  }
+
+  int threshold_est = cleaning_threshold_from_hist(hist, DUMP_COVG_ARRSIZE);
+  ctx_free(hist);
+  return threshold_est;
+}
+
+static inline void _disk_update_hists(uint64_t *kcovg_hist, uint64_t *ucovg_hist,
+                                      uint64_t *len_hist, const Uint32Buffer *cbuf,
+                                      uint32_t median_covg)
+{
+  size_t i;
+  for(i = 0; i < cbuf->len; i++)
+    kcovg_hist[MIN2(cbuf->b[i], DUMP_COVG_ARRSIZE-1)]++;
+  len_hist[MIN2(cbuf->len, DUMP_LEN_ARRSIZE-1)]++;
+  ucovg_hist[MIN2(median_covg, DUMP_COVG_ARRSIZE-1)]++;
+}
+
+// Mark unitig in dc->nbuf to keep or delete, update stats
+static void _disk_unitig_mark(DiskCleaner *dc)
+{
+  const dBNodeBuffer *nbuf = &dc->nbuf;
+  const SortedGraph *sg = dc->sg;
+  DiskCleanerStats *stats = &dc->stats;
+  const dBNode first = nbuf->b[0], last = nbuf->b[nbuf->len-1];
+  size_t i;
+
+  for(i = 0; i < nbuf->len; i++) bitset_set(dc->visited, nbuf->b[i].key);
+
+  // Median coverage, gca_median sorts the coverages so take a copy
+  uint32_buf_reset(&dc->cbuf);
+  for(i = 0; i < nbuf->len; i++)
+    uint32_buf_add(&dc->cbuf, sorted_graph_covg(sg, nbuf->b[i].key));
+  uint32_t median_covg = gca_median_uint32(dc->cbuf.b, dc->cbuf.len);
+
+  _disk_update_hists(dc->kmer_covgs_init, dc->unitig_covgs_init,
+                     dc->len_hist_init, &dc->cbuf, median_covg);
+
+  Edges first_edges = sorted_graph_edges(sg, first.key);
+  Edges last_edges = sorted_graph_edges(sg, last.key);
+
+  bool low_covg_unitig = (median_covg < dc->covg_threshold);
+  bool removable_tip = (nbuf->len < dc->min_keep_tip &&
+                        edges_get_indegree(first_edges, first.orient) +
+                        edges_get_outdegree(last_edges, last.orient) <= 1);
+
+  if(low_covg_unitig && removable_tip) {
+    stats->num_tip_and_low_unitigs++;
+    stats->num_tip_and_low_unitig_kmers += nbuf->len;
+  } else if(low_covg_unitig) {
+    stats->num_low_covg_unitigs++;
+    stats->num_low_covg_unitig_kmers += nbuf->len;
+  } else if(removable_tip) {
+    stats->num_tips++;
+    stats->num_tip_kmers += nbuf->len;
+  } else {
+    // Keeping unitig, only ends can have edges to removed kmers
+    for(i = 0; i < nbuf->len; i++) bitset_set(dc->keep, nbuf->b[i].key);
+    bitset_set(dc->ends, first.key);
+    bitset_set(dc->ends, last.key);
+
+    _disk_update_hists(dc->kmer_covgs_clean, dc->unitig_covgs_clean,
+                       dc->len_hist_clean, &dc->cbuf, median_covg);
+  }
+}
+
+// Walk each unitig once in order of its first kmer in the file
+static void _disk_label_unitigs(DiskCleaner *dc)
+{
+  uint64_t idx;
+
+  for(idx = 0; idx < dc->sg->nkmers; idx++)
+  {
+    if(bitset_get(dc->visited, idx) || !sorted_graph_has_covg(dc->sg, idx))
+      continue;
+
+    db_node_buf_reset(&dc->nbuf);
+    sorted_unitig_fetch(idx, &dc->nbuf, dc->sg);
+    _disk_unitig_mark(dc);
+  }
+}
+
+// Write kept kmers in order, removing edges from unitig ends to removed kmers
+static size_t _disk_write_kept(DiskCleaner *dc, const char *out_path,
+                               const GraphFileHeader *hdr)
+{
+  const SortedGraph *sg = dc->sg;
+  BinaryKmer bkey, next;
+  Covg covgs[dc->ncols];
+  Edges edges[dc->ncols], keep_edges;
+  Orientation orient;
+  Nucleotide nuc;
+  hkey_t next_idx;
+  size_t col, nkmers_written = 0;
+  uint64_t idx;
+
+  FILE *fout = futil_fopen(out_path, "w");
+  graph_write_header(fout, hdr);
+
+  for(idx = 0; idx < sg->nkmers; idx++)
+  {
+    if(!bitset_get(dc->keep, idx)) continue;
+
+    bkey = sorted_graph_bkey(sg, idx);
+    sorted_graph_fetch(sg, idx, covgs, edges);
+
+    if(bitset_get(dc->ends, idx)) {
+      keep_edges = sorted_graph_edges(sg, idx);
+
+      for(orient = 0; orient < 2; orient++) {
+        for(nuc = 0; nuc < 4; nuc++) {
+          if(edges_has_edge(keep_edges, nuc, orient)) {
+            next = bkmer_shift_add_last_nuc(bkey, orient, dc->kmer_size, nuc);
+            next = binary_kmer_get_key(next, dc->kmer_size);
+            next_idx = sorted_graph_find_key(sg, next);
+            if(next_idx == HASH_NOT_FOUND || !bitset_get(dc->keep, next_idx))
+              keep_edges = edges_del_edge(keep_edges, nuc, orient);
+          }
+        }
+      }
+
+      for(col = 0; col < dc->ncols; col++) edges[col] &= keep_edges;
+    }
+
+    graph_write_kmer(fout, hdr->num_of_cols, bkey, covgs, edges);
+    nkmers_written++;
+  }
+
+  fclose(fout);
+  graph_writer_print_status(nkmers_written, hdr->num_of_cols,
+                            out_path, hdr->version);
+
+  return nkmers_written;
+}
+
+static void _disk_print_stats(const DiskCleanerStats *stats)
+{
+  char num_unitigs_str[50], num_tips_str[50], num_tip_unitigs_str[50];
+  char num_unitig_kmers_str[50], num_tip_kmers_str[50], num_tip_unitig_kmers_str[50];
+  ulong_to_str(stats->num_low_covg_unitigs, num_unitigs_str);
+  ulong_to_str(stats->num_tips, num_tips_str);
+  ulong_to_str(stats->num_tip_and_low_unitigs, num_tip_unitigs_str);
+  ulong_to_str(stats->num_low_covg_unitig_kmers, num_unitig_kmers_str);
+  ulong_to_str(stats->num_tip_kmers, num_tip_kmers_str);
+  ulong_to_str(stats->num_tip_and_low_unitig_kmers, num_tip_unitig_kmers_str);
+
+  status("[cleaning] Removing %s low coverage unitigs [%s kmer%s], "
+         "%s unitig tips [%s kmer%s] "
+         "and %s of both [%s kmer%s]",
+         num_unitigs_str,
+         num_unitig_kmers_str, util_plural_str(stats->num_low_covg_unitig_kmers),
+         num_tips_str,
+         num_tip_kmers_str, util_plural_str(stats->num_tip_kmers),
+         num_tip_unitigs_str,
+         num_tip_unitig_kmers_str, util_plural_str(stats->num_tip_and_low_unitig_kmers));
+}
+
+size_t clean_graph_disk(GraphFileReader *file,
+                        size_t covg_threshold, size_t min_keep_tip,
+                        const char *covgs_before_path,
+                        const char *lens_before_path,
+                        const char *covgs_after_path,
+                        const char *lens_after_path,
+                        const char *out_path, const GraphFileHeader *hdr)
+{
+  ctx_assert(file->num_of_kmers >= 0);
+  ctx_assert(hdr->num_of_cols == file_filter_into_ncols(&file->fltr));
+
+  const size_t ncols = file_filter_into_ncols(&file->fltr);
+  const size_t kmer_size = file->hdr.kmer_size;
+  const size_t nkmers = graph_file_nkmers(file);
+  const size_t nbytes = roundup_bits2bytes(nkmers);
+
+  char nkmers_str[50], mem_str[50];
+  ulong_to_str(nkmers, nkmers_str);
+  bytes_to_str(3*nbytes + sorted_graph_mem(nkmers, kmer_size), 1, mem_str);
+  status("[cleaning] Cleaning %s kmers on disk using %s", nkmers_str, mem_str);
+  if(covg_threshold > 0)
+    status("[cleaning] Removing unitigs with coverage < %zu...", covg_threshold);
+  if(min_keep_tip > 0)
+    status("[cleaning] Removing tips shorter than %zu...", min_keep_tip);
+
+  // Checks the file is sorted, which we need for kmer index to be its rank
+  SortedGraph sg;
+  sorted_graph_open(&sg, file);
+
+  uint8_t *bits = ctx_calloc(3*nbytes, 1);
+  DiskCleaner *dc = ctx_calloc(1, sizeof(DiskCleaner));
+  DiskCleaner tmp = {.kmer_size = kmer_size, .ncols = ncols,
+                     .covg_threshold = covg_threshold,
+                     .min_keep_tip = min_keep_tip, .sg = &sg,
+                     .visited = bits, .keep = bits+nbytes, .ends = bits+2*nbytes};
+  memcpy(dc, &tmp, sizeof(DiskCleaner));
+  db_node_buf_alloc(&dc->nbuf, 1024);
+  uint32_buf_alloc(&dc->cbuf, 1024);
+
+  _disk_label_unitigs(dc);
+  _disk_print_stats(&dc->stats);
+
+  if(covgs_before_path != NULL)
+    cleaning_write_covg_histogram(covgs_before_path, dc->kmer_covgs_init,
+                                  dc->unitig_covgs_init, DUMP_COVG_ARRSIZE);
+  if(lens_before_path != NULL)
+    cleaning_write_len_histogram(lens_before_path, dc->len_hist_init,
+                                 DUMP_LEN_ARRSIZE, dc->kmer_size);
+
+  size_t nkmers_written = _disk_write_kept(dc, out_path, hdr);
+
+  char remain_nkmers_str[100], removed_nkmers_str[100];
+  ulong_to_str(nkmers_written, remain_nkmers_str);
+  ulong_to_str(nkmers - nkmers_written, removed_nkmers_str);
+  status("[cleaning] Remaining kmers: %s removed: %s (%.1f%%)",
+         remain_nkmers_str, removed_nkmers_str,
+         nkmers ? (100.0*(nkmers-nkmers_written))/nkmers : 0.0);
+
+  if(covgs_after_path != NULL)
+    cleaning_write_covg_histogram(covgs_after_path, dc->kmer_covgs_clean,
+                                  dc->unitig_covgs_clean, DUMP_COVG_ARRSIZE);
+  if(lens_after_path != NULL)
+    cleaning_write_len_histogram(lens_after_path, dc->len_hist_clean,
+                                 DUMP_LEN_ARRSIZE, dc->kmer_size);
+
+  sorted_graph_close(&sg);
+  db_node_buf_dealloc(&dc->nbuf);
+  uint32_buf_dealloc(&dc->cbuf);
+  ctx_free(dc);
+  ctx_free(bits);
+
+  return nkmers_written;
+}
@@ -0,0 +1,36 @@
+#ifndef CLEAN_GRAPH_DISK_H_
+#define CLEAN_GRAPH_DISK_H_
+
+#include "graph_file_reader.h"
+
+//
+// Clean a sorted graph file without loading it into a hash table.
+// Unitigs are walked through a memory map of the file (see sorted_graph.h)
+// and kmers are identified by their index in the file, so only three bits per
+// kmer (visited, keep, unitig end) and the prefix table are held in memory.
+// The cleaned graph is written in a final pass, in the same sorted order.
+//
+
+// Stream kmer coverages from a graph file and pick a cleaning threshold
+// @return threshold to clean or -1 on error
+int cleaning_disk_get_threshold(GraphFileReader *file);
+
+/**
+ * Remove unitigs with median coverage < `covg_threshold` and tips shorter
+ * than `min_keep_tip` from a sorted graph file. Uses union of colours.
+ *
+ * @param file        sorted graph file, not a stream
+ * @param covgs_before_path, lens_before_path, covgs_after_path, lens_after_path
+ *                    paths to write CSV histograms, ignored if NULL
+ * @param hdr         output header, must have file_filter_into_ncols() colours
+ * @return number of kmers written
+ */
+size_t clean_graph_disk(GraphFileReader *file,
+                        size_t covg_threshold, size_t min_keep_tip,
+                        const char *covgs_before_path,
+                        const char *lens_before_path,
+                        const char *covgs_after_path,
+                        const char *lens_after_path,
+                        const char *out_path, const GraphFileHeader *hdr);
+
+#endif /* CLEAN_GRAPH_DISK_H_ */
@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 #include "correct_reads.h"
 #include "correct_alignment.h"
@@ -5,12 +6,44 @@
 #include "seq_loading_stats.h"
 #include "seq_reader.h"
 #include "file_util.h"
-#include "msg-pool/msgpool.h"
+#include "reorder_buffer.h"
+
+//
+// Reads are corrected in any order but written in input order. Each input has
+// an OrderedOutput that holds reads that finish early until the reads before
+// them are done. Reads are written in batches of CORRECT_BATCH_READS, which
+// are gzip compressed in parallel as separate gzip members. Batch boundaries
+// do not depend on the number of threads, so neither does the output.
+//
+
+#define CORRECT_BATCH_READS 4096
+
+// Output streams: single-ended, pair first reads, pair second reads
+#define OUT_SE 0
+#define OUT_PE1 1
+#define OUT_PE2 2
+
+typedef struct
+{
+  SeqOutput *seqout;
+  // Reads that finished early, order.next is the next read to append to
+  // the current batch. Each read has two strings, r2 is empty if not paired
+  ReorderBuffer order;
+  StrBuf batch[3]; // text of the current batch, per output stream
+  size_t next_batch; // index of the current batch
+  pthread_mutex_t lock;
+  // Batches are written in order of index
+  size_t next_write;
+  pthread_mutex_t write_lock;
+  pthread_cond_t write_cond;
+} OrderedOutput;
 
 typedef struct
 {
   const dBGraph *db_graph;
   volatile size_t *rcounter;
+  const CorrectAlnInput *inputs;
+  OrderedOutput *outputs;
   CorrectAlnWorker corrector;
   // For filling in gaps
   GraphWalker wlk;
@@ -21,14 +54,23 @@ typedef struct
 
   // Corrected alignment
   dBNodeBuffer nodebuf; Int32Buffer posbuf;
+
+  // A batch taken from an OrderedOutput to compress and write
+  StrBuf blk[3], gzblk[3];
+  z_stream strm;
 } CorrectReadsWorker;
 
 static void correct_reads_worker_alloc(CorrectReadsWorker *wrkr,
                                        size_t *read_cntr_ptr,
+                                       const CorrectAlnInput *inputs,
+                                       OrderedOutput *outputs,
                                        bool append_orig_seq, char fq_zero,
                                        const dBGraph *db_graph)
 {
+  size_t i;
   wrkr->rcounter = read_cntr_ptr;
+  wrkr->inputs = inputs;
+  wrkr->outputs = outputs;
   wrkr->fq_zero = fq_zero;
   wrkr->append_orig_seq = append_orig_seq;
   wrkr->db_graph = db_graph;
@@ -40,6 +82,18 @@ static void correct_reads_worker_alloc(CorrectReadsWorker *wrkr,
   strbuf_alloc(&wrkr->qbuf, 1024); // quality scores
   db_node_buf_alloc(&wrkr->nodebuf, 512);
   int32_buf_alloc(&wrkr->posbuf, 512);
+
+  for(i = 0; i < 3; i++) {
+    strbuf_alloc(&wrkr->blk[i], 1024);
+    strbuf_alloc(&wrkr->gzblk[i], 1024);
+  }
+
+  // Same settings as gzopen(path, "w")
+  memset(&wrkr->strm, 0, sizeof(z_stream));
+  if(deflateInit2(&wrkr->strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                  15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    die("Cannot initialise zlib");
+  }
 }
 
 static void correct_reads_worker_dealloc(CorrectReadsWorker *wrkr)
@@ -52,6 +106,157 @@ static void correct_reads_worker_dealloc(CorrectReadsWorker *wrkr)
   strbuf_dealloc(&wrkr->qbuf);
   db_node_buf_dealloc(&wrkr->nodebuf);
   int32_buf_dealloc(&wrkr->posbuf);
+  for(size_t i = 0; i < 3; i++) {
+    strbuf_dealloc(&wrkr->blk[i]);
+    strbuf_dealloc(&wrkr->gzblk[i]);
+  }
+  deflateEnd(&wrkr->strm);
+}
+
+static void ordered_output_alloc(OrderedOutput *out, SeqOutput *seqout,
+                                 size_t nthreads)
+{
+  size_t i;
+  memset(out, 0, sizeof(OrderedOutput));
+  out->seqout = seqout;
+  reorder_buf_alloc(&out->order, 2, nthreads);
+  for(i = 0; i < 3; i++) strbuf_alloc(&out->batch[i], 1024);
+  if(pthread_mutex_init(&out->lock, NULL) != 0 ||
+     pthread_mutex_init(&out->write_lock, NULL) != 0 ||
+     pthread_cond_init(&out->write_cond, NULL) != 0) die("Mutex init failed");
+}
+
+static void ordered_output_dealloc(OrderedOutput *out)
+{
+  size_t i;
+  reorder_buf_dealloc(&out->order);
+  for(i = 0; i < 3; i++) strbuf_dealloc(&out->batch[i]);
+  pthread_mutex_destroy(&out->lock);
+  pthread_mutex_destroy(&out->write_lock);
+  pthread_cond_destroy(&out->write_cond);
+}
+
+// Gzip compress `in` into a single gzip member `out`
+static void gzip_block(z_stream *strm, const StrBuf *in, StrBuf *out)
+{
+  if(deflateReset(strm) != Z_OK) die("zlib error");
+  strbuf_ensure_capacity(out, deflateBound(strm, in->end));
+  strm->next_in = (Bytef*)in->b;
+  strm->avail_in = in->end;
+  strm->next_out = (Bytef*)out->b;
+  strm->avail_out = out->size;
+  if(deflate(strm, Z_FINISH) != Z_STREAM_END) die("zlib error");
+  out->end = strm->total_out;
+}
+
+// Compress and write the batch in wrkr->blk, once all batches before `idx`
+// have been written. Does not hold out->lock.
+static void ordered_output_write(OrderedOutput *out, size_t idx,
+                                 CorrectReadsWorker *wrkr)
+{
+  SeqOutput *seqout = out->seqout;
+  gzFile gzout[3] = {seqout->gzout_se, seqout->gzout_pe[0], seqout->gzout_pe[1]};
+  const char *paths[3] = {seqout->path_se, seqout->path_pe[0], seqout->path_pe[1]};
+  StrBuf *buf[3];
+  size_t i;
+
+  for(i = 0; i < 3; i++) {
+    buf[i] = &wrkr->blk[i];
+    if(seqout->gzblocks && buf[i]->end > 0) {
+      gzip_block(&wrkr->strm, buf[i], &wrkr->gzblk[i]);
+      buf[i] = &wrkr->gzblk[i];
+    }
+  }
+
+  pthread_mutex_lock(&out->write_lock);
+  while(out->next_write != idx)
+    pthread_cond_wait(&out->write_cond, &out->write_lock);
+
+  for(i = 0; i < 3; i++) {
+    if(wrkr->blk[i].end > 0 &&
+       gzwrite(gzout[i], buf[i]->b, buf[i]->end) != (int)buf[i]->end) {
+      die("Cannot write to file: %s", paths[i]);
+    }
+  }
+
+  out->next_write++;
+  pthread_cond_broadcast(&out->write_cond);
+  pthread_mutex_unlock(&out->write_lock);
+
+  for(i = 0; i < 3; i++) strbuf_reset(&wrkr->blk[i]);
+}
+
+// Append the next read to the current batch, after order.next has moved past
+// it. Must hold out->lock. Returns true if the batch is now full
+static bool ordered_output_append(OrderedOutput *out, const StrBuf *r1,
+                                  const StrBuf *r2, bool is_pe)
+{
+  if(is_pe) {
+    strbuf_append_strn(&out->batch[OUT_PE1], r1->b, r1->end);
+    strbuf_append_strn(&out->batch[OUT_PE2], r2->b, r2->end);
+  } else {
+    strbuf_append_strn(&out->batch[OUT_SE], r1->b, r1->end);
+  }
+  return (out->order.next % CORRECT_BATCH_READS == 0);
+}
+
+// Take the current batch. Must hold out->lock.
+// Returns the index of the batch
+static size_t ordered_output_take(OrderedOutput *out, CorrectReadsWorker *wrkr)
+{
+  size_t i;
+  for(i = 0; i < 3; i++) SWAP(out->batch[i], wrkr->blk[i]);
+  return out->next_batch++;
+}
+
+// Add formatted read `seqn` to the output. If it is the next read, append it
+// and any stored reads that follow it, writing batches as they fill.
+// Otherwise store it until the reads before it have been added.
+static void ordered_output_add(OrderedOutput *out, size_t seqn,
+                               const StrBuf *r1, const StrBuf *r2, bool is_pe,
+                               CorrectReadsWorker *wrkr)
+{
+  StrBuf *pend;
+  size_t idx;
+  bool full;
+
+  pthread_mutex_lock(&out->lock);
+
+  if(seqn != out->order.next)
+  {
+    pend = reorder_buf_store(&out->order, seqn);
+    strbuf_set_buff(&pend[0], r1);
+    if(is_pe) strbuf_set_buff(&pend[1], r2);
+    pthread_mutex_unlock(&out->lock);
+    return;
+  }
+
+  reorder_buf_pass(&out->order);
+  full = ordered_output_append(out, r1, r2, is_pe);
+
+  while(1)
+  {
+    if(full) {
+      // Compress and write without holding the lock. Whilst we do so another
+      // thread may add reads, including the next read
+      idx = ordered_output_take(out, wrkr);
+      pthread_mutex_unlock(&out->lock);
+      ordered_output_write(out, idx, wrkr);
+      pthread_mutex_lock(&out->lock);
+    }
+
+    if((pend = reorder_buf_take(&out->order)) == NULL) break;
+    full = ordered_output_append(out, &pend[0], &pend[1], pend[1].end > 0);
+  }
+
+  pthread_mutex_unlock(&out->lock);
+}
+
+// Write out the last batch, once all threads have finished
+static void ordered_output_finish(OrderedOutput *out, CorrectReadsWorker *wrkr)
+{
+  size_t idx = ordered_output_take(out, wrkr);
+  ordered_output_write(out, idx, wrkr);
 }
 
 // Returns the new number of bases printed
@@ -275,11 +480,12 @@ static void correct_read(CorrectReadsWorker *wrkr, AsyncIOData *data)
 
   CorrectAlnInput *input = (CorrectAlnInput*)data->ptr;
   const CorrectAlnParam *params = &input->crt_params;
-  SeqOutput *output = input->output;
+  SeqOutput *seqout = input->output;
+  OrderedOutput *output = &wrkr->outputs[input - wrkr->inputs];
   StrBuf *rbuf1 = &wrkr->rbuf1, *rbuf2 = &wrkr->rbuf2, *qbuf = &wrkr->qbuf;
   dBNodeBuffer *nodebuf = &wrkr->nodebuf;
   Int32Buffer *posbuf = &wrkr->posbuf;
-  seq_format format = output->fmt;
+  seq_format format = seqout->fmt;
 
   read_t *r1 = &data->r1, *r2 = data->r2.seq.end > 0 ? &data->r2 : NULL;
 
@@ -300,9 +506,6 @@ static void correct_read(CorrectReadsWorker *wrkr, AsyncIOData *data)
     // Single ended read
     handle_read(wrkr, params, r1, rbuf1, qbuf, fq_cutoff1, hp_cutoff,
                 nodebuf, posbuf, format, wrkr->append_orig_seq);
-    pthread_mutex_lock(&output->lock_se);
-    gzwrite(output->gzout_se, rbuf1->b, rbuf1->end);
-    pthread_mutex_unlock(&output->lock_se);
   }
   else
   {
@@ -311,11 +514,9 @@ static void correct_read(CorrectReadsWorker *wrkr, AsyncIOData *data)
                 nodebuf, posbuf, format, wrkr->append_orig_seq);
     handle_read(wrkr, params, r2, rbuf2, qbuf, fq_cutoff2, hp_cutoff,
                 nodebuf, posbuf, format, wrkr->append_orig_seq);
-    pthread_mutex_lock(&output->lock_pe);
-    gzwrite(output->gzout_pe[0], rbuf1->b, rbuf1->end);
-    gzwrite(output->gzout_pe[1], rbuf2->b, rbuf2->end);
-    pthread_mutex_unlock(&output->lock_pe);
   }
+
+  ordered_output_add(output, data->seqn, rbuf1, rbuf2, r2 != NULL, wrkr);
 }
 
 // pthread method, loop: grabs job, does processing
@@ -342,12 +543,23 @@ void correct_reads(CorrectAlnInput *inputs, size_t num_inputs,
 
   if(!fq_zero) fq_zero = '.';
 
+  perf_phase_start("correct");
+
   CorrectReadsWorker *wrkrs = ctx_calloc(num_threads, sizeof(CorrectReadsWorker));
+  OrderedOutput *outputs = ctx_calloc(num_inputs, sizeof(OrderedOutput));
+
+  for(i = 0; i < num_inputs; i++)
+    ordered_output_alloc(&outputs[i], inputs[i].output, num_threads);
+
+  // Links are loaded before we start, so every gap traversal can be cached
+  // if there are none
+  GapCache gapcache;
+  gap_cache_alloc(&gapcache, GAP_CACHE_DEFAULT_MEM, true);
 
   for(i = 0; i < num_threads; i++) {
-    correct_reads_worker_alloc(&wrkrs[i], &read_counter,
-                               fq_zero, append_orig_seq,
-                               db_graph);
+    correct_reads_worker_alloc(&wrkrs[i], &read_counter, inputs, outputs,
+                               append_orig_seq, fq_zero, db_graph);
+    wrkrs[i].corrector.gapcache = &gapcache;
   }
 
   AsyncIOInput *asyncio_tasks = ctx_calloc(num_inputs, sizeof(AsyncIOInput));
@@ -360,6 +572,11 @@ void correct_reads(CorrectAlnInput *inputs, size_t num_inputs,
                      wrkrs, num_threads, sizeof(CorrectReadsWorker));
   }
 
+  for(i = 0; i < num_inputs; i++) {
+    ordered_output_finish(&outputs[i], &wrkrs[0]);
+    ordered_output_dealloc(&outputs[i]);
+  }
+
   // Merge stats into workers[0]
   for(i = 1; i < num_threads; i++)
     correct_aln_merge_stats(&wrkrs[0].corrector, &wrkrs[i].corrector);
@@ -375,6 +592,10 @@ void correct_reads(CorrectAlnInput *inputs, size_t num_inputs,
   for(i = 0; i < num_threads; i++)
     correct_reads_worker_dealloc(&wrkrs[i]);
 
+  gap_cache_dealloc(&gapcache);
   ctx_free(wrkrs);
+  ctx_free(outputs);
   ctx_free(asyncio_tasks);
+
+  perf_phase_end("correct");
 }
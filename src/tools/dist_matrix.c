@@ -0,0 +1,393 @@
+#include "global.h"
+#include "dist_matrix.h"
+#include "db_graph.h"
+#include "db_node.h"
+#include "util.h"
+
+// Number of blocks each job processes when counting from a graph
+#define DIST_BLOCKS_PER_JOB 64
+
+// Number of blocks per thread read before counting when streaming
+#define DIST_STREAM_BLOCKS_PER_THREAD 2
+
+void dist_matrix_alloc(DistMatrix *mat, size_t ncols)
+{
+  mat->ncols = ncols;
+  mat->counts = ctx_calloc(ncols*ncols, sizeof(uint64_t));
+  mat->nkmers = mat->nblocks = mat->ntiles = 0;
+}
+
+void dist_matrix_dealloc(DistMatrix *mat)
+{
+  ctx_free(mat->counts);
+  memset(mat, 0, sizeof(DistMatrix));
+}
+
+void dist_matrix_merge(DistMatrix *dst, const DistMatrix *src)
+{
+  ctx_assert(dst->ncols == src->ncols);
+  size_t i, n = dst->ncols * dst->ncols;
+  for(i = 0; i < n; i++) dst->counts[i] += src->counts[i];
+  dst->nkmers += src->nkmers;
+  dst->nblocks += src->nblocks;
+  dst->ntiles += src->ntiles;
+}
+
+void dist_block_alloc(DistBlock *blk, size_t ncols)
+{
+  blk->ncols = ncols;
+  blk->nkmers = blk->ncols_set = 0;
+  blk->bits = ctx_calloc(ncols * DIST_BLOCK_WORDS, sizeof(uint64_t));
+  blk->cols = ctx_calloc(ncols, sizeof(size_t));
+}
+
+void dist_block_dealloc(DistBlock *blk)
+{
+  ctx_free(blk->bits);
+  ctx_free(blk->cols);
+  memset(blk, 0, sizeof(DistBlock));
+}
+
+void dist_block_reset(DistBlock *blk)
+{
+  memset(blk->bits, 0, blk->ncols * DIST_BLOCK_WORDS * sizeof(uint64_t));
+  blk->nkmers = blk->ncols_set = 0;
+}
+
+void dist_block_add_kmer(DistBlock *blk, const uint8_t *colset)
+{
+  ctx_assert(blk->nkmers < DIST_BLOCK_KMERS);
+  const size_t wrd = blk->nkmers / 64, idx = blk->nkmers % 64;
+  const size_t nbytes = roundup_bits2bytes(blk->ncols);
+  size_t i, col;
+  uint8_t byte;
+
+  for(i = 0; i < nbytes; i++) {
+    for(byte = colset[i]; byte; byte &= byte-1) {
+      col = i*8 + __builtin_ctz(byte);
+      blk->bits[col*DIST_BLOCK_WORDS + wrd] |= 1UL << idx;
+    }
+  }
+
+  blk->nkmers++;
+}
+
+// Load a block of kmers from the graph starting at `hkey0`, which must be a
+// multiple of DIST_BLOCK_KMERS. node_in_cols stores 8 kmers per byte with all
+// colours for the same 8 kmers adjacent, so we read each group of bytes once
+// and scatter them into the colour vectors. Block must be empty.
+static void dist_block_load_graph(DistBlock *blk, const dBGraph *db_graph,
+                                  hkey_t hkey0)
+{
+  ctx_assert(blk->nkmers == 0);
+  ctx_assert(hkey0 % DIST_BLOCK_KMERS == 0);
+
+  const HashTable *ht = &db_graph->ht;
+  const size_t ncols = db_graph->num_of_cols;
+  const hkey_t hkey1 = MIN2(hkey0 + DIST_BLOCK_KMERS, ht->capacity);
+  const uint8_t *kset;
+  size_t grp, grp0 = hkey0/8, grp1 = roundup_bits2bytes(hkey1);
+  size_t i, col, wrd, shift;
+  hkey_t hkey;
+  uint8_t assigned, byte;
+
+  for(grp = grp0; grp < grp1; grp++)
+  {
+    // Only count entries that are assigned in the hash table
+    assigned = 0;
+    for(i = 0, hkey = grp*8; i < 8 && hkey < hkey1; i++, hkey++)
+      assigned |= (uint8_t)((hash_table_assigned(ht, hkey) != 0) << i);
+
+    if(!assigned) continue;
+
+    wrd = (grp - grp0) / 8;
+    shift = ((grp - grp0) % 8) * 8;
+    kset = db_graph->node_in_cols + grp*ncols;
+
+    for(col = 0; col < ncols; col++) {
+      byte = kset[col] & assigned;
+      if(byte) blk->bits[col*DIST_BLOCK_WORDS + wrd] |= (uint64_t)byte << shift;
+    }
+
+    blk->nkmers += __builtin_popcount(assigned);
+  }
+}
+
+static inline uint64_t _popcount64(uint64_t x)
+{
+  #if defined(__POPCNT__)
+    return __builtin_popcountl(x);
+  #else
+    // Without the popcnt instruction, __builtin_popcountl() calls a libgcc
+    // function. This SWAR version is inlined and auto-vectorised instead.
+    x = x - ((x >> 1) & 0x5555555555555555UL);
+    x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+    return (x * 0x0101010101010101UL) >> 56;
+  #endif
+}
+
+// Number of kmers in both vectors
+static inline uint64_t _popcount_and(const uint64_t *restrict a,
+                                     const uint64_t *restrict b)
+{
+  size_t i;
+  uint64_t n = 0;
+  for(i = 0; i < DIST_BLOCK_WORDS; i++) n += _popcount64(a[i] & b[i]);
+  return n;
+}
+
+static inline bool _vec_is_empty(const uint64_t *a)
+{
+  size_t i;
+  uint64_t x = 0;
+  for(i = 0; i < DIST_BLOCK_WORDS; i++) x |= a[i];
+  return !x;
+}
+
+void dist_matrix_add_block(DistMatrix *mat, DistBlock *blk)
+{
+  ctx_assert(mat->ncols == blk->ncols);
+  const size_t ncols = blk->ncols;
+  const uint64_t *vec;
+  uint64_t *row;
+  size_t i, j, ti, tj, tiend, tjend, col, ncs = 0;
+
+  // Skip colours with no kmers in this block
+  for(col = 0; col < ncols; col++)
+    if(!_vec_is_empty(blk->bits + col*DIST_BLOCK_WORDS))
+      blk->cols[ncs++] = col;
+
+  blk->ncols_set = ncs;
+
+  // Tiles of colours i,j where i <= j
+  for(ti = 0; ti < ncs; ti += DIST_TILE_COLS) {
+    tiend = MIN2(ti+DIST_TILE_COLS, ncs);
+    for(tj = ti; tj < ncs; tj += DIST_TILE_COLS) {
+      tjend = MIN2(tj+DIST_TILE_COLS, ncs);
+      for(i = ti; i < tiend; i++) {
+        vec = blk->bits + blk->cols[i]*DIST_BLOCK_WORDS;
+        row = mat->counts + blk->cols[i]*ncols;
+        // j == i counts kmers in colour i (diagonal)
+        for(j = MAX2(i, tj); j < tjend; j++)
+          row[blk->cols[j]] += _popcount_and(vec, blk->bits + blk->cols[j]*DIST_BLOCK_WORDS);
+      }
+      mat->ntiles++;
+    }
+  }
+
+  mat->nkmers += blk->nkmers;
+  mat->nblocks++;
+
+  // Only wipe colour vectors we have used
+  for(i = 0; i < ncs; i++)
+    memset(blk->bits + blk->cols[i]*DIST_BLOCK_WORDS, 0,
+           DIST_BLOCK_WORDS * sizeof(uint64_t));
+
+  blk->nkmers = blk->ncols_set = 0;
+}
+
+//
+// Multithreaded counting from a graph
+//
+
+typedef struct {
+  const dBGraph *db_graph;
+  DistMatrix *mats; // one per thread
+  DistBlock *blocks; // one per thread
+} DistMatrixWorkers;
+
+typedef struct {
+  DistMatrixWorkers *wrkrs;
+  size_t blk_start, blk_end;
+} DistMatrixJob;
+
+static void dist_matrix_job(void *arg, size_t threadid)
+{
+  DistMatrixJob *job = (DistMatrixJob*)arg;
+  const dBGraph *db_graph = job->wrkrs->db_graph;
+  DistMatrix *mat = &job->wrkrs->mats[threadid];
+  DistBlock *blk = &job->wrkrs->blocks[threadid];
+  size_t b;
+
+  for(b = job->blk_start; b < job->blk_end; b++) {
+    dist_block_load_graph(blk, db_graph, b*DIST_BLOCK_KMERS);
+    if(blk->nkmers) dist_matrix_add_block(mat, blk);
+  }
+}
+
+void dist_matrix_count_graph(const dBGraph *db_graph, size_t nthreads,
+                             DistMatrix *mat)
+{
+  ctx_assert(db_graph->node_in_cols != NULL);
+  ctx_assert(mat->ncols == db_graph->num_of_cols);
+  ctx_assert(nthreads > 0);
+
+  const size_t ncols = db_graph->num_of_cols;
+  size_t i, nblocks, njobs;
+
+  nblocks = (db_graph->ht.capacity + DIST_BLOCK_KMERS - 1) / DIST_BLOCK_KMERS;
+  njobs = (nblocks + DIST_BLOCKS_PER_JOB - 1) / DIST_BLOCKS_PER_JOB;
+
+  DistMatrixWorkers wrkrs = {.db_graph = db_graph,
+                             .mats = ctx_calloc(nthreads, sizeof(DistMatrix)),
+                             .blocks = ctx_calloc(nthreads, sizeof(DistBlock))};
+
+  for(i = 0; i < nthreads; i++) {
+    dist_matrix_alloc(&wrkrs.mats[i], ncols);
+    dist_block_alloc(&wrkrs.blocks[i], ncols);
+  }
+
+  DistMatrixJob *jobs = ctx_calloc(njobs, sizeof(DistMatrixJob));
+  for(i = 0; i < njobs; i++) {
+    jobs[i] = (DistMatrixJob){.wrkrs = &wrkrs,
+                              .blk_start = i*DIST_BLOCKS_PER_JOB,
+                              .blk_end = MIN2((i+1)*DIST_BLOCKS_PER_JOB, nblocks)};
+  }
+
+  util_run_threads(jobs, njobs, sizeof(DistMatrixJob), nthreads, dist_matrix_job);
+
+  for(i = 0; i < nthreads; i++) {
+    dist_matrix_merge(mat, &wrkrs.mats[i]);
+    dist_matrix_dealloc(&wrkrs.mats[i]);
+    dist_block_dealloc(&wrkrs.blocks[i]);
+  }
+
+  ctx_free(jobs);
+  ctx_free(wrkrs.mats);
+  ctx_free(wrkrs.blocks);
+}
+
+//
+// Counting from sorted graph files
+//
+
+typedef struct {
+  DistMatrix *mats; // one per thread
+  DistBlock *blk;
+} DistStreamJob;
+
+static void dist_stream_job(void *arg, size_t threadid)
+{
+  DistStreamJob *job = (DistStreamJob*)arg;
+  dist_matrix_add_block(&job->mats[threadid], job->blk);
+}
+
+void dist_matrix_count_stream(GraphFileMerge *gfm, size_t nthreads,
+                              DistMatrix *mat)
+{
+  ctx_assert(mat->ncols == gfm->ncols);
+  ctx_assert(nthreads > 0);
+
+  const size_t ncols = gfm->ncols;
+  const size_t nblocks = nthreads * DIST_STREAM_BLOCKS_PER_THREAD;
+  size_t i, col, nfull = 0;
+  BinaryKmer bkmer;
+  Covg covgs[ncols];
+  Edges edges[ncols];
+  uint8_t colset[roundup_bits2bytes(ncols)];
+
+  DistMatrix *mats = ctx_calloc(nthreads, sizeof(DistMatrix));
+  DistBlock *blocks = ctx_calloc(nblocks, sizeof(DistBlock));
+  DistStreamJob *jobs = ctx_calloc(nblocks, sizeof(DistStreamJob));
+
+  for(i = 0; i < nthreads; i++) dist_matrix_alloc(&mats[i], ncols);
+  for(i = 0; i < nblocks; i++) {
+    dist_block_alloc(&blocks[i], ncols);
+    jobs[i] = (DistStreamJob){.mats = mats, .blk = &blocks[i]};
+  }
+
+  while(1)
+  {
+    // Fill a batch of blocks
+    for(nfull = 0; nfull < nblocks; nfull++) {
+      DistBlock *blk = &blocks[nfull];
+      while(!dist_block_is_full(blk) &&
+            graph_file_merge_read(gfm, &bkmer, covgs, edges))
+      {
+        memset(colset, 0, sizeof(colset));
+        for(col = 0; col < ncols; col++)
+          if(covgs[col] || edges[col]) bitset_set(colset, col);
+        dist_block_add_kmer(blk, colset);
+      }
+      if(!dist_block_is_full(blk)) { nfull += (blk->nkmers > 0); break; }
+    }
+
+    if(nfull == 0) break;
+    util_run_threads(jobs, nfull, sizeof(DistStreamJob), nthreads, dist_stream_job);
+    if(nfull < nblocks) break;
+  }
+
+  for(i = 0; i < nthreads; i++) {
+    dist_matrix_merge(mat, &mats[i]);
+    dist_matrix_dealloc(&mats[i]);
+  }
+
+  for(i = 0; i < nblocks; i++) dist_block_dealloc(&blocks[i]);
+
+  ctx_free(mats);
+  ctx_free(blocks);
+  ctx_free(jobs);
+}
+
+//
+// Output
+//
+
+static inline double _dist_norm(const DistMatrix *mat, DistNorm norm,
+                                size_t row, size_t col)
+{
+  const size_t ncols = mat->ncols;
+  size_t i = MIN2(row, col), j = MAX2(row, col);
+  uint64_t shared = mat->counts[ncols*i+j];
+  uint64_t rowsize = mat->counts[ncols*row+row];
+  uint64_t colsize = mat->counts[ncols*col+col];
+
+  switch(norm) {
+    case DIST_NORM_JACCARD:
+      return safe_frac(shared, rowsize + colsize - shared);
+    case DIST_NORM_CONTAINMENT:
+      return safe_frac(shared, rowsize);
+    default: die("Bad norm: %i", (int)norm);
+  }
+}
+
+void dist_matrix_print(const DistMatrix *mat, DistNorm norm, FILE *fout)
+{
+  const size_t ncols = mat->ncols;
+  size_t row, col;
+
+  fprintf(fout, ".");// top left column empty
+  for(row = 0; row < ncols; row++) fprintf(fout, "\tcol%zu", row);
+  fprintf(fout, "\n");
+  for(row = 0; row < ncols; row++) {
+    fprintf(fout, "col%zu", row);
+    for(col = 0; col < ncols; col++) {
+      if(norm == DIST_NORM_CONTAINMENT)
+        fprintf(fout, "\t%.6f", _dist_norm(mat, norm, row, col));
+      else if(col < row)
+        fprintf(fout, "\t.");
+      else if(norm == DIST_NORM_JACCARD)
+        fprintf(fout, "\t%.6f", _dist_norm(mat, norm, row, col));
+      else
+        fprintf(fout, "\t%zu", (size_t)mat->counts[ncols*row+col]);
+    }
+    fprintf(fout, "\n");
+  }
+}
+
+void dist_matrix_print_stats(const DistMatrix *mat, double seconds)
+{
+  char kmers_str[50], blocks_str[50], tiles_str[50];
+  char tiles_rate_str[50], kmers_rate_str[50];
+  ulong_to_str(mat->nkmers, kmers_str);
+  ulong_to_str(mat->nblocks, blocks_str);
+  ulong_to_str(mat->ntiles, tiles_str);
+  num_to_str(safe_frac(mat->ntiles, seconds), 1, tiles_rate_str);
+  num_to_str(safe_frac(mat->nkmers, seconds), 1, kmers_rate_str);
+
+  status("[dist_matrix] %s kmers in %s blocks, %s tiles of %i colours",
+         kmers_str, blocks_str, tiles_str, DIST_TILE_COLS);
+  status("[dist_matrix] %.2f secs: %s tiles/sec, %s kmers/sec",
+         seconds, tiles_rate_str, kmers_rate_str);
+}
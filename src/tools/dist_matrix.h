@@ -0,0 +1,82 @@
+#ifndef DIST_MATRIX_H_
+#define DIST_MATRIX_H_
+
+#include "db_graph.h"
+#include "graph_file_merge.h"
+
+//
+// Count kmers shared between every pair of colours
+//
+// Rather than testing each colour pair for every kmer, kmers are processed in
+// blocks of DIST_BLOCK_KMERS. Each block is transposed into one bit vector per
+// colour, then colour pairs are counted with AND+popcount over the vectors.
+// Colours are processed in tiles of DIST_TILE_COLS so that both tiles of
+// vectors stay in L1 cache whilst all pairs between them are counted - the
+// same trick as a blocked matrix multiply.
+//
+
+// 64 words * 64 bits = 4096 kmers per block, 512 bytes per colour vector
+#define DIST_BLOCK_WORDS 64
+#define DIST_BLOCK_KMERS (DIST_BLOCK_WORDS*64)
+
+// 16 colours * 512 bytes = 8KB per tile, so a pair of tiles fits in L1
+#define DIST_TILE_COLS 16
+
+typedef enum {
+  DIST_NORM_NONE        = 0, // number of shared kmers
+  DIST_NORM_JACCARD     = 1, // |A & B| / |A | B|
+  DIST_NORM_CONTAINMENT = 2  // |A & B| / |A|  (not symmetric)
+} DistNorm;
+
+typedef struct {
+  size_t ncols;
+  uint64_t *counts; // ncols*ncols, only upper triangle used [i*ncols+j] i<=j
+  uint64_t nkmers, nblocks, ntiles;
+} DistMatrix;
+
+// One block of kmers, transposed into a bit vector per colour
+typedef struct {
+  size_t ncols, nkmers;
+  uint64_t *bits; // [col*DIST_BLOCK_WORDS + word]
+  size_t *cols, ncols_set; // colours with at least one kmer in this block
+} DistBlock;
+
+void dist_matrix_alloc(DistMatrix *mat, size_t ncols);
+void dist_matrix_dealloc(DistMatrix *mat);
+
+// Add counts from `src` to `dst`
+void dist_matrix_merge(DistMatrix *dst, const DistMatrix *src);
+
+void dist_block_alloc(DistBlock *blk, size_t ncols);
+void dist_block_dealloc(DistBlock *blk);
+void dist_block_reset(DistBlock *blk);
+
+#define dist_block_is_full(blk) ((blk)->nkmers == DIST_BLOCK_KMERS)
+
+// Add a kmer to a block, where `colset` is a bitset of ncols bits
+// with bit i set if the kmer is in colour i
+// Block must not be full
+void dist_block_add_kmer(DistBlock *blk, const uint8_t *colset);
+
+// Add all pairs of colours in a block to the matrix, then reset the block
+void dist_matrix_add_block(DistMatrix *mat, DistBlock *blk);
+
+// Count kmers shared between colours in a graph using node_in_cols
+// Adds to the counts already in `mat`
+void dist_matrix_count_graph(const dBGraph *db_graph, size_t nthreads,
+                             DistMatrix *mat);
+
+// Count kmers shared between colours from sorted graph files without a graph.
+// Kmers are read in batches of blocks, which are counted in parallel.
+// Adds to the counts already in `mat`
+void dist_matrix_count_stream(GraphFileMerge *gfm, size_t nthreads,
+                              DistMatrix *mat);
+
+// Print matrix in tab separated format
+// With DIST_NORM_NONE and DIST_NORM_JACCARD, lower triangle is printed as '.'
+void dist_matrix_print(const DistMatrix *mat, DistNorm norm, FILE *fout);
+
+// Print number of tiles and kmers processed per second
+void dist_matrix_print_stats(const DistMatrix *mat, double seconds);
+
+#endif /* DIST_MATRIX_H_ */
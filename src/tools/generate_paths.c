@@ -1,3 +1,4 @@
+#define CTX_ALLOC_TAG ALLOC_TAG_WALKERS
 #include "global.h"
 
 #include <pthread.h>
@@ -98,15 +99,25 @@ GenPathWorker* gen_paths_workers_alloc(size_t n, dBGraph *graph)
 {
   size_t i;
   GenPathWorker *workers = ctx_malloc(n * sizeof(GenPathWorker));
-  for(i = 0; i < n; i++)
+
+  // Workers share a gap cache. Links are added as we go, so only gaps that
+  // were traversed without reaching a fork are cached
+  GapCache *gapcache = ctx_malloc(sizeof(GapCache));
+  gap_cache_alloc(gapcache, GAP_CACHE_DEFAULT_MEM, false);
+
+  for(i = 0; i < n; i++) {
     _gen_paths_worker_alloc(&workers[i], graph);
+    workers[i].corrector.gapcache = gapcache;
+  }
   return workers;
 }
 
 void gen_paths_workers_dealloc(GenPathWorker *workers, size_t n)
 {
   size_t i;
+  GapCache *gapcache = n > 0 ? workers[0].corrector.gapcache : NULL;
   for(i = 0; i < n; i++) _gen_paths_worker_dealloc(&workers[i]);
+  if(gapcache != NULL) { gap_cache_dealloc(gapcache); ctx_free(gapcache); }
   ctx_free(workers);
 }
 
@@ -501,6 +512,8 @@ void generate_paths(CorrectAlnInput *tasks, size_t num_inputs,
 {
   size_t i, read_counter = 0;
 
+  perf_phase_start("thread");
+
   for(i = 0; i < num_workers; i++)
     workers[i].shared_nreads = &read_counter;
 
@@ -515,4 +528,6 @@ void generate_paths(CorrectAlnInput *tasks, size_t num_inputs,
   // Merge stats into workers[0]
   for(i = 1; i < num_workers; i++)
     correct_aln_merge_stats(&workers[0].corrector, &workers[i].corrector);
+
+  perf_phase_end("thread");
 }
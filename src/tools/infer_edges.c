@@ -2,6 +2,10 @@
 #include "infer_edges.h"
 #include "db_node.h"
 #include "db_graph.h"
+#include "util.h"
+
+// Number of kmers whose neighbours are looked up in one batch by infer_edges()
+#define INFER_CHUNK 64
 
 static inline void _add_edge_to_colours(hkey_t next_hkey,
                                         const Covg *covgs, Edges *edges,
@@ -26,106 +30,244 @@ static inline void _add_edge_to_colours(hkey_t next_hkey,
   }
 }
 
-// `pop_edges` if true, only add edges that are in at least one other colour
-//  -> If two kmers are in a sample and the population has an edges between
-//     them, add edge to sample.
-// Return 1 if changed; 0 otherwise
-bool infer_kmer_edges(const BinaryKmer node_bkey, bool pop_edges,
-                      Edges *edges, const Covg *covgs,
-                      const dBGraph *db_graph)
+// Edges we may need to add: missing from some colours
+static inline Edges _infer_missing_edges(const Edges *edges, size_t ncols,
+                                         bool pop_edges)
 {
-  Edges uedges = 0, iedges = 0xf, add_edges, edge;
-  size_t orient, nuc, col, kmer_size = db_graph->kmer_size;
-  const size_t ncols = db_graph->num_of_cols;
-  BinaryKmer bkey, bkmer;
-  hkey_t next;
-
-  Edges newedges[ncols];
-  memcpy(newedges, edges, ncols * sizeof(Edges));
+  Edges uedges = 0, iedges = 0xf;
+  size_t col;
 
   for(col = 0; col < ncols; col++) {
     uedges |= edges[col]; // union of edges
     iedges &= edges[col]; // intersection of edges
   }
 
-  add_edges = pop_edges ? uedges & ~iedges : ~iedges;
+  return pop_edges ? uedges & ~iedges : ~iedges;
+}
 
-  if(!add_edges) return 0;
+// Get keys of the neighbours along `add_edges`. The next kmer and its reverse
+// complement are shifted once per orientation, then each base is inserted, so
+// no neighbour needs to be reverse complemented.
+// Returns number of neighbours (at most 8)
+static inline size_t _infer_kmer_nbrs(const BinaryKmer node_bkey,
+                                      Edges add_edges, size_t kmer_size,
+                                      BinaryKmer *bkeys, Edges *nbr_edges)
+{
+  BinaryKmer node_rc = binary_kmer_reverse_complement(node_bkey, kmer_size);
+  BinaryKmer fw[2], rc[2], bkmer, bkmer_rc;
+  size_t orient, nuc, n = 0;
+  Edges edge;
+
+  fw[FORWARD] = binary_kmer_left_shift_one_base(node_bkey, kmer_size);
+  rc[FORWARD] = binary_kmer_right_shift_one_base(node_rc);
+  fw[REVERSE] = binary_kmer_right_shift_one_base(node_bkey);
+  rc[REVERSE] = binary_kmer_left_shift_one_base(node_rc, kmer_size);
 
   for(orient = 0; orient < 2; orient++)
   {
-    bkmer = (orient == FORWARD ? binary_kmer_left_shift_one_base(node_bkey, kmer_size)
-                               : binary_kmer_right_shift_one_base(node_bkey));
-
     for(nuc = 0; nuc < 4; nuc++)
     {
       edge = nuc_orient_to_edge(nuc, orient);
-      if(edge & add_edges)
-      {
-        // edges are missing from some samples
-        if(orient == FORWARD) binary_kmer_set_last_nuc(&bkmer, nuc);
-        else binary_kmer_set_first_nuc(&bkmer, dna_nuc_complement(nuc), kmer_size);
-
-        bkey = binary_kmer_get_key(bkmer, kmer_size);
-        next = hash_table_find(&db_graph->ht, bkey);
-        ctx_assert(!pop_edges || next != HASH_NOT_FOUND);
-
-        if(next != HASH_NOT_FOUND) {
-          _add_edge_to_colours(next, covgs, newedges, edge, db_graph);
-        }
+      if(!(edge & add_edges)) continue;
+
+      bkmer = fw[orient];
+      bkmer_rc = rc[orient];
+
+      if(orient == FORWARD) {
+        binary_kmer_set_last_nuc(&bkmer, nuc);
+        binary_kmer_set_first_nuc(&bkmer_rc, dna_nuc_complement(nuc), kmer_size);
+      } else {
+        binary_kmer_set_first_nuc(&bkmer, dna_nuc_complement(nuc), kmer_size);
+        binary_kmer_set_last_nuc(&bkmer_rc, nuc);
       }
+
+      bkeys[n] = binary_kmer_less_than(bkmer_rc, bkmer) ? bkmer_rc : bkmer;
+      nbr_edges[n++] = edge;
     }
   }
 
+  return n;
+}
+
+// Add edges to the neighbours we found. Returns 1 if changed; 0 otherwise
+static inline bool _infer_kmer_update(const hkey_t *hkeys,
+                                      const Edges *nbr_edges, size_t n,
+                                      bool pop_edges,
+                                      Edges *edges, const Covg *covgs,
+                                      const dBGraph *db_graph)
+{
+  const size_t ncols = db_graph->num_of_cols;
+  size_t i;
+
+  Edges newedges[ncols];
+  memcpy(newedges, edges, ncols * sizeof(Edges));
+
+  for(i = 0; i < n; i++) {
+    ctx_assert(!pop_edges || hkeys[i] != HASH_NOT_FOUND);
+    if(hkeys[i] != HASH_NOT_FOUND)
+      _add_edge_to_colours(hkeys[i], covgs, newedges, nbr_edges[i], db_graph);
+  }
+
   // Check if we changed the edges
   int cmp = memcmp(edges, newedges, ncols*sizeof(Edges));
   memcpy(edges, newedges, ncols*sizeof(Edges));
   return (cmp != 0);
 }
 
-static inline int infer_edges_node(hkey_t hkey,
-                                   bool add_all_edges,
-                                   Covg *tmp_covgs,
-                                   const dBGraph *db_graph,
-                                   size_t *num_nodes_modified)
+// `pop_edges` if true, only add edges that are in at least one other colour
+//  -> If two kmers are in a sample and the population has an edges between
+//     them, add edge to sample.
+// `stats` may be NULL
+// Return 1 if changed; 0 otherwise
+bool infer_kmer_edges(const BinaryKmer node_bkey, bool pop_edges,
+                      Edges *edges, const Covg *covgs,
+                      const dBGraph *db_graph, InferEdgesStats *stats)
 {
-  BinaryKmer bkmer = db_node_get_bkey(db_graph, hkey);
-  Edges *edges = &db_node_edges(db_graph, hkey, 0);
-  size_t col;
+  BinaryKmer bkeys[8];
+  Edges nbr_edges[8];
+  hkey_t hkeys[8];
+  size_t n, num_first_bckt;
+
+  Edges add_edges = _infer_missing_edges(edges, db_graph->num_of_cols,
+                                         pop_edges);
+  if(!add_edges) return 0;
+
+  n = _infer_kmer_nbrs(node_bkey, add_edges, db_graph->kmer_size,
+                       bkeys, nbr_edges);
+  num_first_bckt = hash_table_find_batch(&db_graph->ht, bkeys, n, hkeys);
 
-  // Create coverages that are zero or one depending on if node has colour
-  if(db_graph->col_covgs == NULL) {
-    for(col = 0; col < db_graph->num_of_cols; col++)
-      tmp_covgs[col] = db_node_has_col(db_graph, hkey, col);
-  } else {
-    tmp_covgs = &db_node_covg(db_graph, hkey, 0);
+  if(stats != NULL) {
+    stats->num_lookups += n;
+    stats->num_first_bckt += num_first_bckt;
   }
 
-  (*num_nodes_modified) += infer_kmer_edges(bkmer, !add_all_edges,
-                                            edges, tmp_covgs, db_graph);
+  return _infer_kmer_update(hkeys, nbr_edges, n, pop_edges,
+                            edges, covgs, db_graph);
+}
 
-  return 0; // => keep iterating
+void infer_edges_print_stats(const InferEdgesStats *stats, double seconds)
+{
+  char lookups_str[50], rate_str[50];
+  ulong_to_str(stats->num_lookups, lookups_str);
+  num_to_str(safe_frac(stats->num_lookups, seconds), 1, rate_str);
+
+  status("[inferedges] %s lookups in %.2f secs: %s lookups/sec, "
+         "%.1f%% resolved in their prefetched bucket",
+         lookups_str, seconds, rate_str,
+         100.0 * safe_frac(stats->num_first_bckt, stats->num_lookups));
 }
 
+//
+// Infer edges for all kmers in the graph, looking up the neighbours of
+// INFER_CHUNK kmers at a time
+//
+
+typedef struct {
+  hkey_t nodes[INFER_CHUNK];
+  size_t nbr_end[INFER_CHUNK]; // node i has neighbours [nbr_end[i-1],nbr_end[i])
+  BinaryKmer bkeys[INFER_CHUNK*8];
+  Edges nbr_edges[INFER_CHUNK*8];
+  hkey_t hkeys[INFER_CHUNK*8];
+  size_t n, nnbrs;
+} InferChunk;
+
 typedef struct {
   const size_t nthreads;
   const bool add_all_edges;
   const dBGraph *db_graph;
   size_t num_nodes_modified;
+  InferEdgesStats stats;
 } InferringEdges;
 
+static inline size_t infer_chunk_flush(InferChunk *chunk, bool add_all_edges,
+                                       Covg *tmp_covgs,
+                                       const dBGraph *db_graph,
+                                       InferEdgesStats *stats)
+{
+  size_t i, col, start, num_modified = 0;
+  const Covg *covgs;
+  hkey_t hkey;
+
+  stats->num_lookups += chunk->nnbrs;
+  stats->num_first_bckt += hash_table_find_batch(&db_graph->ht, chunk->bkeys,
+                                                 chunk->nnbrs, chunk->hkeys);
+
+  for(i = 0; i < chunk->n; i++)
+  {
+    hkey = chunk->nodes[i];
+    start = i ? chunk->nbr_end[i-1] : 0;
+
+    // Create coverages that are zero or one depending on if node has colour
+    if(db_graph->col_covgs == NULL) {
+      for(col = 0; col < db_graph->num_of_cols; col++)
+        tmp_covgs[col] = db_node_has_col(db_graph, hkey, col);
+      covgs = tmp_covgs;
+    } else {
+      covgs = &db_node_covg(db_graph, hkey, 0);
+    }
+
+    num_modified += _infer_kmer_update(chunk->hkeys + start,
+                                       chunk->nbr_edges + start,
+                                       chunk->nbr_end[i] - start,
+                                       !add_all_edges,
+                                       &db_node_edges(db_graph, hkey, 0),
+                                       covgs, db_graph);
+  }
+
+  chunk->n = chunk->nnbrs = 0;
+  return num_modified;
+}
+
+static inline int infer_edges_node(hkey_t hkey,
+                                   InferChunk *chunk,
+                                   const InferringEdges *wrkr,
+                                   Covg *tmp_covgs,
+                                   InferEdgesStats *stats,
+                                   size_t *num_nodes_modified)
+{
+  const dBGraph *db_graph = wrkr->db_graph;
+  BinaryKmer bkmer = db_node_get_bkey(db_graph, hkey);
+  const Edges *edges = &db_node_edges(db_graph, hkey, 0);
+
+  Edges add_edges = _infer_missing_edges(edges, db_graph->num_of_cols,
+                                         !wrkr->add_all_edges);
+  if(!add_edges) return 0;
+
+  chunk->nnbrs += _infer_kmer_nbrs(bkmer, add_edges, db_graph->kmer_size,
+                                   chunk->bkeys + chunk->nnbrs,
+                                   chunk->nbr_edges + chunk->nnbrs);
+  chunk->nodes[chunk->n] = hkey;
+  chunk->nbr_end[chunk->n++] = chunk->nnbrs;
+
+  if(chunk->n == INFER_CHUNK) {
+    (*num_nodes_modified) += infer_chunk_flush(chunk, wrkr->add_all_edges,
+                                               tmp_covgs, db_graph, stats);
+  }
+
+  return 0; // => keep iterating
+}
+
 static void infer_edges_worker(void *arg, size_t threadid)
 {
   InferringEdges *wrkr = (InferringEdges*)arg;
   size_t num_modified = 0;
   Covg covgs[wrkr->db_graph->num_of_cols];
+  InferEdgesStats stats = {.num_lookups = 0, .num_first_bckt = 0};
+  InferChunk *chunk = ctx_calloc(1, sizeof(InferChunk));
 
   HASH_ITERATE_PART(&wrkr->db_graph->ht, threadid, wrkr->nthreads,
                     infer_edges_node,
-                    wrkr->add_all_edges, covgs, wrkr->db_graph,
-                    &num_modified);
+                    chunk, wrkr, covgs, &stats, &num_modified);
+
+  num_modified += infer_chunk_flush(chunk, wrkr->add_all_edges,
+                                    covgs, wrkr->db_graph, &stats);
+  ctx_free(chunk);
 
   __sync_fetch_and_add((volatile size_t *)&wrkr->num_nodes_modified, num_modified);
+  __sync_fetch_and_add((volatile uint64_t *)&wrkr->stats.num_lookups,
+                       stats.num_lookups);
+  __sync_fetch_and_add((volatile uint64_t *)&wrkr->stats.num_first_bckt,
+                       stats.num_first_bckt);
 }
 
 size_t infer_edges(size_t nthreads, bool add_all_edges, const dBGraph *db_graph)
@@ -138,9 +280,12 @@ size_t infer_edges(size_t nthreads, bool add_all_edges, const dBGraph *db_graph)
   InferringEdges infedges = {.nthreads = nthreads,
                              .add_all_edges = add_all_edges,
                              .db_graph = db_graph,
-                             .num_nodes_modified = 0};
+                             .num_nodes_modified = 0,
+                             .stats = {.num_lookups = 0, .num_first_bckt = 0}};
 
+  double start = util_wall_secs();
   util_multi_thread(&infedges, nthreads, infer_edges_worker);
+  infer_edges_print_stats(&infedges.stats, util_wall_secs() - start);
 
   return infedges.num_nodes_modified;
 }
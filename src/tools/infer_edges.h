@@ -4,14 +4,25 @@
 #include "cortex_types.h"
 #include "db_graph.h"
 
+typedef struct {
+  uint64_t num_lookups; // neighbour kmers looked up
+  uint64_t num_first_bckt; // lookups resolved in their prefetched bucket
+} InferEdgesStats;
+
 // `pop_edges` if true, only add edges that are in at least one other colour
 //  -> If two kmers are in a sample and the population has an edges between
 //     them, add edge to sample.
+// Neighbours are looked up together with hash_table_find_batch().
+// `stats` may be NULL
 // Return 1 if changed; 0 otherwise
 bool infer_kmer_edges(const BinaryKmer node_bkey, bool pop_edges,
                       Edges *edges, const Covg *covgs,
-                      const dBGraph *db_graph);
+                      const dBGraph *db_graph, InferEdgesStats *stats);
+
+// Print lookups/sec and fraction of lookups resolved in the first bucket
+void infer_edges_print_stats(const InferEdgesStats *stats, double seconds);
 
+// Infer edges for every kmer in the graph, looking up neighbours in batches
 size_t infer_edges(size_t nthreads, bool add_all_edges, const dBGraph *db_graph);
 
 #endif /* INFER_EDGES_H_ */
@@ -0,0 +1,280 @@
+#include "global.h"
+#include "kmer_sketch.h"
+#include "json_hdr.h"
+#include "file_util.h"
+#include "util.h"
+#include "cmd.h"
+
+#if defined(USE_CITY_HASH)
+  #define SKETCH_HASH_NAME "city"
+#elif defined(USE_XXHASH)
+  #define SKETCH_HASH_NAME "xxhash"
+#else
+  #define SKETCH_HASH_NAME "lookup3"
+#endif
+
+void kmer_sketch_alloc(KmerSketch *sk, size_t size, const char *name)
+{
+  ctx_assert(size > 0);
+  size_t namelen = strlen(name);
+  sk->name = ctx_malloc(namelen+1);
+  memcpy(sk->name, name, namelen+1);
+  sk->size = size;
+  sk->hashes = ctx_malloc(2 * size * sizeof(uint64_t));
+  sk->nhashes = 0;
+  sk->maxhash = UINT64_MAX;
+  sk->nkmers = 0;
+}
+
+void kmer_sketch_dealloc(KmerSketch *sk)
+{
+  ctx_free(sk->name);
+  ctx_free(sk->hashes);
+  memset(sk, 0, sizeof(KmerSketch));
+}
+
+void kmer_sketch_add_hash(KmerSketch *sk, uint64_t h)
+{
+  sk->hashes[sk->nhashes++] = h;
+  if(sk->nhashes == 2*sk->size) kmer_sketch_finish(sk);
+}
+
+static int _uint64_cmp(const void *aa, const void *bb)
+{
+  uint64_t a = *(const uint64_t*)aa, b = *(const uint64_t*)bb;
+  return a < b ? -1 : (a > b);
+}
+
+void kmer_sketch_finish(KmerSketch *sk)
+{
+  size_t i, n = 0;
+  qsort(sk->hashes, sk->nhashes, sizeof(uint64_t), _uint64_cmp);
+
+  for(i = 0; i < sk->nhashes && n < sk->size; i++)
+    if(n == 0 || sk->hashes[i] != sk->hashes[n-1])
+      sk->hashes[n++] = sk->hashes[i];
+
+  sk->nhashes = n;
+  if(n == sk->size) sk->maxhash = sk->hashes[n-1];
+}
+
+void kmer_sketch_merge(KmerSketch *dst, const KmerSketch *src)
+{
+  size_t i;
+  for(i = 0; i < src->nhashes; i++)
+    if(src->hashes[i] < dst->maxhash)
+      kmer_sketch_add_hash(dst, src->hashes[i]);
+  dst->nkmers += src->nkmers;
+  kmer_sketch_finish(dst);
+}
+
+double kmer_sketch_est_nkmers(const KmerSketch *sk)
+{
+  if(sk->nhashes < sk->size) return sk->nhashes; // exact
+  // The size-th smallest of n uniform hashes is expected at size/(n+1)
+  double frac = ((double)sk->hashes[sk->size-1] + 1.0) / 18446744073709551616.0;
+  return (sk->size - 1) / frac;
+}
+
+double kmer_sketch_jaccard(const KmerSketch *a, const KmerSketch *b)
+{
+  const size_t s = MIN2(a->size, b->size);
+  size_t i = 0, j = 0, n = 0, shared = 0;
+
+  // Walk the smallest `s` hashes of the union
+  while(i < a->nhashes && j < b->nhashes && n < s) {
+    if(a->hashes[i] < b->hashes[j]) i++;
+    else if(a->hashes[i] > b->hashes[j]) j++;
+    else { i++; j++; shared++; }
+    n++;
+  }
+
+  // Remaining hashes are only in one sketch
+  n += MIN2(s - n, (a->nhashes - i) + (b->nhashes - j));
+
+  return safe_frac(shared, n);
+}
+
+//
+// Sketch files
+//
+
+void kmer_sketch_file_write(const KmerSketch *sks, size_t nsketches,
+                            size_t kmer_size, gzFile gzout, const char *path)
+{
+  size_t i, j, size = 0;
+  for(i = 0; i < nsketches; i++) size = MAX2(size, sks[i].size);
+
+  cJSON *jsonhdr = cJSON_CreateObject();
+  cJSON_AddStringToObject(jsonhdr, "file_format", SKETCH_FILE_FORMAT);
+  cJSON_AddNumberToObject(jsonhdr, "format_version", SKETCH_FORMAT_VERSION);
+  cJSON_AddStringToObject(jsonhdr, "file_key", "");
+  cJSON_AddNumberToObject(jsonhdr, "kmer_size", kmer_size);
+  cJSON_AddNumberToObject(jsonhdr, "max_kmer_size", MAX_KMER_SIZE);
+  cJSON_AddStringToObject(jsonhdr, "hash", SKETCH_HASH_NAME);
+  cJSON_AddNumberToObject(jsonhdr, "sketch_size", size);
+  cJSON_AddNumberToObject(jsonhdr, "num_sketches", nsketches);
+  cJSON_AddItemToObject(jsonhdr, "commands", cJSON_CreateArray());
+  json_hdr_add_curr_cmd(jsonhdr, path);
+  json_hdr_gzprint(jsonhdr, gzout);
+  cJSON_Delete(jsonhdr);
+
+  for(i = 0; i < nsketches; i++) {
+    gzprintf(gzout, "%"PRIu64"\t", sks[i].nkmers);
+    for(j = 0; j < sks[i].nhashes; j++)
+      gzprintf(gzout, "%s%016"PRIx64, j ? "," : "", sks[i].hashes[j]);
+    gzprintf(gzout, "\t%s\n", sks[i].name);
+  }
+}
+
+static void _sketch_parse_line(char *line, size_t size, const char *path,
+                               KmerSketch *sk)
+{
+  char *p = line, *end;
+  uint64_t nkmers, h;
+
+  nkmers = strtoull(p, &end, 10);
+  if(end == p || *end != '\t') die("Bad sketch line [%s]: %s", path, line);
+  p = end+1;
+
+  // Name is everything after the list of hashes
+  char *name = strchr(p, '\t');
+  if(name == NULL) die("Bad sketch line [%s]: %s", path, line);
+  *name++ = '\0';
+
+  kmer_sketch_alloc(sk, size, name);
+  sk->nkmers = nkmers;
+
+  while(*p) {
+    h = strtoull(p, &end, 16);
+    if(end == p || (*end != ',' && *end != '\0'))
+      die("Bad sketch hash [%s]: %s", path, p);
+    if(sk->nhashes == size) die("Too many hashes in sketch [%s]: %s", path, name);
+    sk->hashes[sk->nhashes++] = h;
+    p = *end ? end+1 : end;
+  }
+
+  kmer_sketch_finish(sk);
+}
+
+size_t kmer_sketch_file_load(const char *path, KmerSketchBuffer *sks)
+{
+  gzFile gzin = futil_gzopen(path, "r");
+  cJSON *jsonhdr = json_hdr_load(gzin, path);
+
+  cJSON *fmt = json_hdr_get(jsonhdr, "file_format", cJSON_String, path);
+  if(strcmp(fmt->valuestring, SKETCH_FILE_FORMAT) != 0)
+    die("Not a sketch file ("CMD" sketch): %s", path);
+
+  size_t version = json_hdr_demand_uint(jsonhdr, "format_version", path);
+  if(version != SKETCH_FORMAT_VERSION)
+    die("Unsupported sketch format version %zu: %s", version, path);
+
+  cJSON *hash = json_hdr_get(jsonhdr, "hash", cJSON_String, path);
+  size_t maxk = json_hdr_demand_uint(jsonhdr, "max_kmer_size", path);
+  if(strcmp(hash->valuestring, SKETCH_HASH_NAME) != 0 || maxk != MAX_KMER_SIZE) {
+    die("Sketch made with hash %s and MAXK=%zu, we have %s and MAXK=%i: %s",
+        hash->valuestring, maxk, SKETCH_HASH_NAME, MAX_KMER_SIZE, path);
+  }
+
+  size_t kmer_size = json_hdr_demand_uint(jsonhdr, "kmer_size", path);
+  size_t size = json_hdr_demand_uint(jsonhdr, "sketch_size", path);
+  size_t nsketches = json_hdr_demand_uint(jsonhdr, "num_sketches", path);
+  cJSON_Delete(jsonhdr);
+
+  if(size == 0) die("Invalid sketch size: %s", path);
+
+  StrBuf line;
+  strbuf_alloc(&line, 1024);
+  KmerSketch sk;
+  size_t nloaded = 0;
+
+  while(futil_gzcheck(strbuf_gzreadline(&line, gzin), gzin, path) > 0) {
+    strbuf_chomp(&line);
+    if(line.end == 0) continue;
+    _sketch_parse_line(line.b, size, path, &sk);
+    kmer_sketch_buf_push(sks, &sk, 1);
+    nloaded++;
+  }
+
+  if(nloaded != nsketches)
+    die("Expected %zu sketches, got %zu: %s", nsketches, nloaded, path);
+
+  strbuf_dealloc(&line);
+  gzclose(gzin);
+
+  return kmer_size;
+}
+
+//
+// Distance matrix
+//
+
+typedef struct {
+  const KmerSketch *sks;
+  size_t nsketches, row;
+  double *jaccard;
+} SketchDistJob;
+
+static void _sketch_dist_row(void *arg, size_t threadid)
+{
+  (void)threadid;
+  SketchDistJob *job = (SketchDistJob*)arg;
+  const size_t n = job->nsketches, i = job->row;
+  size_t j;
+  for(j = i; j < n; j++)
+    job->jaccard[i*n+j] = kmer_sketch_jaccard(&job->sks[i], &job->sks[j]);
+}
+
+void kmer_sketch_dist(const KmerSketch *sks, size_t nsketches,
+                      size_t nthreads, double *jaccard)
+{
+  size_t i;
+  SketchDistJob *jobs = ctx_calloc(nsketches, sizeof(SketchDistJob));
+
+  for(i = 0; i < nsketches; i++) {
+    jobs[i] = (SketchDistJob){.sks = sks, .nsketches = nsketches,
+                              .row = i, .jaccard = jaccard};
+  }
+
+  util_run_threads(jobs, nsketches, sizeof(SketchDistJob),
+                   nthreads, _sketch_dist_row);
+
+  ctx_free(jobs);
+}
+
+void kmer_sketch_dist_print(const KmerSketch *sks, size_t nsketches,
+                            const double *jaccard, DistNorm norm, FILE *fout)
+{
+  const size_t n = nsketches;
+  size_t row, col;
+  double *est = ctx_calloc(n, sizeof(double));
+  double jac, shared;
+
+  for(row = 0; row < n; row++) est[row] = kmer_sketch_est_nkmers(&sks[row]);
+
+  fprintf(fout, ".");// top left column empty
+  for(row = 0; row < n; row++) fprintf(fout, "\tcol%zu", row);
+  fprintf(fout, "\n");
+  for(row = 0; row < n; row++) {
+    fprintf(fout, "col%zu", row);
+    for(col = 0; col < n; col++) {
+      if(col < row && norm != DIST_NORM_CONTAINMENT) {
+        fprintf(fout, "\t.");
+        continue;
+      }
+      jac = jaccard[row < col ? row*n+col : col*n+row];
+      // |A&B| = J * |A|B| = J * (|A| + |B|) / (1 + J)
+      shared = jac * (est[row] + est[col]) / (1.0 + jac);
+      if(norm == DIST_NORM_JACCARD)
+        fprintf(fout, "\t%.6f", jac);
+      else if(norm == DIST_NORM_CONTAINMENT)
+        fprintf(fout, "\t%.6f", MIN2(safe_frac(shared, est[row]), 1.0));
+      else
+        fprintf(fout, "\t%.0f", shared);
+    }
+    fprintf(fout, "\n");
+  }
+
+  ctx_free(est);
+}
@@ -0,0 +1,97 @@
+#ifndef KMER_SKETCH_H_
+#define KMER_SKETCH_H_
+
+#include "binary_kmer.h"
+#include "dist_matrix.h"
+
+//
+// Bottom-k MinHash sketches of kmer sets
+//
+// Each kmer key is hashed to 64 bits with two rounds of binary_kmer_hash and
+// a sketch keeps the `size` smallest distinct hash values seen. Jaccard index
+// between two sets is estimated from the fraction of the smallest `size`
+// hashes of the union that are in both sketches (as in Mash). Sketches are
+// small and independent of input size, so thousands of samples can be
+// compared in seconds with `ctx dist --sketch`.
+//
+// Hashes depend on the compiled hash function and MAX_KMER_SIZE, which are
+// stored in the sketch file header and checked when loading.
+//
+
+#define SKETCH_DEFAULT_SIZE 1000
+
+#define SKETCH_FILE_FORMAT "ctxsk"
+#define SKETCH_FORMAT_VERSION 1
+
+typedef struct
+{
+  char *name;
+  size_t size; // max number of hashes kept (k in bottom-k)
+  uint64_t *hashes; // sorted once finished, capacity 2*size
+  size_t nhashes;
+  uint64_t maxhash; // hashes >= maxhash cannot enter a full sketch
+  uint64_t nkmers; // number of kmers added, including duplicates
+} KmerSketch;
+
+#include "madcrowlib/madcrow_buffer.h"
+madcrow_buffer(kmer_sketch_buf, KmerSketchBuffer, KmerSketch);
+
+void kmer_sketch_alloc(KmerSketch *sk, size_t size, const char *name);
+void kmer_sketch_dealloc(KmerSketch *sk);
+
+static inline uint64_t kmer_sketch_hash(BinaryKmer bkey)
+{
+  return ((uint64_t)binary_kmer_hash(bkey, 0) << 32) |
+                    binary_kmer_hash(bkey, 1);
+}
+
+void kmer_sketch_add_hash(KmerSketch *sk, uint64_t h);
+
+// `bkey` must be a kmer key (see binary_kmer_get_key())
+static inline void kmer_sketch_add(KmerSketch *sk, BinaryKmer bkey)
+{
+  sk->nkmers++;
+  uint64_t h = kmer_sketch_hash(bkey);
+  if(h < sk->maxhash) kmer_sketch_add_hash(sk, h);
+}
+
+// Sort, remove duplicates and keep the `size` smallest hashes
+// Must be called before a sketch is compared or saved
+void kmer_sketch_finish(KmerSketch *sk);
+
+// Add hashes from `src` to `dst`, then finish `dst`
+void kmer_sketch_merge(KmerSketch *dst, const KmerSketch *src);
+
+// Estimate number of distinct kmers from a finished sketch
+double kmer_sketch_est_nkmers(const KmerSketch *sk);
+
+// Estimate Jaccard index between two finished sketches
+double kmer_sketch_jaccard(const KmerSketch *a, const KmerSketch *b);
+
+//
+// Sketch files: gzipped JSON header followed by one line per sketch:
+//   <nkmers>\t<hash1>,<hash2>,...\t<name>
+// with hashes in hexadecimal, sorted ascending
+//
+
+void kmer_sketch_file_write(const KmerSketch *sks, size_t nsketches,
+                            size_t kmer_size, gzFile gzout, const char *path);
+
+// Append sketches from a file to `sks`, returns the kmer size
+size_t kmer_sketch_file_load(const char *path, KmerSketchBuffer *sks);
+
+//
+// Distance matrix
+//
+
+// Estimate Jaccard index between all pairs of sketches with `nthreads`
+// `jaccard` must be nsketches*nsketches, upper triangle is set [i*n+j] i<=j
+void kmer_sketch_dist(const KmerSketch *sks, size_t nsketches,
+                      size_t nthreads, double *jaccard);
+
+// Print matrix in the same format as dist_matrix_print(), with values
+// estimated from the Jaccard index and number of kmers in each sketch
+void kmer_sketch_dist_print(const KmerSketch *sks, size_t nsketches,
+                            const double *jaccard, DistNorm norm, FILE *fout);
+
+#endif /* KMER_SKETCH_H_ */
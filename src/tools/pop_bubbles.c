@@ -2,6 +2,8 @@
 #include "pop_bubbles.h"
 #include "db_unitig.h"
 
+#include "carrays/carrays.h" // gca_median()
+
 /*
   Popping bubbles works by iterating over all unitigs. For each unitig
   we attempt to pull out parallel unitigs. Once we have two parallel
@@ -168,6 +170,98 @@ static inline void mark_remove_bubbles(dBNodeBuffer nbuf, size_t threadid,
   }
 }
 
+//
+// Bubble popping without a visited array, used by the fused graph cleaner
+//
+
+// Order unitigs by their lowest end kmer - the same whichever way round
+// the unitig was walked
+static inline hkey_t unitig_rank(const dBNode *nodes, size_t n)
+{
+  return MIN2(nodes[0].key, nodes[n-1].key);
+}
+
+static inline size_t nodes_mean_covg(const dBNode *nodes, size_t n,
+                                     const dBGraph *db_graph)
+{
+  size_t i, sum_covg = 0;
+  for(i = 0; i < n; i++) sum_covg += db_node_sum_covg(db_graph, nodes[i].key);
+  return sum_covg / n;
+}
+
+static inline Covg nodes_median_covg(const dBNode *nodes, size_t n,
+                                     Uint32Buffer *cbuf,
+                                     const dBGraph *db_graph)
+{
+  size_t i;
+  uint32_buf_reset(cbuf);
+  uint32_buf_capacity(cbuf, n);
+  for(i = 0; i < n; i++) cbuf->b[i] = db_node_sum_covg(db_graph, nodes[i].key);
+  return gca_median_uint32(cbuf->b, n);
+}
+
+/**
+ * Check if the unitig `nodes` should be removed as the weaker branch of a
+ * bubble. Both branches of a bubble reach the same decision (ties on coverage
+ * are broken on kmer keys), so this can be called on every unitig in parallel
+ * without a visited array. A branch is only removed in favour of a branch
+ * with median coverage >= `min_keep_covg`, so that removing low coverage
+ * unitigs at the same time cannot remove both branches.
+ * @param alt, cbuf temporary buffers
+ * @return true if the unitig should be removed
+ */
+bool pop_bubbles_unitig_is_weak_branch(const dBNode *nodes, size_t n,
+                                       PopBubblesPrefs prefs,
+                                       size_t min_keep_covg,
+                                       dBNodeBuffer *alt, Uint32Buffer *cbuf,
+                                       const dBGraph *db_graph)
+{
+  dBNode node0, node1, nodes0[16], nodes1[16], endnode;
+  uint8_t i, j, n0, n1;
+  size_t covg, alt_covg;
+  hkey_t rank = unitig_rank(nodes, n);
+
+  // We can only be removed if we meet the limits on removed branches
+  if(prefs.max_rmv_klen > 0 && n > (size_t)prefs.max_rmv_klen) return false;
+  covg = nodes_mean_covg(nodes, n, db_graph);
+  if(prefs.max_rmv_covg > 0 && covg > (size_t)prefs.max_rmv_covg) return false;
+
+  node0 = db_node_reverse(nodes[0]);
+  node1 = nodes[n-1];
+
+  n0 = get_parallel_nodes(db_graph, node0, nodes0);
+  n1 = get_parallel_nodes(db_graph, node1, nodes1);
+
+  if(!n0 || !n1) return false;
+
+  for(i = 0; i < n0; i++)
+  {
+    db_node_buf_reset(alt);
+    db_node_buf_add(alt, db_node_reverse(nodes0[i]));
+    db_unitig_extend(alt, 0, db_graph);
+
+    // find end node in right hand nodes
+    endnode = alt->b[alt->len-1];
+    for(j = 0; j < n1 && !db_nodes_are_equal(endnode, nodes1[j]); j++) {}
+    if(j == n1 || unitig_rank(alt->b, alt->len) == rank) continue;
+
+    // found a bubble
+    if(prefs.max_rmv_kdiff >= 0 &&
+       abs((int)n - (int)alt->len) > prefs.max_rmv_kdiff) continue;
+
+    alt_covg = nodes_mean_covg(alt->b, alt->len, db_graph);
+    if(covg > alt_covg || (covg == alt_covg && rank < unitig_rank(alt->b, alt->len)))
+      continue;
+
+    // Other branch will be kept
+    if(!min_keep_covg ||
+       nodes_median_covg(alt->b, alt->len, cbuf, db_graph) >= min_keep_covg)
+      return true;
+  }
+
+  return false;
+}
+
 /**
  * visited, rmvbits should each have at least db_graph->capacity bits
  * and should be initialised to zeros
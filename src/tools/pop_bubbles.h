@@ -2,6 +2,8 @@
 #define POP_BUBBLES_H_
 
 #include "db_graph.h"
+#include "db_node.h"
+#include "common_buffers.h"
 
 typedef struct
 {
@@ -24,4 +26,20 @@ size_t pop_bubbles(const dBGraph *db_graph, size_t nthreads,
                    PopBubblesPrefs prefs,
                    uint8_t *visited, uint8_t *rmvbits);
 
+/**
+ * Check if the unitig `nodes` should be removed as the weaker branch of a
+ * bubble. Both branches of a bubble reach the same decision, so this can be
+ * called on every unitig in parallel without a visited array.
+ * Used by clean_graph_fused().
+ * @param min_keep_covg only remove a branch in favour of one with median
+ *                      coverage >= min_keep_covg
+ * @param alt, cbuf temporary buffers
+ * @return true if the unitig should be removed
+ */
+bool pop_bubbles_unitig_is_weak_branch(const dBNode *nodes, size_t n,
+                                       PopBubblesPrefs prefs,
+                                       size_t min_keep_covg,
+                                       dBNodeBuffer *alt, Uint32Buffer *cbuf,
+                                       const dBGraph *db_graph);
+
 #endif /* POP_BUBBLES_H_ */
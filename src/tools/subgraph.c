@@ -116,54 +116,102 @@ static void store_read_nodes(read_t *r1, read_t *r2,
   }
 }
 
-static void store_node_neighbours(const hkey_t hkey, dBNodeBuffer *nbuf,
-                                  uint8_t *kmer_mask, const dBGraph *db_graph)
-{
-  // Get neighbours
-  BinaryKmer bkmer = db_node_get_bkey(db_graph, hkey);
-  Edges edges = db_node_get_edges_union(db_graph, hkey);
-  size_t num_next, i;
-  dBNode next_nodes[8];
-  Nucleotide next_bases[8];
+// Number of nodes each thread collects before adding them to the next fringe
+#define FRINGE_BUF_SIZE 1024
 
-  // Get neighbours in forward dir
-  num_next  = db_graph_next_nodes(db_graph, bkmer, FORWARD, edges,
-                                  next_nodes, next_bases);
+// One level of the breadth first search
+typedef struct
+{
+  const size_t nthreads;
+  const dBNodeBuffer *const fringe; // nodes to extend from
+  dBNodeBuffer *const next; // newly reached nodes, filled by all threads
+  uint8_t *const kmer_mask;
+  const dBGraph *const db_graph;
+} SubgraphLevel;
+
+// Append nodes to the shared next fringe
+static inline void fringe_add(dBNodeBuffer *next, const dBNode *nodes, size_t n)
+{
+  size_t offset = __sync_fetch_and_add((volatile size_t*)&next->len, n);
+  if(offset + n > next->size) die("Please increase <mem> size");
+  memcpy(next->b + offset, nodes, n * sizeof(dBNode));
+}
 
-  // Get neighbours in reverse dir
-  num_next += db_graph_next_nodes(db_graph, bkmer, REVERSE, edges,
-                                  next_nodes+num_next, next_bases+num_next);
+// Each thread extends a slice of the fringe. Nodes are claimed with an atomic
+// set on the kmer mask, so each is added to the next fringe only once
+static void extend_level_thread(void *arg, size_t threadid)
+{
+  const SubgraphLevel *lvl = (const SubgraphLevel*)arg;
+  const dBGraph *db_graph = lvl->db_graph;
+  const dBNodeBuffer *fringe = lvl->fringe;
+  size_t i, j, num_next, nbuf = 0;
+  size_t start = (fringe->len * threadid) / lvl->nthreads;
+  size_t end = (fringe->len * (threadid+1)) / lvl->nthreads;
+  dBNode buf[FRINGE_BUF_SIZE], next_nodes[8];
+  Nucleotide next_bases[8];
+  BinaryKmer bkmer;
+  Edges edges;
+  hkey_t hkey;
 
-  // if not flagged add to list
-  // push_try return index of item or -1 on failure
-  for(i = 0; i < num_next; i++) {
-    if(!bitset_get(kmer_mask, next_nodes[i].key) &&
-       db_node_buf_push_try(nbuf, &next_nodes[i], 1) < 0) {
-      die("Please increase <mem> size");
+  for(i = start; i < end; i++)
+  {
+    // Get neighbours
+    hkey = fringe->b[i].key;
+    bkmer = db_node_get_bkey(db_graph, hkey);
+    edges = db_node_get_edges_union(db_graph, hkey);
+
+    num_next  = db_graph_next_nodes(db_graph, bkmer, FORWARD, edges,
+                                    next_nodes, next_bases);
+    num_next += db_graph_next_nodes(db_graph, bkmer, REVERSE, edges,
+                                    next_nodes+num_next, next_bases+num_next);
+
+    // if not flagged, claim and add to list
+    for(j = 0; j < num_next; j++) {
+      if(!bitset_get_mt(lvl->kmer_mask, next_nodes[j].key) &&
+         !bitset_set_mt(lvl->kmer_mask, next_nodes[j].key))
+      {
+        buf[nbuf++] = next_nodes[j];
+        if(nbuf == FRINGE_BUF_SIZE) {
+          fringe_add(lvl->next, buf, nbuf);
+          nbuf = 0;
+        }
+      }
     }
-    bitset_set(kmer_mask, next_nodes[i].key);
   }
-}
 
+  fringe_add(lvl->next, buf, nbuf);
+}
 
-static void extend(SubgraphBuilder *builder, size_t dist)
+// Level-synchronous breadth first search: all threads extend the current
+// fringe, then we swap to the next fringe
+static void extend(SubgraphBuilder *builder, size_t nthreads, size_t dist)
 {
-  const dBGraph *db_graph = builder->db_graph;
-  uint8_t *kmer_mask = builder->kmer_mask;
   dBNodeBuffer *nbuf0 = &builder->nbufs[0], *nbuf1 = &builder->nbufs[1];
-  size_t d, i;
+  size_t d;
+  double start;
+  char dist_str[100], fringe_str[100];
 
   if(dist > 0)
   {
-    char dist_str[100];
     ulong_to_str(dist, dist_str);
-    status("Extending subgraph by %s kmers\n", dist_str);
+    status("Extending subgraph by %s kmers with %zu threads\n", dist_str, nthreads);
 
-    for(d = 0; d < dist; d++) {
+    for(d = 0; d < dist && nbuf0->len > 0; d++)
+    {
+      start = util_wall_secs();
       db_node_buf_reset(nbuf1);
-      for(i = 0; i < nbuf0->len; i++) {
-        store_node_neighbours(nbuf0->b[i].key, nbuf1, kmer_mask, db_graph);
-      }
+
+      SubgraphLevel lvl = {.nthreads = nthreads,
+                           .fringe = nbuf0, .next = nbuf1,
+                           .kmer_mask = builder->kmer_mask,
+                           .db_graph = builder->db_graph};
+
+      util_multi_thread(&lvl, nthreads, extend_level_thread);
+
+      ulong_to_str(nbuf1->len, fringe_str);
+      status("[subgraph] level %zu: %s new kmers in %.2f secs",
+             d+1, fringe_str, util_wall_secs() - start);
+
       SWAP(nbuf0, nbuf1);
     }
   }
@@ -215,7 +263,7 @@ void subgraph_from_reads(dBGraph *db_graph, size_t nthreads, size_t dist,
 
   seq_read_dealloc(&r1);
 
-  extend(&builder, dist);
+  extend(&builder, nthreads, dist);
   subgraph_builder_dealloc(&builder);
 
   if(invert) {
@@ -262,7 +310,7 @@ void subgraph_from_seq(dBGraph *db_graph, size_t nthreads, size_t dist,
 
   print_stats(&builder);
 
-  extend(&builder, dist);
+  extend(&builder, nthreads, dist);
   subgraph_builder_dealloc(&builder);
 
   if(invert) {
@@ -7,7 +7,8 @@
 
 //
 // Breadth first search from seed kmers,
-// then remove all kmers that weren't touched
+// then remove all kmers that weren't touched.
+// Each level of the search is extended by all threads.
 //
 
 /**
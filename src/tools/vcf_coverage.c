@@ -790,6 +790,8 @@ void vcfcov_file(htsFile *vcffh, bcf_hdr_t *vcfhdr,
                  VcfCovStats *stats,
                  dBGraph *db_graph)
 {
+  perf_phase_start("vcfcov");
+
   VcfReader vr;
   vcfr_alloc(&vr, path, vcffh, vcfhdr, samplehdrids,
              db_graph->num_of_cols, db_graph->kmer_size);
@@ -841,4 +843,6 @@ void vcfcov_file(htsFile *vcffh, bcf_hdr_t *vcfhdr,
   free(chr);
   covbuf_dealloc(&covbuf);
   vcfr_dealloc(&vr);
+
+  perf_phase_end("vcfcov");
 }
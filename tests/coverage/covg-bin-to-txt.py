@@ -0,0 +1,57 @@
+#!/usr/bin/env python
+
+#
+# Decode `mccortex coverage --binary` output and print it in the text format
+# of `mccortex coverage`, with edges if the file has them.
+# Usage: ./covg-bin-to-txt.py <in.bin>
+#
+
+from __future__ import print_function
+import struct
+import sys
+
+def rev_nibble(x):
+  return ((x&1)<<3) | ((x&2)<<1) | ((x&4)>>1) | ((x&8)>>3)
+
+# Two hex characters per edge, as edges_to_char() in src/graph/db_node.h
+def edges_str(e):
+  return "%x%x" % (rev_nibble(e>>4), e&0xf)
+
+def read_uint32(fh):
+  return struct.unpack('=I', fh.read(4))[0]
+
+def read_str(fh):
+  n = read_uint32(fh)
+  return fh.read(n).decode('ascii')
+
+def main(path):
+  with open(path, 'rb') as fh:
+    if fh.read(7) != b'CTXCOVG': sys.exit("Bad magic: "+path)
+    version = struct.unpack('=B', fh.read(1))[0]
+    if version != 1: sys.exit("Bad version: "+str(version))
+    (kmer_size, ncols, has_edges) = struct.unpack('=III', fh.read(12))
+
+    while True:
+      hdr = fh.read(4)
+      if len(hdr) == 0: break
+      name_len = struct.unpack('=I', hdr)[0]
+      name = fh.read(name_len).decode('ascii')
+      seq = read_str(fh)
+      nkmers = read_uint32(fh)
+      if nkmers != max(len(seq)-kmer_size+1, 0):
+        sys.exit("Bad number of kmers: "+name)
+      covgs = struct.unpack('='+'I'*(nkmers*ncols), fh.read(4*nkmers*ncols))
+      edges = bytearray(fh.read(nkmers*ncols)) if has_edges else None
+
+      print(">"+name)
+      print(seq)
+      for col in range(ncols):
+        if has_edges:
+          print(">%s_c%i_edges" % (name, col))
+          print(" ".join([edges_str(edges[i*ncols+col]) for i in range(nkmers)]))
+        print(">%s_c%i_covgs" % (name, col))
+        print(" ".join(["%2u" % covgs[i*ncols+col] for i in range(nkmers)]))
+
+if __name__ == '__main__':
+  if len(sys.argv) != 2: sys.exit("usage: "+sys.argv[0]+" <in.bin>")
+  main(sys.argv[1])